@@ -0,0 +1,301 @@
+#include "bcache.h"
+#include "block.h"
+#include "journal.h"
+#include "block_aio.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+// Cache de bloques de tamaño fijo entre la lógica del FS y read_block/write_block.
+// Búsqueda por hash (encadenado por índice), desalojo CLOCK, fijado y bit sucio.
+// Escritura diferida: los bloques sucios bajan a disco al desalojarse o en flush.
+// Con el diario activo no bajan a su lugar sino a la transacción en curso, y
+// un bloque que falta se busca primero entre las copias del diario.
+typedef struct bc_slot {
+    u32 index;
+    int valid;
+    int dirty;
+    int ref;      // bit de referencia para CLOCK
+    int pins;
+    int next;     // siguiente en la cadena del bucket, -1 = fin
+} bc_slot;
+
+static bc_slot *slots = NULL;
+static unsigned char *arena = NULL;
+static int *buckets = NULL;
+static u32 nslots = 0;
+static u32 nbuckets = 0;
+static u32 bc_block_size = 0;
+static u32 clock_hand = 0;
+static char bc_folder[512];
+static bcache_stats stats;
+static u32 ndirty = 0;     // slots sucios
+
+static u32 bucket_of(u32 index) {
+    return (index * 2654435761u) & (nbuckets - 1);
+}
+
+static unsigned char *slot_data(u32 s) {
+    return arena + (size_t)s * bc_block_size;
+}
+
+static void set_dirty(u32 s, int dirty) {
+    if (slots[s].dirty != dirty) ndirty += dirty ? 1u : (u32)-1;
+    slots[s].dirty = dirty;
+}
+
+int bcache_init(size_t budget_bytes, u32 block_size) {
+    bcache_shutdown();
+    u32 n = (u32)(budget_bytes / block_size);
+    if (n < 8) n = 8;
+    u32 nb = 1;
+    while (nb < n * 2) nb <<= 1;
+
+    slots = (bc_slot*)calloc(n, sizeof(bc_slot));
+    arena = (unsigned char*)malloc((size_t)n * block_size);
+    buckets = (int*)malloc(sizeof(int) * nb);
+    if (!slots || !arena || !buckets) {
+        free(slots); free(arena); free(buckets);
+        slots = NULL; arena = NULL; buckets = NULL;
+        errno = ENOMEM;
+        return -1;
+    }
+    for (u32 i = 0; i < nb; i++) buckets[i] = -1;
+    nslots = n;
+    nbuckets = nb;
+    bc_block_size = block_size;
+    clock_hand = 0;
+    bc_folder[0] = '\0';
+    return 0;
+}
+
+static int write_back(u32 s) {
+    if (!slots[s].dirty) return 0;
+    int rc = journal_active() ? journal_log(slots[s].index, slot_data(s))
+                              : write_block(bc_folder, slots[s].index, slot_data(s), bc_block_size);
+    if (rc != 0) return -1;
+    set_dirty(s, 0);
+    stats.writebacks++;
+    return 0;
+}
+
+static int flush_all(void) {
+    int rc = 0;
+    for (u32 s = 0; s < nslots; s++) {
+        if (slots[s].valid && write_back(s) != 0) rc = -1;
+    }
+    return rc;
+}
+
+void bcache_invalidate(void) {
+    if (!slots) return;
+    for (u32 s = 0; s < nslots; s++) {
+        slots[s].valid = 0;
+        slots[s].dirty = 0;
+        slots[s].pins = 0;
+    }
+    ndirty = 0;
+    for (u32 i = 0; i < nbuckets; i++) buckets[i] = -1;
+}
+
+void bcache_shutdown(void) {
+    if (!slots) return;
+    if (bc_folder[0]) flush_all();
+    free(slots); free(arena); free(buckets);
+    slots = NULL; arena = NULL; buckets = NULL;
+    nslots = nbuckets = 0;
+    ndirty = 0;
+}
+
+// Prepara la cache para esta carpeta y tamaño de bloque
+static int bind(const char *folder, u32 block_size) {
+    if (!slots || bc_block_size != block_size) {
+        if (bcache_init(BCACHE_DEFAULT_BUDGET, block_size) != 0) return -1;
+    }
+    if (strcmp(bc_folder, folder) != 0) {
+        if (bc_folder[0]) flush_all();
+        bcache_invalidate();
+        snprintf(bc_folder, sizeof(bc_folder), "%s", folder);
+    }
+    return 0;
+}
+
+// Con mmap el mapeo ya es la cache: se lee y escribe directo sobre él (salvo
+// con diario, que no puede dejar que los metadatos lleguen a su lugar antes)
+static int passthrough(const char *folder, u32 block_size) {
+    return !journal_active() && block_view(folder, 0, block_size) != NULL;
+}
+
+static int lookup(u32 index) {
+    for (int s = buckets[bucket_of(index)]; s >= 0; s = slots[s].next) {
+        if (slots[s].index == index) return s;
+    }
+    return -1;
+}
+
+static void unlink_slot(u32 s) {
+    int *p = &buckets[bucket_of(slots[s].index)];
+    while (*p >= 0 && *p != (int)s) p = &slots[*p].next;
+    if (*p == (int)s) *p = slots[s].next;
+    slots[s].valid = 0;
+}
+
+// Busca un slot libre o desaloja con CLOCK (saltando los fijados)
+static int victim(void) {
+    for (u32 step = 0; step < nslots * 2; step++) {
+        u32 s = clock_hand;
+        clock_hand = (clock_hand + 1) % nslots;
+        if (!slots[s].valid) return (int)s;
+        if (slots[s].pins > 0) continue;
+        if (slots[s].ref) { slots[s].ref = 0; continue; }
+        if (write_back(s) != 0) return -1;
+        unlink_slot(s);
+        stats.evictions++;
+        return (int)s;
+    }
+    errno = ENOBUFS;   // todos fijados
+    return -1;
+}
+
+// Devuelve el slot del bloque; si load=0 no lee de disco (se va a sobrescribir)
+static int slot_for(u32 index, int load) {
+    int s = lookup(index);
+    if (s >= 0) {
+        stats.hits++;
+        slots[s].ref = 1;
+        return s;
+    }
+    stats.misses++;
+    s = victim();
+    if (s < 0) return -1;
+    if (load && !(journal_active() && journal_lookup(index, slot_data((u32)s))) &&
+        read_block(bc_folder, index, slot_data((u32)s), bc_block_size) != 0) return -1;
+    slots[s].index = index;
+    slots[s].valid = 1;
+    set_dirty((u32)s, 0);
+    slots[s].ref = 1;
+    slots[s].pins = 0;
+    u32 b = bucket_of(index);
+    slots[s].next = buckets[b];
+    buckets[b] = s;
+    return s;
+}
+
+const unsigned char *bcache_get(const char *folder, u32 index, u32 block_size) {
+    if (passthrough(folder, block_size)) {
+        stats.hits++;
+        return block_view(folder, index, block_size);
+    }
+    if (bind(folder, block_size) != 0) return NULL;
+    int s = slot_for(index, 1);
+    if (s < 0) return NULL;
+    slots[s].pins++;
+    return slot_data((u32)s);
+}
+
+// Carga de una vez los bloques que falten, todos en vuelo en un solo lote.
+// Usa a lo sumo la mitad de los slots para no desalojar lo que se va a leer.
+int bcache_prefetch(const char *folder, const u32 *blocks, u32 n, u32 block_size) {
+    if (passthrough(folder, block_size)) return 0;
+    if (bind(folder, block_size) != 0) return -1;
+    if (n > nslots / 2) n = nslots / 2;
+    block_req *reqs = (block_req*)malloc(n * sizeof(block_req));
+    if (!reqs) { errno = ENOMEM; return -1; }
+
+    u32 k = 0;
+    for (u32 i = 0; i < n; i++) {
+        if (lookup(blocks[i]) >= 0) continue;
+        int s = victim();
+        if (s < 0) break;
+        u32 b = bucket_of(blocks[i]);
+        slots[s] = (bc_slot){blocks[i], 1, 0, 1, 1, buckets[b]};   // fijado hasta que llegue
+        buckets[b] = s;
+        stats.misses++;
+        if (journal_active() && journal_lookup(blocks[i], slot_data((u32)s))) {
+            slots[s].pins = 0;
+            continue;
+        }
+        reqs[k] = (block_req){0};
+        reqs[k].start = blocks[i];
+        reqs[k].buf = slot_data((u32)s);
+        reqs[k].len = bc_block_size;
+        k++;
+    }
+    int rc = k ? block_rw_batch(folder, reqs, k, bc_block_size) : 0;
+    for (u32 i = 0; i < k; i++) {
+        u32 s = (u32)(((unsigned char*)reqs[i].buf - arena) / bc_block_size);
+        slots[s].pins = 0;
+        if (reqs[i].error) unlink_slot(s);
+    }
+    free(reqs);
+    return rc;
+}
+
+void bcache_put(const unsigned char *data) {
+    if (!arena || data < arena || data >= arena + (size_t)nslots * bc_block_size) return;
+    u32 s = (u32)((size_t)(data - arena) / bc_block_size);
+    if (slots[s].pins > 0) slots[s].pins--;
+}
+
+int bcache_read(const char *folder, u32 index, unsigned char *buf, u32 block_size) {
+    const unsigned char *p = bcache_get(folder, index, block_size);
+    if (!p) return -1;
+    memcpy(buf, p, block_size);
+    bcache_put(p);
+    return 0;
+}
+
+int bcache_write(const char *folder, u32 index, const void *buf, u32 len) {
+    if (passthrough(folder, len)) return write_block(folder, index, buf, len);
+    u32 bs = (slots && len < bc_block_size) ? bc_block_size : len;
+    if (bind(folder, bs) != 0) return -1;
+    int s = slot_for(index, len < bc_block_size);
+    if (s < 0) return -1;
+    memcpy(slot_data((u32)s), buf, len);
+    set_dirty((u32)s, 1);
+    return 0;
+}
+
+// Olvida un bloque sin escribirlo (se liberó y puede reasignarse como datos)
+void bcache_discard(const char *folder, u32 index) {
+    if (journal_active()) journal_revoke(index);
+    if (!slots || strcmp(bc_folder, folder) != 0) return;
+    int s = lookup(index);
+    if (s < 0 || slots[s].pins > 0) return;
+    set_dirty((u32)s, 0);
+    unlink_slot((u32)s);
+}
+
+// Baja los sucios (a su lugar o al diario) sin flush
+int bcache_writeback(const char *folder) {
+    return (slots && strcmp(bc_folder, folder) == 0) ? flush_all() : 0;
+}
+
+// Punto de persistencia; con diario es un commit de la transacción en curso
+int bcache_flush(const char *folder) {
+    int rc = bcache_writeback(folder);
+    if (journal_active()) {
+        if (journal_close() && journal_write() != 0) rc = -1;
+    } else if (block_flush(folder) != 0) {
+        rc = -1;
+    }
+    return rc;
+}
+
+void bcache_get_stats(bcache_stats *out) {
+    *out = stats;
+}
+
+double bcache_hit_rate(void) {
+    unsigned long long total = stats.hits + stats.misses;
+    return total ? (double)stats.hits / (double)total : 0.0;
+}
+
+u32 bcache_capacity(void) {
+    return nslots;
+}
+
+u32 bcache_dirty(void) {
+    return ndirty;
+}
@@ -0,0 +1,36 @@
+#ifndef BCACHE_H
+#define BCACHE_H
+#include "fs_basic.h"
+#include <stddef.h>
+
+// Presupuesto por defecto de la cache de bloques (bytes)
+#define BCACHE_DEFAULT_BUDGET (1024u * 1024u)
+
+typedef struct bcache_stats {
+    unsigned long long hits;
+    unsigned long long misses;
+    unsigned long long evictions;
+    unsigned long long writebacks;   // bloques sucios escritos a disco
+} bcache_stats;
+
+int  bcache_init(size_t budget_bytes, u32 block_size);
+void bcache_shutdown(void);
+
+// Bloque fijado en memoria (solo lectura); liberar con bcache_put
+const unsigned char *bcache_get(const char *folder, u32 index, u32 block_size);
+void bcache_put(const unsigned char *data);
+int  bcache_prefetch(const char *folder, const u32 *blocks, u32 n, u32 block_size);
+
+int  bcache_read(const char *folder, u32 index, unsigned char *buf, u32 block_size);
+int  bcache_write(const char *folder, u32 index, const void *buf, u32 len);
+int  bcache_writeback(const char *folder);
+int  bcache_flush(const char *folder);
+void bcache_discard(const char *folder, u32 index);
+void bcache_invalidate(void);
+
+void   bcache_get_stats(bcache_stats *out);
+double bcache_hit_rate(void);
+u32    bcache_capacity(void);
+u32    bcache_dirty(void);      // bloques sucios que todavía no bajaron
+
+#endif
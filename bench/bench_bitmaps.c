@@ -0,0 +1,93 @@
+// Costo de asignación en bitmaps: formato ASCII viejo ('0'/'1' por byte,
+// búsqueda lineal) contra palabras de 64 bits con ctz/popcount, buscando
+// desde 0 o desde el rotor (next-fit) del superbloque.
+//
+// Compilar desde la raíz del repo: make bench/bench_bitmaps (o make bench)
+// Uso: ./bench_bitmaps [bloques] [iteraciones]
+#include "bench_util.h"
+#include "../fs_basic.h"
+#include "../bitmaps.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static char *ascii_bm;
+
+static int ascii_allocate(u32 total) {
+    for (u32 i = 0; i < total; i++) {
+        if (ascii_bm[i] == '0') {
+            ascii_bm[i] = '1';
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+static u32 ascii_count_free(u32 total) {
+    u32 n = 0;
+    for (u32 i = 0; i < total; i++) n += ascii_bm[i] == '0';
+    return n;
+}
+
+int main(int argc, char **argv) {
+    u32 total = argc >= 2 ? (u32)strtoul(argv[1], NULL, 10) : (1u << 20);
+    u32 iters = argc >= 3 ? (u32)strtoul(argv[2], NULL, 10) : 200;
+    const double fills[] = {0.0, 0.5, 0.9, 0.99};
+
+    ascii_bm = malloc(total);
+    if (!ascii_bm || bitmaps_init(1, total) != 0) return 1;
+    spblock.total_blocks = total;
+
+    printf("bloques=%u, memoria: ascii=%u KiB, empaquetado=%zu KiB\n",
+           total, total / 1024, BITMAP_WORDS(total) * sizeof(u64) / 1024);
+    printf("%-8s %16s %16s %16s %16s %16s\n", "lleno", "ascii ns/alloc", "packed ns/alloc",
+           "rotor ns/alloc", "ascii ns/count", "packed ns/count");
+
+    for (size_t f = 0; f < sizeof(fills) / sizeof(fills[0]); f++) {
+        u32 used = (u32)(fills[f] * total);
+        memset(ascii_bm, '0', total);
+        memset(ascii_bm, '1', used);
+        memset(spblock.data_bitmap, 0, BITMAP_WORDS(total) * sizeof(u64));
+        for (u32 i = 0; i < used; i++) bitmap_set(spblock.data_bitmap, i);
+        bitmaps_recount();
+
+        // Asignar y liberar deja el nivel de ocupación igual en cada vuelta
+        uint64_t t0 = bench_now_ns();
+        for (u32 i = 0; i < iters; i++) {
+            int b = ascii_allocate(total);
+            ascii_bm[b] = '0';
+        }
+        double ascii_alloc = (double)(bench_now_ns() - t0) / iters;
+
+        t0 = bench_now_ns();
+        for (u32 i = 0; i < iters; i++) {
+            spblock.block_rotor = 0;
+            free_block(allocate_block());
+        }
+        double packed_alloc = (double)(bench_now_ns() - t0) / iters;
+
+        // Llenado con next-fit: cada asignación sigue donde terminó la anterior
+        spblock.block_rotor = 0;
+        u32 n = iters < spblock.free_blocks ? iters : spblock.free_blocks;
+        t0 = bench_now_ns();
+        for (u32 i = 0; i < n; i++) allocate_block();
+        double rotor_alloc = n ? (double)(bench_now_ns() - t0) / n : 0.0;
+
+        volatile u32 sink = 0;
+        t0 = bench_now_ns();
+        for (u32 i = 0; i < 10; i++) sink += ascii_count_free(total);
+        double ascii_count = (double)(bench_now_ns() - t0) / 10;
+
+        t0 = bench_now_ns();
+        for (u32 i = 0; i < 10; i++) sink += bitmap_count_set(spblock.data_bitmap, total);
+        double packed_count = (double)(bench_now_ns() - t0) / 10;
+        (void)sink;
+
+        printf("%6.0f%% %16.1f %16.1f %16.1f %16.1f %16.1f\n", fills[f] * 100,
+               ascii_alloc, packed_alloc, rotor_alloc, ascii_count, packed_count);
+    }
+
+    bitmaps_release();
+    free(ascii_bm);
+    return 0;
+}
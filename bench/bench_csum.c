@@ -0,0 +1,165 @@
+// Costo de las sumas CRC32C por bloque: el CRC solo (instrucción crc32 de
+// SSE4.2 en tres flujos contra slicing-by-8) y la E/S de bloques de la imagen
+// sin tabla, con la tabla mantenida sin verificar y con las políticas
+// metadata y always. Con la cache de páginas caliente, así que es el peor
+// caso relativo: en disco real la suma pesa todavía menos.
+//
+// Compilar desde la raíz del repo: make bench/bench_csum (o make bench)
+// Uso: ./bench_csum [carpeta] [bloques] [operaciones]
+#include "bench_util.h"
+#include "../block.h"
+#include "../csum.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#define BS  4096u
+#define RUN 64u      // bloques por operación secuencial
+
+static double mib_s(double bytes, uint64_t ns) {
+    return ns ? bytes / (1024.0 * 1024.0) / ((double)ns / 1e9) : 0.0;
+}
+
+static void crc_bench(u32 iters) {
+    const u32 sizes[] = {512, 1024, 4096, 65536};
+    static unsigned char data[65536], copy[65536];
+    uint64_t seed = 7;
+    for (u32 i = 0; i < sizeof(data); i += 4) {
+        u32 r = bench_rand(&seed);
+        memcpy(data + i, &r, 4);
+    }
+    printf("%-7s %-13s %10s %10s %10s\n", "bloque", "crc32c", "ns/bloque", "MiB/s", "memcpy");
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        u32 len = sizes[s], n = (u32)((u64)iters * 4096 / len) + 1;
+        uint64_t t0 = bench_now_ns();
+        for (u32 i = 0; i < n; i++) {
+            memcpy(copy, data, len);
+            __asm__ __volatile__("" ::: "memory");
+        }
+        uint64_t raw = bench_now_ns() - t0;
+        for (int simd = 1; simd >= 0; simd--) {
+            csum_set_simd(simd);
+            volatile u32 sink = 0;
+            t0 = bench_now_ns();
+            for (u32 i = 0; i < n; i++) sink += csum_crc32c(0, data, len);
+            uint64_t ns = bench_now_ns() - t0;
+            printf("%-7u %-13s %10.1f %10.0f %10.0f\n", len, csum_impl(), (double)ns / n,
+                   mib_s((double)len * n, ns), mib_s((double)len * n, raw));
+            (void)sink;
+        }
+    }
+    csum_set_simd(1);
+    printf("\n");
+}
+
+typedef struct result {
+    double wr, rd, pread, seq_wr, seq_rd;   // ns por operación
+} result;
+
+static int io_bench(const char *dir, u32 first, u32 blocks, u32 ops, const u32 *idx, unsigned char *buf, result *r) {
+    uint64_t t0 = bench_now_ns();
+    for (u32 i = 0; i < ops; i++) {
+        buf[0] = (unsigned char)i;
+        if (write_block(dir, first + idx[i], buf, BS) != 0) return -1;
+    }
+    r->wr = (double)(bench_now_ns() - t0) / ops;
+
+    t0 = bench_now_ns();
+    for (u32 i = 0; i < ops; i++) {
+        if (read_block(dir, first + idx[i], buf, BS) != 0) return -1;
+    }
+    r->rd = (double)(bench_now_ns() - t0) / ops;
+
+    t0 = bench_now_ns();
+    for (u32 i = 0; i < ops; i++) {
+        if (block_pread(dir, first + idx[i], 0, buf, BS, BS) != 0) return -1;
+    }
+    r->pread = (double)(bench_now_ns() - t0) / ops;
+
+    u32 runs = blocks / RUN, n = 0;
+    t0 = bench_now_ns();
+    for (u32 k = 0; k < ops / RUN + 1; k++, n++) {
+        if (write_blocks(dir, first + (k % runs) * RUN, RUN, buf, BS) != 0) return -1;
+    }
+    r->seq_wr = (double)(bench_now_ns() - t0) / n;
+
+    n = 0;
+    t0 = bench_now_ns();
+    for (u32 k = 0; k < ops / RUN + 1; k++, n++) {
+        if (read_blocks(dir, first + (k % runs) * RUN, RUN, buf, BS) != 0) return -1;
+    }
+    r->seq_rd = (double)(bench_now_ns() - t0) / n;
+    return 0;
+}
+
+static void row(const char *name, const result *r, const result *base) {
+    printf("%-18s %9.0f %9.0f %9.0f %11.0f %11.0f\n", name, r->wr, r->rd, r->pread, r->seq_wr, r->seq_rd);
+    if (base == r) return;
+    printf("%-18s %8.1f%% %8.1f%% %8.1f%% %10.1f%% %10.1f%%\n", "",
+           100.0 * (r->wr / base->wr - 1), 100.0 * (r->rd / base->rd - 1), 100.0 * (r->pread / base->pread - 1),
+           100.0 * (r->seq_wr / base->seq_wr - 1), 100.0 * (r->seq_rd / base->seq_rd - 1));
+}
+
+int main(int argc, char **argv) {
+    const char *dir = argc >= 2 ? argv[1] : "/tmp/qrfs_bench_csum";
+    u32 blocks = argc >= 3 ? (u32)strtoul(argv[2], NULL, 10) : 16384;
+    u32 ops    = argc >= 4 ? (u32)strtoul(argv[3], NULL, 10) : 200000;
+    if (blocks < 2 * RUN) blocks = 2 * RUN;
+
+    crc_bench(ops);
+
+    // Volumen de imagen con la tabla al principio, como la deja mkfs
+    superblock sb;
+    memset(&sb, 0, sizeof(sb));
+    sb.blocksize = BS;
+    sb.csum_start = 1;
+    sb.csum_blocks = (blocks + BS / 4 - 1) / (BS / 4) + 1;
+    sb.total_blocks = 1 + sb.csum_blocks + blocks;
+    u32 first = 1 + sb.csum_blocks;
+    if (ensure_folder(dir) != 0 || block_format(dir, QRFS_BACKEND_IMAGE, sb.total_blocks, BS, NULL) != 0) {
+        fprintf(stderr, "No se pudo preparar %s: %s\n", dir, strerror(errno));
+        return 1;
+    }
+
+    unsigned char *buf = (unsigned char*)malloc((size_t)RUN * BS);
+    u32 *idx = (u32*)malloc(sizeof(u32) * ops);
+    if (!buf || !idx) return 1;
+    memset(buf, 0x5a, (size_t)RUN * BS);
+    uint64_t seed = 0x9e3779b97f4a7c15ull;
+    for (u32 i = 0; i < ops; i++) idx[i] = bench_rand(&seed) % blocks;
+    // Calentar la cache de páginas y dejar cada bloque con su suma
+    for (u32 b = 0; b + RUN <= blocks; b += RUN) write_blocks(dir, first + b, RUN, buf, BS);
+
+    printf("imagen: %u bloques de %u bytes, %u operaciones, %u bloques por operación secuencial\n",
+           blocks, BS, ops, RUN);
+    printf("%-18s %9s %9s %9s %11s %11s\n", "(ns por operación)", "write", "read", "pread", "seq write", "seq read");
+
+    const char *names[] = {"tabla, always", "tabla, metadata", "tabla, off"};
+    const int policies[] = {CSUM_VERIFY_ALWAYS, CSUM_VERIFY_METADATA, CSUM_VERIFY_OFF};
+    result base, r;
+    if (io_bench(dir, first, blocks, ops, idx, buf, &base) != 0) return 1;
+    row("sin tabla", &base, &base);
+    if (csum_init(&sb) != 0) return 1;
+    for (u32 b = 0; b + RUN <= blocks; b += RUN) write_blocks(dir, first + b, RUN, buf, BS);
+    for (int p = 2; p >= 0; p--) {
+        csum_set_policy(policies[p]);
+        if (io_bench(dir, first, blocks, ops, idx, buf, &r) != 0) {
+            fprintf(stderr, "Error de E/S con %s: %s\n", names[p], strerror(errno));
+            return 1;
+        }
+        row(names[p], &r, &base);
+    }
+
+    uint64_t t0 = bench_now_ns();
+    if (csum_store(dir) != 0) return 1;
+    csum_stats st;
+    csum_get_stats(&st);
+    printf("\nescritura de la tabla (%u bloques): %.3f ms; sumas actualizadas=%llu, verificadas=%llu, fallidas=%llu\n",
+           sb.csum_blocks, (bench_now_ns() - t0) / 1e6, st.updated, st.verified, st.failures);
+
+    block_close();
+    free(idx);
+    free(buf);
+    return 0;
+}
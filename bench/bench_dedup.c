@@ -0,0 +1,145 @@
+// Costo de la deduplicación en el camino de escritura: el hash solo (xxHash64
+// contra memcpy) y la escritura de bloques de datos con distintas fracciones
+// de contenido repetido, sin tabla (write_block directo) y con el camino de
+// filemap (hash, búsqueda en el índice, verificación leyendo el candidato y
+// referencia o escritura + alta en el índice). Con la cache de páginas
+// caliente: la lectura de verificación sale barata, en disco real pesa más,
+// pero cada acierto también se ahorra una escritura.
+//
+// Compilar desde la raíz del repo: make bench/bench_dedup (o make bench)
+// Uso: ./bench_dedup [carpeta] [bloques]
+#include "bench_util.h"
+#include "../block.h"
+#include "../dedup.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#define BS 4096u
+
+static double mib_s(double bytes, uint64_t ns) {
+    return ns ? bytes / (1024.0 * 1024.0) / ((double)ns / 1e9) : 0.0;
+}
+
+static void hash_bench(void) {
+    const u32 sizes[] = {512, 1024, 4096, 65536};
+    static unsigned char data[65536], copy[65536];
+    uint64_t seed = 7;
+    for (u32 i = 0; i < sizeof(data); i += 4) {
+        u32 r = bench_rand(&seed);
+        memcpy(data + i, &r, 4);
+    }
+    printf("%-7s %10s %10s %10s\n", "bloque", "ns/bloque", "MiB/s", "memcpy");
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        u32 len = sizes[s], n = (u32)(((u64)256 << 20) / len);
+        uint64_t t0 = bench_now_ns();
+        for (u32 i = 0; i < n; i++) {
+            memcpy(copy, data, len);
+            __asm__ __volatile__("" ::: "memory");
+        }
+        uint64_t raw = bench_now_ns() - t0;
+        volatile u64 sink = 0;
+        t0 = bench_now_ns();
+        for (u32 i = 0; i < n; i++) sink += dedup_hash(data, len);
+        uint64_t ns = bench_now_ns() - t0;
+        printf("%-7u %10.1f %10.0f %10.0f\n", len, (double)ns / n, mib_s((double)len * n, ns),
+               mib_s((double)len * n, raw));
+        (void)sink;
+    }
+    printf("\n");
+}
+
+// Contenido del bloque lógico i: de un conjunto de 'distinct' bloques
+// posibles cuando toca repetir, único si no
+static void fill(unsigned char *buf, u32 i, u32 pct, u32 distinct, uint64_t *seed) {
+    u32 tag = bench_rand(seed) % 100 < pct ? bench_rand(seed) % distinct : 0x80000000u | i;
+    for (u32 k = 0; k < BS; k += 4) {
+        u32 v = tag * 2654435761u + k;
+        memcpy(buf + k, &v, 4);
+    }
+}
+
+// Lo mismo que hace filemap para un bloque entero sobre un hueco
+static int write_dedup(const char *dir, u32 *next, unsigned char *buf, unsigned char *cand) {
+    u64 h = dedup_hash(buf, BS);
+    u32 c = dedup_find(h);
+    if (c) {
+        if (read_block(dir, c, cand, BS) != 0) return -1;
+        if (memcmp(cand, buf, BS) == 0) {
+            dedup_ref(c);
+            dedup_note(DEDUP_HIT);
+            return 0;
+        }
+        dedup_note(DEDUP_COLLISION);
+    }
+    u32 b = (*next)++;
+    if (write_block(dir, b, buf, BS) != 0) return -1;
+    dedup_index(b, h);
+    dedup_note(DEDUP_WRITTEN);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    const char *dir = argc >= 2 ? argv[1] : "/tmp/qrfs_bench_dedup";
+    u32 blocks = argc >= 3 ? (u32)strtoul(argv[2], NULL, 10) : 32768;
+
+    hash_bench();
+
+    superblock sb;
+    memset(&sb, 0, sizeof(sb));
+    sb.blocksize = BS;
+    sb.total_blocks = 1 + blocks;
+    sb.dedup_start = 1;
+    sb.dedup_blocks = (sb.total_blocks + BS / DEDUP_RECORD_SIZE - 1) / (BS / DEDUP_RECORD_SIZE);
+    sb.total_blocks += sb.dedup_blocks;
+    u32 first = 1 + sb.dedup_blocks;
+    if (ensure_folder(dir) != 0 || block_format(dir, QRFS_BACKEND_IMAGE, sb.total_blocks, BS, NULL) != 0) {
+        fprintf(stderr, "No se pudo preparar %s: %s\n", dir, strerror(errno));
+        return 1;
+    }
+
+    unsigned char *buf = (unsigned char*)malloc(BS), *cand = (unsigned char*)malloc(BS);
+    if (!buf || !cand) return 1;
+    // Calentar la cache de páginas
+    memset(buf, 0, BS);
+    for (u32 b = 0; b < blocks; b++) write_block(dir, first + b, buf, BS);
+
+    printf("imagen: %u bloques de %u bytes, 256 contenidos posibles para los repetidos\n", blocks, BS);
+    printf("%-10s %12s %12s %9s %10s %10s %8s\n", "repetidos", "sin (ns)", "con (ns)", "costo",
+           "aciertos", "escritos", "ratio");
+    const u32 pcts[] = {0, 25, 50, 90, 100};
+    for (size_t p = 0; p < sizeof(pcts) / sizeof(pcts[0]); p++) {
+        uint64_t seed = 0x9e3779b97f4a7c15ull;
+        uint64_t t0 = bench_now_ns();
+        for (u32 i = 0; i < blocks; i++) {
+            fill(buf, i, pcts[p], 256, &seed);
+            if (write_block(dir, first + i, buf, BS) != 0) return 1;
+        }
+        uint64_t plain = bench_now_ns() - t0;
+
+        if (dedup_init(&sb) != 0) return 1;
+        seed = 0x9e3779b97f4a7c15ull;
+        u32 next = first;
+        t0 = bench_now_ns();
+        for (u32 i = 0; i < blocks; i++) {
+            fill(buf, i, pcts[p], 256, &seed);
+            if (write_dedup(dir, &next, buf, cand) != 0) {
+                fprintf(stderr, "Error de E/S: %s\n", strerror(errno));
+                return 1;
+            }
+        }
+        uint64_t dd = bench_now_ns() - t0;
+        dedup_stats st;
+        dedup_get_stats(&st);
+        printf("%8u%%  %12.0f %12.0f %8.1f%% %10llu %10llu %8.2f\n", pcts[p], (double)plain / blocks,
+               (double)dd / blocks, 100.0 * ((double)dd / plain - 1), st.hits, st.written,
+               (double)blocks / (next - first));
+        dedup_close();
+    }
+
+    block_close();
+    free(buf);
+    free(cand);
+    return 0;
+}
@@ -0,0 +1,112 @@
+// Compara lecturas de bloques: stdio original (fopen/fread/fclose por bloque),
+// backend de archivos con cache de descriptores, imagen con pread y mmap.
+//
+// Compilar desde la raíz del repo: make bench/bench_mmap (o make bench)
+// Uso: ./bench_mmap [carpeta] [bloques] [lecturas]
+#include "bench_util.h"
+#include "../block.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+static u32 bs = 1024;
+
+static u32 sum_block(const unsigned char *p) {
+    u32 s = 0;
+    for (u32 i = 0; i < bs; i++) s += p[i];
+    return s;
+}
+
+// Camino previo a la cache de descriptores, tal como lo hacía read_block
+static int stdio_read(const char *folder, u32 index, unsigned char *buf) {
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/block_%04u.png", folder, index);
+    FILE *fp = fopen(path, "rb");
+    if (!fp) return -1;
+    size_t r = fread(buf, 1, bs, fp);
+    fclose(fp);
+    return r == bs ? 0 : -1;
+}
+
+static void report(const char *name, uint64_t ns, u32 reads, u32 check) {
+    double per = (double)ns / reads;
+    double mbs = ((double)reads * bs / (1024.0 * 1024.0)) / ((double)ns / 1e9);
+    printf("%-8s %10.1f ns/bloque %10.1f MiB/s  (check=%u)\n", name, per, mbs, check);
+}
+
+int main(int argc, char **argv) {
+    const char *base = argc >= 2 ? argv[1] : "/tmp/qrfs_bench_mmap";
+    u32 blocks = argc >= 3 ? (u32)strtoul(argv[2], NULL, 10) : 4096;
+    u32 reads  = argc >= 4 ? (u32)strtoul(argv[3], NULL, 10) : 200000;
+
+    char files_dir[512], image_dir[512];
+    snprintf(files_dir, sizeof(files_dir), "%s/files", base);
+    snprintf(image_dir, sizeof(image_dir), "%s/image", base);
+    if (ensure_folder(files_dir) != 0 || ensure_folder(image_dir) != 0) {
+        fprintf(stderr, "No se pudo preparar %s: %s\n", base, strerror(errno));
+        return 1;
+    }
+    if (block_format(files_dir, QRFS_BACKEND_FILES, blocks, bs, NULL) != 0 ||
+        block_format(image_dir, QRFS_BACKEND_IMAGE, blocks, bs, NULL) != 0) {
+        fprintf(stderr, "No se pudieron formatear los volúmenes de prueba\n");
+        return 1;
+    }
+    block_close();
+
+    unsigned char *buf = malloc(bs);
+    u32 *idx = malloc(sizeof(u32) * reads);
+    if (!buf || !idx) return 1;
+    uint64_t seed = 0x9e3779b97f4a7c15ull;
+    for (u32 i = 0; i < reads; i++) idx[i] = bench_rand(&seed) % blocks;
+
+    printf("bloques=%u, lecturas=%u, block_size=%u\n", blocks, reads, bs);
+
+    u32 check = 0;
+    uint64_t t0 = bench_now_ns();
+    for (u32 i = 0; i < reads; i++) {
+        if (stdio_read(files_dir, idx[i], buf) != 0) return 1;
+        check += sum_block(buf);
+    }
+    report("stdio", bench_now_ns() - t0, reads, check);
+
+    check = 0;
+    block_use_backend(files_dir, QRFS_BACKEND_FILES, bs);
+    t0 = bench_now_ns();
+    for (u32 i = 0; i < reads; i++) {
+        if (read_block(files_dir, idx[i], buf, bs) != 0) return 1;
+        check += sum_block(buf);
+    }
+    report("files", bench_now_ns() - t0, reads, check);
+
+    check = 0;
+    block_use_backend(image_dir, QRFS_BACKEND_IMAGE, bs);
+    t0 = bench_now_ns();
+    for (u32 i = 0; i < reads; i++) {
+        if (read_block(image_dir, idx[i], buf, bs) != 0) return 1;
+        check += sum_block(buf);
+    }
+    report("image", bench_now_ns() - t0, reads, check);
+
+    check = 0;
+    block_use_backend(image_dir, QRFS_BACKEND_MMAP, bs);
+    t0 = bench_now_ns();
+    for (u32 i = 0; i < reads; i++) {
+        const unsigned char *p = block_view(image_dir, idx[i], bs);
+        if (!p) return 1;
+        check += sum_block(p);
+    }
+    report("mmap", bench_now_ns() - t0, reads, check);
+
+    // Costo de un punto de persistencia tras reescribir todo el volumen
+    memset(buf, 0xAB, bs);
+    t0 = bench_now_ns();
+    for (u32 i = 0; i < blocks; i++) write_block(image_dir, i, buf, bs);
+    block_flush(image_dir);
+    printf("mmap escritura+msync de %u bloques: %.3f ms\n", blocks, (bench_now_ns() - t0) / 1e6);
+
+    block_close();
+    free(idx);
+    free(buf);
+    return 0;
+}
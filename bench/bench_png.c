@@ -0,0 +1,93 @@
+// Contenedor PNG de bloques: codificar (filas + deflate stored + CRC32 +
+// Adler32) y decodificar validando solo cabeceras o verificando las sumas,
+// por tamaño de bloque, con las sumas por SIMD (PCLMUL/SSSE3) y sin SIMD.
+// La copia cruda (memcpy) da la referencia de lo que cuesta el modo sin PNG.
+//
+// Compilar desde la raíz del repo: make bench/bench_png (o make bench)
+// Uso: ./bench_png [iteraciones]
+#include "bench_util.h"
+#include "../png.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static double mib_s(u32 bytes, u32 iters, uint64_t ns) {
+    return ns ? (double)bytes * iters / (1024.0 * 1024.0) / ((double)ns / 1e9) : 0.0;
+}
+
+int main(int argc, char **argv) {
+    u32 iters = argc >= 2 ? (u32)strtoul(argv[1], NULL, 10) : 20000;
+    const u32 sizes[] = {512, 1024, 4096, 65536};
+    static unsigned char data[65536], back[65536], enc[PNG_ENCODED_SIZE(65536)];
+    uint64_t seed = 42;
+    for (u32 i = 0; i < sizeof(data); i += 4) {
+        u32 r = bench_rand(&seed);
+        memcpy(data + i, &r, 4);
+    }
+
+    // Con SIMD disponible se mide también el camino sin SIMD
+    png_set_simd(0);
+    const char *plain = png_checksum_impl();
+    png_set_simd(1);
+    int nimpl = strcmp(png_checksum_impl(), plain) != 0 ? 2 : 1;
+
+    // Sumas solas sobre 64 KiB
+    for (int k = 0; k < nimpl; k++) {
+        png_set_simd(k);
+        volatile u32 sink = 0;
+        u32 n = iters / 16 + 1;
+        uint64_t t0 = bench_now_ns();
+        for (u32 i = 0; i < n; i++) sink += png_crc32(0, data, sizeof(data));
+        double crc = mib_s(sizeof(data), n, bench_now_ns() - t0);
+        t0 = bench_now_ns();
+        for (u32 i = 0; i < n; i++) sink += png_adler32(1, data, sizeof(data));
+        double adler = mib_s(sizeof(data), n, bench_now_ns() - t0);
+        printf("%-21s crc32 %8.0f MiB/s, adler32 %8.0f MiB/s\n", png_checksum_impl(), crc, adler);
+        (void)sink;
+    }
+    printf("\n");
+
+    printf("%-7s %-21s %9s %10s %10s %10s %10s %10s\n", "bloque", "sumas", "archivo",
+           "memcpy", "encode", "decode", "verify", "ns/enc");
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        u32 bs = sizes[s], n = (u32)((u64)iters * 1024 / bs) + 1;
+        for (int k = 0; k < nimpl; k++) {
+            png_set_simd(k);
+            size_t len = png_encode(data, bs, enc);
+
+            uint64_t t0 = bench_now_ns();
+            for (u32 i = 0; i < n; i++) {
+                memcpy(back, data, bs);
+                __asm__ __volatile__("" ::: "memory");
+            }
+            uint64_t raw = bench_now_ns() - t0;
+
+            t0 = bench_now_ns();
+            for (u32 i = 0; i < n; i++) {
+                png_encode(data, bs, enc);
+                __asm__ __volatile__("" ::: "memory");
+            }
+            uint64_t encode = bench_now_ns() - t0;
+
+            t0 = bench_now_ns();
+            for (u32 i = 0; i < n; i++) {
+                if (png_decode(enc, len, back, bs) != 0) return 1;
+                __asm__ __volatile__("" ::: "memory");
+            }
+            uint64_t decode = bench_now_ns() - t0;
+
+            t0 = bench_now_ns();
+            for (u32 i = 0; i < n; i++) {
+                if (png_verify(enc, len) != 0 || png_decode(enc, len, back, bs) != 0) return 1;
+            }
+            uint64_t verify = bench_now_ns() - t0;
+            if (memcmp(back, data, bs) != 0) return 1;
+
+            printf("%-7u %-21s %9zu %10.0f %10.0f %10.0f %10.0f %10.0f\n", bs, png_checksum_impl(), len,
+                   mib_s(bs, n, raw), mib_s(bs, n, encode), mib_s(bs, n, decode), mib_s(bs, n, verify),
+                   (double)encode / n);
+        }
+    }
+    printf("\n(MiB/s de datos del bloque; decode valida solo cabeceras, verify además CRC y Adler32)\n");
+    return 0;
+}
@@ -0,0 +1,578 @@
+// Suite de benchmarks con salida JSON, para comparar builds entre sí.
+//
+// Micro: read_block/write_block (y de a RUN bloques) por backend,
+// allocate_block/allocate_inode con los bitmaps llenos en distinto grado,
+// inode_serialize128/inode_deserialize128 (y encode/decode del inodo
+// completo) y búsqueda/recorrido de un bloque de directorio lleno, con
+// entradas fijas y empaquetadas.
+// Macro: mkfs de N bloques, crear/stat/listar/borrar muchos archivos y E/S
+// secuencial y aleatoria de un archivo, por libqrfs sobre un volumen de imagen.
+//
+// Cada caso corre RUNS veces; se informa la mediana y el mínimo en ns por
+// operación (y MiB/s cuando la operación mueve datos). Con la cache de
+// páginas caliente: mide el código de QRFS, no el disco. El progreso y los
+// errores van a stderr, stdout queda solo con el JSON.
+//
+// Compilar desde la raíz del repo: make bench/bench_suite (o make bench)
+// Uso: ./bench_suite [carpeta] [--scale=N] [--only=prefijo] > resultados.json
+#define _XOPEN_SOURCE 700
+#include "bench_util.h"
+#include "../qrfs.h"
+#include "../block.h"
+#include "../bitmaps.h"
+#include "../inode.h"
+#include "../dir.h"
+#include "../mkfs.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <ftw.h>
+
+#define BS   4096u
+#define RUN  64u      // bloques por operación de read_blocks/write_blocks
+#define RUNS 5
+#define CHUNK (128u * 1024u)
+
+static const char *base = "/tmp/qrfs_bench_suite";
+static const char *only = NULL;
+static u32 scale = 1;
+static int results = 0;
+
+// --only=prefijo: los casos cuyo nombre empieza así ("block_io", "io.seq", ...)
+static int selected(const char *name) {
+    return !only || strncmp(name, only, strlen(only)) == 0;
+}
+
+// Si hace falta preparar un grupo: el prefijo pedido y el del grupo coinciden
+static int group(const char *prefix) {
+    if (!only) return 1;
+    size_t a = strlen(only), b = strlen(prefix);
+    return strncmp(only, prefix, a < b ? a : b) == 0;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+// Una entrada de "results". ns[] trae el tiempo total de cada corrida de
+// `ops` operaciones; params es un objeto JSON ya armado.
+static void emit(const char *name, const char *params, u64 ops, uint64_t *ns, u32 runs, u64 bytes_per_op) {
+    qsort(ns, runs, sizeof(ns[0]), cmp_u64);
+    double med = (double)ns[runs / 2] / ops, min = (double)ns[0] / ops;
+    printf("%s    {\"name\": \"%s\", \"params\": %s, \"ops\": %llu, \"runs\": %u, "
+           "\"ns_per_op\": %.1f, \"ns_per_op_min\": %.1f, \"ops_per_s\": %.0f",
+           results++ ? ",\n" : "", name, params, (unsigned long long)ops, runs, med, min, med > 0 ? 1e9 / med : 0.0);
+    if (bytes_per_op) printf(", \"mib_s\": %.1f", med > 0 ? (double)bytes_per_op / (1024.0 * 1024.0) / (med / 1e9) : 0.0);
+    printf("}");
+    fflush(stdout);
+    fprintf(stderr, "%-22s %-40s %12.1f ns/op\n", name, params, med);
+}
+
+static int fail(const char *what) {
+    fprintf(stderr, "Error en %s: %s\n", what, strerror(errno));
+    return -1;
+}
+
+// mkfs y el montaje informan por stdout: se tapa mientras corren
+static int saved_stdout = -1;
+
+static void quiet(int on) {
+    fflush(stdout);
+    if (on) {
+        int fd = open("/dev/null", O_WRONLY);
+        saved_stdout = dup(STDOUT_FILENO);
+        if (fd >= 0) {
+            dup2(fd, STDOUT_FILENO);
+            close(fd);
+        }
+    } else if (saved_stdout >= 0) {
+        dup2(saved_stdout, STDOUT_FILENO);
+        close(saved_stdout);
+        saved_stdout = -1;
+    }
+}
+
+static int rm_entry(const char *path, const struct stat *st, int flag, struct FTW *ftw) {
+    (void)st; (void)flag; (void)ftw;
+    return remove(path);
+}
+
+static void rm_tree(const char *path) {
+    nftw(path, rm_entry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+static void fill_random(unsigned char *buf, size_t len, uint64_t *seed) {
+    for (size_t i = 0; i + 4 <= len; i += 4) {
+        u32 r = bench_rand(seed);
+        memcpy(buf + i, &r, 4);
+    }
+}
+
+// ---- Micro: E/S de bloques ----
+
+static int block_io(u32 backend, const char *bname) {
+    char dir[512], params[128], name[64];
+    u32 blocks = (backend == QRFS_BACKEND_FILES ? 4096u : 16384u) * scale;
+    u32 ops = 20000 * scale;
+    snprintf(dir, sizeof(dir), "%s/io_%s", base, bname);
+    snprintf(params, sizeof(params), "{\"backend\": \"%s\", \"blocks\": %u, \"block_size\": %u}", bname, blocks, BS);
+    u32 format = backend == QRFS_BACKEND_FILES ? QRFS_BACKEND_FILES : QRFS_BACKEND_IMAGE;
+    if (ensure_folder(dir) != 0 || block_format(dir, format, blocks, BS, NULL) != 0) return fail(dir);
+    if (backend == QRFS_BACKEND_MMAP && block_use_backend(dir, QRFS_BACKEND_MMAP, BS) != 0) return fail(dir);
+
+    unsigned char *buf = (unsigned char*)malloc((size_t)RUN * BS);
+    u32 *idx = (u32*)malloc(sizeof(u32) * ops);
+    if (!buf || !idx) {
+        free(buf);
+        free(idx);
+        errno = ENOMEM;
+        return fail("block_io");
+    }
+    uint64_t seed = 0x9e3779b97f4a7c15ull;
+    fill_random(buf, (size_t)RUN * BS, &seed);
+    for (u32 i = 0; i < ops; i++) idx[i] = bench_rand(&seed) % blocks;
+    // Calentar la cache de páginas
+    for (u32 b = 0; b + RUN <= blocks; b += RUN) write_blocks(dir, b, RUN, buf, BS);
+
+    uint64_t ns[RUNS];
+    int rc = 0;
+    snprintf(name, sizeof(name), "block_io.write_block");
+    if (selected(name)) {
+        for (u32 r = 0; r < RUNS && rc == 0; r++) {
+            uint64_t t0 = bench_now_ns();
+            for (u32 i = 0; i < ops && rc == 0; i++) rc = write_block(dir, idx[i], buf, BS);
+            ns[r] = bench_now_ns() - t0;
+        }
+        if (rc == 0) emit(name, params, ops, ns, RUNS, BS);
+    }
+    snprintf(name, sizeof(name), "block_io.read_block");
+    if (rc == 0 && selected(name)) {
+        for (u32 r = 0; r < RUNS && rc == 0; r++) {
+            uint64_t t0 = bench_now_ns();
+            for (u32 i = 0; i < ops && rc == 0; i++) rc = read_block(dir, idx[i], buf, BS);
+            ns[r] = bench_now_ns() - t0;
+        }
+        if (rc == 0) emit(name, params, ops, ns, RUNS, BS);
+    }
+    u32 runs_per = blocks / RUN, n = ops / RUN + 1;
+    snprintf(name, sizeof(name), "block_io.write_blocks");
+    if (rc == 0 && selected(name)) {
+        for (u32 r = 0; r < RUNS && rc == 0; r++) {
+            uint64_t t0 = bench_now_ns();
+            for (u32 k = 0; k < n && rc == 0; k++) rc = write_blocks(dir, (k % runs_per) * RUN, RUN, buf, BS);
+            ns[r] = bench_now_ns() - t0;
+        }
+        if (rc == 0) emit(name, params, n, ns, RUNS, (u64)RUN * BS);
+    }
+    snprintf(name, sizeof(name), "block_io.read_blocks");
+    if (rc == 0 && selected(name)) {
+        for (u32 r = 0; r < RUNS && rc == 0; r++) {
+            uint64_t t0 = bench_now_ns();
+            for (u32 k = 0; k < n && rc == 0; k++) rc = read_blocks(dir, (k % runs_per) * RUN, RUN, buf, BS);
+            ns[r] = bench_now_ns() - t0;
+        }
+        if (rc == 0) emit(name, params, n, ns, RUNS, (u64)RUN * BS);
+    }
+    block_close();
+    free(buf);
+    free(idx);
+    return rc == 0 ? 0 : fail(dir);
+}
+
+// ---- Micro: asignación ----
+
+// Ocupación pareja al azar; asignar y liberar deja el nivel igual en cada
+// vuelta y el rotor sigue avanzando (next-fit en régimen)
+static void fill_bitmap(u64 *bm, u32 total, double fill, uint64_t *seed) {
+    u32 limit = (u32)(fill * 4294967295.0);
+    memset(bm, 0, BITMAP_WORDS(total) * sizeof(u64));
+    for (u32 i = 0; i < total; i++) {
+        if (fill > 0 && bench_rand(seed) <= limit) bitmap_set(bm, i);
+    }
+}
+
+static int alloc_bench(void) {
+    const double fills[] = {0.0, 0.5, 0.9, 0.99};
+    u32 blocks = (1u << 20) * scale, inodes = (1u << 16) * scale, ops = 100000 * scale;
+    if (bitmaps_init(inodes, blocks) != 0) return fail("bitmaps_init");
+    spblock.total_blocks = blocks;
+    spblock.total_inodes = inodes;
+    uint64_t seed = 42, ns[RUNS];
+    char params[128];
+    for (size_t f = 0; f < sizeof(fills) / sizeof(fills[0]); f++) {
+        fill_bitmap(spblock.data_bitmap, blocks, fills[f], &seed);
+        fill_bitmap(spblock.inode_bitmap, inodes, fills[f], &seed);
+        bitmaps_recount();
+        spblock.block_rotor = spblock.inode_rotor = 0;
+
+        snprintf(params, sizeof(params), "{\"fill\": %.2f, \"entries\": %u}", fills[f], blocks);
+        if (selected("alloc.block")) {
+            for (u32 r = 0; r < RUNS; r++) {
+                uint64_t t0 = bench_now_ns();
+                for (u32 i = 0; i < ops; i++) free_block(allocate_block());
+                ns[r] = bench_now_ns() - t0;
+            }
+            emit("alloc.block", params, ops, ns, RUNS, 0);
+        }
+        snprintf(params, sizeof(params), "{\"fill\": %.2f, \"entries\": %u}", fills[f], inodes);
+        if (selected("alloc.inode")) {
+            for (u32 r = 0; r < RUNS; r++) {
+                uint64_t t0 = bench_now_ns();
+                for (u32 i = 0; i < ops; i++) free_inode(allocate_inode());
+                ns[r] = bench_now_ns() - t0;
+            }
+            emit("alloc.inode", params, ops, ns, RUNS, 0);
+        }
+    }
+    bitmaps_release();
+    return 0;
+}
+
+// ---- Micro: inodos ----
+
+static int inode_bench(void) {
+    u32 ops = 1000000 * scale;
+    unsigned char raw[128];
+    u32 direct[12], num, mode, uid, gid, links, size, ind;
+    uint64_t ns[RUNS];
+    for (u32 i = 0; i < 12; i++) direct[i] = 1000 + i;
+    volatile u32 sink = 0;
+
+    if (selected("inode.serialize128")) {
+        for (u32 r = 0; r < RUNS; r++) {
+            uint64_t t0 = bench_now_ns();
+            for (u32 i = 0; i < ops; i++) {
+                inode_serialize128(raw, i, 0100644, 1000, 1000, 1, i * 7, direct, 5000);
+                sink += raw[i & 127];
+            }
+            ns[r] = bench_now_ns() - t0;
+        }
+        emit("inode.serialize128", "{}", ops, ns, RUNS, 128);
+    }
+    if (selected("inode.deserialize128")) {
+        inode_serialize128(raw, 7, 0100644, 1000, 1000, 1, 12345, direct, 5000);
+        for (u32 r = 0; r < RUNS; r++) {
+            uint64_t t0 = bench_now_ns();
+            for (u32 i = 0; i < ops; i++) {
+                raw[16] = (unsigned char)i;
+                inode_deserialize128(raw, &num, &mode, &uid, &gid, &links, &size, direct, &ind);
+                sink += size;
+            }
+            ns[r] = bench_now_ns() - t0;
+        }
+        emit("inode.deserialize128", "{}", ops, ns, RUNS, 128);
+    }
+
+    // El inodo completo (extents, flags, tiempos) como lo usa el resto del sistema
+    inode node;
+    init_inode(&node, 7, 0100644, 12345);
+    if (selected("inode.encode128")) {
+        for (u32 r = 0; r < RUNS; r++) {
+            uint64_t t0 = bench_now_ns();
+            for (u32 i = 0; i < ops; i++) {
+                node.inode_size = i;
+                inode_encode128(raw, &node);
+                sink += raw[i & 127];
+            }
+            ns[r] = bench_now_ns() - t0;
+        }
+        emit("inode.encode128", "{}", ops, ns, RUNS, 128);
+    }
+    if (selected("inode.decode128")) {
+        inode_encode128(raw, &node);
+        for (u32 r = 0; r < RUNS; r++) {
+            uint64_t t0 = bench_now_ns();
+            for (u32 i = 0; i < ops; i++) {
+                raw[16] = (unsigned char)i;
+                inode_decode128(raw, &node);
+                sink += node.inode_size;
+            }
+            ns[r] = bench_now_ns() - t0;
+        }
+        emit("inode.decode128", "{}", ops, ns, RUNS, 128);
+    }
+    (void)sink;
+    return 0;
+}
+
+// ---- Micro: bloques de directorio ----
+
+static int count_entry(u32 inode_id, const char *name, void *ctx) {
+    (void)inode_id; (void)name;
+    (*(u32*)ctx)++;
+    return 0;
+}
+
+static int dir_bench(void) {
+    static unsigned char block[BS];
+    char name[32], params[128];
+    u32 ops = 200000 * scale, id;
+    uint64_t ns[RUNS];
+    u32 saved = spblock.features;
+    for (int packed = 1; packed >= 0; packed--) {
+        if (packed) spblock.features |= QRFS_FEAT_PACKED_DIRS;
+        else spblock.features &= ~QRFS_FEAT_PACKED_DIRS;
+        dirblock_init(block, BS);
+        u32 entries = 0;
+        for (;; entries++) {
+            snprintf(name, sizeof(name), "archivo_%06u.txt", entries);
+            if (dirblock_insert(block, BS, entries + 1, name) != 0) break;
+        }
+        snprintf(params, sizeof(params), "{\"layout\": \"%s\", \"entries\": %u, \"block_size\": %u}",
+                 packed ? "packed" : "fixed", entries, BS);
+        volatile u32 sink = 0;
+        uint64_t seed = 1;
+
+        if (selected("dir.find_hit")) {
+            for (u32 r = 0; r < RUNS; r++) {
+                uint64_t t0 = bench_now_ns();
+                for (u32 i = 0; i < ops; i++) {
+                    snprintf(name, sizeof(name), "archivo_%06u.txt", bench_rand(&seed) % entries);
+                    if (dirblock_find(block, BS, name, &id) == 0) sink += id;
+                }
+                ns[r] = bench_now_ns() - t0;
+            }
+            emit("dir.find_hit", params, ops, ns, RUNS, 0);
+        }
+        // Un nombre que no está recorre el bloque entero
+        if (selected("dir.find_miss")) {
+            for (u32 r = 0; r < RUNS; r++) {
+                uint64_t t0 = bench_now_ns();
+                for (u32 i = 0; i < ops; i++) {
+                    if (dirblock_find(block, BS, "no_existe.txt", &id) == 0) sink += id;
+                }
+                ns[r] = bench_now_ns() - t0;
+            }
+            emit("dir.find_miss", params, ops, ns, RUNS, 0);
+        }
+        if (selected("dir.iterate")) {
+            u32 n = ops / 16;
+            for (u32 r = 0; r < RUNS; r++) {
+                u32 seen = 0;
+                uint64_t t0 = bench_now_ns();
+                for (u32 i = 0; i < n; i++) dirblock_iterate(block, BS, count_entry, &seen);
+                ns[r] = bench_now_ns() - t0;
+                sink += seen;
+            }
+            emit("dir.iterate", params, n, ns, RUNS, BS);
+        }
+        (void)sink;
+    }
+    spblock.features = saved;
+    return 0;
+}
+
+// ---- Macro: mkfs ----
+
+static int mkfs_bench(const char *backend, u32 blocks, const char *extra) {
+    char dir[512], arg_blocks[32], arg_backend[32], params[160];
+    snprintf(dir, sizeof(dir), "%s/mkfs_%s", base, backend);
+    snprintf(arg_blocks, sizeof(arg_blocks), "--blocks=%u", blocks);
+    snprintf(arg_backend, sizeof(arg_backend), "--backend=%s", backend);
+    char *argv[] = {"mkfs", dir, arg_blocks, "--blocksize=4096", "--inodes=4096", arg_backend, (char*)extra, NULL};
+    snprintf(params, sizeof(params), "{\"backend\": \"%s\", \"blocks\": %u, \"block_size\": %u, \"options\": \"%s\"}",
+             backend, blocks, BS, extra ? extra : "");
+    uint64_t ns[3];
+    for (u32 r = 0; r < 3; r++) {
+        rm_tree(dir);
+        quiet(1);
+        uint64_t t0 = bench_now_ns();
+        int rc = mkfs(extra ? 7 : 6, argv);
+        ns[r] = bench_now_ns() - t0;
+        block_close();
+        quiet(0);
+        if (rc != 0) {
+            fprintf(stderr, "mkfs falló en %s\n", dir);
+            return -1;
+        }
+    }
+    emit("mkfs", params, 1, ns, 3, (u64)blocks * BS);
+    return 0;
+}
+
+// ---- Macro: libqrfs ----
+
+static qrfs *volume(const char *dir, u32 blocks, u32 inodes) {
+    char arg_blocks[32], arg_inodes[32];
+    snprintf(arg_blocks, sizeof(arg_blocks), "--blocks=%u", blocks);
+    snprintf(arg_inodes, sizeof(arg_inodes), "--inodes=%u", inodes);
+    char *argv[] = {"mkfs", (char*)dir, arg_blocks, arg_inodes, "--blocksize=4096", "--backend=image", "--extents", NULL};
+    rm_tree(dir);
+    quiet(1);
+    qrfs *fs = mkfs(7, argv) == 0 ? qrfs_mount(dir, NULL) : NULL;
+    quiet(0);
+    if (!fs) fail(dir);
+    return fs;
+}
+
+static int count_dirent(const qrfs_dirent *e, void *ctx) {
+    (void)e;
+    (*(u32*)ctx)++;
+    return 0;
+}
+
+static int files_bench(qrfs *fs) {
+    u32 n = 4000 * scale;
+    char path[64], params[96];
+    struct stat st;
+    uint64_t t_create[3], t_stat[3], t_list[3], t_unlink[3];
+    snprintf(params, sizeof(params), "{\"files\": %u, \"layout\": \"extents\"}", n);
+    if (qrfs_mkdir(fs, "/d", 0755) != 0) return fail("mkdir");
+    for (u32 r = 0; r < 3; r++) {
+        uint64_t t0 = bench_now_ns();
+        for (u32 i = 0; i < n; i++) {
+            snprintf(path, sizeof(path), "/d/archivo_%06u", i);
+            qrfs_file *f = qrfs_open(fs, path, O_CREAT | O_WRONLY, 0644);
+            if (!f) return fail(path);
+            qrfs_close(f);
+        }
+        t_create[r] = bench_now_ns() - t0;
+
+        uint64_t seed = 3;
+        t0 = bench_now_ns();
+        for (u32 i = 0; i < n; i++) {
+            snprintf(path, sizeof(path), "/d/archivo_%06u", bench_rand(&seed) % n);
+            if (qrfs_stat(fs, path, &st) != 0) return fail(path);
+        }
+        t_stat[r] = bench_now_ns() - t0;
+
+        u32 seen = 0;
+        t0 = bench_now_ns();
+        if (qrfs_readdir(fs, "/d", count_dirent, &seen) != 0) return fail("readdir");
+        t_list[r] = bench_now_ns() - t0;
+        if (seen < n) {
+            fprintf(stderr, "readdir vio %u de %u entradas\n", seen, n);
+            return -1;
+        }
+
+        t0 = bench_now_ns();
+        for (u32 i = 0; i < n; i++) {
+            snprintf(path, sizeof(path), "/d/archivo_%06u", i);
+            if (qrfs_unlink(fs, path) != 0) return fail(path);
+        }
+        t_unlink[r] = bench_now_ns() - t0;
+    }
+    if (selected("files.create")) emit("files.create", params, n, t_create, 3, 0);
+    if (selected("files.stat")) emit("files.stat", params, n, t_stat, 3, 0);
+    if (selected("files.readdir")) emit("files.readdir", params, n, t_list, 3, 0);
+    if (selected("files.unlink")) emit("files.unlink", params, n, t_unlink, 3, 0);
+    return 0;
+}
+
+static int file_io_bench(qrfs *fs) {
+    u64 size = (u64)64 * 1024 * 1024 * scale;
+    u32 chunks = (u32)(size / CHUNK), ops = 20000 * scale;
+    char params[128];
+    uint64_t ns[3], seed = 11;
+    unsigned char *buf = (unsigned char*)malloc(CHUNK);
+    if (!buf) {
+        errno = ENOMEM;
+        return fail("file_io");
+    }
+    fill_random(buf, CHUNK, &seed);
+    int rc = 0;
+
+    // Secuencial: el archivo se crea de cero en cada corrida (incluye asignar)
+    snprintf(params, sizeof(params), "{\"bytes\": %llu, \"chunk\": %u}", (unsigned long long)size, CHUNK);
+    for (u32 r = 0; r < 3 && rc == 0; r++) {
+        qrfs_file *f = qrfs_open(fs, "/seq", O_CREAT | O_TRUNC | O_WRONLY, 0644);
+        if (!f) { rc = -1; break; }
+        uint64_t t0 = bench_now_ns();
+        for (u32 i = 0; i < chunks && rc == 0; i++) rc = qrfs_write(f, buf, CHUNK) == (long)CHUNK ? 0 : -1;
+        if (rc == 0) rc = qrfs_fsync(f);
+        ns[r] = bench_now_ns() - t0;
+        qrfs_close(f);
+    }
+    if (rc == 0 && selected("io.seq_write")) emit("io.seq_write", params, chunks, ns, 3, CHUNK);
+    for (u32 r = 0; r < 3 && rc == 0; r++) {
+        qrfs_file *f = qrfs_open(fs, "/seq", O_RDONLY, 0);
+        if (!f) { rc = -1; break; }
+        uint64_t t0 = bench_now_ns();
+        for (u32 i = 0; i < chunks && rc == 0; i++) rc = qrfs_read(f, buf, CHUNK) == (long)CHUNK ? 0 : -1;
+        ns[r] = bench_now_ns() - t0;
+        qrfs_close(f);
+    }
+    if (rc == 0 && selected("io.seq_read")) emit("io.seq_read", params, chunks, ns, 3, CHUNK);
+
+    // Aleatoria: bloques de 4 KiB alineados dentro del mismo archivo
+    u32 nblocks = (u32)(size / BS);
+    snprintf(params, sizeof(params), "{\"bytes\": %llu, \"io_size\": %u}", (unsigned long long)size, BS);
+    qrfs_file *f = rc == 0 ? qrfs_open(fs, "/seq", O_RDWR, 0) : NULL;
+    if (!f) rc = -1;
+    for (u32 r = 0; r < 3 && rc == 0; r++) {
+        seed = 5 + r;
+        uint64_t t0 = bench_now_ns();
+        for (u32 i = 0; i < ops && rc == 0; i++) {
+            u64 off = (u64)(bench_rand(&seed) % nblocks) * BS;
+            rc = qrfs_pwrite(f, buf + (i & 7) * BS, BS, off) == (long)BS ? 0 : -1;
+        }
+        ns[r] = bench_now_ns() - t0;
+    }
+    if (rc == 0 && selected("io.rand_write")) emit("io.rand_write", params, ops, ns, 3, BS);
+    for (u32 r = 0; r < 3 && rc == 0; r++) {
+        seed = 5 + r;
+        uint64_t t0 = bench_now_ns();
+        for (u32 i = 0; i < ops && rc == 0; i++) {
+            u64 off = (u64)(bench_rand(&seed) % nblocks) * BS;
+            rc = qrfs_pread(f, buf, BS, off) == (long)BS ? 0 : -1;
+        }
+        ns[r] = bench_now_ns() - t0;
+    }
+    if (rc == 0 && selected("io.rand_read")) emit("io.rand_read", params, ops, ns, 3, BS);
+    if (f) qrfs_close(f);
+    free(buf);
+    return rc == 0 ? 0 : fail("file_io");
+}
+
+static int macro_bench(void) {
+    char dir[512];
+    int want_files = group("files."), want_io = group("io.");
+    if (group("mkfs")) {
+        if (mkfs_bench("image", 65536 * scale, NULL) != 0) return -1;
+        if (mkfs_bench("files", 8192 * scale, NULL) != 0) return -1;
+        if (mkfs_bench("files", 65536 * scale, "--lazy") != 0) return -1;
+    }
+    if (!want_files && !want_io) return 0;
+    snprintf(dir, sizeof(dir), "%s/vol", base);
+    qrfs *fs = volume(dir, 65536 * scale, 16384 * scale);
+    if (!fs) return -1;
+    int rc = 0;
+    if (want_files) rc = files_bench(fs);
+    if (rc == 0 && want_io) rc = file_io_bench(fs);
+    quiet(1);
+    if (qrfs_unmount(fs) != 0 && rc == 0) rc = -1;
+    quiet(0);
+    return rc;
+}
+
+int main(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--scale=", 8) == 0) scale = (u32)strtoul(argv[i] + 8, NULL, 10);
+        else if (strncmp(argv[i], "--only=", 7) == 0) only = argv[i] + 7;
+        else base = argv[i];
+    }
+    if (scale == 0) scale = 1;
+    if (ensure_folder(base) != 0) {
+        fprintf(stderr, "No se pudo preparar %s: %s\n", base, strerror(errno));
+        return 1;
+    }
+
+    printf("{\n  \"suite\": \"qrfs\",\n  \"schema\": 1,\n  \"scale\": %u,\n  \"block_size\": %u,\n"
+           "  \"runs\": %u,\n  \"results\": [\n", scale, BS, RUNS);
+    const char *names[] = {"files", "image", "mmap"};
+    const u32 backends[] = {QRFS_BACKEND_FILES, QRFS_BACKEND_IMAGE, QRFS_BACKEND_MMAP};
+    int rc = 0;
+    if (group("block_io.")) {
+        for (int b = 0; b < 3 && rc == 0; b++) rc = block_io(backends[b], names[b]);
+    }
+    if (rc == 0 && group("alloc.")) rc = alloc_bench();
+    if (rc == 0 && group("inode.")) rc = inode_bench();
+    if (rc == 0 && group("dir.")) rc = dir_bench();
+    if (rc == 0) rc = macro_bench();
+    printf("\n  ],\n  \"ok\": %s\n}\n", rc == 0 ? "true" : "false");
+    return rc == 0 ? 0 : 1;
+}
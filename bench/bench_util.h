@@ -0,0 +1,23 @@
+#ifndef BENCH_UTIL_H
+#define BENCH_UTIL_H
+#define _POSIX_C_SOURCE 200809L
+#include <time.h>
+#include <stdint.h>
+
+static inline uint64_t bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Generador xorshift para índices aleatorios reproducibles
+static inline uint32_t bench_rand(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return (uint32_t)(x >> 32);
+}
+
+#endif
@@ -1,33 +1,198 @@
 #include "fs_basic.h"
+#include "bitmaps.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
 
-int allocate_inode(void) {
-    for (int i = 0; i < (int)spblock.total_inodes; i++) {
-        if (spblock.inode_bitmap[i] == '0') {
-            spblock.inode_bitmap[i] = '1';
-            return i;
+// Primer bit libre desde start (índice de bit). Salta palabras llenas y
+// ubica el bit con ctz sobre la palabra invertida.
+long bitmap_find_zero(const u64 *bm, u32 nbits, u32 start) {
+    if (start >= nbits) return -1;
+    u32 nwords = BITMAP_WORDS(nbits);
+    u32 w = start >> 6;
+    u64 free_bits = ~bm[w] & (~0ull << (start & 63));
+    for (;;) {
+        if (free_bits) {
+            u32 bit = (w << 6) + (u32)__builtin_ctzll(free_bits);
+            return bit < nbits ? (long)bit : -1;
+        }
+        if (++w >= nwords) return -1;
+        free_bits = ~bm[w];
+    }
+}
+
+long bitmap_find_one(const u64 *bm, u32 nbits, u32 start) {
+    if (start >= nbits) return -1;
+    u32 nwords = BITMAP_WORDS(nbits);
+    u32 w = start >> 6;
+    u64 used = bm[w] & (~0ull << (start & 63));
+    for (;;) {
+        if (used) {
+            u32 bit = (w << 6) + (u32)__builtin_ctzll(used);
+            return bit < nbits ? (long)bit : -1;
         }
+        if (++w >= nwords) return -1;
+        used = bm[w];
     }
-    return -1;
+}
+
+u32 bitmap_count_set(const u64 *bm, u32 nbits) {
+    u32 full = nbits >> 6;
+    u32 n = 0;
+    for (u32 w = 0; w < full; w++) n += (u32)__builtin_popcountll(bm[w]);
+    if (nbits & 63) n += (u32)__builtin_popcountll(bm[full] & ((1ull << (nbits & 63)) - 1));
+    return n;
+}
+
+void bitmap_pack_le(const u64 *bm, u32 nbits, unsigned char *out) {
+    u32 nbytes = BITMAP_BYTES(nbits);
+    for (u32 i = 0; i < nbytes; i++) out[i] = (unsigned char)(bm[i >> 3] >> ((i & 7) * 8));
+}
+
+void bitmap_unpack_le(const unsigned char *in, u32 nbits, u64 *bm) {
+    u32 nbytes = BITMAP_BYTES(nbits);
+    memset(bm, 0, BITMAP_WORDS(nbits) * sizeof(u64));
+    for (u32 i = 0; i < nbytes; i++) bm[i >> 3] |= (u64)in[i] << ((i & 7) * 8);
+    if (nbits & 63) bm[nbits >> 6] &= (1ull << (nbits & 63)) - 1;
+}
+
+// Formato viejo: un byte '0'/'1' por entrada
+int bitmap_is_ascii(const unsigned char *raw, u32 nbits) {
+    for (u32 i = 0; i < nbits; i++) {
+        if (raw[i] != '0' && raw[i] != '1') return 0;
+    }
+    return 1;
+}
+
+void bitmap_from_ascii(const unsigned char *ascii, u32 nbits, u64 *bm) {
+    memset(bm, 0, BITMAP_WORDS(nbits) * sizeof(u64));
+    for (u32 i = 0; i < nbits; i++) {
+        if (ascii[i] == '1') bitmap_set(bm, i);
+    }
+}
+
+int bitmaps_init(u32 total_inodes, u32 total_blocks) {
+    bitmaps_release();
+    spblock.inode_bitmap = (u64*)calloc(BITMAP_WORDS(total_inodes), sizeof(u64));
+    spblock.data_bitmap  = (u64*)calloc(BITMAP_WORDS(total_blocks), sizeof(u64));
+    if (!spblock.inode_bitmap || !spblock.data_bitmap) {
+        bitmaps_release();
+        errno = ENOMEM;
+        return -1;
+    }
+    return 0;
+}
+
+void bitmaps_release(void) {
+    free(spblock.inode_bitmap);
+    free(spblock.data_bitmap);
+    spblock.inode_bitmap = NULL;
+    spblock.data_bitmap = NULL;
+}
+
+// Next-fit: busca desde el rotor hasta el final y luego desde el principio
+static long find_next_fit(const u64 *bm, u32 nbits, u32 rotor) {
+    long i = bitmap_find_zero(bm, nbits, rotor < nbits ? rotor : 0);
+    if (i < 0 && rotor > 0) i = bitmap_find_zero(bm, nbits, 0);
+    return i;
+}
+
+int allocate_inode(void) {
+    if (spblock.free_inodes == 0) return -1;
+    long i = find_next_fit(spblock.inode_bitmap, spblock.total_inodes, spblock.inode_rotor);
+    if (i < 0) return -1;
+    bitmap_set(spblock.inode_bitmap, (u32)i);
+    spblock.free_inodes--;
+    spblock.inode_rotor = (u32)i + 1;
+    return (int)i;
 }
 
 void free_inode(int inode_id) {
-    if (inode_id >= 0 && inode_id < (int)spblock.total_inodes) {
-        spblock.inode_bitmap[inode_id] = '0';
+    if (inode_id >= 0 && inode_id < (int)spblock.total_inodes &&
+        bitmap_test(spblock.inode_bitmap, (u32)inode_id)) {
+        bitmap_clear(spblock.inode_bitmap, (u32)inode_id);
+        spblock.free_inodes++;
     }
 }
 
 int allocate_block(void) {
-    for (int i = 0; i < (int)spblock.total_blocks; i++) {
-        if (spblock.data_bitmap[i] == '0') {
-            spblock.data_bitmap[i] = '1';
-            return i;
-        }
-    }
-    return -1;
+    if (spblock.free_blocks == 0) return -1;
+    long i = find_next_fit(spblock.data_bitmap, spblock.total_blocks, spblock.block_rotor);
+    if (i < 0) return -1;
+    bitmap_set(spblock.data_bitmap, (u32)i);
+    spblock.free_blocks--;
+    spblock.block_rotor = (u32)i + 1;
+    return (int)i;
 }
 
 void free_block(int block_num) {
-    if (block_num >= 0 && block_num < (int)spblock.total_blocks) {
-        spblock.data_bitmap[block_num] = '0';
+    if (block_num >= 0 && block_num < (int)spblock.total_blocks &&
+        bitmap_test(spblock.data_bitmap, (u32)block_num)) {
+        bitmap_clear(spblock.data_bitmap, (u32)block_num);
+        spblock.free_blocks++;
     }
-}
\ No newline at end of file
+}
+
+// Reserva hasta `want` bloques contiguos. Primero intenta seguir en `goal`
+// (para extender el extent anterior); si no, recorre algunos huecos desde el
+// rotor y se queda con el primero suficiente o con el más largo visto.
+long allocate_run(u32 goal, u32 want, u32 *got) {
+    u32 total = spblock.total_blocks;
+    if (spblock.free_blocks == 0 || want == 0) return -1;
+    if (want > spblock.free_blocks) want = spblock.free_blocks;
+
+    long best = -1;
+    u32 best_len = 0;
+    if (goal > 0 && goal < total && !bitmap_test(spblock.data_bitmap, goal)) {
+        long end = bitmap_find_one(spblock.data_bitmap, total, goal);
+        best = goal;
+        best_len = (u32)((end < 0 ? (long)total : end) - goal);
+    }
+
+    u32 pos = spblock.block_rotor < total ? spblock.block_rotor : 0;
+    int wrapped = 0;
+    for (int tries = 0; best_len < want && tries < 16; tries++) {
+        long start = bitmap_find_zero(spblock.data_bitmap, total, pos);
+        if (start < 0) {
+            if (wrapped) break;
+            wrapped = 1;
+            pos = 0;
+            continue;
+        }
+        long end = bitmap_find_one(spblock.data_bitmap, total, (u32)start);
+        u32 len = (u32)((end < 0 ? (long)total : end) - start);
+        if (len > best_len) {
+            best = start;
+            best_len = len;
+        }
+        if (end < 0) {
+            if (wrapped) break;
+            wrapped = 1;
+            pos = 0;
+        } else {
+            pos = (u32)end;
+        }
+    }
+    if (best < 0) return -1;
+
+    u32 n = best_len < want ? best_len : want;
+    for (u32 i = 0; i < n; i++) bitmap_set(spblock.data_bitmap, (u32)best + i);
+    spblock.free_blocks -= n;
+    spblock.block_rotor = (u32)best + n;
+    *got = n;
+    return best;
+}
+
+u32 count_free_inodes(void) {
+    return spblock.free_inodes;
+}
+
+u32 count_free_blocks(void) {
+    return spblock.free_blocks;
+}
+
+// Recalcula los contadores desde los bitmaps (carga de volúmenes viejos, fsck)
+void bitmaps_recount(void) {
+    spblock.free_inodes = spblock.total_inodes - bitmap_count_set(spblock.inode_bitmap, spblock.total_inodes);
+    spblock.free_blocks = spblock.total_blocks - bitmap_count_set(spblock.data_bitmap, spblock.total_blocks);
+}
@@ -3,9 +3,35 @@
 
 #include "fs_basic.h"
 
+// Bitmaps empaquetados: 1 bit por entrada en palabras de 64 bits (1 = ocupado).
+// En disco se guardan como bytes little-endian: bit i -> byte i/8, bit i%8.
+#define BITMAP_WORDS(nbits) (((nbits) + 63u) / 64u)
+#define BITMAP_BYTES(nbits) (((nbits) + 7u) / 8u)
+
+static inline int bitmap_test(const u64 *bm, u32 i) {
+    return (int)((bm[i >> 6] >> (i & 63)) & 1u);
+}
+static inline void bitmap_set(u64 *bm, u32 i)   { bm[i >> 6] |=  (1ull << (i & 63)); }
+static inline void bitmap_clear(u64 *bm, u32 i) { bm[i >> 6] &= ~(1ull << (i & 63)); }
+
+long bitmap_find_zero(const u64 *bm, u32 nbits, u32 start);
+long bitmap_find_one(const u64 *bm, u32 nbits, u32 start);
+u32  bitmap_count_set(const u64 *bm, u32 nbits);
+void bitmap_pack_le(const u64 *bm, u32 nbits, unsigned char *out);
+void bitmap_unpack_le(const unsigned char *in, u32 nbits, u64 *bm);
+int  bitmap_is_ascii(const unsigned char *raw, u32 nbits);
+void bitmap_from_ascii(const unsigned char *ascii, u32 nbits, u64 *bm);
+
+int  bitmaps_init(u32 total_inodes, u32 total_blocks);
+void bitmaps_release(void);
+
 int  allocate_inode(void);
 void free_inode(int inode_id);
 int  allocate_block(void);
 void free_block(int block_num);
+long allocate_run(u32 goal, u32 want, u32 *got);
+u32  count_free_inodes(void);
+u32  count_free_blocks(void);
+void bitmaps_recount(void);
 
-#endif
\ No newline at end of file
+#endif
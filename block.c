@@ -1,9 +1,28 @@
+#define _POSIX_C_SOURCE 200809L
 #include "block.h"
+#include "block_backend.h"
+#include "csum.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 #include <sys/stat.h>
+#include <unistd.h>
+
+// Backend activo y carpeta a la que está asociado
+static const block_backend *backends[QRFS_BACKEND_COUNT] = {
+    &block_backend_files,
+    &block_backend_image,
+    &block_backend_mmap,
+};
+static const block_backend *active = NULL;
+static u32 active_id = QRFS_BACKEND_FILES;
+static char active_folder[512];
+static int prefer_mmap = 0;
+static int sparse = 0;
+static int png = 0;
+
+const unsigned char block_zero[QRFS_MAX_BLOCK_SIZE];
 
 
 int ensure_folder(const char *folder) {
@@ -13,67 +32,294 @@ int ensure_folder(const char *folder) {
         errno = ENOTDIR;
         return -1;
     }
-    char cmd[512];
-    snprintf(cmd, sizeof(cmd), "mkdir -p %s", folder);
-    int rc = system(cmd);
-    (void)rc; // ignoramos el código de retorno
+    // mkdir -p sin pasar por el shell
+    char path[512];
+    size_t len = strlen(folder);
+    if (len == 0 || len >= sizeof(path)) { errno = len ? ENAMETOOLONG : ENOENT; return -1; }
+    memcpy(path, folder, len + 1);
+    for (size_t i = 1; i <= len; i++) {
+        if (path[i] != '/' && path[i] != '\0') continue;
+        char c = path[i];
+        path[i] = '\0';
+        if (mkdir(path, 0755) != 0 && errno != EEXIST) return -1;
+        path[i] = c;
+    }
+    if (stat(folder, &st) != 0) return -1;
+    if (!S_ISDIR(st.st_mode)) { errno = ENOTDIR; return -1; }
     return 0;
 }
-//Bloque nulo
-int create_zero_block(const char *folder, u32 index, u32 block_size) {
+
+const char *block_backend_name(u32 backend) {
+    return backend < QRFS_BACKEND_COUNT ? backends[backend]->name : "desconocido";
+}
+
+int block_detect_backend(const char *folder) {
     char path[512];
-    snprintf(path, sizeof(path), "%s/block_%04u.png", folder, index);
-    FILE *fp = fopen(path, "wb");
-    if (!fp) return -1;
-
-    unsigned char *zeros = (unsigned char*)calloc(1, block_size);
-    if (!zeros) {
-        fclose(fp);
-        errno = ENOMEM;
-        return -1;
+    struct stat st;
+    snprintf(path, sizeof(path), "%s/%s", folder, QRFS_IMAGE_NAME);
+    return (stat(path, &st) == 0 && S_ISREG(st.st_mode)) ? QRFS_BACKEND_IMAGE : QRFS_BACKEND_FILES;
+}
+
+u32 block_current_backend(void) {
+    return active_id;
+}
+
+// La tabla de sumas es del volumen abierto: lo pendiente se escribe antes
+void block_close(void) {
+    if (active) {
+        csum_store(active_folder);
+        active->close();
     }
+    csum_close();
+    active = NULL;
+    active_folder[0] = '\0';
+}
+
+// Con mmap activo, los volúmenes de imagen se montan mapeados en memoria
+void block_set_mmap(int enable) {
+    prefer_mmap = enable;
+}
+
+// Volúmenes ralos (QRFS_FEAT_SPARSE): un bloque que nunca se escribió puede
+// no existir en el almacenamiento y se lee como ceros
+void block_set_sparse(int enable) {
+    sparse = enable;
+}
+
+int block_sparse(void) {
+    return sparse;
+}
+
+// Backend de archivos: cada bloque guardado como un PNG válido (png.h). Se
+// pide antes de formatear; al abrir un volumen lo fija lo que haya en disco.
+void block_set_png(int enable) {
+    png = enable;
+}
+
+int block_png(void) {
+    return png;
+}
+
+int block_use_backend(const char *folder, u32 backend, u32 block_size) {
+    if (backend >= QRFS_BACKEND_COUNT) { errno = EINVAL; return -1; }
+    block_close();
+    if (backends[backend]->open(folder, block_size) != 0) return -1;
+    active = backends[backend];
+    active_id = backend;
+    snprintf(active_folder, sizeof(active_folder), "%s", folder);
+    return 0;
+}
+
+int block_format(const char *folder, u32 backend, u32 total_blocks, u32 block_size,
+                 const block_format_opts *opts) {
+    if (backend >= QRFS_BACKEND_COUNT || block_size > QRFS_MAX_BLOCK_SIZE) { errno = EINVAL; return -1; }
+    block_format_opts o = {0, 0};
+    if (opts) o = *opts;
+    if (o.materialize == 0 || o.materialize > total_blocks) o.materialize = total_blocks;
+    block_close();
+    if (backends[backend]->format(folder, total_blocks, block_size, &o) != 0) return -1;
+    active = backends[backend];
+    active_id = backend;
+    snprintf(active_folder, sizeof(active_folder), "%s", folder);
+    return 0;
+}
+
+// Si nadie eligió backend para esta carpeta, se detecta por lo que hay en disco
+static const block_backend *backend_for(const char *folder, u32 block_size) {
+    if (active && strcmp(active_folder, folder) == 0) return active;
+    u32 backend = (u32)block_detect_backend(folder);
+    if (backend == QRFS_BACKEND_IMAGE && prefer_mmap) backend = QRFS_BACKEND_MMAP;
+    if (block_use_backend(folder, backend, block_size) != 0) return NULL;
+    return active;
+}
+
+// Sumas por bloque (csum.h): toda escritura de bloques enteros actualiza la
+// tabla; las lecturas se comprueban según la política. `data` distingue el
+// camino de datos (read_blocks, rangos) de read_block.
+static int verifying(int data) {
+    return csum_active() && csum_policy() <= (data ? CSUM_VERIFY_ALWAYS : CSUM_VERIFY_METADATA);
+}
+
+static int checked_read(const block_backend *be, const char *folder, u32 index, unsigned char *buf,
+                        u32 block_size, int data) {
+    if (be->read(folder, index, buf, block_size) != 0) return -1;
+    return verifying(data) ? csum_verify(index, buf, block_size) : 0;
+}
 
-    size_t w = fwrite(zeros, 1, block_size, fp);
-    free(zeros);
-    fclose(fp);
-    return (w == block_size) ? 0 : -1;
+static int checked_write(const block_backend *be, const char *folder, u32 index, const void *buf, u32 len) {
+    if (be->write(folder, index, buf, len) != 0) return -1;
+    csum_update(index, buf, len);
+    return 0;
+}
+
+//Bloque nulo
+int create_zero_block(const char *folder, u32 index, u32 block_size) {
+    const block_backend *be = backend_for(folder, block_size);
+    if (!be || be->create(folder, index, block_size) != 0) return -1;
+    csum_update(index, block_zero, block_size);
+    return 0;
 }
 
 // Escribe datos
 int write_block(const char *folder, u32 index, const void *buf, u32 len) {
-    char path[512];
-    snprintf(path, sizeof(path), "%s/block_%04u.png", folder, index);
-    FILE *fp = fopen(path, "r+b");
-    if (!fp) return -1;
-
-    fseek(fp, 0, SEEK_SET);
-    size_t w = fwrite(buf, 1, len, fp);
-    fclose(fp);
-    return (w == len) ? 0 : -1;
+    const block_backend *be = backend_for(folder, len);
+    return be ? checked_write(be, folder, index, buf, len) : -1;
 }
 
 //Lee datos de un bloque
-
 int read_block(const char *folder, u32 block_index, unsigned char *buf, u32 block_size) {
-    char path[512];
-    snprintf(path, sizeof(path), "%s/block_%04u.png", folder, block_index);
-
-    FILE *fp = fopen(path, "rb");
-    if (!fp) {
+    const block_backend *be = backend_for(folder, block_size);
+    if (!be) {
         fprintf(stderr, "Error abriendo bloque %u: %s\n", block_index, strerror(errno));
         return -1;
     }
+    return checked_read(be, folder, block_index, buf, block_size, 0);
+}
 
-    size_t r = fread(buf, 1, block_size, fp);
-    fclose(fp);
+// Vista de solo lectura sin copia; NULL si el backend no la soporta
+// (en ese caso hay que usar read_block con un buffer propio). Con sumas que
+// verificar tampoco hay vista: la copia se comprueba una vez al leerla.
+const unsigned char *block_view(const char *folder, u32 index, u32 block_size) {
+    const block_backend *be = backend_for(folder, block_size);
+    if (csum_active() && csum_policy() != CSUM_VERIFY_OFF) return NULL;
+    return (be && be->view) ? be->view(index, block_size) : NULL;
+}
 
-    if (r != block_size) {
-        fprintf(stderr, "Error leyendo bloque %u (bytes leídos=%zu, esperado=%u)\n",
-                block_index, r, block_size);
-        return -1;
+// Punto de persistencia: fsync/msync según el backend, con la tabla de sumas
+int block_flush(const char *folder) {
+    if (!active || strcmp(active_folder, folder) != 0) return 0;
+    int rc = csum_store(folder);
+    if (active->sync() != 0) rc = -1;
+    return rc;
+}
+
+// Lee/escribe `count` bloques contiguos; los backends con imagen lo hacen en
+// una sola operación, el de archivos bloque a bloque.
+int read_blocks(const char *folder, u32 start, u32 count, unsigned char *buf, u32 block_size) {
+    const block_backend *be = backend_for(folder, block_size);
+    if (!be) return -1;
+    if (!be->read_run) {
+        for (u32 i = 0; i < count; i++) {
+            if (checked_read(be, folder, start + i, buf + (size_t)i * block_size, block_size, 1) != 0) return -1;
+        }
+        return 0;
     }
+    if (be->read_run(start, count, buf, block_size) != 0) return -1;
+    for (u32 i = 0; i < count && verifying(1); i++) {
+        if (csum_verify(start + i, buf + (size_t)i * block_size, block_size) != 0) return -1;
+    }
+    return 0;
+}
 
+int write_blocks(const char *folder, u32 start, u32 count, const void *buf, u32 block_size) {
+    const block_backend *be = backend_for(folder, block_size);
+    if (!be) return -1;
+    const unsigned char *p = (const unsigned char*)buf;
+    if (!be->write_run) {
+        for (u32 i = 0; i < count; i++) {
+            if (checked_write(be, folder, start + i, p + (size_t)i * block_size, block_size) != 0) return -1;
+        }
+        return 0;
+    }
+    if (be->write_run(start, count, buf, block_size) != 0) return -1;
+    for (u32 i = 0; i < count && csum_active(); i++) csum_update(start + i, p + (size_t)i * block_size, block_size);
     return 0;
 }
 
+// Cuántos de los bloques [0, total_blocks) existen en el host; en un volumen
+// no ralo deben estar todos.
+int block_materialized(const char *folder, u32 total_blocks, u32 block_size, u32 *present) {
+    const block_backend *be = backend_for(folder, block_size);
+    if (!be) return -1;
+    return be->count(folder, total_blocks, block_size, present);
+}
+
+// Aviso al host de que se va a leer el rango; vuelve enseguida y la lectura
+// sigue en segundo plano. Sin soporte del backend no hace nada.
+int block_prefetch(const char *folder, u32 start, u32 count, u32 block_size) {
+    const block_backend *be = backend_for(folder, block_size);
+    if (!be) return -1;
+    if (!be->prefetch || count == 0) return 0;
+    return be->prefetch(folder, start, count, block_size);
+}
+
+// Descriptor del que se puede leer/escribir el bloque directamente (splice,
+// pread); -1 si el backend no expone uno (archivos por bloque, mmap) o si hay
+// sumas por bloque, que necesitan ver cada bloque entero.
+int block_fd(const char *folder, u32 index, u32 block_size, off_t *offset) {
+    if (csum_active()) { errno = EOPNOTSUPP; return -1; }
+    return block_fd_raw(folder, index, block_size, offset);
+}
+
+int block_fd_raw(const char *folder, u32 index, u32 block_size, off_t *offset) {
+    const block_backend *be = backend_for(folder, block_size);
+    if (!be) return -1;
+    if (!be->fd) { errno = EOPNOTSUPP; return -1; }
+    return be->fd(index, block_size, offset);
+}
+
+// Rango de bytes que empieza en `in_block` del bloque `start` y sigue por
+// bloques físicos contiguos. Con un descriptor es un solo pread/pwrite; si no
+// (o si hay sumas que mantener o verificar), los bloques completos van por
+// read_blocks/write_blocks y los extremos parciales con un bloque intermedio.
+static int range_io(const char *folder, u32 start, u32 in_block, void *buf, u32 len,
+                    u32 block_size, int writing) {
+    const block_backend *be = backend_for(folder, block_size);
+    if (!be) return -1;
+    start += in_block / block_size;
+    in_block %= block_size;
+
+    off_t off;
+    int fd = (be->fd && !(csum_active() && (writing || verifying(1)))) ? be->fd(start, block_size, &off) : -1;
+    if (fd >= 0) {
+        unsigned char *p = (unsigned char*)buf;
+        off += in_block;
+        while (len > 0) {
+            ssize_t n = writing ? pwrite(fd, p, len, off) : pread(fd, p, len, off);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) { if (n == 0) errno = EIO; return -1; }
+            p += n; off += n; len -= (u32)n;
+        }
+        return 0;
+    }
 
+    unsigned char *p = (unsigned char*)buf, *tmp = NULL;
+    int rc = 0;
+    while (len > 0 && rc == 0) {
+        if (in_block == 0 && len >= block_size) {
+            u32 count = len / block_size;
+            rc = writing ? write_blocks(folder, start, count, p, block_size)
+                         : read_blocks(folder, start, count, p, block_size);
+            start += count;
+            p += (size_t)count * block_size;
+            len -= count * block_size;
+            continue;
+        }
+        u32 n = block_size - in_block;
+        if (n > len) n = len;
+        if (!tmp && !(tmp = (unsigned char*)malloc(block_size))) { errno = ENOMEM; return -1; }
+        rc = checked_read(be, folder, start, tmp, block_size, 1);
+        if (rc == 0) {
+            if (writing) {
+                memcpy(tmp + in_block, p, n);
+                rc = checked_write(be, folder, start, tmp, block_size);
+            } else {
+                memcpy(p, tmp + in_block, n);
+            }
+        }
+        start++;
+        in_block = 0;
+        p += n;
+        len -= n;
+    }
+    free(tmp);
+    return rc;
+}
+
+int block_pread(const char *folder, u32 start, u32 in_block, void *buf, u32 len, u32 block_size) {
+    return range_io(folder, start, in_block, buf, len, block_size, 0);
+}
+
+int block_pwrite(const char *folder, u32 start, u32 in_block, const void *buf, u32 len, u32 block_size) {
+    return range_io(folder, start, in_block, (void*)buf, len, block_size, 1);
+}
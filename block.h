@@ -3,10 +3,70 @@
 #define BLOCK_IO_H
 #include "fs_basic.h"
 
+// Backends de almacenamiento (se guarda en el superbloque)
+#define QRFS_BACKEND_FILES  0   // un archivo block_NNNN.png por bloque (bytes crudos o PNG)
+#define QRFS_BACKEND_IMAGE  1   // una sola imagen preasignada, bloque i en i*block_size
+#define QRFS_BACKEND_MMAP   2   // misma imagen que IMAGE mapeada en memoria (modo de montaje)
+#define QRFS_BACKEND_COUNT  3
+#define QRFS_IMAGE_NAME     "qrfs.img"
+
+// Cantidad de descriptores de bloque que se mantienen abiertos
+#define BLOCK_FD_CACHE_SLOTS 64
+
+#define QRFS_MAX_BLOCK_SIZE 65536u
+
+// Opciones de block_format (NULL = valores por defecto)
+typedef struct block_format_opts {
+    u32 threads;        // hilos para crear archivos de bloque; 0 = uno por CPU
+    u32 materialize;    // bloques [0, materialize) se crean; el resto queda ralo (0 = todos)
+} block_format_opts;
+
+typedef struct block_fd_stats {
+    unsigned long long hits;
+    unsigned long long misses;
+    unsigned long long evictions;
+    unsigned long long syscalls_saved;   // open/close evitados por aciertos
+} block_fd_stats;
+
 int ensure_folder(const char *folder);
 int create_zero_block(const char *folder, u32 index, u32 block_size);
 int write_block(const char *folder, u32 index, const void *buf, u32 len);
 int read_block(const char *folder, u32 block_index, unsigned char *buf, u32 block_size);
+int read_blocks(const char *folder, u32 start, u32 count, unsigned char *buf, u32 block_size);
+int write_blocks(const char *folder, u32 start, u32 count, const void *buf, u32 block_size);
+
+int  block_format(const char *folder, u32 backend, u32 total_blocks, u32 block_size,
+                  const block_format_opts *opts);
+int  block_use_backend(const char *folder, u32 backend, u32 block_size);
+int  block_detect_backend(const char *folder);
+u32  block_current_backend(void);
+const char *block_backend_name(u32 backend);
+void block_close(void);
+void block_set_mmap(int enable);
+void block_set_sparse(int enable);
+int  block_sparse(void);
+void block_set_png(int enable);
+int  block_png(void);
+int  block_materialized(const char *folder, u32 total_blocks, u32 block_size, u32 *present);
+const unsigned char *block_view(const char *folder, u32 index, u32 block_size);
+int  block_flush(const char *folder);
+
+// Acceso por rango de bytes sobre bloques físicos contiguos, sin pasar por la
+// cache de bloques. Con los backends de imagen y mmap se pueden llamar desde
+// varios hilos a la vez; el de archivos no (su cache de descriptores es global).
+int  block_fd(const char *folder, u32 index, u32 block_size, off_t *offset);
+// block_fd aunque haya sumas por bloque: quien escribe o lee por ahí mantiene
+// y verifica la tabla él mismo (csum_update/csum_verify, bloques enteros)
+int  block_fd_raw(const char *folder, u32 index, u32 block_size, off_t *offset);
+int  block_pread(const char *folder, u32 start, u32 in_block, void *buf, u32 len, u32 block_size);
+int  block_pwrite(const char *folder, u32 start, u32 in_block, const void *buf, u32 len, u32 block_size);
+// Lectura anticipada de bloques contiguos por el host (cache de páginas).
+// Con el backend de archivos, mismas restricciones que block_pread.
+int  block_prefetch(const char *folder, u32 start, u32 count, u32 block_size);
+
+void   block_fd_cache_close_all(void);
+void   block_fd_cache_stats(block_fd_stats *out);
+double block_fd_cache_hit_rate(void);
 
 
 #endif
@@ -0,0 +1,414 @@
+#define _GNU_SOURCE
+#include "block_aio.h"
+#include "block.h"
+#include "csum.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+static int engine = BLOCK_AIO_ENGINE_AUTO;
+static int uring_ok = -1;       // -1 = sin probar
+static block_aio_stats stats;
+
+static void count(unsigned long long *field, unsigned long long n) {
+    __atomic_fetch_add(field, n, __ATOMIC_RELAXED);
+}
+
+// Completa un pedido en el hilo del lote; el callback puede liberar `r`
+static void finish(block_req *r) {
+    block_batch *b = r->batch;
+    b->pending--;
+    if (r->verify && !r->error) {
+        for (u32 k = 0; k < r->len / b->block_size && !r->error; k++) {
+            if (csum_verify(r->start + k, (unsigned char*)r->buf + (size_t)k * b->block_size, b->block_size) != 0) {
+                r->error = EIO;
+            }
+        }
+    }
+    if (r->error && !b->error) b->error = r->error;
+    count(&stats.completed, 1);
+    if (r->done) r->done(r);
+}
+
+// pread/pwrite hasta completar, desde lo ya transferido; devuelve errno o 0
+static int fd_io(block_req *r) {
+    unsigned char *p = (unsigned char*)r->buf;
+    while (r->moved < r->len) {
+        ssize_t n = r->write ? pwrite(r->fd, p + r->moved, r->len - r->moved, r->offset + r->moved)
+                             : pread(r->fd, p + r->moved, r->len - r->moved, r->offset + r->moved);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return n == 0 ? EIO : errno;
+        r->moved += (u32)n;
+    }
+    return 0;
+}
+
+// ---- io_uring (syscalls directas, sin liburing) ----
+
+typedef struct uring {
+    int fd;
+    unsigned *sq_tail, *sq_mask, *sq_array, sq_entries;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ptr, *cq_ptr;
+    size_t sq_len, cq_len, sqes_len;
+    u32 queued;      // en la cola de envío, sin io_uring_enter
+    u32 inflight;    // enviados al kernel y sin cosechar
+} uring;
+
+static pthread_key_t ring_key;
+static pthread_once_t ring_once = PTHREAD_ONCE_INIT;
+static __thread uring *thread_ring_ptr;
+
+static void ring_free(void *p) {
+    uring *r = (uring*)p;
+    if (!r) return;
+    if (r->sqes) munmap(r->sqes, r->sqes_len);
+    if (r->cq_ptr && r->cq_ptr != r->sq_ptr) munmap(r->cq_ptr, r->cq_len);
+    if (r->sq_ptr) munmap(r->sq_ptr, r->sq_len);
+    if (r->fd >= 0) close(r->fd);
+    free(r);
+}
+
+static void ring_key_init(void) {
+    pthread_key_create(&ring_key, ring_free);
+}
+
+static uring *ring_setup(unsigned entries) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    int fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if (fd < 0) return NULL;
+
+    uring *r = (uring*)calloc(1, sizeof(uring));
+    if (!r) { close(fd); errno = ENOMEM; return NULL; }
+    r->fd = fd;
+    r->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (r->cq_len > r->sq_len) r->sq_len = r->cq_len;
+        r->cq_len = r->sq_len;
+    }
+    r->sq_ptr = mmap(NULL, r->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (r->sq_ptr == MAP_FAILED) { r->sq_ptr = NULL; goto fail; }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        r->cq_ptr = r->sq_ptr;
+    } else {
+        r->cq_ptr = mmap(NULL, r->cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (r->cq_ptr == MAP_FAILED) { r->cq_ptr = NULL; goto fail; }
+    }
+    r->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = (struct io_uring_sqe*)mmap(NULL, r->sqes_len, PROT_READ | PROT_WRITE,
+                                         MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED) { r->sqes = NULL; goto fail; }
+
+    unsigned char *sq = (unsigned char*)r->sq_ptr, *cq = (unsigned char*)r->cq_ptr;
+    r->sq_tail = (unsigned*)(sq + p.sq_off.tail);
+    r->sq_mask = (unsigned*)(sq + p.sq_off.ring_mask);
+    r->sq_array = (unsigned*)(sq + p.sq_off.array);
+    r->sq_entries = p.sq_entries;
+    r->cq_head = (unsigned*)(cq + p.cq_off.head);
+    r->cq_tail = (unsigned*)(cq + p.cq_off.tail);
+    r->cq_mask = (unsigned*)(cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+    return r;
+fail:
+    ring_free(r);
+    return NULL;
+}
+
+// Anillo del hilo llamador, creado la primera vez; se libera al terminar el hilo
+static uring *thread_ring(void) {
+    if (thread_ring_ptr) return thread_ring_ptr;
+    pthread_once(&ring_once, ring_key_init);
+    uring *r = ring_setup(BLOCK_AIO_DEPTH);
+    if (!r) return NULL;
+    pthread_setspecific(ring_key, r);
+    return thread_ring_ptr = r;
+}
+
+// Envía lo encolado y espera al menos `min` terminados
+static int ring_enter(uring *r, u32 min) {
+    for (;;) {
+        long n = syscall(__NR_io_uring_enter, r->fd, r->queued, min, min ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return -1;
+        count(&stats.enters, 1);
+        r->queued -= (u32)n;
+        r->inflight += (u32)n;
+        return 0;
+    }
+}
+
+static u32 ring_reap(uring *r);
+
+static int ring_push(uring *r, block_req *req) {
+    // Nunca más pedidos en vuelo que entradas: la cola de terminados no desborda
+    // (lleno: se espera a que se libere la mitad, no una entrada por vez)
+    while (r->queued + r->inflight >= r->sq_entries) {
+        if (ring_enter(r, r->sq_entries / 2) != 0) return -1;
+        ring_reap(r);
+    }
+    unsigned tail = *r->sq_tail, idx = tail & *r->sq_mask;
+    struct io_uring_sqe *sqe = &r->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    req->iov.iov_base = (unsigned char*)req->buf + req->moved;
+    req->iov.iov_len = req->len - req->moved;
+    sqe->opcode = req->write ? IORING_OP_WRITEV : IORING_OP_READV;
+    sqe->fd = req->fd;
+    sqe->off = (u64)(req->offset + req->moved);
+    sqe->addr = (u64)(uintptr_t)&req->iov;
+    sqe->len = 1;
+    sqe->user_data = (u64)(uintptr_t)req;
+    r->sq_array[idx] = idx;
+    __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    r->queued++;
+    return 0;
+}
+
+// Cosecha todo lo terminado (de cualquier lote de este hilo)
+static u32 ring_reap(uring *r) {
+    u32 n = 0;
+    unsigned head = *r->cq_head;
+    while (head != __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) {
+        struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+        block_req *req = (block_req*)(uintptr_t)cqe->user_data;
+        int res = cqe->res;
+        __atomic_store_n(r->cq_head, ++head, __ATOMIC_RELEASE);
+        r->inflight--;
+        if (res > 0 && req->moved + (u32)res < req->len) {
+            // Transferencia corta: se pide el resto
+            req->moved += (u32)res;
+            if (ring_push(r, req) == 0) continue;
+            res = -errno;
+        }
+        req->error = res < 0 ? -res : (res == 0 && req->len ? EIO : 0);
+        finish(req);
+        n++;
+    }
+    return n;
+}
+
+// ---- Pool de hilos ----
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_cv = PTHREAD_COND_INITIALIZER;   // hay pedidos
+static pthread_cond_t done_cv = PTHREAD_COND_INITIALIZER;   // terminó alguno
+static block_req *queue_head, *queue_tail;
+static u32 pool_started;
+
+static void *pool_main(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&pool_lock);
+    for (;;) {
+        while (!queue_head) pthread_cond_wait(&pool_cv, &pool_lock);
+        block_req *r = queue_head;
+        queue_head = r->next;
+        if (!queue_head) queue_tail = NULL;
+        pthread_mutex_unlock(&pool_lock);
+
+        r->error = fd_io(r);
+
+        pthread_mutex_lock(&pool_lock);
+        r->next = r->batch->done_head;
+        r->batch->done_head = r;
+        pthread_cond_broadcast(&done_cv);
+    }
+    return NULL;
+}
+
+// Los hilos del pool viven lo que el proceso; se crean la primera vez
+static int pool_push(block_req *r) {
+    pthread_mutex_lock(&pool_lock);
+    while (pool_started < BLOCK_AIO_POOL_THREADS) {
+        pthread_t t;
+        if (pthread_create(&t, NULL, pool_main, NULL) != 0) break;
+        pthread_detach(t);
+        pool_started++;
+    }
+    if (pool_started == 0) {
+        pthread_mutex_unlock(&pool_lock);
+        errno = EAGAIN;
+        return -1;
+    }
+    r->next = NULL;
+    if (queue_tail) queue_tail->next = r;
+    else queue_head = r;
+    queue_tail = r;
+    pthread_cond_signal(&pool_cv);
+    pthread_mutex_unlock(&pool_lock);
+    return 0;
+}
+
+static u32 pool_reap(block_batch *b, int wait) {
+    pthread_mutex_lock(&pool_lock);
+    while (wait && !b->done_head) pthread_cond_wait(&done_cv, &pool_lock);
+    block_req *list = b->done_head;
+    b->done_head = NULL;
+    pthread_mutex_unlock(&pool_lock);
+    u32 n = 0;
+    while (list) {
+        block_req *next = list->next;
+        finish(list);
+        list = next;
+        n++;
+    }
+    return n;
+}
+
+// ---- Lotes ----
+
+static int resolve_engine(void) {
+    int e = __atomic_load_n(&engine, __ATOMIC_RELAXED);
+    if (e != BLOCK_AIO_ENGINE_AUTO) return e;
+    int ok = __atomic_load_n(&uring_ok, __ATOMIC_RELAXED);
+    if (ok < 0) {
+        ok = thread_ring() != NULL;
+        __atomic_store_n(&uring_ok, ok, __ATOMIC_RELAXED);
+    }
+    return ok ? BLOCK_AIO_ENGINE_URING : BLOCK_AIO_ENGINE_POOL;
+}
+
+void block_batch_init(block_batch *b, const char *folder, u32 block_size) {
+    memset(b, 0, sizeof(*b));
+    b->folder = folder;
+    b->block_size = block_size;
+    b->engine = resolve_engine();
+    // Sin anillo en este hilo (límite de memoria bloqueada, por ejemplo) va al pool
+    if (b->engine == BLOCK_AIO_ENGINE_URING && !thread_ring()) b->engine = BLOCK_AIO_ENGINE_POOL;
+}
+
+int block_submit(block_batch *b, block_req *reqs, u32 n) {
+    uring *ring = b->engine == BLOCK_AIO_ENGINE_URING ? thread_ring_ptr : NULL;
+    int rc = 0;
+    for (u32 i = 0; i < n && rc == 0; i++) {
+        block_req *r = &reqs[i];
+        r->batch = b;
+        r->error = 0;
+        r->moved = 0;
+        r->next = NULL;
+        r->verify = 0;
+        b->pending++;
+        count(&stats.submitted, 1);
+
+        // Con sumas por bloque solo van por el descriptor los bloques enteros:
+        // la suma se actualiza al enviar y se verifica al completar
+        off_t off;
+        int fd = -1;
+        if (b->engine != BLOCK_AIO_ENGINE_SYNC) {
+            if (!csum_active()) fd = block_fd(b->folder, r->start, b->block_size, &off);
+            else if (r->in_block == 0 && r->len % b->block_size == 0) fd = block_fd_raw(b->folder, r->start, b->block_size, &off);
+        }
+        if (fd >= 0 && csum_active()) {
+            if (r->write) {
+                for (u32 k = 0; k < r->len / b->block_size; k++) {
+                    csum_update(r->start + k, (unsigned char*)r->buf + (size_t)k * b->block_size, b->block_size);
+                }
+            } else {
+                r->verify = csum_policy() == CSUM_VERIFY_ALWAYS;
+            }
+        }
+        if (fd < 0) {
+            // Backend sin descriptor: se resuelve ahora, con su propio camino
+            int io = r->write ? block_pwrite(b->folder, r->start, r->in_block, r->buf, r->len, b->block_size)
+                              : block_pread(b->folder, r->start, r->in_block, r->buf, r->len, b->block_size);
+            r->error = io == 0 ? 0 : (errno ? errno : EIO);
+            count(&stats.inline_done, 1);
+            finish(r);
+            continue;
+        }
+        r->fd = fd;
+        r->offset = off + r->in_block;
+        if ((ring ? ring_push(ring, r) : pool_push(r)) != 0) {
+            b->pending--;
+            rc = -1;
+        }
+    }
+    int err = errno;
+    if (ring && ring->queued && ring_enter(ring, 0) != 0) rc = -1;
+    else errno = err;
+
+    u32 inflight = ring ? ring->inflight : b->pending;
+    unsigned long long seen = __atomic_load_n(&stats.max_inflight, __ATOMIC_RELAXED);
+    while (inflight > seen && !__atomic_compare_exchange_n(&stats.max_inflight, &seen, inflight, 0,
+                                                           __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+    return rc;
+}
+
+u32 block_poll(block_batch *b, u32 min_complete) {
+    u32 before = b->pending;
+    uring *ring = b->engine == BLOCK_AIO_ENGINE_URING ? thread_ring_ptr : NULL;
+    if (min_complete > before) min_complete = before;
+    for (;;) {
+        if (ring) ring_reap(ring);
+        else if (b->engine == BLOCK_AIO_ENGINE_POOL) pool_reap(b, 0);
+        u32 done = before - b->pending;
+        if (done >= min_complete || b->pending == 0) return done;
+        if (ring) {
+            if (ring_enter(ring, 1) != 0) return done;
+        } else {
+            pool_reap(b, 1);
+        }
+    }
+}
+
+int block_wait(block_batch *b) {
+    while (b->pending > 0) {
+        u32 before = b->pending;
+        block_poll(b, b->pending);
+        if (b->pending == before) {
+            // io_uring_enter falló: no hay forma de cosechar lo que quedó
+            if (!b->error) b->error = errno ? errno : EIO;
+            break;
+        }
+    }
+    if (b->error) { errno = b->error; return -1; }
+    return 0;
+}
+
+int block_rw_batch(const char *folder, block_req *reqs, u32 n, u32 block_size) {
+    // Un solo pedido no tiene con qué solaparse: va directo
+    if (n == 1 && !reqs[0].done) {
+        block_req *r = &reqs[0];
+        int rc = r->write ? block_pwrite(folder, r->start, r->in_block, r->buf, r->len, block_size)
+                          : block_pread(folder, r->start, r->in_block, r->buf, r->len, block_size);
+        r->error = rc == 0 ? 0 : errno;
+        return rc;
+    }
+    block_batch b;
+    block_batch_init(&b, folder, block_size);
+    int rc = block_submit(&b, reqs, n);
+    int err = errno;
+    if (block_wait(&b) != 0) return -1;
+    if (rc != 0) errno = err;
+    return rc;
+}
+
+void block_aio_set_engine(int e) {
+    __atomic_store_n(&engine, e, __ATOMIC_RELAXED);
+}
+
+const char *block_aio_engine(void) {
+    switch (resolve_engine()) {
+    case BLOCK_AIO_ENGINE_URING: return "io_uring";
+    case BLOCK_AIO_ENGINE_POOL:  return "pool de hilos";
+    default:                     return "sincrónico";
+    }
+}
+
+void block_aio_get_stats(block_aio_stats *out) {
+    out->submitted = __atomic_load_n(&stats.submitted, __ATOMIC_RELAXED);
+    out->completed = __atomic_load_n(&stats.completed, __ATOMIC_RELAXED);
+    out->inline_done = __atomic_load_n(&stats.inline_done, __ATOMIC_RELAXED);
+    out->enters = __atomic_load_n(&stats.enters, __ATOMIC_RELAXED);
+    out->max_inflight = __atomic_load_n(&stats.max_inflight, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,81 @@
+#ifndef BLOCK_AIO_H
+#define BLOCK_AIO_H
+#include "fs_basic.h"
+#include <sys/uio.h>
+
+// E/S de bloques asíncrona por lotes, al lado de read_block/write_block.
+// Cada pedido es un rango de bytes como en block_pread (desde `in_block` del
+// bloque `start`, sobre bloques físicos contiguos). Se envían todos los del
+// lote de una vez y se completan con callback o esperando (block_poll /
+// block_wait), así hay muchos en vuelo a la vez.
+//
+// Motores:
+//  - io_uring (syscalls directas, un anillo por hilo) si el kernel lo tiene;
+//  - un pool de hilos con pread/pwrite si no;
+//  - sincrónico cuando el backend no expone descriptor (archivos por bloque,
+//    que no es reentrante, y mmap, que es una copia de memoria) y, con sumas
+//    por bloque (csum.h), para los pedidos que no son bloques enteros.
+// Los callbacks corren en el hilo que envió el lote, al cosecharlo. Un lote
+// se envía y se espera desde el mismo hilo.
+
+#define BLOCK_AIO_DEPTH        64   // entradas del anillo de cada hilo
+#define BLOCK_AIO_POOL_THREADS 4    // hilos del pool de respaldo
+
+// Motor (block_aio_set_engine); AUTO prueba io_uring y si no usa el pool
+#define BLOCK_AIO_ENGINE_AUTO  0
+#define BLOCK_AIO_ENGINE_URING 1
+#define BLOCK_AIO_ENGINE_POOL  2
+#define BLOCK_AIO_ENGINE_SYNC  3
+
+struct block_batch;
+
+typedef struct block_req {
+    u32 start;
+    u32 in_block;
+    void *buf;
+    u32 len;
+    int write;
+    int error;                                  // errno al completarse (0 = bien)
+    void (*done)(struct block_req *req);        // opcional
+    void *ctx;                                  // libre para el llamador
+
+    // Internos
+    struct block_batch *batch;
+    struct block_req *next;
+    int fd;
+    off_t offset;
+    u32 moved;                                  // bytes ya transferidos
+    int verify;                                 // comprobar las sumas al completarse
+    struct iovec iov;
+} block_req;
+
+typedef struct block_batch {
+    const char *folder;
+    u32 block_size;
+    int engine;
+    u32 pending;                // enviados y no cosechados
+    int error;                  // primer error del lote
+    block_req *done_head;       // completados por el pool, sin cosechar
+} block_batch;
+
+typedef struct block_aio_stats {
+    unsigned long long submitted;
+    unsigned long long completed;
+    unsigned long long inline_done;   // resueltos en el momento (backend sin descriptor)
+    unsigned long long enters;        // llamadas a io_uring_enter
+    unsigned long long max_inflight;
+} block_aio_stats;
+
+void block_batch_init(block_batch *b, const char *folder, u32 block_size);
+int  block_submit(block_batch *b, block_req *reqs, u32 n);   // -1 = no se pudo enviar (lo enviado sigue en vuelo)
+u32  block_poll(block_batch *b, u32 min_complete);           // cosecha y devuelve cuántos terminaron
+int  block_wait(block_batch *b);                             // espera todo; 0 o -1 con errno del primer error
+
+// Enviar y esperar en una sola llamada
+int  block_rw_batch(const char *folder, block_req *reqs, u32 n, u32 block_size);
+
+void block_aio_set_engine(int engine);
+const char *block_aio_engine(void);
+void block_aio_get_stats(block_aio_stats *out);
+
+#endif
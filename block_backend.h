@@ -0,0 +1,37 @@
+#ifndef BLOCK_BACKEND_H
+#define BLOCK_BACKEND_H
+#include "fs_basic.h"
+#include "block.h"
+
+// Interfaz interna que implementa cada backend de almacenamiento de bloques.
+// block.c elige uno por carpeta y le delega read_block/write_block.
+typedef struct block_backend {
+    const char *name;
+    int  (*open)(const char *folder, u32 block_size);
+    int  (*format)(const char *folder, u32 total_blocks, u32 block_size, const block_format_opts *opts);
+    int  (*create)(const char *folder, u32 index, u32 block_size);
+    int  (*write)(const char *folder, u32 index, const void *buf, u32 len);
+    int  (*read)(const char *folder, u32 index, unsigned char *buf, u32 block_size);
+    void (*close)(void);
+    const unsigned char *(*view)(u32 index, u32 block_size);  // NULL si no hay vista directa
+    int  (*sync)(void);
+    // Rangos de bloques contiguos en una sola operación (NULL = bloque a bloque)
+    int  (*read_run)(u32 start, u32 count, unsigned char *buf, u32 block_size);
+    int  (*write_run)(u32 start, u32 count, const void *buf, u32 block_size);
+    // Descriptor y offset donde vive el bloque, para splice/pread directos (NULL si no hay)
+    int  (*fd)(u32 index, u32 block_size, off_t *offset);
+    // Bloques materializados en el host (el resto se lee como ceros)
+    int  (*count)(const char *folder, u32 total_blocks, u32 block_size, u32 *present);
+    // Aviso de lectura próxima de un rango contiguo; el host lo trae en segundo
+    // plano a su cache de páginas (NULL = sin aviso)
+    int  (*prefetch)(const char *folder, u32 start, u32 count, u32 block_size);
+} block_backend;
+
+// Un bloque en cero compartido, para no reservar uno en cada create
+extern const unsigned char block_zero[QRFS_MAX_BLOCK_SIZE];
+
+extern const block_backend block_backend_files;
+extern const block_backend block_backend_image;
+extern const block_backend block_backend_mmap;
+
+#endif
@@ -0,0 +1,447 @@
+#define _POSIX_C_SOURCE 200809L
+#include "block.h"
+#include "block_backend.h"
+#include "png.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <pthread.h>
+
+// Cache de descriptores abiertos por bloque (LRU). Cada acierto evita el
+// open/close que antes hacía fopen/fclose en cada acceso.
+typedef struct fd_slot {
+    int fd;                    // -1 = libre
+    u32 index;
+    int dirty;                 // escrito desde el último sync
+    unsigned long long last_use;
+} fd_slot;
+
+static fd_slot fd_cache[BLOCK_FD_CACHE_SLOTS];
+static int fd_cache_ready = 0;
+static char fd_cache_folder[512];
+static unsigned long long fd_cache_tick = 0;
+static block_fd_stats fd_stats;
+// Un descriptor sucio que sale de la cache se cierra sin bajarlo: su índice
+// queda anotado y el próximo sync abre el archivo de nuevo y lo baja. Si no
+// hay memoria para anotarlo se baja ahí; un error queda para el próximo sync.
+static u32 *evicted = NULL;
+static u32 nevicted = 0, evicted_cap = 0;
+static int sync_errno = 0;
+static int folder_dirty = 0;   // se crearon o borraron archivos de bloque
+
+// Modo PNG: el archivo tiene tamaño fijo para cada tamaño de bloque y se
+// reescribe entero. Un solo buffer de codificación alcanza porque el backend
+// no es reentrante.
+static unsigned char png_buf[PNG_ENCODED_SIZE(QRFS_MAX_BLOCK_SIZE)];
+
+static void block_path(char *path, size_t len, const char *folder, u32 index) {
+    snprintf(path, len, "%s/block_%04u.png", folder, index);
+}
+
+static void fd_cache_init(void) {
+    for (int i = 0; i < BLOCK_FD_CACHE_SLOTS; i++) {
+        fd_cache[i].fd = -1;
+        fd_cache[i].dirty = 0;
+    }
+    fd_cache_folder[0] = '\0';
+    fd_cache_ready = 1;
+}
+
+static int remember_evicted(u32 index) {
+    if (nevicted == evicted_cap) {
+        u32 cap = evicted_cap ? evicted_cap * 2 : 256;
+        u32 *p = (u32*)realloc(evicted, cap * sizeof(u32));
+        if (!p) return -1;
+        evicted = p;
+        evicted_cap = cap;
+    }
+    evicted[nevicted++] = index;
+    return 0;
+}
+
+static void fd_slot_close(fd_slot *slot) {
+    if (slot->dirty && remember_evicted(slot->index) != 0 &&
+        fdatasync(slot->fd) != 0 && !sync_errno) sync_errno = errno;
+    close(slot->fd);
+    slot->fd = -1;
+    slot->dirty = 0;
+}
+
+static int by_index(const void *a, const void *b) {
+    u32 x = *(const u32*)a, y = *(const u32*)b;
+    return x < y ? -1 : x > y;
+}
+
+// Baja los archivos de bloque desalojados sucios desde el último sync; uno
+// borrado después (bloque nulo en un volumen ralo) ya no hace falta
+static int evicted_sync(void) {
+    int rc = 0;
+    char path[sizeof(fd_cache_folder) + 32];
+    if (nevicted == 0) return 0;
+    qsort(evicted, nevicted, sizeof(u32), by_index);
+    for (u32 i = 0; i < nevicted; i++) {
+        if (i > 0 && evicted[i] == evicted[i - 1]) continue;
+        block_path(path, sizeof(path), fd_cache_folder, evicted[i]);
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            if (errno != ENOENT) rc = -1;
+            continue;
+        }
+        if (fdatasync(fd) != 0) rc = -1;
+        close(fd);
+    }
+    nevicted = 0;
+    return rc;
+}
+
+static int folder_sync(void) {
+    if (!folder_dirty || !fd_cache_folder[0]) return 0;
+    int dfd = open(fd_cache_folder, O_RDONLY | O_DIRECTORY);
+    int rc = (dfd >= 0 && fsync(dfd) == 0) ? 0 : -1;
+    if (dfd >= 0) close(dfd);
+    if (rc == 0) folder_dirty = 0;
+    return rc;
+}
+
+static void fd_mark_dirty(u32 index) {
+    for (int i = 0; i < BLOCK_FD_CACHE_SLOTS; i++) {
+        if (fd_cache[i].fd >= 0 && fd_cache[i].index == index) fd_cache[i].dirty = 1;
+    }
+}
+
+void block_fd_cache_close_all(void) {
+    if (!fd_cache_ready) fd_cache_init();
+    for (int i = 0; i < BLOCK_FD_CACHE_SLOTS; i++) {
+        if (fd_cache[i].fd >= 0) fd_slot_close(&fd_cache[i]);
+    }
+    if (evicted_sync() != 0 && !sync_errno) sync_errno = errno;
+    if (folder_sync() != 0 && !sync_errno) sync_errno = errno;
+    folder_dirty = 0;
+    fd_cache_folder[0] = '\0';
+}
+
+void block_fd_cache_stats(block_fd_stats *out) {
+    *out = fd_stats;
+}
+
+double block_fd_cache_hit_rate(void) {
+    unsigned long long total = fd_stats.hits + fd_stats.misses;
+    return total ? (double)fd_stats.hits / (double)total : 0.0;
+}
+
+// Devuelve un fd abierto para el bloque; lo abre (y lo crea si create=1)
+// cuando no está en la cache, desalojando el menos usado recientemente.
+static int block_fd_get(const char *folder, u32 index, int create) {
+    if (!fd_cache_ready) fd_cache_init();
+    if (strcmp(fd_cache_folder, folder) != 0) {
+        block_fd_cache_close_all();
+        snprintf(fd_cache_folder, sizeof(fd_cache_folder), "%s", folder);
+    }
+
+    int victim = 0;
+    for (int i = 0; i < BLOCK_FD_CACHE_SLOTS; i++) {
+        if (fd_cache[i].fd >= 0 && fd_cache[i].index == index) {
+            fd_cache[i].last_use = ++fd_cache_tick;
+            fd_stats.hits++;
+            fd_stats.syscalls_saved += 2; // open + close
+            return fd_cache[i].fd;
+        }
+        if (fd_cache[victim].fd >= 0 &&
+            (fd_cache[i].fd < 0 || fd_cache[i].last_use < fd_cache[victim].last_use)) {
+            victim = i;
+        }
+    }
+
+    char path[512];
+    block_path(path, sizeof(path), folder, index);
+    int fd = open(path, create ? (O_RDWR | O_CREAT) : O_RDWR, 0644);
+    if (fd < 0 && !create && errno == EACCES) fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    fd_stats.misses++;
+    if (create) folder_dirty = 1;
+
+    if (fd_cache[victim].fd >= 0) {
+        fd_slot_close(&fd_cache[victim]);
+        fd_stats.evictions++;
+    }
+    fd_cache[victim].fd = fd;
+    fd_cache[victim].index = index;
+    fd_cache[victim].last_use = ++fd_cache_tick;
+    return fd;
+}
+
+// Saca el bloque de la cache de descriptores (antes de borrar su archivo:
+// no hace falta bajarlo)
+static void block_fd_drop(u32 index) {
+    for (int i = 0; i < BLOCK_FD_CACHE_SLOTS; i++) {
+        if (fd_cache[i].fd >= 0 && fd_cache[i].index == index) {
+            close(fd_cache[i].fd);
+            fd_cache[i].fd = -1;
+            fd_cache[i].dirty = 0;
+        }
+    }
+}
+
+//Bloque nulo: truncar a 0 y extender deja el archivo en ceros sin escribir datos.
+//En un volumen ralo basta con que el archivo no exista.
+static int files_create(const char *folder, u32 index, u32 block_size) {
+    if (block_sparse()) {
+        char path[512];
+        block_path(path, sizeof(path), folder, index);
+        if (fd_cache_ready && strcmp(fd_cache_folder, folder) == 0) block_fd_drop(index);
+        if (unlink(path) == 0) folder_dirty = 1;
+        else if (errno != ENOENT) return -1;
+        return 0;
+    }
+    int fd = block_fd_get(folder, index, 1);
+    if (fd < 0) return -1;
+    fd_mark_dirty(index);
+    if (block_png()) {
+        size_t n = png_encode(block_zero, block_size, png_buf);
+        return pwrite(fd, png_buf, n, 0) == (ssize_t)n ? 0 : -1;
+    }
+    if (ftruncate(fd, 0) != 0) return -1;
+    return ftruncate(fd, block_size);
+}
+
+// Escribe datos; en un volumen ralo el archivo del bloque se crea al
+// escribirlo, salvo que lo escrito sean ceros (ya se lee así)
+static int files_write(const char *folder, u32 index, const void *buf, u32 len) {
+    int fd = block_fd_get(folder, index, 0);
+    if (fd < 0 && errno == ENOENT && block_sparse()) {
+        if (len <= QRFS_MAX_BLOCK_SIZE && memcmp(buf, block_zero, len) == 0) return 0;
+        fd = block_fd_get(folder, index, 1);
+    }
+    if (fd < 0) return -1;
+    fd_mark_dirty(index);
+
+    if (block_png()) {          // siempre un bloque entero, como escriben todos los llamadores
+        size_t n = png_encode(buf, len, png_buf);
+        return pwrite(fd, png_buf, n, 0) == (ssize_t)n ? 0 : -1;
+    }
+    ssize_t w = pwrite(fd, buf, len, 0);
+    return (w == (ssize_t)len) ? 0 : -1;
+}
+
+//Lee datos de un bloque
+
+static int files_read(const char *folder, u32 block_index, unsigned char *buf, u32 block_size) {
+    int fd = block_fd_get(folder, block_index, 0);
+    if (fd < 0 && errno == ENOENT && block_sparse()) {
+        memset(buf, 0, block_size);   // nunca se escribió
+        return 0;
+    }
+    if (fd < 0) {
+        fprintf(stderr, "Error abriendo bloque %u: %s\n", block_index, strerror(errno));
+        return -1;
+    }
+
+    if (block_png()) {
+        // Alcanza con el prefijo del tamaño codificado: se validan solo las cabeceras
+        size_t want = PNG_ENCODED_SIZE(block_size);
+        ssize_t r = pread(fd, png_buf, want, 0);
+        if (r != (ssize_t)want || png_decode(png_buf, want, buf, block_size) != 0) {
+            if (r >= 0) errno = EIO;
+            fprintf(stderr, "Error leyendo bloque %u: no es un PNG de QRFS válido\n", block_index);
+            return -1;
+        }
+        return 0;
+    }
+    ssize_t r = pread(fd, buf, block_size, 0);
+    if (r != (ssize_t)block_size) {
+        fprintf(stderr, "Error leyendo bloque %u (bytes leídos=%zd, esperado=%u)\n",
+                block_index, r, block_size);
+        return -1;
+    }
+
+    return 0;
+}
+
+// El modo sale del bloque 0: con firma PNG, todo el volumen está en PNG
+static int files_open(const char *folder, u32 block_size) {
+    (void)block_size;
+    unsigned char head[8];
+    int fd = block_fd_get(folder, 0, 0);
+    if (fd >= 0 && pread(fd, head, sizeof(head), 0) == (ssize_t)sizeof(head)) {
+        block_set_png(png_is_png(head, sizeof(head)));
+    }
+    return 0;
+}
+
+// Reparto del formateo: cada hilo toma tandas de índices consecutivos
+#define FORMAT_BATCH 256
+
+typedef struct format_job {
+    const char *folder;
+    u32 count;
+    u32 block_size;
+    const unsigned char *image;   // bloque en cero ya codificado (modo PNG) o NULL
+    size_t image_len;
+    u32 next;              // próximo índice a repartir (atómico)
+    int error;             // primer errno visto
+    u32 failed_index;
+} format_job;
+
+// Cada archivo se crea ralo con ftruncate; no pasa por la cache de
+// descriptores (no es reentrante) y no escribe un solo byte de datos. En
+// modo PNG se escribe la misma imagen en cero, codificada una vez.
+static void *format_worker(void *arg) {
+    format_job *job = (format_job*)arg;
+    char path[512];
+    for (;;) {
+        u32 start = __atomic_fetch_add(&job->next, FORMAT_BATCH, __ATOMIC_RELAXED);
+        if (start >= job->count || __atomic_load_n(&job->error, __ATOMIC_RELAXED)) break;
+        u32 end = start + FORMAT_BATCH < job->count ? start + FORMAT_BATCH : job->count;
+        for (u32 i = start; i < end; i++) {
+            block_path(path, sizeof(path), job->folder, i);
+            int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            int rc = fd < 0 ? -1
+                   : job->image ? (pwrite(fd, job->image, job->image_len, 0) == (ssize_t)job->image_len ? 0 : -1)
+                   : ftruncate(fd, job->block_size);
+            int err = errno;
+            if (fd >= 0) close(fd);
+            if (rc != 0) {
+                int expected = 0;
+                if (__atomic_compare_exchange_n(&job->error, &expected, err ? err : EIO, 0,
+                                                __ATOMIC_RELAXED, __ATOMIC_RELAXED)) job->failed_index = i;
+                return NULL;
+            }
+        }
+    }
+    return NULL;
+}
+
+// Índice de un nombre block_NNNN.png; -1 si no es un archivo de bloque
+static long block_index_of(const char *name) {
+    unsigned idx;
+    int end = 0;
+    if (sscanf(name, "block_%u.png%n", &idx, &end) != 1 || end == 0 || name[end] != '\0') return -1;
+    return (long)idx;
+}
+
+// Recorre los archivos de bloque de la carpeta; con `remove_from` borra los
+// de índice >= remove_from (restos de un formato anterior) y no cuenta.
+static int scan_block_files(const char *folder, u32 total_blocks, long remove_from, u32 *present) {
+    DIR *d = opendir(folder);
+    if (!d) return -1;
+    char path[512];
+    u32 n = 0;
+    int rc = 0;
+    struct dirent *e;
+    while ((e = readdir(d)) != NULL) {
+        long idx = block_index_of(e->d_name);
+        if (idx < 0) continue;
+        if (remove_from >= 0) {
+            if (idx < remove_from) continue;
+            snprintf(path, sizeof(path), "%s/%s", folder, e->d_name);
+            if (unlink(path) != 0 && errno != ENOENT) rc = -1;
+        } else if ((u32)idx < total_blocks) {
+            n++;
+        }
+    }
+    closedir(d);
+    if (present) *present = n;
+    return rc;
+}
+
+static int files_count(const char *folder, u32 total_blocks, u32 block_size, u32 *present) {
+    (void)block_size;
+    return scan_block_files(folder, total_blocks, -1, present);
+}
+
+// Un archivo block_NNNN.png por bloque; en modo lazy solo los primeros
+// `materialize`, el resto aparece al escribirse. Los archivos que hubieran
+// quedado de un volumen anterior se borran para que se lean como ceros.
+static int files_format(const char *folder, u32 total_blocks, u32 block_size, const block_format_opts *opts) {
+    block_fd_cache_close_all();
+    if (scan_block_files(folder, total_blocks, opts->materialize, NULL) != 0) {
+        fprintf(stderr, "No se pudieron borrar bloques viejos de %s: %s\n", folder, strerror(errno));
+        return -1;
+    }
+    format_job job = {folder, opts->materialize, block_size, NULL, 0, 0, 0, 0};
+    if (block_png()) {
+        job.image_len = png_encode(block_zero, block_size, png_buf);
+        job.image = png_buf;
+    }
+
+    u32 threads = opts->threads;
+    if (threads == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (u32)cpus : 1;
+    }
+    u32 batches = (job.count + FORMAT_BATCH - 1) / FORMAT_BATCH;
+    if (threads > batches) threads = batches ? batches : 1;
+
+    pthread_t *tids = (pthread_t*)calloc(threads, sizeof(pthread_t));
+    if (!tids) { errno = ENOMEM; return -1; }
+    u32 started = 0;
+    for (u32 t = 1; t < threads; t++, started++) {
+        if (pthread_create(&tids[t], NULL, format_worker, &job) != 0) break;
+    }
+    format_worker(&job);
+    for (u32 t = 1; t <= started; t++) pthread_join(tids[t], NULL);
+    free(tids);
+
+    if (job.error) {
+        errno = job.error;
+        fprintf(stderr, "No se pudo crear block_%04u.png: %s\n", job.failed_index, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+// Abrir cada bloque pasa por la cache de descriptores: se avisan a lo sumo
+// la mitad de sus ranuras por vez para no desalojar los que están en uso
+static int files_prefetch(const char *folder, u32 start, u32 count, u32 block_size) {
+    if (count > BLOCK_FD_CACHE_SLOTS / 2) count = BLOCK_FD_CACHE_SLOTS / 2;
+    for (u32 i = 0; i < count; i++) {
+        int fd = block_fd_get(folder, start + i, 0);
+        if (fd < 0) {
+            if (errno == ENOENT && block_sparse()) continue;   // se lee como ceros
+            return -1;
+        }
+        posix_fadvise(fd, 0, block_size, POSIX_FADV_WILLNEED);
+    }
+    return 0;
+}
+
+// Baja los descriptores sucios que siguen en la cache, los archivos de los
+// que se desalojaron y, si cambiaron sus entradas, la carpeta
+static int files_sync(void) {
+    int rc = 0;
+    for (int i = 0; i < BLOCK_FD_CACHE_SLOTS; i++) {
+        if (fd_cache[i].fd < 0 || !fd_cache[i].dirty) continue;
+        if (fsync(fd_cache[i].fd) != 0) rc = -1;
+        else fd_cache[i].dirty = 0;
+    }
+    if (evicted_sync() != 0) rc = -1;
+    if (folder_sync() != 0) rc = -1;
+    if (sync_errno) {
+        errno = sync_errno;
+        sync_errno = 0;
+        rc = -1;
+    }
+    return rc;
+}
+
+const block_backend block_backend_files = {
+    "files",
+    files_open,
+    files_format,
+    files_create,
+    files_write,
+    files_read,
+    block_fd_cache_close_all,
+    NULL,
+    files_sync,
+    NULL,
+    NULL,
+    NULL,
+    files_count,
+    files_prefetch,
+};
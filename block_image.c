@@ -0,0 +1,148 @@
+#define _POSIX_C_SOURCE 200809L
+#include "block.h"
+#include "block_backend.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// Backend de imagen única: todos los bloques viven en <folder>/qrfs.img,
+// el bloque i empieza en el offset i * block_size.
+static int image_fd = -1;
+static u32 image_block_size = 0;
+
+static void image_path(char *path, size_t len, const char *folder) {
+    snprintf(path, len, "%s/%s", folder, QRFS_IMAGE_NAME);
+}
+
+static off_t image_offset(u32 index) {
+    return (off_t)index * (off_t)image_block_size;
+}
+
+static void image_close(void) {
+    if (image_fd >= 0) close(image_fd);
+    image_fd = -1;
+}
+
+static int image_open(const char *folder, u32 block_size) {
+    char path[512];
+    image_path(path, sizeof(path), folder);
+    image_close();
+    image_fd = open(path, O_RDWR);
+    if (image_fd < 0 && errno == EACCES) image_fd = open(path, O_RDONLY);
+    if (image_fd < 0) return -1;
+    image_block_size = block_size;
+    return 0;
+}
+
+// Crea la imagen de una vez: con ftruncate queda rala y los bloques se leen
+// como ceros sin escribirlos; posix_fallocate reserva en el host los bloques
+// a materializar (en modo lazy solo los de metadatos).
+static int image_format(const char *folder, u32 total_blocks, u32 block_size, const block_format_opts *opts) {
+    char path[512];
+    image_path(path, sizeof(path), folder);
+    image_close();
+    image_fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (image_fd < 0) {
+        fprintf(stderr, "No se pudo crear %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    image_block_size = block_size;
+
+    int rc = ftruncate(image_fd, image_offset(total_blocks)) == 0 ? 0 : errno;
+    if (rc == 0) {
+        rc = posix_fallocate(image_fd, 0, image_offset(opts->materialize));
+        if (rc == EOPNOTSUPP || rc == EINVAL) rc = 0;   // el FS no reserva: queda rala
+    }
+    if (rc != 0) {
+        errno = rc;
+        fprintf(stderr, "No se pudo reservar %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+static int image_create(const char *folder, u32 index, u32 block_size) {
+    (void)folder;
+    ssize_t w = pwrite(image_fd, block_zero, block_size, image_offset(index));
+    return (w == (ssize_t)block_size) ? 0 : -1;
+}
+
+static int image_write(const char *folder, u32 index, const void *buf, u32 len) {
+    (void)folder;
+    ssize_t w = pwrite(image_fd, buf, len, image_offset(index));
+    return (w == (ssize_t)len) ? 0 : -1;
+}
+
+static int image_read(const char *folder, u32 index, unsigned char *buf, u32 block_size) {
+    (void)folder;
+    ssize_t r = pread(image_fd, buf, block_size, image_offset(index));
+    if (r != (ssize_t)block_size) {
+        fprintf(stderr, "Error leyendo bloque %u de la imagen (bytes leídos=%zd, esperado=%u)\n",
+                index, r, block_size);
+        return -1;
+    }
+    return 0;
+}
+
+static int image_read_run(u32 start, u32 count, unsigned char *buf, u32 block_size) {
+    size_t len = (size_t)count * block_size;
+    ssize_t r = pread(image_fd, buf, len, image_offset(start));
+    return (r == (ssize_t)len) ? 0 : -1;
+}
+
+static int image_write_run(u32 start, u32 count, const void *buf, u32 block_size) {
+    size_t len = (size_t)count * block_size;
+    ssize_t w = pwrite(image_fd, buf, len, image_offset(start));
+    return (w == (ssize_t)len) ? 0 : -1;
+}
+
+static int image_sync(void) {
+    return image_fd >= 0 ? fdatasync(image_fd) : 0;
+}
+
+static int image_fd_of(u32 index, u32 block_size, off_t *offset) {
+    (void)block_size;
+    if (image_fd < 0) { errno = EBADF; return -1; }
+    *offset = image_offset(index);
+    return image_fd;
+}
+
+static int image_prefetch(const char *folder, u32 start, u32 count, u32 block_size) {
+    (void)folder;
+    if (image_fd < 0) { errno = EBADF; return -1; }
+    int rc = posix_fadvise(image_fd, image_offset(start), (off_t)count * block_size, POSIX_FADV_WILLNEED);
+    if (rc != 0) { errno = rc; return -1; }
+    return 0;
+}
+
+// Estimación por el espacio que ocupa la imagen en el host (st_blocks)
+static int image_count(const char *folder, u32 total_blocks, u32 block_size, u32 *present) {
+    char path[512];
+    struct stat st;
+    image_path(path, sizeof(path), folder);
+    if (stat(path, &st) != 0) return -1;
+    unsigned long long n = ((unsigned long long)st.st_blocks * 512u + block_size - 1) / block_size;
+    *present = n < total_blocks ? (u32)n : total_blocks;
+    return 0;
+}
+
+const block_backend block_backend_image = {
+    "image",
+    image_open,
+    image_format,
+    image_create,
+    image_write,
+    image_read,
+    image_close,
+    NULL,
+    image_sync,
+    image_read_run,
+    image_write_run,
+    image_fd_of,
+    image_count,
+    image_prefetch,
+};
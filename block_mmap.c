@@ -0,0 +1,157 @@
+#define _POSIX_C_SOURCE 200809L
+#include "block.h"
+#include "block_backend.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Backend mmap: usa la misma imagen que block_image.c pero mapeada completa al
+// montar. Las lecturas devuelven punteros al mapeo (block_view) sin copiar.
+static unsigned char *map_base = NULL;
+static size_t map_len = 0;
+static int map_writable = 0;
+static u32 map_block_size = 0;
+
+static void mmap_close(void) {
+    if (map_base) {
+        if (map_writable) msync(map_base, map_len, MS_SYNC);
+        munmap(map_base, map_len);
+    }
+    map_base = NULL;
+    map_len = 0;
+}
+
+static int mmap_open(const char *folder, u32 block_size) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", folder, QRFS_IMAGE_NAME);
+    mmap_close();
+
+    map_writable = 1;
+    int fd = open(path, O_RDWR);
+    if (fd < 0 && errno == EACCES) {
+        map_writable = 0;
+        fd = open(path, O_RDONLY);
+    }
+    if (fd < 0) return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+
+    int prot = map_writable ? (PROT_READ | PROT_WRITE) : PROT_READ;
+    void *p = mmap(NULL, (size_t)st.st_size, prot, MAP_SHARED, fd, 0);
+    close(fd); // el mapeo sigue vivo sin el descriptor
+    if (p == MAP_FAILED) return -1;
+
+    map_base = (unsigned char*)p;
+    map_len = (size_t)st.st_size;
+    map_block_size = block_size;
+    return 0;
+}
+
+// Devuelve la dirección del bloque dentro del mapeo, o NULL si se sale
+static unsigned char *mmap_addr(u32 index, u32 len) {
+    size_t off = (size_t)index * map_block_size;
+    if (!map_base || off + len > map_len) {
+        errno = EINVAL;
+        return NULL;
+    }
+    return map_base + off;
+}
+
+static int mmap_format(const char *folder, u32 total_blocks, u32 block_size, const block_format_opts *opts) {
+    if (block_backend_image.format(folder, total_blocks, block_size, opts) != 0) return -1;
+    block_backend_image.close();
+    return mmap_open(folder, block_size);
+}
+
+static int mmap_create(const char *folder, u32 index, u32 block_size) {
+    (void)folder;
+    unsigned char *p = mmap_addr(index, block_size);
+    if (!p || !map_writable) return -1;
+    memset(p, 0, block_size);
+    return 0;
+}
+
+static int mmap_write(const char *folder, u32 index, const void *buf, u32 len) {
+    (void)folder;
+    unsigned char *p = mmap_addr(index, len);
+    if (!p || !map_writable) return -1;
+    memcpy(p, buf, len);
+    return 0;
+}
+
+static int mmap_read(const char *folder, u32 index, unsigned char *buf, u32 block_size) {
+    (void)folder;
+    const unsigned char *p = mmap_addr(index, block_size);
+    if (!p) {
+        fprintf(stderr, "Error leyendo bloque %u: fuera del mapeo\n", index);
+        return -1;
+    }
+    memcpy(buf, p, block_size);
+    return 0;
+}
+
+static const unsigned char *mmap_view(u32 index, u32 block_size) {
+    return mmap_addr(index, block_size);
+}
+
+static int mmap_read_run(u32 start, u32 count, unsigned char *buf, u32 block_size) {
+    const unsigned char *p = mmap_addr(start, count * block_size);
+    if (!p) return -1;
+    memcpy(buf, p, (size_t)count * block_size);
+    return 0;
+}
+
+static int mmap_write_run(u32 start, u32 count, const void *buf, u32 block_size) {
+    unsigned char *p = mmap_addr(start, count * block_size);
+    if (!p || !map_writable) return -1;
+    memcpy(p, buf, (size_t)count * block_size);
+    return 0;
+}
+
+// posix_madvise pide direcciones alineadas a página
+static int mmap_prefetch(const char *folder, u32 start, u32 count, u32 block_size) {
+    (void)folder;
+    unsigned char *p = mmap_addr(start, count * block_size);
+    if (!p) return -1;
+    uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t from = (uintptr_t)p & ~(page - 1);
+    int rc = posix_madvise((void*)from, (uintptr_t)p + (size_t)count * block_size - from, POSIX_MADV_WILLNEED);
+    if (rc != 0) { errno = rc; return -1; }
+    return 0;
+}
+
+static int mmap_count(const char *folder, u32 total_blocks, u32 block_size, u32 *present) {
+    return block_backend_image.count(folder, total_blocks, block_size, present);
+}
+
+static int mmap_sync(void) {
+    if (!map_base || !map_writable) return 0;
+    return msync(map_base, map_len, MS_SYNC);
+}
+
+const block_backend block_backend_mmap = {
+    "mmap",
+    mmap_open,
+    mmap_format,
+    mmap_create,
+    mmap_write,
+    mmap_read,
+    mmap_close,
+    mmap_view,
+    mmap_sync,
+    mmap_read_run,
+    mmap_write_run,
+    NULL,
+    mmap_count,
+    mmap_prefetch,
+};
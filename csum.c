@@ -0,0 +1,315 @@
+#define _DEFAULT_SOURCE
+#include "csum.h"
+#include "block.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <endian.h>
+#include <pthread.h>
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define CSUM_X86 1
+#endif
+
+// ---- CRC32C (polinomio 0x82F63B78, reflejado) ----
+
+#define CRC32C_POLY 0x82F63B78u
+// Tramos de los tres flujos en paralelo: la instrucción crc32 tarda 3 ciclos
+// pero acepta una por ciclo, así que tres cadenas independientes la llenan
+#define CRC32C_LONG  8192
+#define CRC32C_SHORT 256
+
+static u32 crc_table[8][256];
+static u32 crc_long[4][256], crc_short[4][256];   // desplazan una suma LONG / SHORT bytes en ceros
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+static int use_sse42 = 0;
+static int want_simd = 1;
+
+// a * b módulo el polinomio (reflejados)
+static u32 gf2_mul(u32 a, u32 b) {
+    u32 m = 1u << 31, p = 0;
+    for (;;) {
+        if (a & m) {
+            p ^= b;
+            if ((a & (m - 1)) == 0) break;
+        }
+        m >>= 1;
+        b = (b & 1) ? (b >> 1) ^ CRC32C_POLY : b >> 1;
+    }
+    return p;
+}
+
+// Tabla por byte del operador "agregar len bytes en cero" (es lineal)
+static void zeros_table(u32 t[4][256], u32 len) {
+    u32 op = 1u << 31;                        // x^0
+    for (u32 i = 0; i < len; i++) op = gf2_mul(op, 1u << 23);   // * x^8
+    for (u32 n = 0; n < 256; n++) {
+        for (int k = 0; k < 4; k++) t[k][n] = gf2_mul(op, n << (8 * k));
+    }
+}
+
+static void crc_init(void) {
+    for (u32 i = 0; i < 256; i++) {
+        u32 c = i;
+        for (int k = 0; k < 8; k++) c = (c & 1) ? CRC32C_POLY ^ (c >> 1) : c >> 1;
+        crc_table[0][i] = c;
+    }
+    for (u32 i = 0; i < 256; i++) {
+        for (int t = 1; t < 8; t++) {
+            u32 c = crc_table[t - 1][i];
+            crc_table[t][i] = crc_table[0][c & 0xff] ^ (c >> 8);
+        }
+    }
+    zeros_table(crc_long, CRC32C_LONG);
+    zeros_table(crc_short, CRC32C_SHORT);
+#ifdef CSUM_X86
+    __builtin_cpu_init();
+    use_sse42 = __builtin_cpu_supports("sse4.2");
+#endif
+}
+
+static inline u32 load32le(const unsigned char *p) {
+    u32 v;
+    memcpy(&v, p, 4);
+    return le32toh(v);
+}
+
+// Slicing-by-8; `c` ya invertido
+static u32 crc32c_slice8(u32 c, const unsigned char *p, size_t n) {
+    while (n >= 8) {
+        u32 a = load32le(p) ^ c, b = load32le(p + 4);
+        c = crc_table[7][a & 0xff] ^ crc_table[6][(a >> 8) & 0xff] ^
+            crc_table[5][(a >> 16) & 0xff] ^ crc_table[4][a >> 24] ^
+            crc_table[3][b & 0xff] ^ crc_table[2][(b >> 8) & 0xff] ^
+            crc_table[1][(b >> 16) & 0xff] ^ crc_table[0][b >> 24];
+        p += 8;
+        n -= 8;
+    }
+    while (n--) c = crc_table[0][(c ^ *p++) & 0xff] ^ (c >> 8);
+    return c;
+}
+
+#ifdef CSUM_X86
+static inline u32 crc_shift(u32 t[4][256], u32 c) {
+    return t[0][c & 0xff] ^ t[1][(c >> 8) & 0xff] ^ t[2][(c >> 16) & 0xff] ^ t[3][c >> 24];
+}
+
+// Tres flujos sobre tramos consecutivos de `span` bytes; al final se corre
+// cada suma parcial sobre el tramo siguiente y se combinan
+__attribute__((target("sse4.2")))
+static u32 crc32c_sse42(u32 c, const unsigned char *p, size_t n) {
+    while (n && ((uintptr_t)p & 7)) {
+        c = _mm_crc32_u8(c, *p++);
+        n--;
+    }
+    u64 c0 = c;
+    while (n >= 3 * CRC32C_LONG) {
+        u64 c1 = 0, c2 = 0;
+        for (const unsigned char *end = p + CRC32C_LONG; p < end; p += 8) {
+            c0 = _mm_crc32_u64(c0, *(const u64*)p);
+            c1 = _mm_crc32_u64(c1, *(const u64*)(p + CRC32C_LONG));
+            c2 = _mm_crc32_u64(c2, *(const u64*)(p + 2 * CRC32C_LONG));
+        }
+        c0 = crc_shift(crc_long, (u32)c0) ^ c1;
+        c0 = crc_shift(crc_long, (u32)c0) ^ c2;
+        p += 2 * CRC32C_LONG;
+        n -= 3 * CRC32C_LONG;
+    }
+    while (n >= 3 * CRC32C_SHORT) {
+        u64 c1 = 0, c2 = 0;
+        for (const unsigned char *end = p + CRC32C_SHORT; p < end; p += 8) {
+            c0 = _mm_crc32_u64(c0, *(const u64*)p);
+            c1 = _mm_crc32_u64(c1, *(const u64*)(p + CRC32C_SHORT));
+            c2 = _mm_crc32_u64(c2, *(const u64*)(p + 2 * CRC32C_SHORT));
+        }
+        c0 = crc_shift(crc_short, (u32)c0) ^ c1;
+        c0 = crc_shift(crc_short, (u32)c0) ^ c2;
+        p += 2 * CRC32C_SHORT;
+        n -= 3 * CRC32C_SHORT;
+    }
+    for (; n >= 8; p += 8, n -= 8) c0 = _mm_crc32_u64(c0, *(const u64*)p);
+    c = (u32)c0;
+    while (n--) c = _mm_crc32_u8(c, *p++);
+    return c;
+}
+#endif
+
+u32 csum_crc32c(u32 crc, const void *buf, size_t len) {
+    pthread_once(&crc_once, crc_init);
+    const unsigned char *p = (const unsigned char*)buf;
+#ifdef CSUM_X86
+    if (use_sse42 && want_simd) return ~crc32c_sse42(~crc, p, len);
+#endif
+    return ~crc32c_slice8(~crc, p, len);
+}
+
+void csum_set_simd(int enable) {
+    want_simd = enable;
+}
+
+const char *csum_impl(void) {
+    pthread_once(&crc_once, crc_init);
+    return (use_sse42 && want_simd) ? "sse4.2 x3" : "slicing-by-8";
+}
+
+// ---- Tabla ----
+
+static u32 *table = NULL;          // una entrada por bloque, little-endian como en disco
+static u64 *dirty = NULL;          // bloques de la tabla cambiados desde el último csum_store
+static u32 t_start, t_blocks, t_total, t_bs;
+static u32 j_start, j_blocks;      // diario (fuera de la tabla)
+static int policy = CSUM_VERIFY_ALWAYS;
+static csum_stats stats;
+
+static void count(unsigned long long *field) {
+    __atomic_fetch_add(field, 1, __ATOMIC_RELAXED);
+}
+
+void csum_close(void) {
+    free(table);
+    free(dirty);
+    table = NULL;
+    dirty = NULL;
+}
+
+int csum_active(void) {
+    return table != NULL;
+}
+
+static int setup(const superblock *sb) {
+    if ((u64)sb->csum_start + sb->csum_blocks > sb->total_blocks ||
+        (u64)sb->csum_blocks * sb->blocksize < (u64)sb->total_blocks * 4) {
+        fprintf(stderr, "Región de sumas inválida (start=%u, blocks=%u)\n", sb->csum_start, sb->csum_blocks);
+        errno = EINVAL;
+        return -1;
+    }
+    csum_close();
+    table = (u32*)calloc((size_t)sb->csum_blocks * sb->blocksize, 1);
+    dirty = (u64*)calloc((sb->csum_blocks + 63) / 64, sizeof(u64));
+    if (!table || !dirty) {
+        csum_close();
+        errno = ENOMEM;
+        return -1;
+    }
+    t_start = sb->csum_start;
+    t_blocks = sb->csum_blocks;
+    t_total = sb->total_blocks;
+    t_bs = sb->blocksize;
+    j_start = (sb->features & QRFS_FEAT_JOURNAL) ? sb->journal_start : 0;
+    j_blocks = (sb->features & QRFS_FEAT_JOURNAL) ? sb->journal_blocks : 0;
+    return 0;
+}
+
+int csum_init(const superblock *sb) {
+    return setup(sb);
+}
+
+int csum_load(const char *folder, const superblock *sb) {
+    if (setup(sb) != 0) return -1;
+    if (read_blocks(folder, t_start, t_blocks, (unsigned char*)table, t_bs) != 0) {
+        fprintf(stderr, "Error leyendo la tabla de sumas\n");
+        csum_close();
+        return -1;
+    }
+    return 0;
+}
+
+int csum_store(const char *folder) {
+    if (!table) return 0;
+    u32 per_block = t_bs / 4;
+    for (u32 w = 0; w < (t_blocks + 63) / 64; w++) {
+        u64 bits = __atomic_exchange_n(&dirty[w], 0, __ATOMIC_ACQ_REL);
+        while (bits) {
+            u32 k = w * 64 + (u32)__builtin_ctzll(bits);
+            bits &= bits - 1;
+            if (write_block(folder, t_start + k, table + (size_t)k * per_block, t_bs) != 0) {
+                // Lo que no se escribió vuelve a quedar pendiente
+                __atomic_fetch_or(&dirty[w], bits | (1ull << (k & 63)), __ATOMIC_RELAXED);
+                return -1;
+            }
+            count(&stats.stored);
+        }
+    }
+    return 0;
+}
+
+int csum_covers(u32 index) {
+    return table && index < t_total &&
+           (index < t_start || index - t_start >= t_blocks) &&
+           (index < j_start || index - j_start >= j_blocks);
+}
+
+void csum_update(u32 index, const void *buf, u32 block_size) {
+    if (block_size != t_bs || !csum_covers(index)) return;
+    u32 crc = csum_crc32c(0, buf, block_size);
+    u32 k = index / (t_bs / 4);
+    __atomic_store_n(&table[index], htole32(crc), __ATOMIC_RELAXED);
+    __atomic_fetch_or(&dirty[k / 64], 1ull << (k & 63), __ATOMIC_RELEASE);
+    count(&stats.updated);
+}
+
+int csum_check(u32 index, const void *buf, u32 block_size) {
+    if (block_size != t_bs || !csum_covers(index)) return 0;
+    u32 want = le32toh(__atomic_load_n(&table[index], __ATOMIC_RELAXED));
+    return want != 0 && csum_crc32c(0, buf, block_size) != want;
+}
+
+int csum_verify(u32 index, const void *buf, u32 block_size) {
+    if (block_size != t_bs || !csum_covers(index)) return 0;
+    u32 want = le32toh(__atomic_load_n(&table[index], __ATOMIC_RELAXED));
+    if (want == 0) {
+        count(&stats.unknown);
+        return 0;
+    }
+    count(&stats.verified);
+    u32 got = csum_crc32c(0, buf, block_size);
+    if (got == want) return 0;
+    count(&stats.failures);
+    fprintf(stderr, "Suma incorrecta en el bloque %u (esperada %08x, leída %08x)\n", index, want, got);
+    errno = EIO;
+    return -1;
+}
+
+// Por tandas de bloques contiguos, sin verificar lo que se lee
+int csum_rebuild(const char *folder) {
+    if (!table) return 0;
+    enum { RUN = 64 };
+    unsigned char *buf = (unsigned char*)malloc((size_t)RUN * t_bs);
+    if (!buf) { errno = ENOMEM; return -1; }
+    int saved = policy, rc = 0;
+    policy = CSUM_VERIFY_OFF;
+    for (u32 b = 0; b < t_total && rc == 0; b += RUN) {
+        u32 n = t_total - b < RUN ? t_total - b : RUN;
+        rc = read_blocks(folder, b, n, buf, t_bs);
+        for (u32 i = 0; i < n && rc == 0; i++) csum_update(b + i, buf + (size_t)i * t_bs, t_bs);
+    }
+    policy = saved;
+    free(buf);
+    return rc == 0 ? csum_store(folder) : rc;
+}
+
+void csum_set_policy(int p) {
+    policy = p;
+}
+
+int csum_policy(void) {
+    return policy;
+}
+
+static const char *policy_names[] = {"always", "metadata", "off"};
+
+const char *csum_policy_name(int p) {
+    return p >= 0 && p <= CSUM_VERIFY_OFF ? policy_names[p] : "desconocida";
+}
+
+int csum_parse_policy(const char *name) {
+    for (int p = 0; p <= CSUM_VERIFY_OFF; p++) {
+        if (strcmp(name, policy_names[p]) == 0) return p;
+    }
+    return -1;
+}
+
+void csum_get_stats(csum_stats *out) {
+    *out = stats;
+}
@@ -0,0 +1,59 @@
+#ifndef CSUM_H
+#define CSUM_H
+#include "fs_basic.h"
+#include <stddef.h>
+
+// Sumas CRC32C por bloque (QRFS_FEAT_CHECKSUMS). La tabla es una región del
+// layout que reserva mkfs, csum_start/csum_blocks, con un u32 little-endian
+// por bloque del volumen. Se tiene entera en memoria: block.c la actualiza en
+// cada escritura y comprueba las lecturas según la política; los bloques de
+// la tabla que cambiaron se escriben en block_flush (el mismo punto de
+// persistencia que los datos).
+//
+// Una entrada en 0 es "sin suma" (bloque nunca escrito desde mkfs) y no se
+// verifica. La tabla y el diario, que tiene su propia suma por commit, quedan
+// fuera. Lo escrito después del último flush puede quedar con la suma vieja
+// tras una caída: fsck lo reporta y --fix-checksums rehace la tabla.
+
+// Qué lecturas se comprueban (fsops_options.verify)
+#define CSUM_VERIFY_ALWAYS   0   // todo lo que se lee del backend
+#define CSUM_VERIFY_METADATA 1   // solo read_block (caches, diario): superbloque, bitmaps, inodos, directorios, índices
+#define CSUM_VERIFY_OFF      2   // la tabla se mantiene pero no se comprueba nada
+
+typedef struct csum_stats {
+    unsigned long long updated;    // bloques escritos con su suma
+    unsigned long long verified;   // lecturas comprobadas
+    unsigned long long unknown;    // lecturas de bloques sin suma
+    unsigned long long failures;   // sumas que no coinciden
+    unsigned long long stored;     // bloques de la tabla escritos
+} csum_stats;
+
+// CRC32C (Castagnoli): instrucción crc32 de SSE4.2 en tres flujos si la CPU
+// la tiene; si no (o con enable = 0), slicing-by-8
+u32  csum_crc32c(u32 crc, const void *buf, size_t len);
+void csum_set_simd(int enable);
+const char *csum_impl(void);
+
+int  csum_init(const superblock *sb);                       // tabla nueva en cero (mkfs)
+int  csum_load(const char *folder, const superblock *sb);   // lee la tabla del volumen
+int  csum_store(const char *folder);                        // escribe los bloques de la tabla que cambiaron
+void csum_close(void);                                      // descarta la tabla (sin escribir)
+int  csum_active(void);
+// Recalcula la suma de todos los bloques desde lo que hay en disco
+int  csum_rebuild(const char *folder);
+
+void csum_set_policy(int policy);
+int  csum_policy(void);
+const char *csum_policy_name(int policy);
+int  csum_parse_policy(const char *name);                   // -1 si no es una política
+
+// Los llama block.c con bloques enteros; no hacen nada sin tabla, con otro
+// tamaño o fuera de la región cubierta
+void csum_update(u32 index, const void *buf, u32 block_size);
+int  csum_verify(u32 index, const void *buf, u32 block_size);   // -1 con errno = EIO si no coincide
+int  csum_check(u32 index, const void *buf, u32 block_size);    // 1 = no coincide (sin mensaje ni estadística)
+int  csum_covers(u32 index);
+
+void csum_get_stats(csum_stats *out);
+
+#endif
@@ -0,0 +1,207 @@
+#include "dcache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+// Tabla hash encadenada por índice sobre un arreglo fijo de slots (como la
+// cache de bloques) y una lista doblemente enlazada para el orden LRU.
+typedef struct dc_slot {
+    u32 parent;
+    u32 inode_id;
+    int valid;
+    int negative;
+    int hnext;              // siguiente en la cadena del bucket, -1 = fin
+    int prev, next;         // lista LRU (lru_head = más reciente)
+    unsigned char len;
+    char name[DCACHE_NAME_INLINE];
+} dc_slot;
+
+static dc_slot *slots = NULL;
+static int *buckets = NULL;
+static u32 nslots = 0;
+static u32 nbuckets = 0;
+static int lru_head = -1, lru_tail = -1;
+static int free_list = -1;
+static char dc_folder[512];
+static dcache_stats stats;
+
+static u32 hash_of(u32 parent, const char *name, size_t len) {
+    u32 h = 2166136261u ^ (parent * 2654435761u);
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)name[i];
+        h *= 16777619u;
+    }
+    return h & (nbuckets - 1);
+}
+
+int dcache_init(size_t budget_bytes) {
+    dcache_shutdown();
+    u32 n = (u32)(budget_bytes / sizeof(dc_slot));
+    if (n < 16) n = 16;
+    u32 nb = 1;
+    while (nb < n) nb <<= 1;
+
+    slots = (dc_slot*)calloc(n, sizeof(dc_slot));
+    buckets = (int*)malloc(sizeof(int) * nb);
+    if (!slots || !buckets) {
+        free(slots); free(buckets);
+        slots = NULL; buckets = NULL;
+        errno = ENOMEM;
+        return -1;
+    }
+    nslots = n;
+    nbuckets = nb;
+    dc_folder[0] = '\0';
+    dcache_clear();
+    return 0;
+}
+
+void dcache_shutdown(void) {
+    free(slots); free(buckets);
+    slots = NULL; buckets = NULL;
+    nslots = nbuckets = 0;
+    lru_head = lru_tail = free_list = -1;
+}
+
+void dcache_clear(void) {
+    if (!slots) return;
+    for (u32 i = 0; i < nbuckets; i++) buckets[i] = -1;
+    for (u32 s = 0; s < nslots; s++) {
+        slots[s].valid = 0;
+        slots[s].next = (s + 1 < nslots) ? (int)s + 1 : -1;
+    }
+    free_list = 0;
+    lru_head = lru_tail = -1;
+}
+
+// Prepara la cache para esta carpeta; cambiar de volumen la vacía
+static int bind(const char *folder) {
+    if (!slots && dcache_init(DCACHE_DEFAULT_BUDGET) != 0) return -1;
+    if (strcmp(dc_folder, folder) != 0) {
+        dcache_clear();
+        snprintf(dc_folder, sizeof(dc_folder), "%s", folder);
+    }
+    return 0;
+}
+
+static void lru_unlink(int s) {
+    if (slots[s].prev >= 0) slots[slots[s].prev].next = slots[s].next;
+    else lru_head = slots[s].next;
+    if (slots[s].next >= 0) slots[slots[s].next].prev = slots[s].prev;
+    else lru_tail = slots[s].prev;
+}
+
+static void lru_push_front(int s) {
+    slots[s].prev = -1;
+    slots[s].next = lru_head;
+    if (lru_head >= 0) slots[lru_head].prev = s;
+    lru_head = s;
+    if (lru_tail < 0) lru_tail = s;
+}
+
+static int find(u32 parent, const char *name, size_t len, u32 *bucket) {
+    *bucket = hash_of(parent, name, len);
+    for (int s = buckets[*bucket]; s >= 0; s = slots[s].hnext) {
+        if (slots[s].parent == parent && slots[s].len == len && memcmp(slots[s].name, name, len) == 0) return s;
+    }
+    return -1;
+}
+
+static void drop(int s) {
+    u32 b = hash_of(slots[s].parent, slots[s].name, slots[s].len);
+    int *p = &buckets[b];
+    while (*p >= 0 && *p != s) p = &slots[*p].hnext;
+    if (*p == s) *p = slots[s].hnext;
+    lru_unlink(s);
+    slots[s].valid = 0;
+    slots[s].next = free_list;
+    free_list = s;
+}
+
+static void insert(const char *folder, u32 parent, const char *name, u32 inode_id, int negative) {
+    size_t len = strlen(name);
+    if (len >= DCACHE_NAME_INLINE || bind(folder) != 0) return;
+    u32 b;
+    int s = find(parent, name, len, &b);
+    if (s >= 0) {
+        lru_unlink(s);
+    } else {
+        if (free_list < 0) {          // desalojar la menos usada
+            drop(lru_tail);
+            stats.evictions++;
+        }
+        s = free_list;
+        free_list = slots[s].next;
+        slots[s].parent = parent;
+        slots[s].len = (unsigned char)len;
+        memcpy(slots[s].name, name, len);
+        slots[s].valid = 1;
+        slots[s].hnext = buckets[b];
+        buckets[b] = s;
+    }
+    slots[s].inode_id = inode_id;
+    slots[s].negative = negative;
+    lru_push_front(s);
+}
+
+int dcache_lookup(const char *folder, u32 parent, const char *name, u32 *inode_id) {
+    size_t len = strlen(name);
+    if (len >= DCACHE_NAME_INLINE || bind(folder) != 0) return DCACHE_MISS;
+    u32 b;
+    int s = find(parent, name, len, &b);
+    if (s < 0) {
+        stats.misses++;
+        return DCACHE_MISS;
+    }
+    lru_unlink(s);
+    lru_push_front(s);
+    if (slots[s].negative) {
+        stats.negative_hits++;
+        return DCACHE_NEGATIVE;
+    }
+    stats.hits++;
+    if (inode_id) *inode_id = slots[s].inode_id;
+    return DCACHE_HIT;
+}
+
+void dcache_add(const char *folder, u32 parent, const char *name, u32 inode_id) {
+    insert(folder, parent, name, inode_id, 0);
+}
+
+void dcache_add_negative(const char *folder, u32 parent, const char *name) {
+    insert(folder, parent, name, 0, 1);
+}
+
+void dcache_invalidate(const char *folder, u32 parent, const char *name) {
+    if (!slots || strcmp(dc_folder, folder) != 0) return;
+    u32 b;
+    int s = find(parent, name, strlen(name), &b);
+    if (s < 0) return;
+    drop(s);
+    stats.invalidations++;
+}
+
+// Olvida todos los nombres bajo un directorio (al borrarlo o reemplazarlo)
+void dcache_invalidate_dir(const char *folder, u32 parent) {
+    if (!slots || strcmp(dc_folder, folder) != 0) return;
+    for (u32 s = 0; s < nslots; s++) {
+        if (slots[s].valid && slots[s].parent == parent) {
+            drop((int)s);
+            stats.invalidations++;
+        }
+    }
+}
+
+void dcache_get_stats(dcache_stats *out) {
+    *out = stats;
+}
+
+double dcache_hit_rate(void) {
+    unsigned long long hit = stats.hits + stats.negative_hits, total = hit + stats.misses;
+    return total ? (double)hit / (double)total : 0.0;
+}
+
+u32 dcache_capacity(void) {
+    return nslots;
+}
@@ -0,0 +1,38 @@
+#ifndef DCACHE_H
+#define DCACHE_H
+#include "fs_basic.h"
+#include <stddef.h>
+
+// Cache de nombres (padre, nombre) -> inodo, con entradas negativas para
+// nombres que no existen. Memoria acotada, desalojo LRU.
+#define DCACHE_DEFAULT_BUDGET (256u * 1024u)
+#define DCACHE_NAME_INLINE    52    // nombres más largos no se cachean
+
+// Resultado de dcache_lookup
+#define DCACHE_MISS     0
+#define DCACHE_HIT      1
+#define DCACHE_NEGATIVE 2
+
+typedef struct dcache_stats {
+    unsigned long long hits;
+    unsigned long long negative_hits;
+    unsigned long long misses;
+    unsigned long long evictions;
+    unsigned long long invalidations;
+} dcache_stats;
+
+int  dcache_init(size_t budget_bytes);
+void dcache_shutdown(void);
+
+int  dcache_lookup(const char *folder, u32 parent, const char *name, u32 *inode_id);
+void dcache_add(const char *folder, u32 parent, const char *name, u32 inode_id);
+void dcache_add_negative(const char *folder, u32 parent, const char *name);
+void dcache_invalidate(const char *folder, u32 parent, const char *name);
+void dcache_invalidate_dir(const char *folder, u32 parent);
+void dcache_clear(void);
+
+void   dcache_get_stats(dcache_stats *out);
+double dcache_hit_rate(void);
+u32    dcache_capacity(void);
+
+#endif
@@ -0,0 +1,273 @@
+#define _DEFAULT_SOURCE
+#include "dedup.h"
+#include "block.h"
+#include "bcache.h"
+#include "bitmaps.h"
+#include "fs_utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <endian.h>
+
+// ---- Hash (xxHash64, semilla 0) ----
+
+#define P1 0x9E3779B185EBCA87ull
+#define P2 0xC2B2AE3D27D4EB4Full
+#define P3 0x165667B19E3779F9ull
+#define P4 0x85EBCA77C2B2AE63ull
+#define P5 0x27D4EB2F165667C5ull
+
+static u64 rotl(u64 x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+// Little-endian en cualquier host: el hash queda en disco
+static u64 rd64(const unsigned char *p) {
+    u64 v;
+    memcpy(&v, p, 8);
+    return le64toh(v);
+}
+
+static u64 mix(u64 acc, u64 in) {
+    acc += in * P2;
+    return rotl(acc, 31) * P1;
+}
+
+static u64 merge(u64 h, u64 v) {
+    h ^= mix(0, v);
+    return h * P1 + P4;
+}
+
+u64 dedup_hash(const void *buf, u32 len) {
+    const unsigned char *p = (const unsigned char*)buf, *end = p + len;
+    u64 h;
+    if (len >= 32) {
+        u64 v1 = P1 + P2, v2 = P2, v3 = 0, v4 = 0 - P1;
+        for (; p + 32 <= end; p += 32) {
+            v1 = mix(v1, rd64(p));
+            v2 = mix(v2, rd64(p + 8));
+            v3 = mix(v3, rd64(p + 16));
+            v4 = mix(v4, rd64(p + 24));
+        }
+        h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        h = merge(merge(merge(merge(h, v1), v2), v3), v4);
+    } else {
+        h = P5;
+    }
+    h += len;
+    for (; p + 8 <= end; p += 8) h = rotl(h ^ mix(0, rd64(p)), 27) * P1 + P4;
+    for (; p < end; p++) h = rotl(h ^ (*p * P5), 11) * P1;
+    h ^= h >> 33;
+    h *= P2;
+    h ^= h >> 29;
+    h *= P3;
+    h ^= h >> 32;
+    return h ? h : 1;
+}
+
+// ---- Tabla e índice ----
+
+static u64 *hashes = NULL;         // por bloque del volumen
+static u32 *refs = NULL;
+static u64 *dirty = NULL;          // bloques de la tabla cambiados desde el último dedup_store
+static u32 *slots = NULL;          // índice: bloque o 0 (vacío); hash = hashes[bloque]
+static u32 mask;
+static u32 t_start, t_blocks, t_total, t_bs;
+static dedup_stats stats;
+
+void dedup_close(void) {
+    free(hashes); free(refs); free(dirty); free(slots);
+    hashes = NULL; refs = NULL; dirty = NULL; slots = NULL;
+    memset(&stats, 0, sizeof(stats));
+}
+
+int dedup_active(void) {
+    return hashes != NULL;
+}
+
+static int setup(const superblock *sb) {
+    if ((u64)sb->dedup_start + sb->dedup_blocks > sb->total_blocks ||
+        (u64)sb->dedup_blocks * sb->blocksize < (u64)sb->total_blocks * DEDUP_RECORD_SIZE) {
+        fprintf(stderr, "Región de deduplicación inválida (start=%u, blocks=%u)\n",
+                sb->dedup_start, sb->dedup_blocks);
+        errno = EINVAL;
+        return -1;
+    }
+    dedup_close();
+    // Carga máxima del índice 1/2: a lo sumo un bloque indexado por bloque del volumen
+    u32 cap = 16;
+    while (cap < 2 * (u64)sb->total_blocks) cap *= 2;
+    hashes = (u64*)calloc(sb->total_blocks, sizeof(u64));
+    refs = (u32*)calloc(sb->total_blocks, sizeof(u32));
+    dirty = (u64*)calloc(BITMAP_WORDS(sb->dedup_blocks), sizeof(u64));
+    slots = (u32*)calloc(cap, sizeof(u32));
+    if (!hashes || !refs || !dirty || !slots) {
+        dedup_close();
+        errno = ENOMEM;
+        return -1;
+    }
+    mask = cap - 1;
+    t_start = sb->dedup_start;
+    t_blocks = sb->dedup_blocks;
+    t_total = sb->total_blocks;
+    t_bs = sb->blocksize;
+    return 0;
+}
+
+static void touch(u32 block) {
+    bitmap_set(dirty, block / (t_bs / DEDUP_RECORD_SIZE));
+}
+
+static void slot_add(u32 block) {
+    u32 i = (u32)hashes[block] & mask;
+    while (slots[i]) i = (i + 1) & mask;
+    slots[i] = block;
+}
+
+// Borrado con corrimiento hacia atrás, para no dejar marcas en el sondeo
+static void slot_remove(u32 block) {
+    u32 i = (u32)hashes[block] & mask;
+    while (slots[i] && slots[i] != block) i = (i + 1) & mask;
+    if (!slots[i]) return;
+    for (u32 j = (i + 1) & mask; slots[j]; j = (j + 1) & mask) {
+        u32 home = (u32)hashes[slots[j]] & mask;
+        // slots[j] puede ocupar el hueco si su posición ideal no cae en (i, j]
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            slots[i] = slots[j];
+            i = j;
+        }
+    }
+    slots[i] = 0;
+}
+
+int dedup_init(const superblock *sb) {
+    return setup(sb);
+}
+
+int dedup_load(const char *folder, const superblock *sb) {
+    if (setup(sb) != 0) return -1;
+    unsigned char *raw = (unsigned char*)malloc((size_t)t_blocks * t_bs);
+    if (!raw) {
+        dedup_close();
+        errno = ENOMEM;
+        return -1;
+    }
+    if (read_blocks(folder, t_start, t_blocks, raw, t_bs) != 0) {
+        fprintf(stderr, "Error leyendo la tabla de deduplicación\n");
+        free(raw);
+        dedup_close();
+        return -1;
+    }
+    for (u32 b = 0; b < t_total; b++) {
+        const unsigned char *r = raw + (size_t)b * DEDUP_RECORD_SIZE;
+        refs[b] = u32le_read(r + 8);
+        if (refs[b] == 0) continue;
+        hashes[b] = rd64(r);
+        // Un hash repetido (no debería pasar) queda con sus referencias pero fuera del índice
+        if (hashes[b] && !dedup_find(hashes[b])) slot_add(b);
+        stats.indexed++;
+        stats.references += refs[b];
+        if (refs[b] > 1) stats.shared++;
+    }
+    free(raw);
+    return 0;
+}
+
+int dedup_store(const char *folder) {
+    if (!hashes) return 0;
+    u32 per = t_bs / DEDUP_RECORD_SIZE;
+    unsigned char *buf = (unsigned char*)malloc(t_bs);
+    if (!buf) { errno = ENOMEM; return -1; }
+    int rc = 0;
+    for (long k = bitmap_find_one(dirty, t_blocks, 0); k >= 0 && rc == 0;
+         k = bitmap_find_one(dirty, t_blocks, (u32)k + 1)) {
+        memset(buf, 0, t_bs);
+        for (u32 i = 0; i < per && (u64)k * per + i < t_total; i++) {
+            u32 b = (u32)k * per + i;
+            unsigned char *r = buf + (size_t)i * DEDUP_RECORD_SIZE;
+            u32le_write((u32)hashes[b], r);
+            u32le_write((u32)(hashes[b] >> 32), r + 4);
+            u32le_write(refs[b], r + 8);
+        }
+        rc = bcache_write(folder, t_start + (u32)k, buf, t_bs);
+        if (rc == 0) {
+            bitmap_clear(dirty, (u32)k);
+            stats.stored++;
+        }
+    }
+    free(buf);
+    return rc;
+}
+
+u32 dedup_find(u64 hash) {
+    if (!hashes) return 0;
+    for (u32 i = (u32)hash & mask; slots[i]; i = (i + 1) & mask) {
+        if (hashes[slots[i]] == hash) return slots[i];
+    }
+    return 0;
+}
+
+u32 dedup_refs(u32 block) {
+    return hashes && block < t_total ? refs[block] : 0;
+}
+
+void dedup_index(u32 block, u64 hash) {
+    if (!hashes || block >= t_total || refs[block] || dedup_find(hash)) return;
+    hashes[block] = hash;
+    refs[block] = 1;
+    slot_add(block);
+    touch(block);
+    stats.indexed++;
+    stats.references++;
+}
+
+void dedup_ref(u32 block) {
+    if (!hashes || block >= t_total || refs[block] == 0) return;
+    if (++refs[block] == 2) stats.shared++;
+    stats.references++;
+    touch(block);
+}
+
+void dedup_forget(u32 block) {
+    if (!hashes || block >= t_total || refs[block] == 0) return;
+    slot_remove(block);
+    if (refs[block] > 1) stats.shared--;
+    stats.indexed--;
+    stats.references -= refs[block];
+    hashes[block] = 0;
+    refs[block] = 0;
+    touch(block);
+}
+
+int dedup_unref(u32 block) {
+    if (!hashes || block >= t_total || refs[block] == 0) return 0;
+    if (refs[block] == 1) {
+        dedup_forget(block);
+        return 0;
+    }
+    if (--refs[block] == 1) stats.shared--;
+    stats.references--;
+    touch(block);
+    return 1;
+}
+
+void dedup_note(int event) {
+    switch (event) {
+    case DEDUP_HIT:       stats.hits++; break;
+    case DEDUP_UNCHANGED: stats.unchanged++; break;
+    case DEDUP_WRITTEN:   stats.written++; break;
+    case DEDUP_COW:       stats.cow++; break;
+    case DEDUP_COLLISION: stats.collisions++; break;
+    }
+}
+
+void dedup_get_stats(dedup_stats *out) {
+    *out = stats;
+}
+
+double dedup_ratio(void) {
+    u64 used = (u64)spblock.total_blocks - spblock.free_blocks - spblock.data_region_start;
+    if (used == 0) return 1.0;
+    return (double)(used + stats.references - stats.indexed) / (double)used;
+}
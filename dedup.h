@@ -0,0 +1,65 @@
+#ifndef DEDUP_H
+#define DEDUP_H
+#include "fs_basic.h"
+
+// Deduplicación de bloques de datos (QRFS_FEAT_DEDUP). La tabla es una
+// región del layout que reserva mkfs, dedup_start/dedup_blocks, con un
+// registro de 16 bytes por bloque del volumen:
+//   [0..7]   hash de 64 bits del contenido, little-endian (0 = sin hash)
+//   [8..11]  referencias desde mapas de archivos
+//   [12..15] reservado (0)
+// Se tiene entera en memoria junto con un índice hash -> bloque (sondeo
+// lineal) que se arma al cargar. Los bloques de la tabla que cambiaron se
+// escriben con superblock_store, por la cache de bloques, así que van en la
+// misma transacción del diario que los bitmaps y los inodos.
+//
+// Solo entran al índice bloques de datos de archivos regulares escritos
+// enteros por file_write. Un bloque con 0 referencias es de un solo dueño
+// fuera del índice (directorios, índices, extents, datos de antes): se
+// libera como siempre. Con 1 referencia está en el índice pero no se
+// comparte; con más, escribirle implica copiarlo (filemap lo hace).
+//
+// Las funciones no son reentrantes: fsops las llama con meta tomado.
+
+#define DEDUP_RECORD_SIZE 16
+
+// Eventos de la escritura, para las estadísticas (dedup_note)
+#define DEDUP_HIT       0   // el bloque ya existía en otro lado: se comparte, no se escribe
+#define DEDUP_UNCHANGED 1   // se reescribió con el mismo contenido: no se escribe
+#define DEDUP_WRITTEN   2   // contenido nuevo, escrito en su bloque
+#define DEDUP_COW       3   // contenido nuevo sobre un bloque compartido: copia a uno propio
+#define DEDUP_COLLISION 4   // mismo hash que un bloque con otro contenido (no se comparte)
+
+typedef struct dedup_stats {
+    unsigned long long hits;
+    unsigned long long unchanged;
+    unsigned long long written;
+    unsigned long long cow;
+    unsigned long long collisions;
+    unsigned long long stored;       // bloques de la tabla escritos
+    u32 indexed;                     // bloques en el índice
+    u32 shared;                      // con más de una referencia
+    unsigned long long references;   // referencias a bloques del índice
+} dedup_stats;
+
+u64  dedup_hash(const void *buf, u32 len);      // nunca 0
+
+int  dedup_init(const superblock *sb);                      // tabla nueva en cero (mkfs)
+int  dedup_load(const char *folder, const superblock *sb);  // lee la tabla y arma el índice
+int  dedup_store(const char *folder);                       // bloques de la tabla que cambiaron
+void dedup_close(void);
+int  dedup_active(void);
+
+u32  dedup_find(u64 hash);                  // bloque del índice con ese hash (0 = ninguno)
+u32  dedup_refs(u32 block);
+void dedup_index(u32 block, u64 hash);      // entra con 1 referencia (si el hash no estaba)
+void dedup_ref(u32 block);                  // una referencia más a un bloque del índice
+int  dedup_unref(u32 block);                // 1 = sigue referenciado, no se libera
+void dedup_forget(u32 block);               // sale del índice (se reescribe en el lugar)
+
+void dedup_note(int event);
+void dedup_get_stats(dedup_stats *out);
+// Bloques de datos lógicos / físicos en uso (1.0 sin nada compartido)
+double dedup_ratio(void);
+
+#endif
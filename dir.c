@@ -1,11 +1,17 @@
-
 #include "fs_basic.h"
 #include "fs_utils.h"
+#include "bcache.h"
+#include "dir.h"
+#include "htree.h"
+#include "filemap.h"
+#include "dcache.h"
+#include "inode.h"
 
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <sys/stat.h>
 
 void init_dir_entry(dir_entry *entry, u32 inode_id, const char *name) {
     entry->inode_id = inode_id;
@@ -13,56 +19,487 @@ void init_dir_entry(dir_entry *entry, u32 inode_id, const char *name) {
     entry->name[sizeof(entry->name)-1] = '\0';
 }
 
-void build_root_dir_block(unsigned char *block, u32 block_size, u32 root_inode) {
-    memset(block, 0, block_size);
-    u32le_write(root_inode, &block[0]);
-    strncpy((char*)&block[4], ".", 256); //los cuatro bytes del inodo mas los 256 del nombre
-    u32le_write(root_inode, &block[264]); //inode en offset 264
-    strncpy((char*)&block[268], "..", 256); //nonmbre de 256 en la posicion 268
+// ---- Formato de las entradas ----
+// Con QRFS_FEAT_PACKED_DIRS cada entrada ocupa lo que necesita su nombre
+// (ver dir.h) y las entradas encadenadas por rec_len cubren todo el bloque.
+// Sin el flag (volúmenes viejos) son slots fijos de 264 bytes con el nombre
+// terminado en '\0'; un slot está libre si su nombre está vacío.
+
+static int packed(void) {
+    return (spblock.features & QRFS_FEAT_PACKED_DIRS) != 0;
 }
 
+static u32 rec_len_read(const unsigned char *p) {
+    u32 v = (u32)p[0] | ((u32)p[1] << 8);
+    return v ? v : 65536;      // 0 = bloque entero de 64 KiB
+}
 
-void list_directory_block(const char *folder, u32 block_size, u32 dir_block_index) {
-    char path[512]; // Construir ruta del bloque
-    snprintf(path, sizeof(path), "%s/block_%04u.png", folder, dir_block_index);
+static void rec_len_write(u32 v, unsigned char *p) {
+    p[0] = (unsigned char)(v & 0xff);
+    p[1] = (unsigned char)((v >> 8) & 0xff);
+}
 
-    FILE *fp = fopen(path, "rb");
-    if (!fp) {
-        fprintf(stderr, "Error abriendo bloque de directorio: %s\n", strerror(errno));
+static void rec_write(unsigned char *p, u32 inode_id, u32 rec_len, const char *name, u32 name_len) {
+    u32le_write(inode_id, &p[0]);
+    rec_len_write(rec_len, &p[4]);
+    p[6] = (unsigned char)name_len;
+    p[7] = 0;
+    memcpy(&p[DIRENT_HEADER], name, name_len);
+    memset(&p[DIRENT_HEADER + name_len], 0, DIRENT_LEN(name_len) - DIRENT_HEADER - name_len);
+}
+
+// Valida la entrada en `off`; devuelve su rec_len o 0 si el bloque está roto
+static u32 rec_check(const unsigned char *block, u32 block_size, u32 off) {
+    if (off + DIRENT_HEADER > block_size) return 0;
+    u32 rl = rec_len_read(&block[off + 4]), nl = block[off + 6];
+    if (rl < DIRENT_HEADER || (rl & 3) || off + rl > block_size || (nl && DIRENT_LEN(nl) > rl)) {
+        fprintf(stderr, "Bloque de directorio corrupto (offset %u, rec_len %u)\n", off, rl);
+        return 0;
+    }
+    return rl;
+}
+
+void build_root_dir_block(unsigned char *block, u32 block_size, u32 root_inode) {
+    memset(block, 0, block_size);
+    if (!packed()) {
+        u32le_write(root_inode, &block[0]);
+        strncpy((char*)&block[4], ".", 256); //los cuatro bytes del inodo mas los 256 del nombre
+        u32le_write(root_inode, &block[264]); //inode en offset 264
+        strncpy((char*)&block[268], "..", 256); //nonmbre de 256 en la posicion 268
         return;
     }
+    // "." ocupa lo justo y ".." se queda con el resto del bloque
+    rec_write(&block[0], root_inode, DIRENT_LEN(1), ".", 1);
+    rec_write(&block[DIRENT_LEN(1)], root_inode, block_size - DIRENT_LEN(1), "..", 2);
+}
+
+static int print_cb(u32 inode_id, const char *name, void *ctx) {
+    size_t *i = (size_t*)ctx;
+    printf("  [%zu] inode=%u, name='%s'\n", (*i)++, inode_id, name);
+    return 0;
+}
 
-    unsigned char *buf = (unsigned char*)malloc(block_size);
+void list_directory_block(const char *folder, u32 block_size, u32 dir_block_index) {
+    const unsigned char *buf = bcache_get(folder, dir_block_index, block_size);
     if (!buf) {
-        fclose(fp);
-        errno = ENOMEM;
-        fprintf(stderr, "Memoria insuficiente\n");
+        fprintf(stderr, "Error leyendo bloque de directorio %u\n", dir_block_index);
         return;
     }
 
-    size_t r = fread(buf, 1, block_size, fp);
-    fclose(fp);
-    if (r != block_size) {
-        free(buf);
-        fprintf(stderr, "Error leyendo bloque (bytes=%zu)\n", r);
-        return;
+    printf("Contenido del directorio (bloque %u):\n", dir_block_index);
+    size_t i = 0;
+    dirblock_iterate(buf, block_size, print_cb, &i);
+
+    bcache_put(buf);
+}
+
+// ---- Bloque de directorio ----
+
+void dirblock_init(unsigned char *block, u32 block_size) {
+    memset(block, 0, block_size);
+    if (packed()) rec_len_write(block_size, &block[4]);   // una sola entrada libre
+}
+
+u32 dirblock_entry_size(u32 name_len) {
+    return packed() ? DIRENT_LEN(name_len) : DIR_ENTRY_SIZE;
+}
+
+// Offset de la entrada con ese nombre (y de la anterior, o -1 si es la primera)
+static int packed_find(const unsigned char *block, u32 block_size, const char *name, int *prev_off) {
+    u32 len = (u32)strlen(name);
+    int prev = -1;
+    for (u32 off = 0, rl; off < block_size; prev = (int)off, off += rl) {
+        if (!(rl = rec_check(block, block_size, off))) break;
+        if (block[off + 6] == len && memcmp(&block[off + DIRENT_HEADER], name, len) == 0) {
+            if (prev_off) *prev_off = prev;
+            return (int)off;
+        }
     }
+    return -1;
+}
 
+int dirblock_find(const unsigned char *block, u32 block_size, const char *name, u32 *inode_id) {
+    if (packed()) {
+        int off = packed_find(block, block_size, name, NULL);
+        if (off >= 0 && inode_id) *inode_id = u32le_read(&block[off]);
+        return off;
+    }
+    for (u32 off = 0; off + DIR_ENTRY_SIZE <= block_size; off += DIR_ENTRY_SIZE) {
+        const char *n = (const char*)&block[off + 4];
+        if (n[0] != '\0' && strncmp(n, name, 256) == 0) {
+            if (inode_id) *inode_id = u32le_read(&block[off]);
+            return (int)off;
+        }
+    }
+    return -1;
+}
 
-    size_t entry_size = 264;
-    size_t max_entries = block_size / entry_size;// Cada entrada ocupa 264 bytes: 4 (inode) + 256 (nombre) + 4 (padding)
+// Usa la primera entrada libre, o el sobrante de una ocupada, donde entre el nombre
+int dirblock_insert(unsigned char *block, u32 block_size, u32 inode_id, const char *name) {
+    if (packed()) {
+        u32 len = (u32)strlen(name), need = DIRENT_LEN(len);
+        for (u32 off = 0, rl; off < block_size; off += rl) {
+            if (!(rl = rec_check(block, block_size, off))) break;
+            u32 nl = block[off + 6], used = nl ? DIRENT_LEN(nl) : 0;
+            if (rl - used < need) continue;
+            if (used) {
+                rec_len_write(used, &block[off + 4]);
+                off += used;
+                rl -= used;
+            }
+            rec_write(&block[off], inode_id, rl, name, len);
+            return 0;
+        }
+        return -1;   // bloque lleno
+    }
+    for (u32 off = 0; off + DIR_ENTRY_SIZE <= block_size; off += DIR_ENTRY_SIZE) {
+        if (block[off + 4] != '\0') continue;
+        memset(&block[off], 0, DIR_ENTRY_SIZE);
+        u32le_write(inode_id, &block[off]);
+        strncpy((char*)&block[off + 4], name, 256);
+        block[off + 4 + DIR_NAME_MAX] = '\0';
+        return 0;
+    }
+    return -1;   // bloque lleno
+}
 
-    printf("Contenido del directorio (bloque %u):\n", dir_block_index);
-    for (size_t i = 0; i < max_entries; i++) {
-        size_t offset = i * entry_size;
-        u32 inode_id = u32le_read(&buf[offset]);
-        const char *name = (const char*)&buf[offset + 4];
+// El espacio de la entrada borrada pasa a la anterior; si es la primera del
+// bloque queda como entrada libre (y absorbe a la siguiente cuando se borre).
+int dirblock_remove(unsigned char *block, u32 block_size, const char *name) {
+    if (packed()) {
+        int prev;
+        int off = packed_find(block, block_size, name, &prev);
+        if (off < 0) return -1;
+        u32 rl = rec_len_read(&block[off + 4]);
+        if (prev >= 0) {
+            rec_len_write(rec_len_read(&block[prev + 4]) + rl, &block[prev + 4]);
+            memset(&block[off], 0, DIRENT_HEADER);
+        } else {
+            u32le_write(0, &block[off]);
+            block[off + 6] = 0;
+        }
+        return 0;
+    }
+    int off = dirblock_find(block, block_size, name, NULL);
+    if (off < 0) return -1;
+    memset(&block[off], 0, DIR_ENTRY_SIZE);
+    return 0;
+}
+
+// Recorre las entradas con offset >= `from`, pasando el offset de cada una.
+// Las entradas no se mueven dentro del bloque (altas y bajas solo cambian
+// rec_len), así que el offset sirve como posición estable.
+typedef int (*dirblock_off_fn)(u32 inode_id, const char *name, u32 off, void *ctx);
+
+static int dirblock_walk(const unsigned char *block, u32 block_size, u32 from, dirblock_off_fn fn, void *ctx) {
+    char name[DIR_NAME_MAX + 1];
+    if (packed()) {
+        for (u32 off = 0, rl; off < block_size; off += rl) {
+            if (!(rl = rec_check(block, block_size, off))) { errno = EIO; return -1; }
+            u32 nl = block[off + 6];
+            if (nl == 0 || off < from) continue;
+            memcpy(name, &block[off + DIRENT_HEADER], nl);
+            name[nl] = '\0';
+            int rc = fn(u32le_read(&block[off]), name, off, ctx);
+            if (rc != 0) return rc;
+        }
+        return 0;
+    }
+    u32 off = (from + DIR_ENTRY_SIZE - 1) / DIR_ENTRY_SIZE * DIR_ENTRY_SIZE;
+    for (; off + DIR_ENTRY_SIZE <= block_size; off += DIR_ENTRY_SIZE) {
+        if (block[off + 4] == '\0') continue;
+        memcpy(name, &block[off + 4], DIR_NAME_MAX);
+        name[DIR_NAME_MAX] = '\0';
+        int rc = fn(u32le_read(&block[off]), name, off, ctx);
+        if (rc != 0) return rc;
+    }
+    return 0;
+}
+
+typedef struct walk_iter {
+    dir_iter_fn fn;
+    void *ctx;
+} walk_iter;
+
+static int walk_iter_cb(u32 inode_id, const char *name, u32 off, void *p) {
+    walk_iter *w = (walk_iter*)p;
+    (void)off;
+    return w->fn(inode_id, name, w->ctx);
+}
+
+int dirblock_iterate(const unsigned char *block, u32 block_size, dir_iter_fn fn, void *ctx) {
+    walk_iter w = {fn, ctx};
+    return dirblock_walk(block, block_size, 0, walk_iter_cb, &w);
+}
+
+// ---- Bloques del directorio ----
+
+u32 dir_nblocks(const inode *dir) {
+    return ceil_div(dir->inode_size, spblock.blocksize);
+}
+
+int dir_map(const char *folder, const inode *dir, u32 logical, u32 *physical) {
+    u32 run;
+    if (filemap_bmap(folder, dir, logical, physical, &run) != 0) return -1;
+    if (*physical == 0) {
+        fprintf(stderr, "Directorio %u: bloque lógico %u sin asignar\n", dir->inode_number, logical);
+        errno = EIO;
+        return -1;
+    }
+    return 0;
+}
+
+// Lee en un solo lote los bloques [first, first + count) del directorio
+// (los que falten en la cache) antes de recorrerlos de a uno
+int dir_prefetch(const char *folder, const inode *dir, u32 first, u32 count) {
+    u32 n = dir_nblocks(dir), phys[DIR_PREFETCH_BLOCKS], k = 0;
+    if (count > DIR_PREFETCH_BLOCKS) count = DIR_PREFETCH_BLOCKS;
+    for (u32 l = first; l < n && l < first + count; l++) {
+        if (dir_map(folder, dir, l, &phys[k]) != 0) return -1;
+        k++;
+    }
+    return k > 1 ? bcache_prefetch(folder, phys, k, spblock.blocksize) : 0;
+}
+
+// Agrega un bloque al final del directorio (el contenido lo escribe el llamador)
+int dir_append_block(const char *folder, inode *dir, u32 *logical, u32 *physical) {
+    u32 n = dir_nblocks(dir), run;
+    if (n >= filemap_max_blocks(dir)) { errno = EFBIG; return -1; }
+    if (filemap_alloc(folder, dir, n, 1, physical, &run) != 0) return -1;
+    dir->inode_size = (n + 1) * spblock.blocksize;
+    *logical = n;
+    return 0;
+}
+
+// ---- Directorio completo ----
+
+static int check_name(const char *name) {
+    size_t len = strlen(name);
+    if (len == 0) { errno = EINVAL; return -1; }
+    if (len > DIR_NAME_MAX) { errno = ENAMETOOLONG; return -1; }
+    return 0;
+}
+
+static int lookup_disk(const char *folder, const inode *dir, const char *name, u32 *inode_id) {
+    if (dir->flags & QRFS_INODE_HTREE) return htree_lookup(folder, dir, name, inode_id);
+
+    u32 n = dir_nblocks(dir), bs = spblock.blocksize;
+    for (u32 l = 0; l < n; l++) {
+        u32 phys;
+        if (l % DIR_PREFETCH_BLOCKS == 0 && dir_prefetch(folder, dir, l, DIR_PREFETCH_BLOCKS) != 0) return -1;
+        if (dir_map(folder, dir, l, &phys) != 0) return -1;
+        const unsigned char *buf = bcache_get(folder, phys, bs);
+        if (!buf) return -1;
+        int off = dirblock_find(buf, bs, name, inode_id);
+        bcache_put(buf);
+        if (off >= 0) return 0;
+    }
+    errno = ENOENT;
+    return -1;
+}
 
-        // Si inode_id == 0 y nombre vacío, asumimos entrada libre
-        if (inode_id == 0 && name[0] == '\0') continue;
+static int add_entry(const char *folder, inode *dir, const char *name, u32 inode_id) {
+    if (dir->flags & QRFS_INODE_HTREE) return htree_insert(folder, dir, name, inode_id);
 
-        printf("  [%zu] inode=%u, name='%s'\n", i, inode_id, name);
+    u32 n = dir_nblocks(dir), bs = spblock.blocksize, phys;
+    unsigned char *buf = (unsigned char*)malloc(bs);
+    if (!buf) { errno = ENOMEM; return -1; }
+    for (u32 l = 0; l < n; l++) {
+        if (dir_map(folder, dir, l, &phys) != 0 || bcache_read(folder, phys, buf, bs) != 0) goto fail;
+        if (dirblock_insert(buf, bs, inode_id, name) == 0) {
+            int rc = bcache_write(folder, phys, buf, bs);
+            free(buf);
+            return rc;
+        }
     }
 
+    // Sin lugar: los directorios grandes pasan a índice hash
+    // (el índice se arma en bloques nuevos: si no hay lugar para eso, se
+    // intenta seguir lineal con un bloque más)
+    if (n >= DIR_INDEX_MIN_BLOCKS) {
+        if (htree_build(folder, dir) == 0) {
+            free(buf);
+            return htree_insert(folder, dir, name, inode_id);
+        }
+        if (errno != ENOSPC) goto fail;
+    }
+
+    u32 logical;
+    if (dir_append_block(folder, dir, &logical, &phys) != 0) goto fail;
+    dirblock_init(buf, bs);
+    dirblock_insert(buf, bs, inode_id, name);
+    int rc = bcache_write(folder, phys, buf, bs);
     free(buf);
+    return rc;
+fail:
+    free(buf);
+    return -1;
+}
+
+static int remove_entry(const char *folder, inode *dir, const char *name) {
+    if (dir->flags & QRFS_INODE_HTREE) return htree_remove(folder, dir, name);
+
+    u32 n = dir_nblocks(dir), bs = spblock.blocksize, phys;
+    unsigned char *buf = (unsigned char*)malloc(bs);
+    if (!buf) { errno = ENOMEM; return -1; }
+    for (u32 l = 0; l < n; l++) {
+        if (dir_map(folder, dir, l, &phys) != 0 || bcache_read(folder, phys, buf, bs) != 0) {
+            free(buf);
+            return -1;
+        }
+        if (dirblock_remove(buf, bs, name) == 0) {
+            int rc = bcache_write(folder, phys, buf, bs);
+            free(buf);
+            return rc;
+        }
+    }
+    free(buf);
+    errno = ENOENT;
+    return -1;
+}
+
+// Búsqueda en disco que deja el resultado (positivo o negativo) en la dcache
+static int lookup_fill(const char *folder, const inode *dir, const char *name, u32 *inode_id) {
+    u32 ino;
+    if (lookup_disk(folder, dir, name, &ino) != 0) {
+        if (errno == ENOENT) dcache_add_negative(folder, dir->inode_number, name);
+        return -1;
+    }
+    dcache_add(folder, dir->inode_number, name, ino);
+    if (inode_id) *inode_id = ino;
+    return 0;
+}
+
+int dir_lookup(const char *folder, const inode *dir, const char *name, u32 *inode_id) {
+    if (check_name(name) != 0) return -1;
+    switch (dcache_lookup(folder, dir->inode_number, name, inode_id)) {
+        case DCACHE_HIT:      return 0;
+        case DCACHE_NEGATIVE: errno = ENOENT; return -1;
+        default:              return lookup_fill(folder, dir, name, inode_id);
+    }
+}
+
+int dir_add(const char *folder, inode *dir, const char *name, u32 inode_id) {
+    if (dir_lookup(folder, dir, name, NULL) == 0) { errno = EEXIST; return -1; }
+    if (errno != ENOENT) return -1;
+    if (add_entry(folder, dir, name, inode_id) != 0) {
+        dcache_invalidate(folder, dir->inode_number, name);
+        return -1;
+    }
+    dcache_add(folder, dir->inode_number, name, inode_id);
+    return 0;
+}
+
+int dir_remove(const char *folder, inode *dir, const char *name) {
+    if (check_name(name) != 0) return -1;
+    if (remove_entry(folder, dir, name) != 0) {
+        dcache_invalidate(folder, dir->inode_number, name);
+        return -1;
+    }
+    dcache_add_negative(folder, dir->inode_number, name);
+    return 0;
+}
+
+// Mueve `src_name` a `dst_name`, reemplazando el destino si existe. Devuelve
+// 1 y el inodo reemplazado en *replaced, 0 si no había destino, -1 en error.
+// Si origen y destino son el mismo directorio hay que pasar el mismo puntero.
+int dir_rename(const char *folder, inode *src, const char *src_name,
+               inode *dst, const char *dst_name, u32 *replaced) {
+    u32 ino, old;
+    if (dir_lookup(folder, src, src_name, &ino) != 0) return -1;
+    int had = dir_lookup(folder, dst, dst_name, &old) == 0;
+    if (!had && errno != ENOENT) return -1;
+    if (had && old == ino) return 0;     // mismo archivo: no hay nada que hacer
+    if (had && dir_remove(folder, dst, dst_name) != 0) return -1;
+    if (dir_add(folder, dst, dst_name, ino) != 0) return -1;
+    if (dir_remove(folder, src, src_name) != 0) return -1;
+    if (had && replaced) *replaced = old;
+    return had;
+}
+
+// Resuelve una ruta absoluta desde la raíz. Los componentes en la dcache no
+// tocan disco; en un fallo se lee el inodo del directorio y se busca en él.
+int dir_resolve(const char *folder, const char *path, u32 *inode_id) {
+    char comp[DIR_NAME_MAX + 1];
+    u32 cur = spblock.root_inode;
+    const char *p = path;
+    for (;;) {
+        while (*p == '/') p++;
+        if (*p == '\0') break;
+        size_t len = strcspn(p, "/");
+        if (len > DIR_NAME_MAX) { errno = ENAMETOOLONG; return -1; }
+        memcpy(comp, p, len);
+        comp[len] = '\0';
+        p += len;
+        if (strcmp(comp, ".") == 0) continue;
+
+        u32 next;
+        int r = dcache_lookup(folder, cur, comp, &next);
+        if (r == DCACHE_NEGATIVE) { errno = ENOENT; return -1; }
+        if (r == DCACHE_MISS) {
+            inode dir;
+            if (inode_read(folder, cur, &dir) != 0) return -1;
+            if ((dir.inode_mode & S_IFMT) != S_IFDIR) { errno = ENOTDIR; return -1; }
+            if (lookup_fill(folder, &dir, comp, &next) != 0) return -1;
+        }
+        cur = next;
+    }
+    *inode_id = cur;
+    return 0;
+}
+
+// Posiciones de un directorio lineal: bit 62, bloque lógico en 32..61 y
+// offset + 1 abajo. Las de uno indexado nunca tienen el bit 62.
+#define DIR_POS_LINEAR (1ull << 62)
+
+typedef struct walk_pos {
+    dir_pos_fn fn;
+    void *ctx;
+    u32 logical;
+} walk_pos;
+
+static int walk_pos_cb(u32 inode_id, const char *name, u32 off, void *p) {
+    walk_pos *w = (walk_pos*)p;
+    return w->fn(inode_id, name, DIR_POS_LINEAR | ((u64)w->logical << 32) | (off + 1), w->ctx);
+}
+
+int dir_iterate_from(const char *folder, const inode *dir, u64 pos, dir_pos_fn fn, void *ctx) {
+    if (dir->flags & QRFS_INODE_HTREE) {
+        // El directorio pasó a índice en medio del listado: la posición ya no
+        // dice nada y se empieza de nuevo (repetir es mejor que saltear)
+        if (pos & DIR_POS_LINEAR) pos = 0;
+        return htree_iterate_from(folder, dir, pos, fn, ctx);
+    }
+
+    u32 n = dir_nblocks(dir), bs = spblock.blocksize;
+    u32 first = (u32)((pos >> 32) & 0x3fffffffu), from = (u32)pos;
+    for (u32 l = first; l < n; l++, from = 0) {
+        u32 phys;
+        if ((l - first) % DIR_PREFETCH_BLOCKS == 0 && dir_prefetch(folder, dir, l, DIR_PREFETCH_BLOCKS) != 0) return -1;
+        if (dir_map(folder, dir, l, &phys) != 0) return -1;
+        const unsigned char *buf = bcache_get(folder, phys, bs);
+        if (!buf) return -1;
+        walk_pos w = {fn, ctx, l};
+        int rc = dirblock_walk(buf, bs, from, walk_pos_cb, &w);
+        bcache_put(buf);
+        if (rc != 0) return rc;
+    }
+    return 0;
+}
+
+int dir_iterate(const char *folder, const inode *dir, dir_iter_fn fn, void *ctx) {
+    if (dir->flags & QRFS_INODE_HTREE) return htree_iterate(folder, dir, fn, ctx);
+
+    u32 n = dir_nblocks(dir), bs = spblock.blocksize;
+    for (u32 l = 0; l < n; l++) {
+        u32 phys;
+        if (l % DIR_PREFETCH_BLOCKS == 0 && dir_prefetch(folder, dir, l, DIR_PREFETCH_BLOCKS) != 0) return -1;
+        if (dir_map(folder, dir, l, &phys) != 0) return -1;
+        const unsigned char *buf = bcache_get(folder, phys, bs);
+        if (!buf) return -1;
+        int rc = dirblock_iterate(buf, bs, fn, ctx);
+        bcache_put(buf);
+        if (rc != 0) return rc;
+    }
+    return 0;
 }
@@ -2,7 +2,64 @@
 #define DIR_H
 #include "fs_basic.h"
 
+// Entradas fijas (volúmenes sin QRFS_FEAT_PACKED_DIRS): 4 (inode) + 256 (nombre) + 4 (padding)
+#define DIR_ENTRY_SIZE 264
+#define DIR_NAME_MAX   255
+
+// Entrada de largo variable (QRFS_FEAT_PACKED_DIRS):
+//  [0..3] inode
+//  [4..5] rec_len: bytes hasta la entrada siguiente (0 = 65536)
+//  [6]    name_len (0 = entrada libre)
+//  [7]    reservado
+//  [8..]  nombre sin '\0', relleno hasta múltiplo de 4
+#define DIRENT_HEADER  8
+#define DIRENT_LEN(name_len) ((DIRENT_HEADER + (u32)(name_len) + 3u) & ~3u)
+
+// Un directorio lineal que crece más allá de estos bloques se convierte a índice hash
+#define DIR_INDEX_MIN_BLOCKS 4
+// Bloques de directorio que se piden juntos al recorrerlo
+#define DIR_PREFETCH_BLOCKS 32
+
+// Callback de recorrido; devolver != 0 corta el recorrido
+typedef int (*dir_iter_fn)(u32 inode_id, const char *name, void *ctx);
+// Igual, con `next`: la posición para retomar después de esta entrada
+typedef int (*dir_pos_fn)(u32 inode_id, const char *name, u64 next, void *ctx);
+
 void init_dir_entry(dir_entry *entry, u32 inode_id, const char *name);
 void build_root_dir_block(unsigned char *block, u32 block_size, u32 root_inode);
 void list_directory_block(const char *folder, u32 block_size, u32 dir_block_index);
-#endif
\ No newline at end of file
+
+// Operaciones sobre un bloque de directorio en memoria
+void dirblock_init(unsigned char *block, u32 block_size);
+u32  dirblock_entry_size(u32 name_len);
+int  dirblock_find(const unsigned char *block, u32 block_size, const char *name, u32 *inode_id);
+int  dirblock_insert(unsigned char *block, u32 block_size, u32 inode_id, const char *name);
+int  dirblock_remove(unsigned char *block, u32 block_size, const char *name);
+int  dirblock_iterate(const unsigned char *block, u32 block_size, dir_iter_fn fn, void *ctx);
+
+// Bloques de un directorio (lógicos 0..n-1)
+u32  dir_nblocks(const inode *dir);
+int  dir_map(const char *folder, const inode *dir, u32 logical, u32 *physical);
+int  dir_prefetch(const char *folder, const inode *dir, u32 first, u32 count);
+int  dir_append_block(const char *folder, inode *dir, u32 *logical, u32 *physical);
+
+// Operaciones sobre el directorio completo (lineal o indexado). Las búsquedas
+// pasan por la dcache y las altas/bajas la mantienen al día. Las que
+// modifican el inodo del directorio dejan al llamador el inode_write.
+int dir_lookup(const char *folder, const inode *dir, const char *name, u32 *inode_id);
+int dir_add(const char *folder, inode *dir, const char *name, u32 inode_id);
+int dir_remove(const char *folder, inode *dir, const char *name);
+int dir_iterate(const char *folder, const inode *dir, dir_iter_fn fn, void *ctx);
+// Recorrido que retoma desde una posición estable (0 = el principio): en un
+// directorio lineal (bloque lógico, offset) y en uno indexado (hash, orden
+// entre los nombres con ese hash). Agregar o borrar otras entradas entre dos
+// llamadas no hace saltear ni repetir las que siguen; la excepción es la
+// conversión a índice en medio de un listado, que lo hace empezar de nuevo.
+int dir_iterate_from(const char *folder, const inode *dir, u64 pos, dir_pos_fn fn, void *ctx);
+int dir_rename(const char *folder, inode *src, const char *src_name,
+               inode *dst, const char *dst_name, u32 *replaced);
+
+// Ruta -> inodo pasando por la dcache. Al borrar un directorio el llamador
+// debe olvidar sus nombres con dcache_invalidate_dir.
+int dir_resolve(const char *folder, const char *path, u32 *inode_id);
+#endif
@@ -0,0 +1,501 @@
+#include "fs_basic.h"
+#include "fs_utils.h"
+#include "extent.h"
+#include "filemap.h"
+#include "bitmaps.h"
+#include "bcache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+// Mapeo por extents: los primeros QRFS_INLINE_EXTENTS viven en el inodo y el
+// resto en una cadena de bloques de extents. Todos ordenados por bloque lógico.
+typedef struct extent_list {
+    qrfs_extent *v;
+    u32 n, cap;
+    u32 *chain;     // bloques de extents que tenía el inodo al cargar
+    u32 nchain;
+} extent_list;
+
+static u32 extents_per_block(void) {
+    return (spblock.blocksize - EXTENT_BLOCK_HEADER) / EXTENT_RECORD_SIZE;
+}
+
+static int list_push(extent_list *l, qrfs_extent e) {
+    if (l->n == l->cap) {
+        u32 cap = l->cap ? l->cap * 2 : 16;
+        qrfs_extent *v = (qrfs_extent*)realloc(l->v, cap * sizeof(qrfs_extent));
+        if (!v) { errno = ENOMEM; return -1; }
+        l->v = v;
+        l->cap = cap;
+    }
+    l->v[l->n++] = e;
+    return 0;
+}
+
+static void list_free(extent_list *l) {
+    free(l->v);
+    free(l->chain);
+    memset(l, 0, sizeof(*l));
+}
+
+static int check_header(const unsigned char *buf, u32 b) {
+    if (buf[0] != 'Q' || buf[1] != 'R' || buf[2] != 'E' || buf[3] != 'X' ||
+        u32le_read(&buf[4]) > extents_per_block()) {
+        fprintf(stderr, "Bloque de extents %u inválido\n", b);
+        errno = EIO;
+        return -1;
+    }
+    return 0;
+}
+
+static int extent_load(const char *folder, const inode *node, extent_list *l) {
+    memset(l, 0, sizeof(*l));
+    for (u32 i = 0; i < QRFS_INLINE_EXTENTS; i++) {
+        if (node->extents[i].length && list_push(l, node->extents[i]) != 0) goto fail;
+    }
+    for (u32 b = node->extent_block; b != 0; ) {
+        if (l->nchain >= spblock.total_blocks) { errno = ELOOP; goto fail; }
+        u32 *chain = (u32*)realloc(l->chain, (l->nchain + 1) * sizeof(u32));
+        if (!chain) { errno = ENOMEM; goto fail; }
+        l->chain = chain;
+        l->chain[l->nchain++] = b;
+
+        const unsigned char *buf = bcache_get(folder, b, spblock.blocksize);
+        if (!buf) goto fail;
+        if (check_header(buf, b) != 0) { bcache_put(buf); goto fail; }
+        u32 count = u32le_read(&buf[4]);
+        u32 next  = u32le_read(&buf[8]);
+        for (u32 i = 0; i < count; i++) {
+            const unsigned char *r = &buf[EXTENT_BLOCK_HEADER + i * EXTENT_RECORD_SIZE];
+            qrfs_extent e = { u32le_read(&r[0]), u32le_read(&r[4]), u32le_read(&r[8]) };
+            if (list_push(l, e) != 0) { bcache_put(buf); goto fail; }
+        }
+        bcache_put(buf);
+        b = next;
+    }
+    return 0;
+fail:
+    list_free(l);
+    return -1;
+}
+
+static int extent_hit(const qrfs_extent *e, u32 logical, u32 *physical, u32 *run) {
+    if (e->length == 0 || logical < e->logical || logical - e->logical >= e->length) return 0;
+    *physical = e->physical + (logical - e->logical);
+    *run = e->length - (logical - e->logical);
+    return 1;
+}
+
+// Traduce un bloque lógico. Si cae en un hueco, physical=0 y run es la
+// distancia hasta el próximo extent (o UINT32_MAX si no hay más).
+int extent_lookup(const char *folder, const inode *node, u32 logical, u32 *physical, u32 *run) {
+    u32 next = UINT32_MAX;
+    for (u32 i = 0; i < QRFS_INLINE_EXTENTS; i++) {
+        const qrfs_extent *e = &node->extents[i];
+        if (extent_hit(e, logical, physical, run)) return 0;
+        if (e->length && e->logical > logical && e->logical < next) next = e->logical;
+    }
+
+    u32 hops = 0;
+    for (u32 b = node->extent_block; b != 0 && next == UINT32_MAX; hops++) {
+        if (hops >= spblock.total_blocks) { errno = ELOOP; return -1; }
+        const unsigned char *buf = bcache_get(folder, b, spblock.blocksize);
+        if (!buf) return -1;
+        if (check_header(buf, b) != 0) { bcache_put(buf); return -1; }
+        u32 count = u32le_read(&buf[4]);
+
+        // Búsqueda binaria del último extent con logical <= buscado
+        u32 lo = 0, hi = count;
+        while (lo < hi) {
+            u32 mid = (lo + hi) / 2;
+            if (u32le_read(&buf[EXTENT_BLOCK_HEADER + mid * EXTENT_RECORD_SIZE]) <= logical) lo = mid + 1;
+            else hi = mid;
+        }
+        if (lo > 0) {
+            const unsigned char *r = &buf[EXTENT_BLOCK_HEADER + (lo - 1) * EXTENT_RECORD_SIZE];
+            qrfs_extent e = { u32le_read(&r[0]), u32le_read(&r[4]), u32le_read(&r[8]) };
+            if (extent_hit(&e, logical, physical, run)) { bcache_put(buf); return 0; }
+        }
+        if (lo < count) next = u32le_read(&buf[EXTENT_BLOCK_HEADER + lo * EXTENT_RECORD_SIZE]);
+        u32 nb = u32le_read(&buf[8]);
+        bcache_put(buf);
+        b = nb;
+    }
+
+    *physical = 0;
+    *run = next == UINT32_MAX ? UINT32_MAX : next - logical;
+    return 0;
+}
+
+// Contenedor de extents: los del inodo (b = 0) o un bloque de la cadena,
+// copiado en `buf`. Cada cambio escribe solo los contenedores que toca.
+typedef struct xnode {
+    u32 b;
+    u32 prev;              // bloque anterior en la cadena (0 = el inodo)
+    unsigned char *buf;
+} xnode;
+
+static u32 x_count(const inode *node, const xnode *x) {
+    if (x->b) return u32le_read(&x->buf[4]);
+    u32 n = 0;
+    while (n < QRFS_INLINE_EXTENTS && node->extents[n].length) n++;
+    return n;
+}
+
+static u32 x_cap(const xnode *x) {
+    return x->b ? extents_per_block() : QRFS_INLINE_EXTENTS;
+}
+
+static u32 x_next(const inode *node, const xnode *x) {
+    return x->b ? u32le_read(&x->buf[8]) : node->extent_block;
+}
+
+static void x_set_next(inode *node, xnode *x, u32 next) {
+    if (x->b) u32le_write(next, &x->buf[8]);
+    else node->extent_block = next;
+}
+
+static qrfs_extent x_get(const inode *node, const xnode *x, u32 i) {
+    if (!x->b) return node->extents[i];
+    const unsigned char *r = &x->buf[EXTENT_BLOCK_HEADER + i * EXTENT_RECORD_SIZE];
+    qrfs_extent e = { u32le_read(&r[0]), u32le_read(&r[4]), u32le_read(&r[8]) };
+    return e;
+}
+
+static void x_put(inode *node, xnode *x, u32 i, qrfs_extent e) {
+    if (!x->b) { node->extents[i] = e; return; }
+    unsigned char *r = &x->buf[EXTENT_BLOCK_HEADER + i * EXTENT_RECORD_SIZE];
+    u32le_write(e.logical,  &r[0]);
+    u32le_write(e.physical, &r[4]);
+    u32le_write(e.length,   &r[8]);
+}
+
+static void x_set_count(inode *node, xnode *x, u32 n) {
+    if (x->b) u32le_write(n, &x->buf[4]);
+    else memset(&node->extents[n], 0, (QRFS_INLINE_EXTENTS - n) * sizeof(qrfs_extent));
+}
+
+static void x_insert_at(inode *node, xnode *x, u32 pos, qrfs_extent e) {
+    u32 n = x_count(node, x);
+    for (u32 i = n; i > pos; i--) x_put(node, x, i, x_get(node, x, i - 1));
+    x_put(node, x, pos, e);
+    if (x->b) x_set_count(node, x, n + 1);
+}
+
+static void x_delete_at(inode *node, xnode *x, u32 pos) {
+    u32 n = x_count(node, x);
+    for (u32 i = pos; i + 1 < n; i++) x_put(node, x, i, x_get(node, x, i + 1));
+    x_set_count(node, x, n - 1);
+}
+
+static int x_load(const char *folder, xnode *x, u32 b, u32 prev) {
+    *x = (xnode){b, prev, NULL};
+    if (!b) return 0;
+    if (!(x->buf = (unsigned char*)malloc(spblock.blocksize))) { errno = ENOMEM; return -1; }
+    if (bcache_read(folder, b, x->buf, spblock.blocksize) != 0 || check_header(x->buf, b) != 0) {
+        free(x->buf);
+        x->buf = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+static int x_write(const char *folder, const xnode *x) {
+    return x->b ? bcache_write(folder, x->b, x->buf, spblock.blocksize) : 0;
+}
+
+static void x_free(xnode *x) {
+    free(x->buf);
+    x->buf = NULL;
+}
+
+// Contenedor donde está (o iría) `logical`: el último cuyo primer extent no
+// lo pasa. *idx queda en el último extent con logical <= buscado (-1 si no hay).
+static int x_locate(const char *folder, const inode *node, u32 logical, xnode *x, long *idx) {
+    u32 found = 0, found_prev = 0, prev = 0, hops = 0;
+    for (u32 b = node->extent_block; b != 0; hops++) {
+        if (hops >= spblock.total_blocks) { errno = ELOOP; return -1; }
+        const unsigned char *buf = bcache_get(folder, b, spblock.blocksize);
+        if (!buf) return -1;
+        if (check_header(buf, b) != 0) { bcache_put(buf); return -1; }
+        u32 count = u32le_read(&buf[4]), next = u32le_read(&buf[8]);
+        u32 first = count ? u32le_read(&buf[EXTENT_BLOCK_HEADER]) : 0;
+        bcache_put(buf);
+        if (count && first > logical) break;
+        if (count) { found = b; found_prev = prev; }
+        prev = b;
+        b = next;
+    }
+    if (x_load(folder, x, found, found_prev) != 0) return -1;
+
+    long lo = 0, hi = (long)x_count(node, x);
+    while (lo < hi) {
+        long mid = (lo + hi) / 2;
+        if (x_get(node, x, (u32)mid).logical <= logical) lo = mid + 1;
+        else hi = mid;
+    }
+    *idx = lo - 1;
+    return 0;
+}
+
+// Bloque nuevo de la cadena con un solo extent, escrito antes de enlazarlo
+static int x_new_block(const char *folder, qrfs_extent e, u32 next, u32 *out) {
+    int b = allocate_block();
+    if (b < 0) { errno = ENOSPC; return -1; }
+    unsigned char *buf = (unsigned char*)calloc(1, spblock.blocksize);
+    if (!buf) { free_block(b); errno = ENOMEM; return -1; }
+    buf[0]='Q'; buf[1]='R'; buf[2]='E'; buf[3]='X';
+    u32le_write(1, &buf[4]);
+    u32le_write(next, &buf[8]);
+    u32le_write(e.logical,  &buf[EXTENT_BLOCK_HEADER]);
+    u32le_write(e.physical, &buf[EXTENT_BLOCK_HEADER + 4]);
+    u32le_write(e.length,   &buf[EXTENT_BLOCK_HEADER + 8]);
+    int rc = bcache_write(folder, (u32)b, buf, spblock.blocksize);
+    free(buf);
+    if (rc != 0) { filemap_release(folder, (u32)b); return -1; }
+    *out = (u32)b;
+    return 0;
+}
+
+// Pone `e` en la posición pos de x. Si no entra: el inodo pasa su último
+// extent al principio de la cadena, y un bloque lleno se parte en dos (se
+// escribe el bloque nuevo y después el que lo enlaza).
+static int x_insert(const char *folder, inode *node, xnode *x, u32 pos, qrfs_extent e) {
+    u32 count = x_count(node, x);
+    if (count < x_cap(x)) {
+        x_insert_at(node, x, pos, e);
+        return x_write(folder, x);
+    }
+    if (!x->b) {
+        qrfs_extent last = pos == count ? e : node->extents[count - 1];
+        int rc;
+        if (node->extent_block) {
+            xnode first;
+            if (x_load(folder, &first, node->extent_block, 0) != 0) return -1;
+            rc = x_insert(folder, node, &first, 0, last);
+            x_free(&first);
+        } else {
+            u32 b;
+            rc = x_new_block(folder, last, 0, &b);
+            if (rc == 0) node->extent_block = b;
+        }
+        if (rc == 0 && pos < count) {
+            x_set_count(node, x, count - 1);
+            x_insert_at(node, x, pos, e);
+        }
+        return rc;
+    }
+
+    int b = allocate_block();
+    if (b < 0) { errno = ENOSPC; return -1; }
+    xnode y = {(u32)b, x->b, (unsigned char*)malloc(spblock.blocksize)};
+    if (!y.buf) { free_block(b); errno = ENOMEM; return -1; }
+    u32 half = count / 2;
+    memcpy(y.buf, x->buf, EXTENT_BLOCK_HEADER);
+    memcpy(&y.buf[EXTENT_BLOCK_HEADER], &x->buf[EXTENT_BLOCK_HEADER + half * EXTENT_RECORD_SIZE],
+           (count - half) * EXTENT_RECORD_SIZE);
+    x_set_count(node, &y, count - half);
+    x_set_count(node, x, half);
+    x_set_next(node, x, (u32)b);
+    if (pos <= half) x_insert_at(node, x, pos, e);
+    else x_insert_at(node, &y, pos - half, e);
+    int rc = x_write(folder, &y);
+    if (rc == 0) rc = x_write(folder, x);
+    if (rc != 0) filemap_release(folder, (u32)b);
+    x_free(&y);
+    return rc;
+}
+
+// Quita el extent pos de x. Un bloque de la cadena que queda vacío se
+// desengancha escribiendo el anterior (`held` si es ese, ya cargado) y
+// después se libera.
+static int x_remove(const char *folder, inode *node, xnode *x, u32 pos, xnode *held) {
+    x_delete_at(node, x, pos);
+    if (!x->b || x_count(node, x) > 0) return x_write(folder, x);
+    u32 next = x_next(node, x);
+    int rc;
+    if (held && held->b == x->prev) {
+        x_set_next(node, held, next);
+        rc = x_write(folder, held);
+    } else {
+        xnode p;
+        if (x_load(folder, &p, x->prev, 0) != 0) return -1;
+        x_set_next(node, &p, next);
+        rc = x_write(folder, &p);
+        x_free(&p);
+    }
+    if (rc == 0) filemap_release(folder, x->b);
+    return rc;
+}
+
+// Agrega un rango nuevo (que no debe solaparse) fusionándolo con sus vecinos
+int extent_insert(const char *folder, inode *node, u32 logical, u32 physical, u32 length) {
+    xnode x, y = {0, 0, NULL};
+    long i;
+    if (x_locate(folder, node, logical, &x, &i) != 0) return -1;
+
+    // Vecino siguiente: en el mismo contenedor o el primero del que sigue
+    int rc = 0;
+    xnode *nx = &x;
+    u32 npos = (u32)(i + 1);
+    if (npos >= x_count(node, &x)) {
+        u32 nb = x_next(node, &x);
+        nx = NULL;
+        if (nb) {
+            if ((rc = x_load(folder, &y, nb, x.b)) != 0) goto out;
+            nx = &y;
+            npos = 0;
+        }
+    }
+    qrfs_extent prev = {0, 0, 0}, next = {0, 0, 0};
+    if (i >= 0) prev = x_get(node, &x, (u32)i);
+    if (nx && npos < x_count(node, nx)) next = x_get(node, nx, npos);
+    int with_prev = prev.length && prev.logical + prev.length == logical &&
+                    prev.physical + prev.length == physical;
+    int with_next = next.length && logical + length == next.logical &&
+                    physical + length == next.physical;
+
+    if (with_prev && with_next) {
+        prev.length += length + next.length;
+        x_put(node, &x, (u32)i, prev);
+        if (nx == &x) {
+            rc = x_remove(folder, node, &x, npos, NULL);
+        } else {
+            rc = x_remove(folder, node, &y, 0, &x);
+            if (rc == 0) rc = x_write(folder, &x);
+        }
+    } else if (with_prev) {
+        prev.length += length;
+        x_put(node, &x, (u32)i, prev);
+        rc = x_write(folder, &x);
+    } else if (with_next) {
+        next.logical = logical;
+        next.physical = physical;
+        next.length += length;
+        x_put(node, nx, npos, next);
+        rc = x_write(folder, nx);
+    } else {
+        qrfs_extent e = { logical, physical, length };
+        rc = x_insert(folder, node, &x, (u32)(i + 1), e);
+    }
+out:
+    x_free(&x);
+    x_free(&y);
+    return rc;
+}
+
+// Cambia el bloque físico de un bloque lógico (mapeado o hueco): parte el
+// extent que lo contiene y lo vuelve a insertar solo. El bloque anterior
+// queda en *old (0 si era hueco) para que el llamador lo libere; si falla,
+// el mapa vuelve a apuntar al anterior.
+int extent_remap(const char *folder, inode *node, u32 logical, u32 physical, u32 *old) {
+    xnode x;
+    long i;
+    *old = 0;
+    if (x_locate(folder, node, logical, &x, &i) != 0) return -1;
+    int rc = 0;
+    qrfs_extent e = i >= 0 ? x_get(node, &x, (u32)i) : (qrfs_extent){0, 0, 0};
+    if (i >= 0 && logical - e.logical < e.length) {
+        u32 off = logical - e.logical;
+        qrfs_extent right = { logical + 1, e.physical + off + 1, e.length - off - 1 };
+        *old = e.physical + off;
+        if (off > 0) {
+            e.length = off;
+            x_put(node, &x, (u32)i, e);
+            rc = x_write(folder, &x);
+        } else if (right.length) {
+            x_put(node, &x, (u32)i, right);
+            rc = x_write(folder, &x);
+            right.length = 0;
+        } else {
+            rc = x_remove(folder, node, &x, (u32)i, NULL);
+        }
+        if (rc == 0 && right.length) rc = extent_insert(folder, node, right.logical, right.physical, right.length);
+    }
+    x_free(&x);
+    if (rc == 0 && extent_insert(folder, node, logical, physical, 1) != 0) {
+        int err = errno;
+        if (*old) extent_insert(folder, node, logical, *old, 1);
+        errno = err;
+        rc = -1;
+    }
+    if (rc != 0) *old = 0;
+    return rc;
+}
+
+static void release_run(const char *folder, qrfs_extent e, u32 from) {
+    for (u32 k = from; k < e.length; k++) filemap_release(folder, e.physical + k);
+}
+
+// Libera todo lo que esté en bloques lógicos >= nblocks: primero se escribe
+// el contenedor cortado (sin siguiente), después se liberan los datos y la
+// cadena que quedó afuera.
+int extent_truncate(const char *folder, inode *node, u32 nblocks) {
+    xnode x;
+    long i;
+    if (x_locate(folder, node, nblocks, &x, &i) != 0) return -1;
+    u32 count = x_count(node, &x), keep = (u32)(i + 1);
+    qrfs_extent cut = i >= 0 ? x_get(node, &x, (u32)i) : (qrfs_extent){0, 0, 0};
+    int partial = i >= 0 && cut.logical < nblocks && cut.logical + cut.length > nblocks;
+    if (i >= 0 && cut.logical == nblocks && cut.length) keep--;
+    if (keep == count && !partial && x_next(node, &x) == 0) { x_free(&x); return 0; }
+
+    qrfs_extent *gone = (qrfs_extent*)malloc((count - keep + 1) * sizeof(qrfs_extent));
+    if (!gone) { x_free(&x); errno = ENOMEM; return -1; }
+    u32 ngone = 0;
+    for (u32 k = keep; k < count; k++) gone[ngone++] = x_get(node, &x, k);
+    u32 rest = x_next(node, &x);
+
+    if (partial) {
+        qrfs_extent e = cut;
+        e.length = nblocks - cut.logical;
+        x_put(node, &x, (u32)i, e);
+    }
+    x_set_count(node, &x, keep);
+    x_set_next(node, &x, 0);
+    int rc, drop_x = x.b && keep == 0;
+    if (drop_x) {
+        xnode p;
+        if ((rc = x_load(folder, &p, x.prev, 0)) == 0) {
+            x_set_next(node, &p, 0);
+            rc = x_write(folder, &p);
+            x_free(&p);
+        }
+    } else {
+        rc = x_write(folder, &x);
+    }
+    if (rc != 0) { free(gone); x_free(&x); return -1; }
+
+    if (partial) release_run(folder, cut, nblocks - cut.logical);
+    for (u32 k = 0; k < ngone; k++) release_run(folder, gone[k], 0);
+    free(gone);
+    if (drop_x) filemap_release(folder, x.b);
+    x_free(&x);
+    for (u32 b = rest, hops = 0; b != 0; hops++) {
+        if (hops >= spblock.total_blocks) { errno = ELOOP; return -1; }
+        const unsigned char *buf = bcache_get(folder, b, spblock.blocksize);
+        if (!buf) return -1;
+        if (check_header(buf, b) != 0) { bcache_put(buf); return -1; }
+        u32 n = u32le_read(&buf[4]), next = u32le_read(&buf[8]);
+        for (u32 k = 0; k < n; k++) {
+            const unsigned char *r = &buf[EXTENT_BLOCK_HEADER + k * EXTENT_RECORD_SIZE];
+            qrfs_extent e = { u32le_read(&r[0]), u32le_read(&r[4]), u32le_read(&r[8]) };
+            release_run(folder, e, 0);
+        }
+        bcache_put(buf);
+        filemap_release(folder, b);
+        b = next;
+    }
+    return 0;
+}
+
+int extent_count(const char *folder, const inode *node, u32 *count, u32 *extra_blocks) {
+    extent_list l;
+    if (extent_load(folder, node, &l) != 0) return -1;
+    *count = l.n;
+    *extra_blocks = l.nchain;
+    list_free(&l);
+    return 0;
+}
@@ -0,0 +1,19 @@
+#ifndef EXTENT_H
+#define EXTENT_H
+#include "fs_basic.h"
+
+// Bloque de extents extra (cuando no alcanzan los 4 del inodo):
+//  [0..3]  magic "QREX"
+//  [4..7]  cantidad de extents en este bloque
+//  [8..11] siguiente bloque de extents (0 = fin)
+//  [12..]  extents de 12 bytes (logical, physical, length), ordenados por logical
+#define EXTENT_BLOCK_HEADER 12
+#define EXTENT_RECORD_SIZE  12
+
+int extent_lookup(const char *folder, const inode *node, u32 logical, u32 *physical, u32 *run);
+int extent_insert(const char *folder, inode *node, u32 logical, u32 physical, u32 length);
+int extent_remap(const char *folder, inode *node, u32 logical, u32 physical, u32 *old);
+int extent_truncate(const char *folder, inode *node, u32 nblocks);
+int extent_count(const char *folder, const inode *node, u32 *count, u32 *extra_blocks);
+
+#endif
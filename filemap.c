@@ -0,0 +1,402 @@
+#include "fs_basic.h"
+#include "fs_utils.h"
+#include "filemap.h"
+#include "extent.h"
+#include "bitmaps.h"
+#include "bcache.h"
+#include "block.h"
+#include "dedup.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+// Los bloques de datos de archivos regulares van directo al backend con
+// read_blocks/write_blocks (rangos contiguos en una sola operación); los
+// metadatos (bloque indirecto, bloques de extents) pasan por la cache.
+// Un archivo con QRFS_INODE_INLINE no tiene bloques: sus datos viven en el
+// registro del inodo hasta que crece más allá de QRFS_INLINE_DATA.
+// Con deduplicación (QRFS_FEAT_DEDUP) los datos se escriben bloque por
+// bloque contra el índice de dedup.c: un bloque puede quedar mapeado en
+// varios archivos, y escribirle a uno compartido lo copia primero.
+
+static u32 ptrs_per_block(void) {
+    return spblock.blocksize / 4;
+}
+
+u32 filemap_max_blocks(const inode *node) {
+    if (node->flags & QRFS_INODE_EXTENTS) return UINT32_MAX;
+    return 12 + ptrs_per_block();
+}
+
+void filemap_release(const char *folder, u32 block) {
+    if (dedup_unref(block)) return;     // lo siguen mapeando otros archivos
+    bcache_discard(folder, block);
+    free_block((int)block);
+}
+
+// Cantidad de punteros consecutivos (físicos contiguos) desde ptrs[i]
+static u32 contiguous(const u32 *ptrs, u32 i, u32 n) {
+    u32 run = 1;
+    while (i + run < n && ptrs[i + run] != 0 && ptrs[i + run] == ptrs[i] + run) run++;
+    return run;
+}
+
+static u32 holes(const u32 *ptrs, u32 i, u32 n) {
+    u32 run = 1;
+    while (i + run < n && ptrs[i + run] == 0) run++;
+    return run;
+}
+
+static int direct_bmap(const char *folder, const inode *node, u32 logical, u32 *physical, u32 *run) {
+    if (logical < 12) {
+        *physical = node->direct[logical];
+        *run = *physical ? contiguous(node->direct, logical, 12) : holes(node->direct, logical, 12);
+        return 0;
+    }
+    u32 idx = logical - 12, per = ptrs_per_block();
+    if (idx >= per) { errno = EFBIG; return -1; }
+    if (node->indirect1 == 0) {
+        *physical = 0;
+        *run = per - idx;
+        return 0;
+    }
+    const unsigned char *buf = bcache_get(folder, node->indirect1, spblock.blocksize);
+    if (!buf) return -1;
+    u32 *ptrs = (u32*)malloc(per * sizeof(u32));
+    if (!ptrs) { bcache_put(buf); errno = ENOMEM; return -1; }
+    for (u32 i = 0; i < per; i++) ptrs[i] = u32le_read(&buf[i * 4]);
+    bcache_put(buf);
+    *physical = ptrs[idx];
+    *run = *physical ? contiguous(ptrs, idx, per) : holes(ptrs, idx, per);
+    free(ptrs);
+    return 0;
+}
+
+int filemap_bmap(const char *folder, const inode *node, u32 logical, u32 *physical, u32 *run) {
+    if (node->flags & QRFS_INODE_INLINE) {      // sin bloques: todo hueco
+        *physical = 0;
+        *run = 1;
+        return 0;
+    }
+    if (node->flags & QRFS_INODE_EXTENTS) return extent_lookup(folder, node, logical, physical, run);
+    return direct_bmap(folder, node, logical, physical, run);
+}
+
+static int set_indirect(const char *folder, inode *node, u32 idx, u32 start, u32 n) {
+    unsigned char *buf = (unsigned char*)calloc(1, spblock.blocksize);
+    if (!buf) { errno = ENOMEM; return -1; }
+    if (node->indirect1 == 0) {
+        int b = allocate_block();
+        if (b < 0) { free(buf); errno = ENOSPC; return -1; }
+        node->indirect1 = (u32)b;
+    } else if (bcache_read(folder, node->indirect1, buf, spblock.blocksize) != 0) {
+        free(buf);
+        return -1;
+    }
+    for (u32 i = 0; i < n; i++) u32le_write(start + i, &buf[(idx + i) * 4]);
+    int rc = bcache_write(folder, node->indirect1, buf, spblock.blocksize);
+    free(buf);
+    return rc;
+}
+
+// Bloque físico siguiente al del lógico anterior, para que el archivo quede contiguo
+static u32 alloc_goal(const char *folder, const inode *node, u32 logical) {
+    u32 prev, prev_run;
+    if (logical > 0 && filemap_bmap(folder, node, logical - 1, &prev, &prev_run) == 0 && prev) return prev + 1;
+    return 0;
+}
+
+// Asigna bloques para el hueco que empieza en `logical` (hasta `want`,
+// recortado al hueco) intentando que queden contiguos al bloque anterior.
+int filemap_alloc(const char *folder, inode *node, u32 logical, u32 want, u32 *physical, u32 *run) {
+    if (node->flags & QRFS_INODE_INLINE) { errno = EINVAL; return -1; }   // antes filemap_uninline
+    u32 cur, gap;
+    if (filemap_bmap(folder, node, logical, &cur, &gap) != 0) return -1;
+    if (cur != 0) { *physical = cur; *run = gap; return 0; }
+    if (want > gap) want = gap;
+    if (want == 0) want = 1;
+
+    // Sin extents no se cruza el límite direct/indirecto en una sola asignación
+    int extents = (node->flags & QRFS_INODE_EXTENTS) != 0;
+    if (!extents && logical < 12 && logical + want > 12) want = 12 - logical;
+
+    u32 got = 0;
+    long start = allocate_run(alloc_goal(folder, node, logical), want, &got);
+    if (start < 0) { errno = ENOSPC; return -1; }
+
+    int rc;
+    if (extents) {
+        rc = extent_insert(folder, node, logical, (u32)start, got);
+    } else if (logical < 12) {
+        for (u32 i = 0; i < got; i++) node->direct[logical + i] = (u32)start + i;
+        rc = 0;
+    } else {
+        rc = set_indirect(folder, node, logical - 12, (u32)start, got);
+    }
+    if (rc != 0) {
+        for (u32 i = 0; i < got; i++) free_block((int)start + (int)i);
+        return -1;
+    }
+    *physical = (u32)start;
+    *run = got;
+    return 0;
+}
+
+// Cambia el bloque físico de `logical` (mapeado o hueco) y libera el anterior
+int filemap_remap(const char *folder, inode *node, u32 logical, u32 physical) {
+    if (node->flags & QRFS_INODE_INLINE) { errno = EINVAL; return -1; }
+    u32 old = 0, run;
+    if (node->flags & QRFS_INODE_EXTENTS) {
+        if (extent_remap(folder, node, logical, physical, &old) != 0) return -1;
+    } else if (logical < 12) {
+        old = node->direct[logical];
+        node->direct[logical] = physical;
+    } else if (direct_bmap(folder, node, logical, &old, &run) != 0 ||
+               set_indirect(folder, node, logical - 12, physical, 1) != 0) {
+        return -1;
+    }
+    if (old) filemap_release(folder, old);
+    return 0;
+}
+
+// Pasa los datos del inodo a un bloque propio. Desde acá el archivo mapea
+// sus bloques como cualquier otro (con extents si el volumen los usa).
+int filemap_uninline(const char *folder, inode *node) {
+    if (!(node->flags & QRFS_INODE_INLINE)) return 0;
+    u32 bs = spblock.blocksize;
+    if (node->inode_size > QRFS_INLINE_DATA) { errno = EIO; return -1; }
+
+    unsigned char data[QRFS_INLINE_DATA];
+    u32 flags = node->flags;
+    memcpy(data, node->inline_data, sizeof(data));
+    memset(node->inline_data, 0, sizeof(node->inline_data));
+    node->flags &= ~QRFS_INODE_INLINE;
+    if (spblock.features & QRFS_FEAT_EXTENTS) node->flags |= QRFS_INODE_EXTENTS;
+    if (node->inode_size == 0) return 0;
+
+    u32 phys, run;
+    unsigned char *buf = (unsigned char*)calloc(1, bs);
+    if (!buf) { errno = ENOMEM; goto fail; }
+    if (filemap_alloc(folder, node, 0, 1, &phys, &run) != 0) goto fail;
+    memcpy(buf, data, node->inode_size);
+    if (write_block(folder, phys, buf, bs) != 0) {
+        filemap_truncate(folder, node, 0);
+        goto fail;
+    }
+    free(buf);
+    return 0;
+fail:
+    free(buf);
+    node->flags = flags;
+    memcpy(node->inline_data, data, sizeof(data));
+    return -1;
+}
+
+// Libera los bloques desde el lógico `nblocks` en adelante
+int filemap_truncate(const char *folder, inode *node, u32 nblocks) {
+    if (node->flags & QRFS_INODE_INLINE) return 0;
+    if (node->flags & QRFS_INODE_EXTENTS) return extent_truncate(folder, node, nblocks);
+
+    for (u32 i = nblocks; i < 12; i++) {
+        if (node->direct[i]) filemap_release(folder, node->direct[i]);
+        node->direct[i] = 0;
+    }
+    if (node->indirect1 == 0) return 0;
+
+    u32 per = ptrs_per_block();
+    u32 first = nblocks > 12 ? nblocks - 12 : 0;
+    unsigned char *buf = (unsigned char*)malloc(spblock.blocksize);
+    if (!buf) { errno = ENOMEM; return -1; }
+    if (bcache_read(folder, node->indirect1, buf, spblock.blocksize) != 0) { free(buf); return -1; }
+    for (u32 i = first; i < per; i++) {
+        u32 b = u32le_read(&buf[i * 4]);
+        if (b) filemap_release(folder, b);
+        u32le_write(0, &buf[i * 4]);
+    }
+    int rc = 0;
+    if (first == 0) {
+        filemap_release(folder, node->indirect1);
+        node->indirect1 = 0;
+    } else {
+        rc = bcache_write(folder, node->indirect1, buf, spblock.blocksize);
+    }
+    free(buf);
+    return rc;
+}
+
+long file_read(const char *folder, const inode *node, u64 offset, void *buf, u32 len) {
+    u32 bs = spblock.blocksize;
+    if (offset >= node->inode_size) return 0;
+    if (offset + len > node->inode_size) len = (u32)(node->inode_size - offset);
+    if (node->flags & QRFS_INODE_INLINE) {
+        if (node->inode_size > QRFS_INLINE_DATA) { errno = EIO; return -1; }
+        memcpy(buf, node->inline_data + offset, len);
+        return (long)len;
+    }
+
+    unsigned char *out = (unsigned char*)buf;
+    unsigned char *tmp = NULL;
+    u64 pos = offset, end = offset + len;
+    while (pos < end) {
+        u32 logical = (u32)(pos / bs), in = (u32)(pos % bs);
+        u32 phys, run;
+        if (filemap_bmap(folder, node, logical, &phys, &run) != 0) goto fail;
+
+        u64 span = (u64)run * bs - in;            // bytes cubiertos por este tramo
+        if (span > end - pos) span = end - pos;
+        if (phys == 0) {
+            memset(out + (pos - offset), 0, (size_t)span);   // hueco
+        } else if (in == 0 && span >= bs) {
+            u32 k = (u32)(span / bs);
+            if (read_blocks(folder, phys, k, out + (pos - offset), bs) != 0) goto fail;
+            span = (u64)k * bs;
+        } else {
+            if (!tmp && !(tmp = (unsigned char*)malloc(bs))) { errno = ENOMEM; goto fail; }
+            if (read_block(folder, phys, tmp, bs) != 0) goto fail;
+            if (span > bs - in) span = bs - in;
+            memcpy(out + (pos - offset), tmp + in, (size_t)span);
+        }
+        pos += span;
+    }
+    free(tmp);
+    return (long)len;
+fail:
+    free(tmp);
+    return -1;
+}
+
+// Un bloque entero en `logical`, que hoy mapea `cur` (0 = hueco). El hash
+// elige un candidato y el contenido decide: si coincide se comparte sin
+// escribir; si no, se escribe en el bloque propio o, si `cur` es compartido,
+// en uno nuevo (copia al modificar). `scratch` es un bloque para comparar.
+static int dedup_block(const char *folder, inode *node, u32 logical, u32 cur,
+                       const unsigned char *data, unsigned char *scratch) {
+    u32 bs = spblock.blocksize;
+    u64 hash = dedup_hash(data, bs);
+    u32 found = dedup_find(hash);
+    if (found) {
+        if (read_block(folder, found, scratch, bs) != 0) return -1;
+        if (memcmp(scratch, data, bs) == 0) {
+            if (found == cur) {
+                dedup_note(DEDUP_UNCHANGED);
+                return 0;
+            }
+            dedup_ref(found);
+            if (filemap_remap(folder, node, logical, found) != 0) {
+                dedup_unref(found);
+                return -1;
+            }
+            dedup_note(DEDUP_HIT);
+            return 0;
+        }
+        dedup_note(DEDUP_COLLISION);
+    }
+
+    u32 phys = cur, run;
+    if (cur && dedup_refs(cur) > 1) {
+        u32 got;
+        long b = allocate_run(alloc_goal(folder, node, logical), 1, &got);
+        if (b < 0) { errno = ENOSPC; return -1; }
+        if (write_block(folder, (u32)b, data, bs) != 0 || filemap_remap(folder, node, logical, (u32)b) != 0) {
+            free_block((int)b);
+            return -1;
+        }
+        phys = (u32)b;
+        dedup_note(DEDUP_COW);
+    } else {
+        if (cur == 0 && filemap_alloc(folder, node, logical, 1, &phys, &run) != 0) return -1;
+        dedup_forget(cur);      // el contenido cambia: sale del índice
+        if (write_block(folder, phys, data, bs) != 0) return -1;
+        dedup_note(DEDUP_WRITTEN);
+    }
+    dedup_index(phys, hash);    // no entra si otro bloque ya tiene el hash
+    return 0;
+}
+
+// file_write con deduplicación. Los bordes parciales se completan con lo que
+// había (o ceros en un hueco) antes de pasar por el índice.
+static long write_dedup(const char *folder, inode *node, u64 offset, const unsigned char *in_buf, u32 len) {
+    u32 bs = spblock.blocksize;
+    unsigned char *tmp = (unsigned char*)malloc(bs), *scratch = (unsigned char*)malloc(bs);
+    u64 pos = offset, end = offset + len;
+    if (!tmp || !scratch) { errno = ENOMEM; goto fail; }
+    while (pos < end) {
+        u32 logical = (u32)(pos / bs), in = (u32)(pos % bs), cur, run;
+        u32 span = end - pos < bs - in ? (u32)(end - pos) : bs - in;
+        if (filemap_bmap(folder, node, logical, &cur, &run) != 0) goto fail;
+        const unsigned char *data = in_buf + (pos - offset);
+        if (span < bs) {
+            if (cur == 0) memset(tmp, 0, bs);
+            else if (read_block(folder, cur, tmp, bs) != 0) goto fail;
+            memcpy(tmp + in, data, span);
+            data = tmp;
+        }
+        if (dedup_block(folder, node, logical, cur, data, scratch) != 0) goto fail;
+        pos += span;
+    }
+    free(tmp);
+    free(scratch);
+    if (end > node->inode_size) node->inode_size = (u32)end;
+    return (long)len;
+fail:
+    free(tmp);
+    free(scratch);
+    if (pos > node->inode_size) node->inode_size = (u32)pos;
+    return -1;
+}
+
+// Escribe y asigna lo que falte; actualiza el tamaño en `node` (el llamador
+// guarda el inodo con inode_write).
+long file_write(const char *folder, inode *node, u64 offset, const void *buf, u32 len) {
+    u32 bs = spblock.blocksize;
+    if (offset + len > UINT32_MAX) { errno = EFBIG; return -1; }
+    if (node->flags & QRFS_INODE_INLINE) {
+        if (offset + len <= QRFS_INLINE_DATA) {
+            memcpy(node->inline_data + offset, buf, len);
+            if (offset + len > node->inode_size) node->inode_size = (u32)(offset + len);
+            return (long)len;
+        }
+        if (filemap_uninline(folder, node) != 0) return -1;
+    }
+    if (dedup_active()) return write_dedup(folder, node, offset, (const unsigned char*)buf, len);
+
+    const unsigned char *in_buf = (const unsigned char*)buf;
+    unsigned char *tmp = NULL;
+    u32 fresh_lo = 0, fresh_hi = 0;   // bloques lógicos asignados en esta llamada
+    u64 pos = offset, end = offset + len;
+    while (pos < end) {
+        u32 logical = (u32)(pos / bs), in = (u32)(pos % bs);
+        u32 phys, run;
+        if (filemap_bmap(folder, node, logical, &phys, &run) != 0) goto fail;
+        if (phys == 0) {
+            u32 want = (u32)((end - (u64)logical * bs + bs - 1) / bs);
+            if (filemap_alloc(folder, node, logical, want, &phys, &run) != 0) goto fail;
+            fresh_lo = logical;
+            fresh_hi = logical + run;
+        }
+
+        u64 span = (u64)run * bs - in;
+        if (span > end - pos) span = end - pos;
+        if (in == 0 && span >= bs) {
+            u32 k = (u32)(span / bs);
+            if (write_blocks(folder, phys, k, in_buf + (pos - offset), bs) != 0) goto fail;
+            span = (u64)k * bs;
+        } else {
+            if (!tmp && !(tmp = (unsigned char*)malloc(bs))) { errno = ENOMEM; goto fail; }
+            if (logical >= fresh_lo && logical < fresh_hi) memset(tmp, 0, bs);
+            else if (read_block(folder, phys, tmp, bs) != 0) goto fail;
+            if (span > bs - in) span = bs - in;
+            memcpy(tmp + in, in_buf + (pos - offset), (size_t)span);
+            if (write_block(folder, phys, tmp, bs) != 0) goto fail;
+        }
+        pos += span;
+    }
+    free(tmp);
+    if (end > node->inode_size) node->inode_size = (u32)end;
+    return (long)len;
+fail:
+    free(tmp);
+    if (pos > node->inode_size) node->inode_size = (u32)pos;
+    return -1;
+}
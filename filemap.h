@@ -0,0 +1,18 @@
+#ifndef FILEMAP_H
+#define FILEMAP_H
+#include "fs_basic.h"
+
+// Traducción bloque lógico -> físico para ambos modos de inodo
+// (direct[12]/indirect1 o extents) y lectura/escritura de datos de archivo.
+int  filemap_bmap(const char *folder, const inode *node, u32 logical, u32 *physical, u32 *run);
+int  filemap_alloc(const char *folder, inode *node, u32 logical, u32 want, u32 *physical, u32 *run);
+int  filemap_truncate(const char *folder, inode *node, u32 nblocks);
+int  filemap_remap(const char *folder, inode *node, u32 logical, u32 physical);
+int  filemap_uninline(const char *folder, inode *node);
+void filemap_release(const char *folder, u32 block);
+u32  filemap_max_blocks(const inode *node);
+
+long file_read(const char *folder, const inode *node, u64 offset, void *buf, u32 len);
+long file_write(const char *folder, inode *node, u64 offset, const void *buf, u32 len);
+
+#endif
@@ -7,19 +7,69 @@
 #include <time.h>
 
 typedef uint32_t u32;
+typedef uint64_t u64;
 
 extern const u32 block_size;              // aqui hay que cambiarlo conforme lo que dijo el profe de los qr
 extern const u32 DEFAULT_TOTAL_BLOCKS;
 extern const u32 DEFAULT_TOTAL_INODES;
 
+// Versión 1: bitmaps de 128 entradas copiados dentro del bloque 0.
+// Versión 2: bitmaps solo en sus regiones, de tantos bloques como haga falta.
+#define QRFS_VERSION 2u
+
+// Flags de features del superbloque (offset 312)
+#define QRFS_FEAT_PACKED_BITMAPS 0x1u   // bitmaps de 1 bit por entrada (antes: bytes '0'/'1')
+#define QRFS_FEAT_FREE_COUNTS    0x2u   // contadores de libres y rotores válidos (offsets 316..331)
+#define QRFS_FEAT_EXTENTS        0x4u   // los inodos nuevos mapean sus datos con extents
+#define QRFS_FEAT_PACKED_DIRS    0x8u   // entradas de directorio de largo variable (rec_len/name_len)
+#define QRFS_FEAT_SPARSE         0x10u  // bloques sin materializar: un bloque ausente se lee como ceros
+#define QRFS_FEAT_JOURNAL        0x20u  // diario de metadatos en journal_start/journal_blocks (offsets 332..339)
+#define QRFS_FEAT_INLINE_DATA    0x40u  // los archivos regulares nuevos guardan sus datos en el inodo mientras entren
+#define QRFS_FEAT_CHECKSUMS      0x80u  // CRC32C por bloque en csum_start/csum_blocks (offsets 340..347)
+#define QRFS_FEAT_DEDUP          0x100u // bloques de datos compartidos por contenido, tabla en dedup_start/dedup_blocks (offsets 348..355)
+
+// Flags del inodo (registro de 128 bytes, offset 76)
+#define QRFS_INODE_EXTENTS 0x1u   // bytes 24..75 = extents + bloque de extents extra
+#define QRFS_INODE_HTREE   0x2u   // directorio con índice hash (bloque lógico 0 = raíz del índice)
+#define QRFS_INODE_INLINE  0x4u   // datos en bytes 24..75 y 80..127, sin bloques
+
+// Bytes de datos que entran en el registro del inodo (52 del mapa + 48 de la cola)
+#define QRFS_INLINE_DATA 100
+
+// Extents guardados dentro del registro del inodo (4 * 12 bytes = 48)
+#define QRFS_INLINE_EXTENTS 4
+
+typedef struct qrfs_extent {
+    u32 logical;    // primer bloque lógico del archivo
+    u32 physical;   // primer bloque físico
+    u32 length;     // cantidad de bloques contiguos
+} qrfs_extent;
+
 typedef struct superblock {
     u32 version;
     u32 blocksize;
     u32 total_blocks;
     u32 total_inodes;
-    char inode_bitmap[128];
-    char data_bitmap[128];
+    u32 features;
+    u64 *inode_bitmap;   // BITMAP_WORDS(total_inodes) palabras
+    u64 *data_bitmap;    // BITMAP_WORDS(total_blocks) palabras
     unsigned int root_inode;
+
+    // Layout en bloques
+    u32 inode_bitmap_start, inode_bitmap_blocks;
+    u32 data_bitmap_start,  data_bitmap_blocks;
+    u32 inode_table_start,  inode_table_blocks;
+    u32 data_region_start;
+    u32 backend;
+    u32 journal_start, journal_blocks;   // solo con QRFS_FEAT_JOURNAL
+    u32 csum_start, csum_blocks;         // solo con QRFS_FEAT_CHECKSUMS
+    u32 dedup_start, dedup_blocks;       // solo con QRFS_FEAT_DEDUP
+
+    // Contabilidad de espacio libre y punto de partida de la próxima búsqueda
+    u32 free_blocks;
+    u32 free_inodes;
+    u32 block_rotor;
+    u32 inode_rotor;
 } superblock;
 
 typedef struct inode {
@@ -32,8 +82,18 @@ typedef struct inode {
     struct timespec last_access_time;
     struct timespec last_modification_time;
     struct timespec metadata_last_change_time;
-    u32   direct[12];
-    u32   indirect1;
+    u32   flags;
+    union {
+        struct {
+            u32 direct[12];
+            u32 indirect1;
+        };
+        struct {                                     // si flags & QRFS_INODE_EXTENTS
+            qrfs_extent extents[QRFS_INLINE_EXTENTS];
+            u32 extent_block;                        // primer bloque de extents extra (0 = ninguno)
+        };
+        unsigned char inline_data[QRFS_INLINE_DATA]; // si flags & QRFS_INODE_INLINE
+    };
 } inode;
 
 typedef struct dir_entry {
@@ -1,5 +1,6 @@
 
 #include "fs_basic.h"
+#include "bitmaps.h"
 #include <string.h>
 #include <unistd.h>
 #include <time.h>
@@ -11,12 +12,12 @@ const u32 DEFAULT_TOTAL_INODES = 10;
 superblock spblock;
 
 void initialize_superblock(void) {
-    spblock.version = 1;
+    spblock.version = QRFS_VERSION;
     spblock.blocksize = block_size;
     spblock.total_blocks = DEFAULT_TOTAL_BLOCKS;
     spblock.total_inodes = DEFAULT_TOTAL_INODES;
-    memset(spblock.data_bitmap,  '0', sizeof(spblock.data_bitmap));
-    memset(spblock.inode_bitmap, '0', sizeof(spblock.inode_bitmap));
+    spblock.features = QRFS_FEAT_PACKED_BITMAPS;
+    bitmaps_init(spblock.total_inodes, spblock.total_blocks);
     spblock.root_inode = 0;
 }
 
@@ -0,0 +1,656 @@
+#include "fs_basic.h"
+#include "fs_utils.h"
+#include "fscheck.h"
+#include "bitmaps.h"
+#include "block.h"
+#include "block_aio.h"
+#include "csum.h"
+#include "dedup.h"
+#include "dir.h"
+#include "extent.h"
+#include "htree.h"
+#include "inode.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/stat.h>
+
+typedef struct checker {
+    const char *folder;
+    u32 bs;
+    u32 ipb;                    // registros por bloque de la tabla
+    u32 table_blocks;           // bloques de la tabla con inodos
+    u64 *claimed;               // bitmap de bloques reconstruido
+    u32 *uses;                  // con dedup: veces que los mapas nombran cada bloque de datos
+    u64 *reached;               // bitmap de inodos reconstruido (alcanzables)
+    u32 *mode;                  // modo de cada inodo válido (0 = libre o inválido)
+    u32 *links;
+    u32 *refs;                  // entradas que nombran a cada inodo
+    u32 *parent;                // directorio donde apareció cada directorio
+    u32 *level, nlevel;         // directorios del nivel que se recorre
+    u32 *next_level, nnext;
+    u32 next;                   // próximo trabajo a repartir (atómico)
+    int error;                  // primer errno de E/S o memoria
+    fscheck_report *r;
+} checker;
+
+static pthread_mutex_t msg_lock = PTHREAD_MUTEX_INITIALIZER;
+static u32 messages;
+
+static void problem(u32 *counter, const char *fmt, ...) {
+    __atomic_fetch_add(counter, 1, __ATOMIC_RELAXED);
+    pthread_mutex_lock(&msg_lock);
+    if (messages++ < FSCHECK_MAX_MESSAGES) {
+        va_list ap;
+        va_start(ap, fmt);
+        fputs("  ", stderr);
+        vfprintf(stderr, fmt, ap);
+        fputc('\n', stderr);
+        va_end(ap);
+    }
+    pthread_mutex_unlock(&msg_lock);
+}
+
+static void fail(checker *ck, int err) {
+    int expected = 0;
+    __atomic_compare_exchange_n(&ck->error, &expected, err ? err : EIO, 0,
+                                __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+static int failed(checker *ck) {
+    return __atomic_load_n(&ck->error, __ATOMIC_RELAXED) != 0;
+}
+
+static int ck_read(checker *ck, u32 start, u32 in_block, void *buf, u32 len) {
+    if (block_pread(ck->folder, start, in_block, buf, len, ck->bs) != 0) {
+        fail(ck, errno);
+        return -1;
+    }
+    __atomic_fetch_add(&ck->r->bytes_read, len, __ATOMIC_RELAXED);
+    return 0;
+}
+
+static int in_data(u32 b) {
+    return b >= spblock.data_region_start && b < spblock.total_blocks;
+}
+
+// ---- Mapa de bloques de un inodo ----
+
+// Se llama por cada bloque del inodo; meta = 1 para el indirecto y los
+// bloques de extents. Devolver != 0 corta el recorrido.
+typedef int (*block_fn)(checker *ck, u32 ino, u32 logical, u32 physical, int meta, void *arg);
+
+static int walk_run(checker *ck, u32 ino, u32 logical, u32 physical, u32 length,
+                    block_fn fn, void *arg) {
+    if (!in_data(physical) || (u64)physical + length > spblock.total_blocks ||
+        (u64)logical + length > UINT32_MAX) {
+        problem(&ck->r->bad_inodes, "Inodo %u: extent (%u, %u, %u) fuera de la región de datos",
+                ino, logical, physical, length);
+        return 1;
+    }
+    for (u32 k = 0; k < length; k++) {
+        int rc = fn(ck, ino, logical + k, physical + k, 0, arg);
+        if (rc != 0) return rc;
+    }
+    return 0;
+}
+
+// 0 = recorrido completo, 1 = mapa inválido (ya reportado), -1 = error de E/S.
+// `buf` (un bloque) se usa para el indirecto y los bloques de extents.
+static int walk_blocks(checker *ck, u32 ino, const inode *node, unsigned char *buf,
+                       block_fn fn, void *arg) {
+    int rc;
+    if (node->flags & QRFS_INODE_INLINE) return 0;      // datos en el registro, sin bloques
+    if (!(node->flags & QRFS_INODE_EXTENTS)) {
+        for (u32 i = 0; i < 12; i++) {
+            if (node->direct[i] == 0) continue;
+            if ((rc = walk_run(ck, ino, i, node->direct[i], 1, fn, arg)) != 0) return rc;
+        }
+        if (node->indirect1 == 0) return 0;
+        if (!in_data(node->indirect1)) {
+            problem(&ck->r->bad_inodes, "Inodo %u: indirecto %u fuera de la región de datos", ino, node->indirect1);
+            return 1;
+        }
+        if ((rc = fn(ck, ino, 0, node->indirect1, 1, arg)) != 0) return rc;
+        if (ck_read(ck, node->indirect1, 0, buf, ck->bs) != 0) return -1;
+        for (u32 i = 0; i < ck->bs / 4; i++) {
+            u32 p = u32le_read(&buf[i * 4]);
+            if (p && (rc = walk_run(ck, ino, 12 + i, p, 1, fn, arg)) != 0) return rc;
+        }
+        return 0;
+    }
+
+    for (u32 i = 0; i < QRFS_INLINE_EXTENTS; i++) {
+        const qrfs_extent *e = &node->extents[i];
+        if (e->length && (rc = walk_run(ck, ino, e->logical, e->physical, e->length, fn, arg)) != 0) return rc;
+    }
+    u32 per = (ck->bs - EXTENT_BLOCK_HEADER) / EXTENT_RECORD_SIZE, hops = 0;
+    for (u32 b = node->extent_block; b != 0; ) {
+        if (!in_data(b) || ++hops > spblock.total_blocks) {
+            problem(&ck->r->bad_inodes, "Inodo %u: cadena de extents inválida en el bloque %u", ino, b);
+            return 1;
+        }
+        if ((rc = fn(ck, ino, 0, b, 1, arg)) != 0) return rc;
+        if (ck_read(ck, b, 0, buf, ck->bs) != 0) return -1;
+        u32 n = u32le_read(&buf[4]);
+        if (memcmp(buf, "QREX", 4) != 0 || n > per) {
+            problem(&ck->r->bad_inodes, "Inodo %u: bloque de extents %u inválido", ino, b);
+            return 1;
+        }
+        for (u32 i = 0; i < n; i++) {
+            const unsigned char *p = &buf[EXTENT_BLOCK_HEADER + i * EXTENT_RECORD_SIZE];
+            u32 length = u32le_read(p + 8);
+            if (length && (rc = walk_run(ck, ino, u32le_read(p), u32le_read(p + 4), length, fn, arg)) != 0) return rc;
+        }
+        b = u32le_read(&buf[8]);
+    }
+    return 0;
+}
+
+// ---- Fase 1: tabla de inodos ----
+
+static int claim(checker *ck, u32 ino, u32 logical, u32 physical, int meta, void *arg) {
+    (void)logical; (void)arg;
+    // Con dedup un bloque de datos puede estar en varios mapas; la fase 3
+    // compara esas veces con sus referencias
+    int shared = ck->uses && !meta && __atomic_fetch_add(&ck->uses[physical], 1, __ATOMIC_RELAXED) > 0;
+    u64 bit = 1ull << (physical & 63);
+    if (__atomic_fetch_or(&ck->claimed[physical >> 6], bit, __ATOMIC_RELAXED) & bit) {
+        if (!shared) problem(&ck->r->duplicate_blocks, "Bloque %u reclamado dos veces (inodo %u)", physical, ino);
+    } else {
+        __atomic_fetch_add(&ck->r->blocks_claimed, 1, __ATOMIC_RELAXED);
+    }
+    return 0;
+}
+
+static void check_inode(checker *ck, u32 id, const unsigned char *rec, unsigned char *buf) {
+    inode node;
+    inode_decode128(rec, &node);
+    u32 type = (u32)node.inode_mode & S_IFMT;
+    if (node.inode_number != id || (type != S_IFDIR && type != S_IFREG)) {
+        problem(&ck->r->bad_inodes, "Inodo %u: registro inválido (número=%u, modo=%o)",
+                id, node.inode_number, (unsigned)node.inode_mode);
+        return;
+    }
+    if ((node.flags & QRFS_INODE_INLINE) && (type != S_IFREG || node.inode_size > QRFS_INLINE_DATA)) {
+        problem(&ck->r->bad_inodes, "Inodo %u: datos en el inodo inválidos (modo=%o, tamaño=%u)",
+                id, (unsigned)node.inode_mode, node.inode_size);
+        return;
+    }
+    // links = 0 es un huérfano (borrado mientras estaba abierto): se valida igual
+    if (walk_blocks(ck, id, &node, buf, claim, NULL) != 0) return;
+    ck->mode[id] = (u32)node.inode_mode;
+    ck->links[id] = node.links_quaintities;
+}
+
+// Una tanda de la tabla de inodos en pedidos de FSCHECK_TABLE_REQ bloques,
+// todos en vuelo a la vez
+static int read_table(checker *ck, u32 first, u32 n, unsigned char *table) {
+    block_req reqs[FSCHECK_BATCH / FSCHECK_TABLE_REQ];
+    u32 k = 0;
+    for (u32 b = 0; b < n; b += FSCHECK_TABLE_REQ, k++) {
+        reqs[k] = (block_req){0};
+        reqs[k].start = spblock.inode_table_start + first + b;
+        reqs[k].buf = table + (size_t)b * ck->bs;
+        reqs[k].len = (n - b < FSCHECK_TABLE_REQ ? n - b : FSCHECK_TABLE_REQ) * ck->bs;
+    }
+    if (block_rw_batch(ck->folder, reqs, k, ck->bs) != 0) {
+        fail(ck, errno);
+        return -1;
+    }
+    __atomic_fetch_add(&ck->r->bytes_read, (unsigned long long)n * ck->bs, __ATOMIC_RELAXED);
+    return 0;
+}
+
+static void *scan_worker(void *arg) {
+    checker *ck = (checker*)arg;
+    unsigned char *table = (unsigned char*)malloc((size_t)FSCHECK_BATCH * ck->bs);
+    unsigned char *buf = (unsigned char*)malloc(ck->bs);
+    if (!table || !buf) fail(ck, ENOMEM);
+
+    while (!failed(ck)) {
+        u32 first = __atomic_fetch_add(&ck->next, FSCHECK_BATCH, __ATOMIC_RELAXED);
+        if (first >= ck->table_blocks) break;
+        u32 n = ck->table_blocks - first < FSCHECK_BATCH ? ck->table_blocks - first : FSCHECK_BATCH;
+        if (read_table(ck, first, n, table) != 0) break;
+        for (u32 k = 0; k < n * ck->ipb; k++) {
+            u32 id = first * ck->ipb + k;
+            if (id >= spblock.total_inodes) break;
+            if (!bitmap_test(spblock.inode_bitmap, id)) continue;
+            __atomic_fetch_add(&ck->r->inodes_used, 1, __ATOMIC_RELAXED);
+            check_inode(ck, id, &table[k * 128], buf);
+        }
+    }
+    free(table);
+    free(buf);
+    return NULL;
+}
+
+// ---- Fase 2: árbol de directorios ----
+
+// Bloque lógico de un directorio indexado según su índice
+enum { HT_NONE, HT_INDEX, HT_LEAF };
+typedef struct ht_range {
+    u32 lo, hi;                 // rango de hash de la hoja
+    unsigned char kind, hi_inclusive;
+} ht_range;
+
+typedef struct dir_ctx {
+    checker *ck;
+    u32 dir;
+    u32 dots, dotdots;
+    u32 nblocks, seen;          // bloques según el tamaño y los que tienen mapeo
+    unsigned long long entries;
+    unsigned char *blocks;      // DIR_PREFETCH_BLOCKS bloques que se leen en un lote
+    u32 phys[DIR_PREFETCH_BLOCKS], logical[DIR_PREFETCH_BLOCKS], queued;
+    // Directorio indexado: mapa lógico -> físico y qué es cada bloque
+    int indexed;
+    u32 *map;
+    ht_range *range;            // NULL si el índice está roto (ya reportado)
+    u32 cur;                    // bloque lógico que se está recorriendo
+} dir_ctx;
+
+static int entry_cb(u32 id, const char *name, void *p) {
+    dir_ctx *d = (dir_ctx*)p;
+    checker *ck = d->ck;
+    d->entries++;
+    if (id >= spblock.total_inodes || ck->mode[id] == 0) {
+        problem(&ck->r->dangling_entries, "Directorio %u: '%s' apunta al inodo %u, libre o inválido",
+                d->dir, name, id);
+        return 0;
+    }
+    __atomic_fetch_add(&ck->refs[id], 1, __ATOMIC_RELAXED);
+
+    if (d->range) {
+        const ht_range *r = &d->range[d->cur];
+        u32 h = htree_hash(name);
+        if (r->kind != HT_LEAF) {
+            problem(&ck->r->bad_directories, "Directorio %u: '%s' en el bloque lógico %u, fuera del índice",
+                    d->dir, name, d->cur);
+        } else if (h < r->lo || (r->hi_inclusive ? h > r->hi : h >= r->hi)) {
+            problem(&ck->r->bad_directories, "Directorio %u: '%s' (hash %08x) fuera del rango de su hoja %u",
+                    d->dir, name, h, d->cur);
+        }
+    }
+
+    if (strcmp(name, ".") == 0) {
+        d->dots++;
+        if (id != d->dir) problem(&ck->r->bad_directories, "Directorio %u: '.' apunta a %u", d->dir, id);
+        return 0;
+    }
+    if (strcmp(name, "..") == 0) {
+        d->dotdots++;
+        if (id != ck->parent[d->dir]) {
+            problem(&ck->r->bad_directories, "Directorio %u: '..' apunta a %u, esperado %u",
+                    d->dir, id, ck->parent[d->dir]);
+        }
+        return 0;
+    }
+    u64 bit = 1ull << (id & 63);
+    int dir = (ck->mode[id] & S_IFMT) == S_IFDIR;
+    if (__atomic_fetch_or(&ck->reached[id >> 6], bit, __ATOMIC_RELAXED) & bit) {
+        if (dir) problem(&ck->r->bad_directories, "Directorio %u con más de un nombre ('%s' en %u)", id, name, d->dir);
+    } else if (dir) {
+        ck->parent[id] = d->dir;
+        ck->next_level[__atomic_fetch_add(&ck->nnext, 1, __ATOMIC_RELAXED)] = id;
+    }
+    return 0;
+}
+
+// Lee los bloques juntados en un solo lote y recorre sus entradas
+static int dir_flush(dir_ctx *d) {
+    checker *ck = d->ck;
+    block_req reqs[DIR_PREFETCH_BLOCKS];
+    for (u32 i = 0; i < d->queued; i++) {
+        reqs[i] = (block_req){0};
+        reqs[i].start = d->phys[i];
+        reqs[i].buf = d->blocks + (size_t)i * ck->bs;
+        reqs[i].len = ck->bs;
+    }
+    if (d->queued && block_rw_batch(ck->folder, reqs, d->queued, ck->bs) != 0) {
+        fail(ck, errno);
+        return -1;
+    }
+    __atomic_fetch_add(&ck->r->bytes_read, (unsigned long long)d->queued * ck->bs, __ATOMIC_RELAXED);
+    for (u32 i = 0; i < d->queued; i++) {
+        const unsigned char *b = d->blocks + (size_t)i * ck->bs;
+        // Con el índice roto no se sabe cuáles son nodos: se saltean por el magic
+        if (d->indexed && memcmp(&b[8], "QRHT", 4) == 0) continue;
+        d->cur = d->logical[i];
+        if (dirblock_iterate(b, ck->bs, entry_cb, d) < 0) {
+            problem(&ck->r->bad_directories, "Directorio %u: bloque %u ilegible", d->dir, d->phys[i]);
+        }
+    }
+    d->queued = 0;
+    return 0;
+}
+
+static int dir_block(checker *ck, u32 ino, u32 logical, u32 physical, int meta, void *arg) {
+    (void)ck; (void)ino;
+    dir_ctx *d = (dir_ctx*)arg;
+    if (meta || logical >= d->nblocks) return 0;
+    d->seen++;
+    d->logical[d->queued] = logical;
+    d->phys[d->queued++] = physical;
+    return d->queued == DIR_PREFETCH_BLOCKS ? dir_flush(d) : 0;
+}
+
+static int index_map(checker *ck, u32 ino, u32 logical, u32 physical, int meta, void *arg) {
+    (void)ck; (void)ino;
+    dir_ctx *d = (dir_ctx*)arg;
+    if (!meta && logical < d->nblocks) d->map[logical] = physical;
+    return 0;
+}
+
+// Recorre los nodos de índice con lecturas propias (la cache de bloques no
+// es reentrante) y anota el rango de hash de cada hoja, como htree_check.
+// 0 = índice sano, 1 = roto (ya reportado), -1 = error de E/S.
+static int index_walk(checker *ck, dir_ctx *d, u32 logical, u32 level,
+                      u32 lo, u32 hi, int hi_inclusive, int root) {
+    if (logical >= d->nblocks || !d->map[logical] || d->range[logical].kind != HT_NONE) {
+        problem(&ck->r->bad_directories, "Directorio %u: nodo de índice en el bloque lógico %u inválido",
+                d->dir, logical);
+        return 1;
+    }
+    unsigned char *b = (unsigned char*)malloc(ck->bs);
+    if (!b) { fail(ck, ENOMEM); return -1; }
+    if (ck_read(ck, d->map[logical], 0, b, ck->bs) != 0) { free(b); return -1; }
+    u32 count = u32le_read(&b[12]), lv = u32le_read(&b[16]);
+    if (root) level = lv;
+    if (memcmp(&b[8], "QRHT", 4) != 0 || count == 0 || count > (ck->bs - HTREE_HEADER) / HTREE_ENTRY_SIZE ||
+        lv >= HTREE_MAX_LEVELS || lv != level) {
+        problem(&ck->r->bad_directories, "Directorio %u: nodo de índice %u inválido", d->dir, logical);
+        free(b);
+        return 1;
+    }
+    d->range[logical].kind = HT_INDEX;
+
+    int rc = 0;
+    for (u32 i = 0; i < count && rc == 0; i++) {
+        const unsigned char *e = &b[HTREE_HEADER + i * HTREE_ENTRY_SIZE];
+        u32 child = u32le_read(e + 4);
+        u32 clo = i == 0 ? lo : u32le_read(e);
+        u32 chi = i + 1 < count ? u32le_read(e + HTREE_ENTRY_SIZE) : hi;
+        int cincl = i + 1 < count ? (int)(chi & 1u) : hi_inclusive;
+        if (level > 0) {
+            rc = index_walk(ck, d, child, level - 1, clo, chi, cincl, 0);
+        } else if (child >= d->nblocks || !d->map[child] || d->range[child].kind != HT_NONE) {
+            problem(&ck->r->bad_directories, "Directorio %u: hoja %u del índice inválida o repetida", d->dir, child);
+            rc = 1;
+        } else {
+            ht_range *r = &d->range[child];
+            r->kind = HT_LEAF;
+            r->lo = clo & ~1u;
+            r->hi = cincl ? chi & ~1u : chi;
+            r->hi_inclusive = (unsigned char)cincl;
+        }
+    }
+    free(b);
+    return rc;
+}
+
+// Directorio indexado: primero el índice, después las hojas en lotes.
+// Como walk_blocks: 0 = recorrido completo.
+static int check_indexed(checker *ck, dir_ctx *d, const inode *node, unsigned char *buf) {
+    int rc = -1;
+    d->map = (u32*)calloc(d->nblocks ? d->nblocks : 1, sizeof(u32));
+    d->range = (ht_range*)calloc(d->nblocks ? d->nblocks : 1, sizeof(ht_range));
+    if (!d->map || !d->range) { fail(ck, ENOMEM); goto out; }
+    if ((rc = walk_blocks(ck, d->dir, node, buf, index_map, d)) != 0) goto out;
+    int ix = index_walk(ck, d, 0, 0, 0, UINT32_MAX, 1, 1);
+    if ((rc = ix < 0 ? -1 : 0) != 0) goto out;
+    if (ix > 0) { free(d->range); d->range = NULL; }
+    for (u32 l = 0; l < d->nblocks && rc == 0; l++) {
+        if (!d->map[l]) continue;
+        if (d->range && d->range[l].kind == HT_INDEX) { d->seen++; continue; }
+        rc = dir_block(ck, d->dir, l, d->map[l], 0, d);
+    }
+    if (rc == 0) rc = dir_flush(d);
+out:
+    free(d->map);
+    free(d->range);
+    d->map = NULL;
+    d->range = NULL;
+    return rc;
+}
+
+static void check_directory(checker *ck, u32 dir, unsigned char *buf, unsigned char *blocks) {
+    unsigned char rec[128];
+    inode node;
+    if (ck_read(ck, spblock.inode_table_start, dir * 128, rec, sizeof(rec)) != 0) return;
+    inode_decode128(rec, &node);
+
+    dir_ctx d;
+    memset(&d, 0, sizeof(d));
+    d.ck = ck;
+    d.dir = dir;
+    d.nblocks = dir_nblocks(&node);
+    d.blocks = blocks;
+    d.indexed = (node.flags & QRFS_INODE_HTREE) != 0;
+    if (d.indexed ? check_indexed(ck, &d, &node, buf) != 0
+                  : walk_blocks(ck, dir, &node, buf, dir_block, &d) != 0 || dir_flush(&d) != 0) return;
+    __atomic_fetch_add(&ck->r->entries, d.entries, __ATOMIC_RELAXED);
+    if (d.seen < d.nblocks) {
+        problem(&ck->r->bad_directories, "Directorio %u: %u de %u bloques sin asignar",
+                dir, d.nblocks - d.seen, d.nblocks);
+    }
+    if (d.dots != 1 || d.dotdots != 1) {
+        problem(&ck->r->bad_directories, "Directorio %u: %u entradas '.' y %u '..'", dir, d.dots, d.dotdots);
+    }
+}
+
+static void *walk_worker(void *arg) {
+    checker *ck = (checker*)arg;
+    unsigned char *buf = (unsigned char*)malloc(ck->bs);
+    unsigned char *blocks = (unsigned char*)malloc((size_t)DIR_PREFETCH_BLOCKS * ck->bs);
+    if (!buf || !blocks) fail(ck, ENOMEM);
+
+    while (!failed(ck)) {
+        u32 i = __atomic_fetch_add(&ck->next, 1, __ATOMIC_RELAXED);
+        if (i >= ck->nlevel) break;
+        check_directory(ck, ck->level[i], buf, blocks);
+    }
+    free(buf);
+    free(blocks);
+    return NULL;
+}
+
+// ---- Fase 4: sumas por bloque ----
+
+// Tandas de FSCHECK_CSUM_RUN bloques con al menos uno reclamado; se leen
+// enteras (un solo pread) y se compara cada bloque en uso con su suma
+static void *csum_worker(void *arg) {
+    checker *ck = (checker*)arg;
+    unsigned char *buf = (unsigned char*)malloc((size_t)FSCHECK_CSUM_RUN * ck->bs);
+    if (!buf) fail(ck, ENOMEM);
+
+    while (!failed(ck)) {
+        u32 first = __atomic_fetch_add(&ck->next, FSCHECK_CSUM_RUN, __ATOMIC_RELAXED);
+        if (first >= spblock.total_blocks) break;
+        u32 n = spblock.total_blocks - first < FSCHECK_CSUM_RUN ? spblock.total_blocks - first : FSCHECK_CSUM_RUN;
+        u32 used = 0;
+        for (u32 k = 0; k < n; k++) used += bitmap_test(ck->claimed, first + k) && csum_covers(first + k);
+        if (used == 0) continue;
+        if (ck_read(ck, first, 0, buf, n * ck->bs) != 0) break;
+        for (u32 k = 0; k < n; k++) {
+            u32 b = first + k;
+            if (!bitmap_test(ck->claimed, b) || !csum_covers(b)) continue;
+            __atomic_fetch_add(&ck->r->blocks_verified, 1, __ATOMIC_RELAXED);
+            if (csum_check(b, buf + (size_t)k * ck->bs, ck->bs)) {
+                problem(&ck->r->bad_checksums, "Bloque %u: la suma no coincide con el contenido", b);
+            }
+        }
+    }
+    free(buf);
+    return NULL;
+}
+
+// ---- Pool ----
+
+static void run_pool(checker *ck, u32 threads, u32 jobs, void *(*worker)(void*)) {
+    if (threads > jobs) threads = jobs ? jobs : 1;
+    pthread_t *tids = (pthread_t*)calloc(threads, sizeof(pthread_t));
+    if (!tids) { fail(ck, ENOMEM); return; }
+    ck->next = 0;
+    u32 started = 0;
+    for (u32 t = 1; t < threads; t++, started++) {
+        if (pthread_create(&tids[t], NULL, worker, ck) != 0) break;
+    }
+    worker(ck);
+    for (u32 t = 1; t <= started; t++) pthread_join(tids[t], NULL);
+    free(tids);
+}
+
+// ---- Fase 3: comparación ----
+
+static void compare_inodes(checker *ck) {
+    fscheck_report *r = ck->r;
+    for (u32 id = 0; id < spblock.total_inodes; id++) {
+        if (!bitmap_test(ck->reached, id)) {
+            if (ck->mode[id]) problem(&r->orphan_inodes, "Inodo %u ocupado y sin nombre", id);
+            continue;
+        }
+        r->reachable++;
+        if ((ck->mode[id] & S_IFMT) == S_IFDIR) r->directories++;
+        if (ck->links[id] != ck->refs[id]) {
+            problem(&r->link_mismatches, "Inodo %u: links=%u pero lo nombran %u entradas",
+                    id, ck->links[id], ck->refs[id]);
+        }
+    }
+}
+
+static void compare_blocks(checker *ck) {
+    fscheck_report *r = ck->r;
+    u32 words = BITMAP_WORDS(spblock.total_blocks);
+    for (u32 w = 0; w < words; w++) {
+        u64 mask = ~0ull;
+        if (w == words - 1 && (spblock.total_blocks & 63)) mask = (1ull << (spblock.total_blocks & 63)) - 1;
+        u64 unmarked = ck->claimed[w] & ~spblock.data_bitmap[w] & mask;
+        u64 leaked = spblock.data_bitmap[w] & ~ck->claimed[w] & mask;
+        while (unmarked) {
+            problem(&r->blocks_unmarked, "Bloque %u en uso pero libre en el bitmap",
+                    w * 64 + (u32)__builtin_ctzll(unmarked));
+            unmarked &= unmarked - 1;
+        }
+        r->blocks_leaked += (u32)__builtin_popcountll(leaked);
+    }
+}
+
+// Un bloque nombrado n > 1 veces tiene que tener n referencias; uno nombrado
+// una vez, 0 (fuera del índice) o 1; uno sin nombrar, ninguna
+static void compare_refs(checker *ck) {
+    fscheck_report *r = ck->r;
+    for (u32 b = spblock.data_region_start; b < spblock.total_blocks; b++) {
+        u32 n = ck->uses[b], refs = dedup_refs(b);
+        if (n) {
+            r->data_refs += n;
+            r->data_blocks++;
+        }
+        if (n > 1) r->shared_blocks++;
+        if (n > 1 ? refs != n : refs > n) {
+            problem(&r->bad_refcounts, "Bloque %u: los mapas lo nombran %u veces, la tabla de dedup dice %u",
+                    b, n, refs);
+        }
+    }
+}
+
+// ----
+
+int fscheck_clean(const fscheck_report *r) {
+    return !r->bad_inodes && !r->duplicate_blocks && !r->bad_directories && !r->dangling_entries &&
+           !r->link_mismatches && !r->blocks_unmarked && !r->bad_checksums && !r->bad_refcounts;
+}
+
+int fscheck_run(const char *folder, u32 threads, fscheck_report *report) {
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    memset(report, 0, sizeof(*report));
+    messages = 0;
+    // Las lecturas del chequeo no se verifican al vuelo: la fase 4 cuenta las sumas
+    int policy = csum_policy();
+    csum_set_policy(CSUM_VERIFY_OFF);
+
+    // Con el backend de archivos la E/S no es reentrante
+    if (block_current_backend() == QRFS_BACKEND_FILES) {
+        threads = 1;
+    } else if (threads == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (u32)cpus : 1;
+    }
+    report->threads = threads;
+
+    u32 ni = spblock.total_inodes;
+    checker ck;
+    memset(&ck, 0, sizeof(ck));
+    ck.folder = folder;
+    ck.bs = spblock.blocksize;
+    ck.ipb = ck.bs / 128;
+    ck.table_blocks = ceil_div(ni, ck.ipb);
+    ck.r = report;
+    ck.claimed = (u64*)calloc(BITMAP_WORDS(spblock.total_blocks), sizeof(u64));
+    ck.reached = (u64*)calloc(BITMAP_WORDS(ni), sizeof(u64));
+    ck.mode = (u32*)calloc(ni, sizeof(u32));
+    ck.links = (u32*)calloc(ni, sizeof(u32));
+    ck.refs = (u32*)calloc(ni, sizeof(u32));
+    ck.parent = (u32*)calloc(ni, sizeof(u32));
+    ck.level = (u32*)malloc(ni * sizeof(u32));
+    ck.next_level = (u32*)malloc(ni * sizeof(u32));
+    if (dedup_active()) ck.uses = (u32*)calloc(spblock.total_blocks, sizeof(u32));
+    int rc = -1;
+    if (!ck.claimed || !ck.reached || !ck.mode || !ck.links || !ck.refs || !ck.parent ||
+        !ck.level || !ck.next_level || (dedup_active() && !ck.uses)) {
+        errno = ENOMEM;
+        goto out;
+    }
+
+    // Superbloque, bitmaps, tabla de inodos y diario son del sistema
+    for (u32 b = 0; b < spblock.data_region_start; b++) bitmap_set(ck.claimed, b);
+
+    run_pool(&ck, threads, ceil_div(ck.table_blocks, FSCHECK_BATCH), scan_worker);
+    if (ck.error) { errno = ck.error; goto out; }
+
+    u32 root = spblock.root_inode;
+    if (root >= ni || (ck.mode[root] & S_IFMT) != S_IFDIR) {
+        problem(&report->bad_directories, "Inodo raíz %u inválido", root);
+    } else {
+        bitmap_set(ck.reached, root);
+        ck.parent[root] = root;
+        ck.level[0] = root;
+        ck.nlevel = 1;
+    }
+    while (ck.nlevel > 0) {
+        ck.nnext = 0;
+        run_pool(&ck, threads, ck.nlevel, walk_worker);
+        if (ck.error) { errno = ck.error; goto out; }
+        u32 *t = ck.level;
+        ck.level = ck.next_level;
+        ck.next_level = t;
+        ck.nlevel = ck.nnext;
+    }
+
+    compare_inodes(&ck);
+    compare_blocks(&ck);
+    if (ck.uses) compare_refs(&ck);
+    if (csum_active()) {
+        run_pool(&ck, threads, ceil_div(spblock.total_blocks, FSCHECK_CSUM_RUN), csum_worker);
+        if (ck.error) { errno = ck.error; goto out; }
+    }
+    if (messages > FSCHECK_MAX_MESSAGES) {
+        fprintf(stderr, "  ... y %u problemas más\n", messages - FSCHECK_MAX_MESSAGES);
+    }
+    rc = 0;
+
+out:
+    csum_set_policy(policy);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    report->seconds = (double)(t1.tv_sec - t0.tv_sec) + (double)(t1.tv_nsec - t0.tv_nsec) / 1e9;
+    free(ck.claimed); free(ck.reached); free(ck.uses);
+    free(ck.mode); free(ck.links); free(ck.refs); free(ck.parent);
+    free(ck.level); free(ck.next_level);
+    return rc;
+}
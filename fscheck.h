@@ -0,0 +1,64 @@
+#ifndef FSCHECK_H
+#define FSCHECK_H
+#include "fs_basic.h"
+
+// Chequeo completo del volumen cargado en spblock (superblock_load antes).
+// Recorre la tabla de inodos entera y el árbol de directorios desde la raíz
+// con un pool de hilos, reconstruye los bitmaps de inodos y bloques y los
+// compara con los de disco. Lee directo del backend, sin las caches (que no
+// son reentrantes), con lotes de E/S asíncrona; con el backend de archivos
+// usa un solo hilo.
+//
+// Fase 1: cada inodo marcado en el bitmap se valida y se reclaman sus
+//         bloques (datos, indirecto, bloques de extents).
+// Fase 2: recorrido por niveles desde la raíz; cuenta las entradas que
+//         apuntan a cada inodo y marca los alcanzables.
+// Fase 3: comparación de bitmaps y de cantidades de enlaces; con
+//         QRFS_FEAT_DEDUP, también de las referencias de cada bloque de datos
+//         contra la tabla de deduplicación.
+// Fase 4: con QRFS_FEAT_CHECKSUMS, cada bloque reclamado se lee y se compara
+//         con su suma (las lecturas de las fases anteriores no se verifican).
+
+// Inodos de la tabla que toma cada hilo por vez (en bloques de la tabla)
+#define FSCHECK_BATCH 64
+// ... leídos en pedidos de este tamaño, todos en vuelo (E/S asíncrona)
+#define FSCHECK_TABLE_REQ 8
+// Problemas que se describen uno por uno; del resto solo se cuentan
+#define FSCHECK_MAX_MESSAGES 20
+// Bloques contiguos por lectura al verificar las sumas
+#define FSCHECK_CSUM_RUN 64
+
+typedef struct fscheck_report {
+    u32 threads;
+    u32 inodes_used;            // marcados en el bitmap de disco
+    u32 directories;
+    u32 reachable;              // inodos con nombre (más la raíz)
+    unsigned long long entries; // entradas de directorio recorridas
+    unsigned long long blocks_claimed;   // bloques de datos y metadatos de archivos
+    unsigned long long bytes_read;
+    unsigned long long blocks_verified;  // bloques en uso comparados con su suma
+    unsigned long long data_refs;        // con dedup: bloques de datos según los mapas
+    unsigned long long data_blocks;      // ... y bloques físicos distintos que ocupan
+    u32 shared_blocks;                   // ... mapeados más de una vez
+    double seconds;
+
+    // Errores
+    u32 bad_inodes;             // registro inválido o punteros fuera de la región de datos
+    u32 duplicate_blocks;       // bloques reclamados por más de un dueño (sin contar los compartidos por dedup)
+    u32 bad_directories;        // bloques ilegibles, sin "." o "..", o con dos nombres
+    u32 dangling_entries;       // entradas a inodos libres o inválidos
+    u32 link_mismatches;        // links del inodo distinto de las entradas que lo nombran
+    u32 blocks_unmarked;        // en uso pero libres en el bitmap de disco
+    u32 bad_checksums;          // bloques en uso que no coinciden con su suma
+    u32 bad_refcounts;          // referencias de la tabla de dedup distintas de los mapas
+    // Advertencias (espacio perdido, no corrompe)
+    u32 orphan_inodes;          // ocupados sin nombre
+    u32 blocks_leaked;          // ocupados en disco sin dueño
+} fscheck_report;
+
+// threads = 0: uno por CPU. Devuelve 0 si pudo recorrer el volumen (los
+// problemas encontrados quedan en el reporte) y -1 ante errores de E/S.
+int fscheck_run(const char *folder, u32 threads, fscheck_report *report);
+int fscheck_clean(const fscheck_report *report);   // 1 = sin errores
+
+#endif
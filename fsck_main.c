@@ -0,0 +1,31 @@
+#include "mkfs.h"
+#include "block.h"
+#include "bcache.h"
+#include "superblock.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Uso: %s <carpeta> [--mmap] [--cache=KiB] [--migrate] [--threads=N] [--fix-checksums]\n", argv[0]);
+        return 1;
+    }
+    u32 bs, threads = 0;
+    int fix_checksums = 0;
+    if (superblock_probe(argv[1], &bs) != 0) return 1;
+    for (int i = 2; i < argc; ++i) {
+        if (strcmp(argv[i], "--mmap") == 0) block_set_mmap(1);
+        else if (strcmp(argv[i], "--migrate") == 0) {
+            if (superblock_migrate_bitmaps(argv[1], bs) != 0) {
+                fprintf(stderr, "No se pudieron migrar los bitmaps.\n");
+                return 1;
+            }
+        }
+        else if (strncmp(argv[i], "--cache=", 8) == 0) bcache_init((size_t)strtoul(argv[i] + 8, NULL, 10) * 1024, bs);
+        else if (strncmp(argv[i], "--threads=", 10) == 0) threads = (u32)strtoul(argv[i] + 10, NULL, 10);
+        else if (strcmp(argv[i], "--fix-checksums") == 0) fix_checksums = 1;
+    }
+
+    return fsck_qrfs(argv[1], threads, fix_checksums);
+}
@@ -0,0 +1,912 @@
+#define _XOPEN_SOURCE 700
+#include "fsops.h"
+#include "block.h"
+#include "block_aio.h"
+#include "bcache.h"
+#include "bitmaps.h"
+#include "csum.h"
+#include "dcache.h"
+#include "dedup.h"
+#include "dir.h"
+#include "filemap.h"
+#include "fs_utils.h"
+#include "icache.h"
+#include "inode.h"
+#include "journal.h"
+#include "superblock.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+static pthread_mutex_t meta = PTHREAD_MUTEX_INITIALIZER;
+static pthread_rwlock_t io = PTHREAD_RWLOCK_INITIALIZER;
+static int parallel = 0;
+static int sync_ops = 0;                // operaciones de nombres persistentes al volver
+static u32 *open_count = NULL;          // por inodo, aperturas vivas
+static unsigned char *orphan = NULL;    // sin enlaces, se libera en el último release
+static unsigned char *zeros = NULL;     // un bloque en cero para rellenar bloques nuevos
+
+// Commit agrupado
+static pthread_cond_t commit_cv = PTHREAD_COND_INITIALIZER;
+static u64 commits_started = 0, commits_done = 0;
+static int committing = 0, commit_rc = 0, commit_errno = 0;
+static char mnt_folder[1024];           // para el commit por plazo del hilo del diario
+static void commit_tick(void);
+
+#define IS_DIR(n) (((n)->inode_mode & S_IFMT) == S_IFDIR)
+
+static void touch(inode *node) {
+    now_timespec(&node->last_modification_time);
+    node->metadata_last_change_time = node->last_modification_time;
+}
+
+static inode *get_dir(const char *folder, u32 id) {
+    inode *dir = icache_get(folder, id);
+    if (dir && !IS_DIR(dir)) {
+        icache_put(dir);
+        errno = ENOTDIR;
+        return NULL;
+    }
+    return dir;
+}
+
+// Libera datos e inodo. Requiere meta e io exclusivo.
+static int release_inode(const char *folder, u32 id) {
+    inode *node = icache_get(folder, id);
+    if (!node) return -1;
+    int rc = filemap_truncate(folder, node, 0);
+    node->inode_size = 0;
+    node->links_quaintities = 0;
+    if (IS_DIR(node)) dcache_invalidate_dir(folder, id);
+    icache_put(node);
+    icache_forget(folder, id);
+    free_inode((int)id);
+    return rc;
+}
+
+// Quita un enlace; sin enlaces ni aperturas se libera ya, si no al cerrar
+static int drop_link(const char *folder, inode *node) {
+    if (node->links_quaintities > 0) node->links_quaintities--;
+    now_timespec(&node->metadata_last_change_time);
+    icache_mark_dirty(node);
+    if (node->links_quaintities > 0) return 0;
+    u32 id = node->inode_number;
+    if (open_count[id] > 0) {
+        orphan[id] = 1;
+        return 0;
+    }
+    return release_inode(folder, id);
+}
+
+static int count_cb(u32 inode_id, const char *name, void *ctx) {
+    (void)inode_id;
+    if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) return 0;
+    (*(u32*)ctx)++;
+    return 1;
+}
+
+static int dir_is_empty(const char *folder, const inode *dir) {
+    u32 n = 0;
+    if (dir_iterate(folder, dir, count_cb, &n) < 0) return -1;
+    return n == 0;
+}
+
+// ---- Montaje ----
+
+int fsops_mount(const char *folder, const fsops_options *opt) {
+    fsops_options o = {0, 0, 0, 0, 0, 0};
+    if (opt) o = *opt;
+    u32 bs;
+
+    block_set_mmap(o.use_mmap);
+    csum_set_policy(o.verify);
+    if (superblock_probe(folder, &bs) != 0) return -1;
+    if (bcache_init(o.bcache_budget ? o.bcache_budget : BCACHE_DEFAULT_BUDGET, bs) != 0) return -1;
+    if (superblock_load(folder, bs) != 0) return -1;
+    if (icache_init(o.icache_budget ? o.icache_budget : ICACHE_DEFAULT_BUDGET) != 0 ||
+        dcache_init(o.dcache_budget ? o.dcache_budget : DCACHE_DEFAULT_BUDGET) != 0) return -1;
+
+    free(open_count); free(orphan); free(zeros);
+    open_count = (u32*)calloc(spblock.total_inodes, sizeof(u32));
+    orphan = (unsigned char*)calloc(spblock.total_inodes, 1);
+    zeros = (unsigned char*)calloc(1, bs);
+    if (!open_count || !orphan || !zeros) { errno = ENOMEM; return -1; }
+
+    inode *root = get_dir(folder, spblock.root_inode);
+    if (!root) {
+        fprintf(stderr, "Inodo raíz inválido: %s\n", strerror(errno));
+        return -1;
+    }
+    icache_put(root);
+    parallel = block_current_backend() != QRFS_BACKEND_FILES;
+    sync_ops = o.sync_ops;
+    // Con el backend de archivos el checkpoint no puede ir en otro hilo
+    if ((spblock.features & QRFS_FEAT_JOURNAL) &&
+        journal_start(folder, spblock.journal_start, spblock.journal_blocks, bs, parallel) != 0) {
+        fprintf(stderr, "No se pudo abrir el diario: %s\n", strerror(errno));
+        return -1;
+    }
+    snprintf(mnt_folder, sizeof(mnt_folder), "%s", folder);
+    if (journal_active()) journal_set_commit_hook(commit_tick);
+    return 0;
+}
+
+static int sync_locked(const char *folder) {
+    int rc = icache_sync(folder);
+    if (superblock_store(folder) != 0) rc = -1;
+    if (bcache_flush(folder) != 0) rc = -1;
+    return rc;
+}
+
+// Commit agrupado (con meta tomado): espera un commit que haya empezado
+// después de la llamada. Si no hay uno en curso lo hace, soltando meta
+// mientras escribe el diario; los que llegan en ese tiempo esperan el
+// siguiente, que los cubre a todos con un solo flush.
+static int group_commit(const char *folder) {
+    u64 want = commits_started + 1;
+    while (commits_done < want) {
+        if (committing) {
+            pthread_cond_wait(&commit_cv, &meta);
+            continue;
+        }
+        committing = 1;
+        u64 mine = ++commits_started;
+        int rc = icache_sync(folder);
+        if (superblock_store(folder) != 0) rc = -1;
+        if (bcache_writeback(folder) != 0) rc = -1;
+        if (!journal_active()) {
+            if (block_flush(folder) != 0) rc = -1;
+        } else if (journal_close()) {
+            if (parallel) pthread_mutex_unlock(&meta);
+            if (journal_write() != 0) rc = -1;
+            if (parallel) pthread_mutex_lock(&meta);
+        }
+        commit_rc = rc;
+        commit_errno = rc ? errno : 0;
+        commits_done = mine;
+        committing = 0;
+        pthread_cond_broadcast(&commit_cv);
+    }
+    if (commit_rc) errno = commit_errno;
+    return commit_rc;
+}
+
+// Con meta tomado: cierra la transacción del diario si pasó el tamaño o el
+// plazo. Si falla, la transacción queda en vuelo y la reintenta el próximo commit.
+static void commit_if_due(const char *folder) {
+    if (journal_active() && !committing && journal_commit_due(bcache_dirty() + icache_dirty()))
+        group_commit(folder);
+}
+
+// Desde el hilo del diario; si meta está ocupado se prueba en la próxima vuelta
+static void commit_tick(void) {
+    if (pthread_mutex_trylock(&meta) != 0) return;
+    commit_if_due(mnt_folder);
+    pthread_mutex_unlock(&meta);
+}
+
+// Fin de una operación que cambia nombres: con sync_ops, persistente al volver
+static int op_done(const char *folder, int rc) {
+    if (rc == 0 && sync_ops) return group_commit(folder);
+    commit_if_due(folder);
+    return rc;
+}
+
+int fsops_sync(const char *folder) {
+    pthread_mutex_lock(&meta);
+    int rc = group_commit(folder);
+    pthread_mutex_unlock(&meta);
+    return rc;
+}
+
+int fsops_unmount(const char *folder) {
+    journal_set_commit_hook(NULL);
+    pthread_rwlock_wrlock(&io);
+    pthread_mutex_lock(&meta);
+    for (u32 i = 0; orphan && i < spblock.total_inodes; i++) {
+        if (orphan[i]) release_inode(folder, i);
+    }
+    int rc = sync_locked(folder);
+    if (journal_stop() != 0) rc = -1;
+    dedup_close();
+    icache_shutdown();
+    dcache_shutdown();
+    bcache_shutdown();
+    block_close();
+    free(open_count); free(orphan); free(zeros);
+    open_count = NULL; orphan = NULL; zeros = NULL;
+    pthread_mutex_unlock(&meta);
+    pthread_rwlock_unlock(&io);
+    return rc;
+}
+
+u32 fsops_root(void) {
+    return spblock.root_inode;
+}
+
+u32 fsops_block_size(void) {
+    return spblock.blocksize;
+}
+
+int fsops_parallel_io(void) {
+    return parallel;
+}
+
+int fsops_direct_writes(void) {
+    return parallel && !dedup_active();
+}
+
+// ---- Nombres ----
+
+int fsops_lookup(const char *folder, u32 parent, const char *name, u32 *inode_id) {
+    pthread_mutex_lock(&meta);
+    inode *dir = get_dir(folder, parent);
+    int rc = dir ? dir_lookup(folder, dir, name, inode_id) : -1;
+    if (dir) icache_put(dir);
+    pthread_mutex_unlock(&meta);
+    return rc;
+}
+
+int fsops_getattr(const char *folder, u32 inode_id, struct stat *st) {
+    pthread_mutex_lock(&meta);
+    inode *node = icache_get(folder, inode_id);
+    if (!node) {
+        pthread_mutex_unlock(&meta);
+        return -1;
+    }
+    memset(st, 0, sizeof(*st));
+    st->st_ino = inode_id;
+    st->st_mode = node->inode_mode;
+    st->st_nlink = node->links_quaintities;
+    st->st_uid = node->user_id;
+    st->st_gid = node->group_id;
+    st->st_size = node->inode_size;
+    st->st_blksize = spblock.blocksize;
+    st->st_blocks = ((blkcnt_t)node->inode_size + 511) / 512;
+    st->st_atim = node->last_access_time;
+    st->st_mtim = node->last_modification_time;
+    st->st_ctim = node->metadata_last_change_time;
+    icache_put(node);
+    pthread_mutex_unlock(&meta);
+    return 0;
+}
+
+// Alta de un inodo nuevo enlazado en `dir`. Requiere meta.
+static int new_inode(const char *folder, inode *dir, const char *name, mode_t mode,
+                     u32 uid, u32 gid, u32 *inode_id) {
+    u32 old;
+    if (dir_lookup(folder, dir, name, &old) == 0) { errno = EEXIST; return -1; }
+    if (errno != ENOENT) return -1;
+
+    int id = allocate_inode();
+    if (id < 0) { errno = ENOSPC; return -1; }
+    inode node;
+    init_inode(&node, (u32)id, mode, 0);
+    node.user_id = uid;
+    node.group_id = gid;
+    if (icache_store(folder, &node) != 0) {
+        free_inode(id);
+        return -1;
+    }
+    if (dir_add(folder, dir, name, (u32)id) != 0) {
+        icache_forget(folder, (u32)id);
+        free_inode(id);
+        return -1;
+    }
+    touch(dir);
+    icache_mark_dirty(dir);
+    *inode_id = (u32)id;
+    return 0;
+}
+
+int fsops_create(const char *folder, u32 parent, const char *name, mode_t mode,
+                 u32 uid, u32 gid, u32 *inode_id) {
+    pthread_mutex_lock(&meta);
+    inode *dir = get_dir(folder, parent);
+    int rc = dir ? new_inode(folder, dir, name, S_IFREG | (mode & 07777), uid, gid, inode_id) : -1;
+    if (dir) icache_put(dir);
+    rc = op_done(folder, rc);
+    pthread_mutex_unlock(&meta);
+    return rc;
+}
+
+int fsops_mkdir(const char *folder, u32 parent, const char *name, mode_t mode,
+                u32 uid, u32 gid, u32 *inode_id) {
+    pthread_mutex_lock(&meta);
+    inode *dir = get_dir(folder, parent);
+    int rc = dir ? new_inode(folder, dir, name, S_IFDIR | (mode & 07777), uid, gid, inode_id) : -1;
+    if (rc == 0) {
+        inode *node = icache_get(folder, *inode_id);
+        if (!node || dir_add(folder, node, ".", *inode_id) != 0 ||
+            dir_add(folder, node, "..", parent) != 0) {
+            int err = errno;
+            dir_remove(folder, dir, name);
+            if (node) {
+                filemap_truncate(folder, node, 0);
+                icache_put(node);
+            }
+            icache_forget(folder, *inode_id);
+            free_inode((int)*inode_id);
+            errno = err;
+            rc = -1;
+        } else {
+            node->links_quaintities = 2;
+            icache_mark_dirty(node);
+            icache_put(node);
+            dir->links_quaintities++;
+            icache_mark_dirty(dir);
+        }
+    }
+    if (dir) icache_put(dir);
+    rc = op_done(folder, rc);
+    pthread_mutex_unlock(&meta);
+    return rc;
+}
+
+int fsops_unlink(const char *folder, u32 parent, const char *name) {
+    pthread_rwlock_wrlock(&io);
+    pthread_mutex_lock(&meta);
+    inode *dir = get_dir(folder, parent), *node = NULL;
+    u32 id;
+    int rc = -1;
+    if (!dir || dir_lookup(folder, dir, name, &id) != 0) goto out;
+    if (!(node = icache_get(folder, id))) goto out;
+    if (IS_DIR(node)) { errno = EISDIR; goto out; }
+    if (dir_remove(folder, dir, name) != 0) goto out;
+    touch(dir);
+    icache_mark_dirty(dir);
+    rc = drop_link(folder, node);
+out:
+    if (node) icache_put(node);
+    if (dir) icache_put(dir);
+    rc = op_done(folder, rc);
+    pthread_mutex_unlock(&meta);
+    pthread_rwlock_unlock(&io);
+    return rc;
+}
+
+int fsops_rmdir(const char *folder, u32 parent, const char *name) {
+    if (strcmp(name, ".") == 0) { errno = EINVAL; return -1; }
+    if (strcmp(name, "..") == 0) { errno = ENOTEMPTY; return -1; }
+    pthread_rwlock_wrlock(&io);
+    pthread_mutex_lock(&meta);
+    inode *dir = get_dir(folder, parent), *node = NULL;
+    u32 id;
+    int rc = -1, empty;
+    if (!dir || dir_lookup(folder, dir, name, &id) != 0) goto out;
+    if (!(node = get_dir(folder, id))) goto out;
+    if ((empty = dir_is_empty(folder, node)) <= 0) {
+        if (empty == 0) errno = ENOTEMPTY;
+        goto out;
+    }
+    if (dir_remove(folder, dir, name) != 0) goto out;
+    dir->links_quaintities--;
+    touch(dir);
+    icache_mark_dirty(dir);
+    icache_put(node);
+    node = NULL;
+    rc = release_inode(folder, id);
+out:
+    if (node) icache_put(node);
+    if (dir) icache_put(dir);
+    rc = op_done(folder, rc);
+    pthread_mutex_unlock(&meta);
+    pthread_rwlock_unlock(&io);
+    return rc;
+}
+
+// 1 si `dir` es `ancestor` o está debajo de él
+static int is_under(const char *folder, u32 dir, u32 ancestor) {
+    for (u32 depth = 0; depth < spblock.total_inodes; depth++) {
+        if (dir == ancestor) return 1;
+        if (dir == spblock.root_inode) return 0;
+        inode *node = icache_get(folder, dir);
+        if (!node) return -1;
+        int rc = dir_lookup(folder, node, "..", &dir);
+        icache_put(node);
+        if (rc != 0) return -1;
+    }
+    errno = ELOOP;
+    return -1;
+}
+
+int fsops_rename(const char *folder, u32 parent, const char *name, u32 new_parent, const char *new_name) {
+    if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0 ||
+        strcmp(new_name, ".") == 0 || strcmp(new_name, "..") == 0) { errno = EINVAL; return -1; }
+    pthread_rwlock_wrlock(&io);
+    pthread_mutex_lock(&meta);
+    inode *src = get_dir(folder, parent), *dst = get_dir(folder, new_parent);
+    inode *node = NULL, *old = NULL;
+    u32 id, old_id, replaced;
+    int rc = -1;
+    if (!src || !dst || dir_lookup(folder, src, name, &id) != 0) goto out;
+    if (!(node = icache_get(folder, id))) goto out;
+
+    if (dir_lookup(folder, dst, new_name, &old_id) == 0) {
+        if (old_id == id) { rc = 0; goto out; }
+        if (!(old = icache_get(folder, old_id))) goto out;
+        if (IS_DIR(old) && !IS_DIR(node)) { errno = EISDIR; goto out; }
+        if (!IS_DIR(old) && IS_DIR(node)) { errno = ENOTDIR; goto out; }
+        if (IS_DIR(old)) {
+            int empty = dir_is_empty(folder, old);
+            if (empty <= 0) {
+                if (empty == 0) errno = ENOTEMPTY;
+                goto out;
+            }
+        }
+    } else if (errno != ENOENT) {
+        goto out;
+    }
+
+    int moving_dir = IS_DIR(node) && parent != new_parent;
+    if (moving_dir) {
+        int under = is_under(folder, new_parent, id);
+        if (under != 0) {
+            if (under > 0) errno = EINVAL;
+            goto out;
+        }
+    }
+
+    if (dir_rename(folder, src, name, dst, new_name, &replaced) < 0) goto out;
+    rc = 0;
+    if (old) {
+        if (IS_DIR(old)) {
+            dst->links_quaintities--;
+            icache_put(old);
+            old = NULL;
+            rc = release_inode(folder, old_id);
+        } else {
+            rc = drop_link(folder, old);
+        }
+    }
+    if (moving_dir) {
+        if (dir_remove(folder, node, "..") != 0 || dir_add(folder, node, "..", new_parent) != 0) rc = -1;
+        src->links_quaintities--;
+        dst->links_quaintities++;
+    }
+    touch(src);
+    touch(dst);
+    node->metadata_last_change_time = src->last_modification_time;
+    icache_mark_dirty(src);
+    icache_mark_dirty(dst);
+    icache_mark_dirty(node);
+out:
+    if (old) icache_put(old);
+    if (node) icache_put(node);
+    if (dst) icache_put(dst);
+    if (src) icache_put(src);
+    rc = op_done(folder, rc);
+    pthread_mutex_unlock(&meta);
+    pthread_rwlock_unlock(&io);
+    return rc;
+}
+
+// ---- Atributos ----
+
+int fsops_truncate(const char *folder, u32 inode_id, u64 size) {
+    if (size > UINT32_MAX) { errno = EFBIG; return -1; }
+    pthread_rwlock_wrlock(&io);
+    pthread_mutex_lock(&meta);
+    inode *node = icache_get(folder, inode_id);
+    int rc = -1;
+    if (!node) goto out;
+    if (IS_DIR(node)) { errno = EISDIR; goto out; }
+
+    u32 bs = spblock.blocksize;
+    if (node->flags & QRFS_INODE_INLINE) {
+        // Si sigue entrando en el inodo se limpia lo que queda afuera; si no, pasa a un bloque
+        if (size <= QRFS_INLINE_DATA) memset(node->inline_data + size, 0, QRFS_INLINE_DATA - (u32)size);
+        else if (filemap_uninline(folder, node) != 0) goto out;
+    } else if (size != node->inode_size) {
+        // Al achicar se corta en el tamaño nuevo; al crecer, en el viejo: lo
+        // que haya quedado asignado más allá del final no se ve sin escribir
+        u64 from = size < node->inode_size ? size : node->inode_size;
+        u32 keep = (u32)((from + bs - 1) / bs);
+        if (filemap_truncate(folder, node, keep) != 0) goto out;
+        // La cola del último bloque queda en cero para que crecer después lea
+        // ceros; con deduplicación el bloque puede ser compartido y se copia
+        u32 tail = (u32)(from % bs), phys, run;
+        if (tail && filemap_bmap(folder, node, keep - 1, &phys, &run) == 0 && phys &&
+            (dedup_active() ? file_write(folder, node, from, zeros, bs - tail) < 0
+                            : block_pwrite(folder, phys, tail, zeros, bs - tail, bs) != 0)) goto out;
+    }
+    node->inode_size = (u32)size;
+    touch(node);
+    icache_mark_dirty(node);
+    rc = 0;
+out:
+    if (node) icache_put(node);
+    if (rc == 0) commit_if_due(folder);
+    pthread_mutex_unlock(&meta);
+    pthread_rwlock_unlock(&io);
+    return rc;
+}
+
+int fsops_chmod(const char *folder, u32 inode_id, mode_t mode) {
+    pthread_mutex_lock(&meta);
+    inode *node = icache_get(folder, inode_id);
+    if (node) {
+        node->inode_mode = (node->inode_mode & S_IFMT) | (mode & 07777);
+        now_timespec(&node->metadata_last_change_time);
+        icache_mark_dirty(node);
+        icache_put(node);
+        commit_if_due(folder);
+    }
+    pthread_mutex_unlock(&meta);
+    return node ? 0 : -1;
+}
+
+// (u32)-1 deja el campo como está
+int fsops_chown(const char *folder, u32 inode_id, u32 uid, u32 gid) {
+    pthread_mutex_lock(&meta);
+    inode *node = icache_get(folder, inode_id);
+    if (node) {
+        if (uid != (u32)-1) node->user_id = uid;
+        if (gid != (u32)-1) node->group_id = gid;
+        now_timespec(&node->metadata_last_change_time);
+        icache_mark_dirty(node);
+        icache_put(node);
+        commit_if_due(folder);
+    }
+    pthread_mutex_unlock(&meta);
+    return node ? 0 : -1;
+}
+
+// ---- Listado ----
+
+typedef struct readdir_ctx {
+    const char *folder;
+    fsops_dir_fn fn;
+    void *ctx;
+} readdir_ctx;
+
+static int readdir_cb(u32 inode_id, const char *name, u64 next, void *p) {
+    readdir_ctx *rd = (readdir_ctx*)p;
+    mode_t mode = 0;
+    inode *node = icache_get(rd->folder, inode_id);
+    if (node) {
+        mode = node->inode_mode;
+        icache_put(node);
+    }
+    return rd->fn(name, inode_id, mode, next, rd->ctx);
+}
+
+// El offset es una posición estable del directorio (dir_iterate_from): se
+// retoma ahí sin recorrer lo anterior, aunque entre llamadas se borren o
+// agreguen entradas (rm -r)
+int fsops_readdir(const char *folder, u32 inode_id, u64 offset, fsops_dir_fn fn, void *ctx) {
+    pthread_mutex_lock(&meta);
+    inode *dir = get_dir(folder, inode_id);
+    int rc = -1;
+    if (dir) {
+        readdir_ctx rd = {folder, fn, ctx};
+        rc = dir_iterate_from(folder, dir, offset, readdir_cb, &rd) < 0 ? -1 : 0;
+        icache_put(dir);
+    }
+    pthread_mutex_unlock(&meta);
+    return rc;
+}
+
+int fsops_statfs(const char *folder, struct statvfs *st) {
+    (void)folder;
+    pthread_mutex_lock(&meta);
+    memset(st, 0, sizeof(*st));
+    st->f_bsize = spblock.blocksize;
+    st->f_frsize = spblock.blocksize;
+    st->f_blocks = spblock.total_blocks;
+    st->f_bfree = spblock.free_blocks;
+    st->f_bavail = spblock.free_blocks;
+    st->f_files = spblock.total_inodes;
+    st->f_ffree = spblock.free_inodes;
+    st->f_favail = spblock.free_inodes;
+    st->f_namemax = DIR_NAME_MAX;
+    pthread_mutex_unlock(&meta);
+    return 0;
+}
+
+// ---- Aperturas ----
+
+int fsops_open(const char *folder, u32 inode_id) {
+    pthread_mutex_lock(&meta);
+    inode *node = icache_get(folder, inode_id);
+    if (node) {
+        open_count[inode_id]++;
+        icache_put(node);
+    }
+    pthread_mutex_unlock(&meta);
+    return node ? 0 : -1;
+}
+
+int fsops_release(const char *folder, u32 inode_id) {
+    if (inode_id >= spblock.total_inodes) { errno = EINVAL; return -1; }
+    pthread_mutex_lock(&meta);
+    if (open_count[inode_id] > 0) open_count[inode_id]--;
+    int last = open_count[inode_id] == 0 && orphan[inode_id];
+    pthread_mutex_unlock(&meta);
+    if (!last) return 0;
+
+    // Liberar bloques pide io exclusivo, que va antes que meta
+    int rc = 0;
+    pthread_rwlock_wrlock(&io);
+    pthread_mutex_lock(&meta);
+    if (open_count[inode_id] == 0 && orphan[inode_id]) {
+        orphan[inode_id] = 0;
+        rc = release_inode(folder, inode_id);
+        commit_if_due(folder);
+    }
+    pthread_mutex_unlock(&meta);
+    pthread_rwlock_unlock(&io);
+    return rc;
+}
+
+// ---- Datos ----
+
+static int push_seg(fsops_seg **segs, u32 *n, u32 *cap, u32 physical, u32 in_block, u32 len, u32 fresh) {
+    if (*n == *cap) {
+        u32 c = *cap ? *cap * 2 : 8;
+        fsops_seg *p = (fsops_seg*)realloc(*segs, c * sizeof(fsops_seg));
+        if (!p) { errno = ENOMEM; return -1; }
+        *segs = p;
+        *cap = c;
+    }
+    (*segs)[(*n)++] = (fsops_seg){physical, in_block, len, NULL, fresh};
+    return 0;
+}
+
+int fsops_map(const char *folder, u32 inode_id, u64 offset, u32 len, int for_write,
+              fsops_seg **segs, u32 *nsegs, u32 *mapped) {
+    *segs = NULL;
+    *nsegs = 0;
+    *mapped = 0;
+    if (for_write && offset + len > UINT32_MAX) { errno = EFBIG; return -1; }
+    if (for_write && dedup_active()) { errno = EOPNOTSUPP; return -1; }   // fsops_write
+
+    pthread_rwlock_rdlock(&io);
+    pthread_mutex_lock(&meta);
+    inode *node = icache_get(folder, inode_id);
+    u32 bs = spblock.blocksize, cap = 0;
+    if (!node) goto fail;
+    if (IS_DIR(node)) { errno = EISDIR; goto fail; }
+    if (!for_write) {
+        if (offset >= node->inode_size) len = 0;
+        else if (offset + len > node->inode_size) len = (u32)(node->inode_size - offset);
+    }
+    if ((node->flags & QRFS_INODE_INLINE) && for_write && filemap_uninline(folder, node) != 0) goto fail;
+    if ((node->flags & QRFS_INODE_INLINE) && len) {
+        // Copia tomada bajo meta, en la misma reserva que el tramo
+        if (node->inode_size > QRFS_INLINE_DATA) { errno = EIO; goto fail; }
+        fsops_seg *s = (fsops_seg*)malloc(sizeof(fsops_seg) + len);
+        if (!s) { errno = ENOMEM; goto fail; }
+        memcpy(s + 1, node->inline_data + offset, len);
+        *s = (fsops_seg){0, 0, len, (const unsigned char*)(s + 1), 0};
+        *segs = s;
+        *nsegs = 1;
+        goto done;
+    }
+
+    u64 pos = offset, end = offset + len;
+    while (pos < end) {
+        u32 logical = (u32)(pos / bs), in = (u32)(pos % bs);
+        u32 phys, run, fresh = 0;
+        if (filemap_bmap(folder, node, logical, &phys, &run) != 0) goto fail;
+        if (phys == 0 && for_write) {
+            u32 want = (u32)((end - (u64)logical * bs + bs - 1) / bs);
+            if (filemap_alloc(folder, node, logical, want, &phys, &run) != 0) goto fail;
+            fresh = 1;
+            // En cero antes de quedar enganchados: los que la escritura no
+            // cubre enteros y los que llenan un hueco dentro del tamaño, que
+            // un lector ya puede ver mientras se copia
+            u64 covered = (u64)(logical + run) * bs;
+            if (covered > end) covered = end;
+            u32 last = (u32)((covered - 1) / bs);
+            for (u32 k = 0; k < run; k++) {
+                int partial = (k == 0 && in) || (logical + k == last && (covered % bs));
+                if ((partial || (u64)(logical + k) * bs < node->inode_size) &&
+                    block_pwrite(folder, phys + k, 0, zeros, bs, bs) != 0) goto fail;
+            }
+        }
+        u64 span = (u64)run * bs - in;
+        if (span > end - pos) span = end - pos;
+        if (push_seg(segs, nsegs, &cap, phys, in, (u32)span, fresh) != 0) goto fail;
+        pos += span;
+    }
+    if (for_write && len) {
+        touch(node);
+        icache_mark_dirty(node);
+    }
+done:
+    icache_put(node);
+    pthread_mutex_unlock(&meta);
+    *mapped = len;
+    return 0;     // io queda tomado hasta fsops_io_end
+fail:
+    if (node) icache_put(node);
+    pthread_mutex_unlock(&meta);
+    pthread_rwlock_unlock(&io);
+    free(*segs);
+    *segs = NULL;
+    *nsegs = 0;
+    return -1;
+}
+
+void fsops_io_end(void) {
+    pthread_rwlock_unlock(&io);
+}
+
+void fsops_write_end(const char *folder, u32 inode_id, u64 offset,
+                     const fsops_seg *segs, u32 nsegs, u32 done) {
+    u32 bs = spblock.blocksize, at = 0;
+    for (u32 i = 0; i < nsegs; at += segs[i].len, i++) {
+        if (!segs[i].fresh || at + segs[i].len <= done) continue;
+        u32 blocks = (segs[i].in_block + segs[i].len + bs - 1) / bs;
+        for (u32 k = 0; k < blocks; k++) block_pwrite(folder, segs[i].physical + k, 0, zeros, bs, bs);
+    }
+    u64 end = done ? offset + done : 0;
+    pthread_mutex_lock(&meta);
+    inode *node = icache_get(folder, inode_id);
+    if (node) {
+        if (end > node->inode_size) {
+            node->inode_size = (u32)end;
+            icache_mark_dirty(node);
+        }
+        icache_put(node);
+    }
+    commit_if_due(folder);
+    pthread_mutex_unlock(&meta);
+    pthread_rwlock_unlock(&io);
+}
+
+// Todos los tramos de una lectura o escritura en un solo lote, en vuelo a la
+// vez; los huecos (solo al leer) se llenan con ceros
+static int io_segments(const char *folder, const fsops_seg *segs, u32 n, unsigned char *buf, int writing) {
+    block_req stack[8], *reqs = n <= 8 ? stack : (block_req*)malloc(n * sizeof(block_req));
+    if (!reqs) { errno = ENOMEM; return -1; }
+    u32 k = 0;
+    for (u32 i = 0; i < n; buf += segs[i].len, i++) {
+        if (segs[i].data) {
+            memcpy(buf, segs[i].data, segs[i].len);
+            continue;
+        }
+        if (segs[i].physical == 0) {
+            memset(buf, 0, segs[i].len);
+            continue;
+        }
+        reqs[k] = (block_req){0};
+        reqs[k].start = segs[i].physical;
+        reqs[k].in_block = segs[i].in_block;
+        reqs[k].buf = buf;
+        reqs[k].len = segs[i].len;
+        reqs[k].write = writing;
+        k++;
+    }
+    int rc = k ? block_rw_batch(folder, reqs, k, spblock.blocksize) : 0;
+    if (reqs != stack) free(reqs);
+    return rc;
+}
+
+// ---- Lectura anticipada ----
+
+static fsops_ra_stats ra_stats;         // bajo meta
+
+// Avisa al backend los bloques lógicos [from, to) por tramos físicos
+// contiguos, salteando los huecos
+static int prefetch_range(const char *folder, const inode *node, u32 from, u32 to) {
+    while (from < to) {
+        u32 phys, run;
+        if (filemap_bmap(folder, node, from, &phys, &run) != 0) return -1;
+        if (run > to - from) run = to - from;
+        if (phys && block_prefetch(folder, phys, run, spblock.blocksize) != 0) return -1;
+        from += run;
+    }
+    return 0;
+}
+
+int fsops_readahead(const char *folder, u32 inode_id, fsops_ra *ra, u64 offset, u32 len) {
+    if (!ra || len == 0) return 0;
+    pthread_mutex_lock(&meta);
+    if (offset != ra->next) {
+        ra->seq = 0;
+        ra->window = 0;
+    }
+    ra->seq++;
+    ra->next = offset + len;
+    if (ra->seq < FSOPS_RA_TRIGGER) {
+        pthread_mutex_unlock(&meta);
+        return 0;
+    }
+
+    u32 bs = spblock.blocksize;
+    u64 end = (ra->next + bs - 1) / bs;           // primer bloque después de esta lectura
+    int rc = 0;
+    if (end > UINT32_MAX) goto out;
+    if (ra->window == 0 || ra->ahead < end) {
+        // Ventana nueva, o el lector pasó lo pedido: se vuelve a pedir desde acá
+        if (ra->window == 0) ra->window = FSOPS_RA_MIN;
+        ra->ahead = (u32)end;
+    }
+    if (ra->ahead - end > ra->window / 2) goto out;   // queda bastante en vuelo
+
+    inode *node = icache_get(folder, inode_id);
+    if (!node) { rc = -1; goto out; }
+    u64 size_blocks = ((u64)node->inode_size + bs - 1) / bs, stop = end + ra->window;
+    if (stop > size_blocks) stop = size_blocks;
+    if (!IS_DIR(node) && stop > ra->ahead) {
+        rc = prefetch_range(folder, node, ra->ahead, (u32)stop);
+        ra_stats.windows++;
+        ra_stats.blocks += stop - ra->ahead;
+        ra->ahead = (u32)stop;
+        if (ra->window < FSOPS_RA_MAX) ra->window *= 2;
+    }
+    icache_put(node);
+out:
+    pthread_mutex_unlock(&meta);
+    return rc;
+}
+
+void fsops_get_ra_stats(fsops_ra_stats *out) {
+    pthread_mutex_lock(&meta);
+    *out = ra_stats;
+    pthread_mutex_unlock(&meta);
+}
+
+long fsops_read(const char *folder, u32 inode_id, u64 offset, void *buf, u32 len) {
+    if (!parallel) {
+        pthread_mutex_lock(&meta);
+        inode *node = icache_get(folder, inode_id);
+        long r = -1;
+        if (node) {
+            r = IS_DIR(node) ? (errno = EISDIR, -1) : file_read(folder, node, offset, buf, len);
+            icache_put(node);
+        }
+        pthread_mutex_unlock(&meta);
+        return r;
+    }
+
+    fsops_seg *segs;
+    u32 n, got;
+    if (fsops_map(folder, inode_id, offset, len, 0, &segs, &n, &got) != 0) return -1;
+    int rc = io_segments(folder, segs, n, (unsigned char*)buf, 0);
+    fsops_io_end();
+    free(segs);
+    return rc == 0 ? (long)got : -1;
+}
+
+long fsops_write(const char *folder, u32 inode_id, u64 offset, const void *buf, u32 len) {
+    // Lo que puede quedar dentro del inodo se copia bajo meta, sin pasarlo a un
+    // bloque. Con deduplicación todo va por acá, y con io exclusivo: compartir
+    // o copiar un bloque puede liberar el que el archivo tenía.
+    int dedup = dedup_active();
+    if (!parallel || dedup || offset + len <= QRFS_INLINE_DATA) {
+        if (dedup) pthread_rwlock_wrlock(&io);
+        pthread_mutex_lock(&meta);
+        inode *node = icache_get(folder, inode_id);
+        long r = -1;
+        if (node) {
+            if (IS_DIR(node)) {
+                errno = EISDIR;
+            } else {
+                // Si falla no cambian los tiempos; solo se guarda el inodo si
+                // alcanzó a asignar o crecer antes del error
+                inode before = *node;
+                r = file_write(folder, node, offset, buf, len);
+                if (r >= 0) touch(node);
+                if (r >= 0 || memcmp(&before, node, sizeof(before)) != 0) icache_mark_dirty(node);
+            }
+            icache_put(node);
+            commit_if_due(folder);
+        }
+        pthread_mutex_unlock(&meta);
+        if (dedup) pthread_rwlock_unlock(&io);
+        return r;
+    }
+
+    fsops_seg *segs;
+    u32 n, got;
+    if (fsops_map(folder, inode_id, offset, len, 1, &segs, &n, &got) != 0) return -1;
+    int rc = io_segments(folder, segs, n, (unsigned char*)buf, 1);
+    fsops_write_end(folder, inode_id, offset, segs, n, rc == 0 ? got : 0);
+    free(segs);
+    return rc == 0 ? (long)got : -1;
+}
@@ -0,0 +1,121 @@
+#ifndef FSOPS_H
+#define FSOPS_H
+#include "fs_basic.h"
+#include <stddef.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+
+// Operaciones de un volumen montado, por número de inodo, seguras para
+// llamar desde varios hilos. Es la capa que usan los frontends (FUSE).
+//
+// Locking:
+//  - meta: un mutex que protege caches, bitmaps, directorios e inodos.
+//  - io:   rwlock que las transferencias de datos toman compartido mientras
+//          copian fuera de meta; liberar bloques (truncate, unlink, rmdir,
+//          rename que reemplaza) lo toma exclusivo para que ninguna copia en
+//          curso escriba en un bloque ya reasignado.
+// Con el backend de archivos por bloque los datos también se copian bajo
+// meta, porque su cache de descriptores no es reentrante.
+//
+// Con diario (QRFS_FEAT_JOURNAL) fsops_sync es un commit agrupado: los
+// llamadores concurrentes comparten una sola escritura del diario y un flush.
+//
+// Errores: -1 con errno, como el resto del código.
+
+typedef struct fsops_options {
+    size_t bcache_budget;     // 0 = por defecto
+    size_t icache_budget;
+    size_t dcache_budget;
+    int    use_mmap;          // volúmenes de imagen: montar mapeados
+    int    sync_ops;          // create/mkdir/unlink/rmdir/rename persistentes al volver
+    int    verify;            // volúmenes con sumas por bloque: CSUM_VERIFY_* (0 = todo)
+} fsops_options;
+
+// Tramo de un rango de archivo que vive en bloques físicos contiguos
+typedef struct fsops_seg {
+    u32 physical;             // primer bloque; 0 = hueco (se lee como ceros)
+    u32 in_block;             // offset dentro de ese bloque
+    u32 len;                  // bytes
+    const unsigned char *data;   // datos en el inodo (solo al leer): copia que vive con *segs
+    u32 fresh;                // asignados por esta escritura (fsops_write_end)
+} fsops_seg;
+
+// Lectura anticipada por archivo abierto. Tras FSOPS_RA_TRIGGER lecturas
+// seguidas donde terminó la anterior se pide al backend la ventana de bloques
+// que sigue (traducida por el mapa del inodo, sin los huecos), y se vuelve a
+// pedir, duplicada, cuando el lector consume la mitad de lo adelantado. Un
+// salto vuelve la ventana a cero. Los bloques de datos no pasan por la cache
+// de bloques: el aviso lo atiende el host en segundo plano.
+#define FSOPS_RA_TRIGGER 2
+#define FSOPS_RA_MIN     8      // bloques
+#define FSOPS_RA_MAX     256
+
+// Estado de un handle; empieza en cero. Lo actualiza fsops_readahead bajo el
+// lock global, así que el handle se puede compartir entre hilos.
+typedef struct fsops_ra {
+    u64 next;                 // offset donde seguiría una lectura secuencial
+    u32 seq;                  // lecturas secuenciales seguidas
+    u32 window;               // bloques; 0 = sin ventana abierta
+    u32 ahead;                // primer bloque lógico todavía no pedido
+} fsops_ra;
+
+typedef struct fsops_ra_stats {
+    unsigned long long windows;   // pedidos de lectura anticipada
+    unsigned long long blocks;    // bloques pedidos
+} fsops_ra_stats;
+
+// Callback de fsops_readdir: `next` es el offset para retomar después de esta
+// entrada. Devolver != 0 corta el listado (buffer lleno).
+typedef int (*fsops_dir_fn)(const char *name, u32 inode_id, mode_t mode, u64 next, void *ctx);
+
+int  fsops_mount(const char *folder, const fsops_options *opt);
+int  fsops_unmount(const char *folder);
+int  fsops_sync(const char *folder);
+u32  fsops_root(void);
+u32  fsops_block_size(void);
+int  fsops_parallel_io(void);   // 1 si los datos se copian fuera del lock global
+int  fsops_direct_writes(void); // 1 si las escrituras pueden ir por fsops_map (sin deduplicación)
+
+int  fsops_lookup(const char *folder, u32 parent, const char *name, u32 *inode_id);
+int  fsops_getattr(const char *folder, u32 inode_id, struct stat *st);
+int  fsops_create(const char *folder, u32 parent, const char *name, mode_t mode,
+                  u32 uid, u32 gid, u32 *inode_id);
+int  fsops_mkdir(const char *folder, u32 parent, const char *name, mode_t mode,
+                 u32 uid, u32 gid, u32 *inode_id);
+int  fsops_unlink(const char *folder, u32 parent, const char *name);
+int  fsops_rmdir(const char *folder, u32 parent, const char *name);
+int  fsops_rename(const char *folder, u32 parent, const char *name, u32 new_parent, const char *new_name);
+int  fsops_truncate(const char *folder, u32 inode_id, u64 size);
+int  fsops_chmod(const char *folder, u32 inode_id, mode_t mode);
+int  fsops_chown(const char *folder, u32 inode_id, u32 uid, u32 gid);
+int  fsops_readdir(const char *folder, u32 inode_id, u64 offset, fsops_dir_fn fn, void *ctx);
+int  fsops_statfs(const char *folder, struct statvfs *st);
+
+// Un inodo abierto no se libera al quedar sin enlaces hasta el último release
+int  fsops_open(const char *folder, u32 inode_id);
+int  fsops_release(const char *folder, u32 inode_id);
+
+long fsops_read(const char *folder, u32 inode_id, u64 offset, void *buf, u32 len);
+// Antes de fsops_read/fsops_map con el rango que se va a leer
+int  fsops_readahead(const char *folder, u32 inode_id, fsops_ra *ra, u64 offset, u32 len);
+void fsops_get_ra_stats(fsops_ra_stats *out);
+long fsops_write(const char *folder, u32 inode_id, u64 offset, const void *buf, u32 len);
+
+// Camino sin copia intermedia: traduce el rango a tramos físicos (asignando
+// si `for_write`) y deja tomado el lock io compartido hasta fsops_io_end, para
+// que el llamador copie directo desde/hacia los bloques. `*segs` se libera con free. Solo con fsops_parallel_io().
+// Un archivo con los datos en el inodo se lee en un tramo con `data`; para
+// escribirle se pasa antes a un bloque, así que las escrituras que entran en
+// QRFS_INLINE_DATA conviene hacerlas con fsops_write. Con deduplicación las
+// escrituras solo van por fsops_write (for_write da EOPNOTSUPP).
+int  fsops_map(const char *folder, u32 inode_id, u64 offset, u32 len, int for_write,
+               fsops_seg **segs, u32 *nsegs, u32 *mapped);
+void fsops_io_end(void);
+// En lugar de fsops_io_end después de escribir: `done` son los bytes copiados
+// desde `offset` (hasta el final de un tramo). El archivo crece solo hasta
+// ahí, y los bloques nuevos que quedaron sin escribir se ponen en cero, así
+// una copia que falla no deja a la vista lo que tenían antes.
+void fsops_write_end(const char *folder, u32 inode_id, u64 offset,
+                     const fsops_seg *segs, u32 nsegs, u32 done);
+
+#endif
@@ -0,0 +1,544 @@
+#include "fs_basic.h"
+#include "fs_utils.h"
+#include "htree.h"
+#include "dir.h"
+#include "filemap.h"
+#include "bcache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+// Camino desde la raíz hasta una hoja
+typedef struct ht_path {
+    u32 n;                          // nodos de índice recorridos
+    u32 node[HTREE_MAX_LEVELS];     // bloque lógico de cada nodo (node[0] = raíz)
+    u32 pos[HTREE_MAX_LEVELS];      // entrada elegida en cada nodo
+    u32 leaf;                       // bloque lógico de la hoja
+} ht_path;
+
+// Nombre en tránsito (partición de hojas, construcción del índice)
+typedef struct ht_rec {
+    u32 hash;
+    u32 inode_id;
+    char name[DIR_NAME_MAX + 1];
+} ht_rec;
+
+typedef struct ht_recs {
+    ht_rec *v;
+    u32 n, cap;
+} ht_recs;
+
+// FNV-1a con mezcla final; el bit 0 queda libre para las claves de continuación
+u32 htree_hash(const char *name) {
+    u32 h = 2166136261u;
+    for (const unsigned char *p = (const unsigned char*)name; *p; p++) {
+        h ^= *p;
+        h *= 16777619u;
+    }
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    return h & ~1u;
+}
+
+static u32 node_cap(void) {
+    return (spblock.blocksize - HTREE_HEADER) / HTREE_ENTRY_SIZE;
+}
+
+static u32 ix_count(const unsigned char *b) { return u32le_read(&b[12]); }
+static u32 ix_level(const unsigned char *b) { return u32le_read(&b[16]); }
+static u32 ix_hash(const unsigned char *b, u32 i)  { return u32le_read(&b[HTREE_HEADER + i * HTREE_ENTRY_SIZE]); }
+static u32 ix_block(const unsigned char *b, u32 i) { return u32le_read(&b[HTREE_HEADER + i * HTREE_ENTRY_SIZE + 4]); }
+
+static void ix_set(unsigned char *b, u32 i, u32 hash, u32 block) {
+    u32le_write(hash,  &b[HTREE_HEADER + i * HTREE_ENTRY_SIZE]);
+    u32le_write(block, &b[HTREE_HEADER + i * HTREE_ENTRY_SIZE + 4]);
+}
+
+static void ix_init(unsigned char *b, u32 level) {
+    dirblock_init(b, spblock.blocksize);
+    b[8]='Q'; b[9]='R'; b[10]='H'; b[11]='T';
+    u32le_write(0, &b[12]);
+    u32le_write(level, &b[16]);
+}
+
+static void ix_insert_at(unsigned char *b, u32 pos, u32 hash, u32 block) {
+    u32 count = ix_count(b);
+    unsigned char *at = &b[HTREE_HEADER + pos * HTREE_ENTRY_SIZE];
+    memmove(at + HTREE_ENTRY_SIZE, at, (count - pos) * HTREE_ENTRY_SIZE);
+    ix_set(b, pos, hash, block);
+    u32le_write(count + 1, &b[12]);
+}
+
+static int ix_check(const unsigned char *b, u32 logical) {
+    if (b[8] != 'Q' || b[9] != 'R' || b[10] != 'H' || b[11] != 'T' ||
+        ix_count(b) == 0 || ix_count(b) > node_cap() || ix_level(b) >= HTREE_MAX_LEVELS) {
+        fprintf(stderr, "Bloque de índice de directorio inválido (bloque lógico %u)\n", logical);
+        errno = EIO;
+        return -1;
+    }
+    return 0;
+}
+
+// Nodo de índice fijado en la cache; liberar con bcache_put
+static const unsigned char *ix_get(const char *folder, const inode *dir, u32 logical) {
+    u32 phys;
+    if (dir_map(folder, dir, logical, &phys) != 0) return NULL;
+    const unsigned char *b = bcache_get(folder, phys, spblock.blocksize);
+    if (b && ix_check(b, logical) != 0) {
+        bcache_put(b);
+        return NULL;
+    }
+    return b;
+}
+
+// Última entrada con clave <= hash; la entrada 0 cubre todo lo anterior
+static u32 ix_search(const unsigned char *b, u32 hash) {
+    u32 lo = 1, hi = ix_count(b);
+    while (lo < hi) {
+        u32 mid = (lo + hi) / 2;
+        if (ix_hash(b, mid) <= hash) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo - 1;
+}
+
+static int ht_descend(const char *folder, const inode *dir, u32 hash, ht_path *p) {
+    u32 logical = 0, expect = 0;
+    p->n = 0;
+    for (;;) {
+        const unsigned char *b = ix_get(folder, dir, logical);
+        if (!b) return -1;
+        u32 level = ix_level(b);
+        if (p->n > 0 && level != expect) {
+            bcache_put(b);
+            fprintf(stderr, "Índice de directorio %u: niveles inconsistentes\n", dir->inode_number);
+            errno = EIO;
+            return -1;
+        }
+        u32 pos = ix_search(b, hash), child = ix_block(b, pos);
+        bcache_put(b);
+        p->node[p->n] = logical;
+        p->pos[p->n] = pos;
+        p->n++;
+        if (level == 0) {
+            p->leaf = child;
+            return 0;
+        }
+        expect = level - 1;
+        logical = child;
+    }
+}
+
+// Avanza el camino a la hoja siguiente en orden de hash. Devuelve 1 y la
+// clave con la que empieza, 0 si no hay más hojas, -1 en error.
+static int ht_next(const char *folder, const inode *dir, ht_path *p, u32 *key) {
+    int i = (int)p->n - 1;
+    u32 child = 0;
+    for (; i >= 0; i--) {
+        const unsigned char *b = ix_get(folder, dir, p->node[i]);
+        if (!b) return -1;
+        int more = p->pos[i] + 1 < ix_count(b);
+        if (more) {
+            p->pos[i]++;
+            *key  = ix_hash(b, p->pos[i]);
+            child = ix_block(b, p->pos[i]);
+        }
+        bcache_put(b);
+        if (more) break;
+    }
+    if (i < 0) return 0;
+
+    for (u32 j = (u32)i + 1; j < p->n; j++) {
+        const unsigned char *b = ix_get(folder, dir, child);
+        if (!b) return -1;
+        p->node[j] = child;
+        p->pos[j] = 0;
+        child = ix_block(b, 0);
+        bcache_put(b);
+    }
+    p->leaf = child;
+    return 1;
+}
+
+int htree_lookup(const char *folder, const inode *dir, const char *name, u32 *inode_id) {
+    u32 hash = htree_hash(name), bs = spblock.blocksize;
+    ht_path p;
+    if (ht_descend(folder, dir, hash, &p) != 0) return -1;
+    for (;;) {
+        u32 phys, key;
+        if (dir_map(folder, dir, p.leaf, &phys) != 0) return -1;
+        const unsigned char *buf = bcache_get(folder, phys, bs);
+        if (!buf) return -1;
+        int off = dirblock_find(buf, bs, name, inode_id);
+        bcache_put(buf);
+        if (off >= 0) return 0;
+
+        int r = ht_next(folder, dir, &p, &key);
+        if (r < 0) return -1;
+        if (r == 0 || key != (hash | 1u)) break;
+    }
+    errno = ENOENT;
+    return -1;
+}
+
+int htree_remove(const char *folder, inode *dir, const char *name) {
+    u32 hash = htree_hash(name), bs = spblock.blocksize;
+    ht_path p;
+    if (ht_descend(folder, dir, hash, &p) != 0) return -1;
+    unsigned char *buf = (unsigned char*)malloc(bs);
+    if (!buf) { errno = ENOMEM; return -1; }
+    for (;;) {
+        u32 phys, key;
+        if (dir_map(folder, dir, p.leaf, &phys) != 0 || bcache_read(folder, phys, buf, bs) != 0) break;
+        if (dirblock_remove(buf, bs, name) == 0) {
+            int rc = bcache_write(folder, phys, buf, bs);
+            free(buf);
+            return rc;
+        }
+        int r = ht_next(folder, dir, &p, &key);
+        if (r < 0) break;
+        if (r == 0 || key != (hash | 1u)) { errno = ENOENT; break; }
+    }
+    free(buf);
+    return -1;
+}
+
+// Inserta (key -> child) después de la entrada elegida en el nivel `i` del
+// camino, partiendo nodos llenos hacia arriba. Si la raíz está llena, su
+// contenido baja a un bloque nuevo y el árbol crece un nivel.
+static int ht_index_insert(const char *folder, inode *dir, ht_path *p, u32 i, u32 key, u32 child) {
+    u32 bs = spblock.blocksize, cap = node_cap();
+    unsigned char *b = (unsigned char*)malloc(bs), *nb = (unsigned char*)malloc(bs);
+    int rc = -1;
+    if (!b || !nb) { errno = ENOMEM; goto out; }
+
+    for (;;) {
+        u32 phys, nl, np;
+        if (dir_map(folder, dir, p->node[i], &phys) != 0 || bcache_read(folder, phys, b, bs) != 0) goto out;
+        u32 count = ix_count(b), pos = p->pos[i] + 1;
+        if (count < cap) {
+            ix_insert_at(b, pos, key, child);
+            rc = bcache_write(folder, phys, b, bs);
+            goto out;
+        }
+
+        if (i == 0) {
+            if (p->n >= HTREE_MAX_LEVELS) { errno = EFBIG; goto out; }
+            if (dir_append_block(folder, dir, &nl, &np) != 0) goto out;
+            if (bcache_write(folder, np, b, bs) != 0) goto out;
+            ix_init(nb, ix_level(b) + 1);
+            ix_insert_at(nb, 0, 0, nl);
+            if (bcache_write(folder, phys, nb, bs) != 0) goto out;
+            memmove(&p->node[1], &p->node[0], p->n * sizeof(u32));
+            memmove(&p->pos[1],  &p->pos[0],  p->n * sizeof(u32));
+            p->node[1] = nl;
+            p->pos[0] = 0;
+            p->n++;
+            i = 1;
+            continue;
+        }
+
+        // Partir el nodo: la mitad superior va a un bloque nuevo
+        if (dir_append_block(folder, dir, &nl, &np) != 0) goto out;
+        u32 half = count / 2;
+        ix_init(nb, ix_level(b));
+        memcpy(&nb[HTREE_HEADER], &b[HTREE_HEADER + half * HTREE_ENTRY_SIZE], (count - half) * HTREE_ENTRY_SIZE);
+        u32le_write(count - half, &nb[12]);
+        u32le_write(half, &b[12]);
+        memset(&b[HTREE_HEADER + half * HTREE_ENTRY_SIZE], 0, (count - half) * HTREE_ENTRY_SIZE);
+        if (pos >= half) ix_insert_at(nb, pos - half, key, child);
+        else             ix_insert_at(b, pos, key, child);
+        if (bcache_write(folder, phys, b, bs) != 0 || bcache_write(folder, np, nb, bs) != 0) goto out;
+
+        key = ix_hash(nb, 0);
+        child = nl;
+        i--;
+    }
+out:
+    free(b);
+    free(nb);
+    return rc;
+}
+
+static int recs_push(ht_recs *r, u32 inode_id, const char *name) {
+    if (r->n == r->cap) {
+        u32 cap = r->cap ? r->cap * 2 : 16;
+        ht_rec *v = (ht_rec*)realloc(r->v, cap * sizeof(ht_rec));
+        if (!v) { errno = ENOMEM; return -1; }
+        r->v = v;
+        r->cap = cap;
+    }
+    ht_rec *e = &r->v[r->n++];
+    e->hash = htree_hash(name);
+    e->inode_id = inode_id;
+    strncpy(e->name, name, DIR_NAME_MAX);
+    e->name[DIR_NAME_MAX] = '\0';
+    return 0;
+}
+
+static int collect_cb(u32 inode_id, const char *name, void *ctx) {
+    return recs_push((ht_recs*)ctx, inode_id, name) != 0 ? -1 : 0;
+}
+
+static int rec_cmp(const void *a, const void *b) {
+    u32 x = ((const ht_rec*)a)->hash, y = ((const ht_rec*)b)->hash;
+    return x < y ? -1 : x > y;
+}
+
+// Punto de corte de una hoja desbordada: lo más cerca posible de la mitad en
+// bytes, preferentemente entre hashes distintos y con ambas mitades entrando.
+static u32 split_point(const ht_recs *r, u32 bs) {
+    u32 n = r->n, total = 0, s0 = 1;
+    u32 *prefix = (u32*)malloc((n + 1) * sizeof(u32));
+    if (!prefix) return n / 2;
+    prefix[0] = 0;
+    for (u32 i = 0; i < n; i++) {
+        total += dirblock_entry_size((u32)strlen(r->v[i].name));
+        prefix[i + 1] = total;
+    }
+    while (s0 < n - 1 && prefix[s0] < total / 2) s0++;
+
+    u32 fallback = 0;
+    for (u32 d = 0; d < n; d++) {
+        for (int side = 0; side < 2; side++) {
+            long s = side ? (long)s0 + d : (long)s0 - d;
+            if (s < 1 || s > (long)n - 1 || (side && d == 0)) continue;
+            if (prefix[s] > bs || total - prefix[s] > bs) continue;
+            if (r->v[s].hash != r->v[s - 1].hash) { free(prefix); return (u32)s; }
+            if (!fallback) fallback = (u32)s;
+        }
+    }
+    free(prefix);
+    return fallback ? fallback : n / 2;
+}
+
+static int fill_leaf(unsigned char *buf, u32 bs, const ht_recs *r, u32 from, u32 to) {
+    dirblock_init(buf, bs);
+    for (u32 i = from; i < to; i++) {
+        if (dirblock_insert(buf, bs, r->v[i].inode_id, r->v[i].name) != 0) { errno = ENOSPC; return -1; }
+    }
+    return 0;
+}
+
+int htree_insert(const char *folder, inode *dir, const char *name, u32 inode_id) {
+    u32 hash = htree_hash(name), bs = spblock.blocksize, phys;
+    ht_path p;
+    if (ht_descend(folder, dir, hash, &p) != 0) return -1;
+    unsigned char *buf = (unsigned char*)malloc(bs), *nbuf = NULL;
+    ht_recs r = {0};
+    int rc = -1;
+    if (!buf) { errno = ENOMEM; return -1; }
+    if (dir_map(folder, dir, p.leaf, &phys) != 0 || bcache_read(folder, phys, buf, bs) != 0) goto out;
+    if (dirblock_insert(buf, bs, inode_id, name) == 0) {
+        rc = bcache_write(folder, phys, buf, bs);
+        goto out;
+    }
+
+    // Hoja llena: se reparte por hash entre ella y una hoja nueva
+    if (dirblock_iterate(buf, bs, collect_cb, &r) != 0 || recs_push(&r, inode_id, name) != 0) goto out;
+    qsort(r.v, r.n, sizeof(ht_rec), rec_cmp);
+    u32 s = split_point(&r, bs);
+    u32 key = r.v[s].hash | (r.v[s].hash == r.v[s - 1].hash ? 1u : 0u);
+
+    u32 nl, np;
+    if (!(nbuf = (unsigned char*)malloc(bs))) { errno = ENOMEM; goto out; }
+    if (fill_leaf(buf, bs, &r, 0, s) != 0 || fill_leaf(nbuf, bs, &r, s, r.n) != 0) goto out;
+    if (dir_append_block(folder, dir, &nl, &np) != 0) goto out;
+    if (ht_index_insert(folder, dir, &p, p.n - 1, key, nl) != 0) goto out;
+    if (bcache_write(folder, np, nbuf, bs) != 0) goto out;
+    rc = bcache_write(folder, phys, buf, bs);
+out:
+    free(r.v);
+    free(nbuf);
+    free(buf);
+    return rc;
+}
+
+// Convierte un directorio lineal: junta sus nombres y arma raíz + una hoja
+// en bloques nuevos, insertando después cada nombre por hash. El índice se
+// construye sobre una copia del inodo y el directorio cambia de mapa recién
+// cuando entró todo; los bloques viejos se liberan al final. Si algo falla
+// (sin lugar, típicamente) se liberan los bloques nuevos y el directorio
+// queda lineal como estaba.
+int htree_build(const char *folder, inode *dir) {
+    u32 bs = spblock.blocksize, phys;
+    ht_recs r = {0};
+    unsigned char *buf = (unsigned char*)malloc(bs);
+    int rc = -1;
+    if (!buf) { errno = ENOMEM; return -1; }
+    if (dir_iterate(folder, dir, collect_cb, &r) != 0) goto out;
+
+    // El índice usa extents aunque el volumen no, porque con direct/indirect1
+    // no pasaría de 12 + bs/4 bloques (unas 13k entradas con bloques de 1 KiB)
+    inode ix = *dir;
+    memset(ix.inline_data, 0, sizeof(ix.inline_data));
+    ix.inode_size = 0;
+    ix.flags |= QRFS_INODE_HTREE | QRFS_INODE_EXTENTS;
+
+    u32 root, leaf;
+    if (dir_append_block(folder, &ix, &root, &phys) != 0) goto undo;
+    if (dir_append_block(folder, &ix, &leaf, &phys) != 0) goto undo;
+    dirblock_init(buf, bs);
+    if (bcache_write(folder, phys, buf, bs) != 0) goto undo;
+    ix_init(buf, 0);
+    ix_insert_at(buf, 0, 0, leaf);
+    if (dir_map(folder, &ix, root, &phys) != 0 || bcache_write(folder, phys, buf, bs) != 0) goto undo;
+    for (u32 i = 0; i < r.n; i++) {
+        if (htree_insert(folder, &ix, r.v[i].name, r.v[i].inode_id) != 0) goto undo;
+    }
+
+    inode old = *dir;
+    *dir = ix;
+    filemap_truncate(folder, &old, 0);   // un error acá solo deja bloques perdidos, no nombres
+    rc = 0;
+    goto out;
+undo:;
+    int err = errno;
+    filemap_truncate(folder, &ix, 0);
+    errno = err;
+out:
+    free(r.v);
+    free(buf);
+    return rc;
+}
+
+// ---- Recorrido en orden de hash ----
+
+typedef struct ht_walk {
+    dir_iter_fn fn;
+    void *ctx;
+    htree_info *info;
+    u32 lo, hi;          // rango de hash de la hoja actual
+    int hi_inclusive;    // la hoja siguiente es de continuación
+} ht_walk;
+
+static int check_cb(u32 inode_id, const char *name, void *ctx) {
+    ht_walk *w = (ht_walk*)ctx;
+    u32 h = htree_hash(name);
+    w->info->entries++;
+    if (h < w->lo || (w->hi_inclusive ? h > w->hi : h >= w->hi)) {
+        fprintf(stderr, "Índice de directorio: '%s' (hash %08x) fuera de su hoja\n", name, h);
+        w->info->misplaced++;
+    }
+    return w->fn ? w->fn(inode_id, name, w->ctx) : 0;
+}
+
+static int walk_node(const char *folder, const inode *dir, u32 logical, u32 level,
+                     u32 lo, u32 hi, int hi_inclusive, ht_walk *w) {
+    u32 bs = spblock.blocksize;
+    unsigned char *b = (unsigned char*)malloc(bs);
+    if (!b) { errno = ENOMEM; return -1; }
+    u32 phys;
+    int rc = -1;
+    if (dir_map(folder, dir, logical, &phys) != 0 || bcache_read(folder, phys, b, bs) != 0) goto out;
+    if (ix_check(b, logical) != 0) goto out;
+    if (ix_level(b) != level) {
+        fprintf(stderr, "Índice de directorio %u: niveles inconsistentes\n", dir->inode_number);
+        errno = EIO;
+        goto out;
+    }
+    if (w->info) w->info->index_blocks++;
+
+    u32 count = ix_count(b);
+    rc = 0;
+    for (u32 i = 0; i < count && rc == 0; i++) {
+        u32 clo = i == 0 ? lo : ix_hash(b, i);
+        u32 chi = i + 1 < count ? ix_hash(b, i + 1) : hi;
+        int cincl = i + 1 < count ? (int)(chi & 1u) : hi_inclusive;
+        if (level > 0) {
+            rc = walk_node(folder, dir, ix_block(b, i), level - 1, clo, chi, cincl, w);
+            continue;
+        }
+        u32 lphys;
+        if (dir_map(folder, dir, ix_block(b, i), &lphys) != 0) { rc = -1; break; }
+        const unsigned char *leaf = bcache_get(folder, lphys, bs);
+        if (!leaf) { rc = -1; break; }
+        if (w->info) {
+            w->info->leaves++;
+            w->lo = clo & ~1u;
+            w->hi = cincl ? chi & ~1u : chi;
+            w->hi_inclusive = cincl;
+            rc = dirblock_iterate(leaf, bs, check_cb, w);
+        } else {
+            rc = dirblock_iterate(leaf, bs, w->fn, w->ctx);
+        }
+        bcache_put(leaf);
+    }
+out:
+    free(b);
+    return rc;
+}
+
+static int walk(const char *folder, const inode *dir, ht_walk *w) {
+    const unsigned char *root = ix_get(folder, dir, 0);
+    if (!root) return -1;
+    u32 level = ix_level(root);
+    bcache_put(root);
+    if (w->info) w->info->levels = level + 1;
+    return walk_node(folder, dir, 0, level, 0, UINT32_MAX, 1, w);
+}
+
+int htree_iterate(const char *folder, const inode *dir, dir_iter_fn fn, void *ctx) {
+    // El recorrido pasa por todos los bloques: si entran en la cache se piden juntos
+    u32 n = dir_nblocks(dir);
+    if (n <= bcache_capacity() / 2) {
+        for (u32 l = 0; l < n; l += DIR_PREFETCH_BLOCKS) {
+            if (dir_prefetch(folder, dir, l, DIR_PREFETCH_BLOCKS) != 0) return -1;
+        }
+    }
+    ht_walk w = { fn, ctx, NULL, 0, 0, 0 };
+    return walk(folder, dir, &w);
+}
+
+static int rec_cmp_name(const void *a, const void *b) {
+    const ht_rec *x = (const ht_rec*)a, *y = (const ht_rec*)b;
+    if (x->hash != y->hash) return x->hash < y->hash ? -1 : 1;
+    return strcmp(x->name, y->name);
+}
+
+// Posición = (hash >> 1) << 31 | cuántos nombres con ese hash ya se vieron.
+// Cada hoja se entrega ordenada por (hash, nombre), así las posiciones crecen
+// y retomar es bajar por el índice hasta la primera hoja del hash.
+int htree_iterate_from(const char *folder, const inode *dir, u64 pos, dir_pos_fn fn, void *ctx) {
+    u32 h = (u32)(pos >> 31) << 1, skip = (u32)(pos & 0x7fffffffu), bs = spblock.blocksize;
+    ht_path p;
+    if (ht_descend(folder, dir, h, &p) != 0) return -1;
+    ht_recs r = {0};
+    u32 last = 0, rank = 0;
+    int rc = 0, seen = 0;
+    for (;;) {
+        u32 phys, key;
+        const unsigned char *leaf = NULL;
+        if (dir_map(folder, dir, p.leaf, &phys) != 0 || !(leaf = bcache_get(folder, phys, bs))) { rc = -1; break; }
+        r.n = 0;
+        rc = dirblock_iterate(leaf, bs, collect_cb, &r);
+        bcache_put(leaf);
+        if (rc != 0) break;
+        qsort(r.v, r.n, sizeof(ht_rec), rec_cmp_name);
+        for (u32 i = 0; i < r.n && rc == 0; i++) {
+            const ht_rec *e = &r.v[i];
+            if (e->hash < h) continue;
+            if (!seen || e->hash != last) {
+                last = e->hash;
+                rank = 0;
+                seen = 1;
+            }
+            rank++;
+            if (e->hash == h && rank <= skip) continue;
+            rc = fn(e->inode_id, e->name, ((u64)(e->hash >> 1) << 31) | rank, ctx);
+        }
+        if (rc != 0) break;
+        int more = ht_next(folder, dir, &p, &key);
+        if (more <= 0) { rc = more; break; }
+    }
+    free(r.v);
+    return rc;
+}
+
+int htree_check(const char *folder, const inode *dir, htree_info *info) {
+    memset(info, 0, sizeof(*info));
+    ht_walk w = { NULL, NULL, info, 0, 0, 0 };
+    return walk(folder, dir, &w);
+}
@@ -0,0 +1,40 @@
+#ifndef HTREE_H
+#define HTREE_H
+#include "fs_basic.h"
+#include "dir.h"
+
+// Índice hash de directorio (inodo con QRFS_INODE_HTREE). El bloque lógico 0
+// es la raíz; los nodos de índice apuntan a otros nodos o a hojas, que son
+// bloques de directorio comunes con los nombres de su rango de hash.
+//
+// Bloque de índice:
+//  [0..7]   entrada libre que cubre el bloque (un lector lineal no ve nombres)
+//  [8..11]  magic "QRHT"
+//  [12..15] cantidad de entradas
+//  [16..19] nivel (0 = los hijos son hojas)
+//  [20..]   entradas de 8 bytes (hash, bloque lógico), ordenadas por hash
+//
+// Los hashes de nombres tienen el bit 0 en cero. Una clave con el bit 0 en
+// uno marca una hoja que continúa los nombres con el mismo hash de la anterior.
+#define HTREE_HEADER     20
+#define HTREE_ENTRY_SIZE 8
+#define HTREE_MAX_LEVELS 4
+
+typedef struct htree_info {
+    u32 levels;         // niveles de índice (1 = solo la raíz)
+    u32 index_blocks;
+    u32 leaves;
+    u32 entries;
+    u32 misplaced;      // nombres fuera del rango de hash de su hoja
+} htree_info;
+
+u32 htree_hash(const char *name);
+int htree_build(const char *folder, inode *dir);
+int htree_lookup(const char *folder, const inode *dir, const char *name, u32 *inode_id);
+int htree_insert(const char *folder, inode *dir, const char *name, u32 inode_id);
+int htree_remove(const char *folder, inode *dir, const char *name);
+int htree_iterate(const char *folder, const inode *dir, dir_iter_fn fn, void *ctx);
+int htree_iterate_from(const char *folder, const inode *dir, u64 pos, dir_pos_fn fn, void *ctx);
+int htree_check(const char *folder, const inode *dir, htree_info *info);
+
+#endif
@@ -0,0 +1,350 @@
+#include "icache.h"
+#include "inode.h"
+#include "bcache.h"
+#include "bitmaps.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+// Slots fijos con hash encadenado por índice y lista LRU, como la dcache.
+// Un slot con referencias no se desaloja.
+typedef struct ic_slot {
+    inode node;          // primero: icache_put recibe &slot->node
+    u32 id;
+    int valid;
+    int dirty;
+    int refs;
+    int gone;            // olvidado con referencias: se libera en el último put
+    int hnext;           // siguiente en la cadena del bucket, -1 = fin
+    int prev, next;      // LRU (lru_head = más reciente); next también arma la lista libre
+} ic_slot;
+
+static ic_slot *slots = NULL;
+static int *buckets = NULL;
+static u32 nslots = 0;
+static u32 nbuckets = 0;
+static int lru_head = -1, lru_tail = -1;
+static int free_list = -1;
+static char ic_folder[512];
+static icache_stats stats;
+static u32 ndirty = 0;     // inodos sucios
+
+static u32 bucket_of(u32 id) {
+    return (id * 2654435761u) & (nbuckets - 1);
+}
+
+static void set_dirty(int s, int dirty) {
+    if (slots[s].dirty != dirty) ndirty += dirty ? 1u : (u32)-1;
+    slots[s].dirty = dirty;
+}
+
+static u32 table_block(u32 id) {
+    return spblock.inode_table_start + (u32)((u64)id * 128 / spblock.blocksize);
+}
+
+static u32 table_offset(u32 id) {
+    return (u32)((u64)id * 128 % spblock.blocksize);
+}
+
+static void clear_slots(void) {
+    for (u32 i = 0; i < nbuckets; i++) buckets[i] = -1;
+    for (u32 s = 0; s < nslots; s++) {
+        slots[s].valid = 0;
+        slots[s].dirty = 0;
+        slots[s].refs = 0;
+        slots[s].gone = 0;
+        slots[s].next = (s + 1 < nslots) ? (int)s + 1 : -1;
+    }
+    ndirty = 0;
+    free_list = 0;
+    lru_head = lru_tail = -1;
+}
+
+int icache_init(size_t budget_bytes) {
+    icache_shutdown();
+    u32 n = (u32)(budget_bytes / sizeof(ic_slot));
+    if (n < 16) n = 16;
+    u32 nb = 1;
+    while (nb < n) nb <<= 1;
+
+    slots = (ic_slot*)calloc(n, sizeof(ic_slot));
+    buckets = (int*)malloc(sizeof(int) * nb);
+    if (!slots || !buckets) {
+        free(slots); free(buckets);
+        slots = NULL; buckets = NULL;
+        errno = ENOMEM;
+        return -1;
+    }
+    nslots = n;
+    nbuckets = nb;
+    ic_folder[0] = '\0';
+    clear_slots();
+    return 0;
+}
+
+void icache_shutdown(void) {
+    if (!slots) return;
+    if (ic_folder[0]) icache_sync(ic_folder);
+    free(slots); free(buckets);
+    slots = NULL; buckets = NULL;
+    nslots = nbuckets = 0;
+    ndirty = 0;
+    lru_head = lru_tail = free_list = -1;
+}
+
+static int bind(const char *folder) {
+    if (!slots && icache_init(ICACHE_DEFAULT_BUDGET) != 0) return -1;
+    if (strcmp(ic_folder, folder) != 0) {
+        if (ic_folder[0]) icache_sync(ic_folder);
+        clear_slots();
+        snprintf(ic_folder, sizeof(ic_folder), "%s", folder);
+    }
+    return 0;
+}
+
+static void lru_unlink(int s) {
+    if (slots[s].prev >= 0) slots[slots[s].prev].next = slots[s].next;
+    else lru_head = slots[s].next;
+    if (slots[s].next >= 0) slots[slots[s].next].prev = slots[s].prev;
+    else lru_tail = slots[s].prev;
+}
+
+static void lru_push_front(int s) {
+    slots[s].prev = -1;
+    slots[s].next = lru_head;
+    if (lru_head >= 0) slots[lru_head].prev = s;
+    lru_head = s;
+    if (lru_tail < 0) lru_tail = s;
+}
+
+static int find(u32 id) {
+    for (int s = buckets[bucket_of(id)]; s >= 0; s = slots[s].hnext) {
+        if (slots[s].id == id) return s;
+    }
+    return -1;
+}
+
+static void link_slot(int s, u32 id) {
+    u32 b = bucket_of(id);
+    slots[s].id = id;
+    slots[s].valid = 1;
+    set_dirty(s, 0);
+    slots[s].refs = 0;
+    slots[s].gone = 0;
+    slots[s].hnext = buckets[b];
+    buckets[b] = s;
+    lru_push_front(s);
+}
+
+static void unhash(int s) {
+    int *p = &buckets[bucket_of(slots[s].id)];
+    while (*p >= 0 && *p != s) p = &slots[*p].hnext;
+    if (*p == s) *p = slots[s].hnext;
+}
+
+static void drop(int s) {
+    unhash(s);
+    lru_unlink(s);
+    slots[s].valid = 0;
+    set_dirty(s, 0);
+    slots[s].next = free_list;
+    free_list = s;
+}
+
+// Baja de una vez todos los inodos sucios que viven en el bloque `tb` de la tabla
+static int writeback_block(u32 tb) {
+    u32 bs = spblock.blocksize;
+    unsigned char *buf = (unsigned char*)malloc(bs);
+    if (!buf) { errno = ENOMEM; return -1; }
+    int rc = bcache_read(ic_folder, tb, buf, bs);
+    if (rc == 0) {
+        for (u32 s = 0; s < nslots; s++) {
+            if (!slots[s].valid || !slots[s].dirty || table_block(slots[s].id) != tb) continue;
+            inode_encode128(&buf[table_offset(slots[s].id)], &slots[s].node);
+        }
+        rc = bcache_write(ic_folder, tb, buf, bs);
+    }
+    // Limpios solo si el bloque se escribió; si no, siguen pendientes
+    for (u32 s = 0; rc == 0 && s < nslots; s++) {
+        if (!slots[s].valid || !slots[s].dirty || table_block(slots[s].id) != tb) continue;
+        set_dirty((int)s, 0);
+        stats.records_written++;
+    }
+    if (rc == 0) stats.blocks_written++;
+    free(buf);
+    return rc;
+}
+
+// Slot libre, o el no referenciado menos usado
+static int take_slot(void) {
+    if (free_list < 0) {
+        int s = lru_tail;
+        while (s >= 0 && slots[s].refs > 0) s = slots[s].prev;
+        if (s < 0) { errno = ENOBUFS; return -1; }   // todos referenciados
+        if (slots[s].dirty && writeback_block(table_block(slots[s].id)) != 0) return -1;
+        drop(s);
+        stats.evictions++;
+    }
+    int s = free_list;
+    free_list = slots[s].next;
+    return s;
+}
+
+// Lee el registro pedido y, con los slots libres que haya, los demás
+// inodos en uso del mismo bloque de la tabla
+static int load(u32 id) {
+    int s = take_slot();
+    if (s < 0) return -1;
+    u32 tb = table_block(id), bs = spblock.blocksize;
+    const unsigned char *buf = bcache_get(ic_folder, tb, bs);
+    if (!buf) {
+        slots[s].next = free_list;
+        free_list = s;
+        return -1;
+    }
+    inode_decode128(&buf[table_offset(id)], &slots[s].node);
+    slots[s].node.inode_number = id;
+    link_slot(s, id);
+
+    u32 per = bs / 128, first = (tb - spblock.inode_table_start) * per;
+    for (u32 r = 0; r < per && free_list >= 0 && spblock.inode_bitmap; r++) {
+        u32 other = first + r;
+        if (other == id || other >= spblock.total_inodes || !bitmap_test(spblock.inode_bitmap, other) ||
+            find(other) >= 0) continue;
+        int t = free_list;
+        free_list = slots[t].next;
+        inode_decode128(&buf[r * 128], &slots[t].node);
+        slots[t].node.inode_number = other;
+        link_slot(t, other);
+        stats.prefetched++;
+    }
+    bcache_put(buf);
+    return s;
+}
+
+inode *icache_get(const char *folder, u32 inode_id) {
+    if (inode_id >= spblock.total_inodes) { errno = EINVAL; return NULL; }
+    if (bind(folder) != 0) return NULL;
+    int s = find(inode_id);
+    if (s >= 0) {
+        stats.hits++;
+        lru_unlink(s);
+        lru_push_front(s);
+    } else {
+        stats.misses++;
+        if ((s = load(inode_id)) < 0) return NULL;
+    }
+    slots[s].refs++;
+    return &slots[s].node;
+}
+
+static int slot_of(const inode *node) {
+    const ic_slot *p = (const ic_slot*)node;
+    if (!slots || p < slots || p >= slots + nslots) return -1;
+    return (int)(p - slots);
+}
+
+void icache_put(inode *node) {
+    int s = slot_of(node);
+    if (s >= 0 && slots[s].refs > 0 && --slots[s].refs == 0 && slots[s].gone) drop(s);
+}
+
+void icache_mark_dirty(inode *node) {
+    int s = slot_of(node);
+    if (s >= 0 && !slots[s].gone) set_dirty(s, 1);
+}
+
+int icache_store(const char *folder, const inode *node) {
+    u32 id = node->inode_number;
+    if (id >= spblock.total_inodes) { errno = EINVAL; return -1; }
+    if (bind(folder) != 0) return -1;
+    int s = find(id);
+    if (s >= 0) {
+        lru_unlink(s);
+        lru_push_front(s);
+    } else {
+        if ((s = take_slot()) < 0) return -1;
+        link_slot(s, id);
+    }
+    if (&slots[s].node != node) slots[s].node = *node;
+    set_dirty(s, 1);
+    return 0;
+}
+
+// Se liberó el inodo: olvidar la copia sin escribirla. Si alguien todavía
+// la tiene, sale del hash ya (un get del mismo número lee el registro nuevo),
+// no se vuelve a ensuciar y el slot se libera en el último icache_put.
+void icache_forget(const char *folder, u32 inode_id) {
+    if (!slots || strcmp(ic_folder, folder) != 0) return;
+    int s = find(inode_id);
+    if (s < 0) return;
+    if (slots[s].refs == 0) {
+        drop(s);
+    } else {
+        unhash(s);
+        set_dirty(s, 0);
+        slots[s].gone = 1;
+    }
+}
+
+static int by_id(const void *a, const void *b) {
+    u32 x = slots[*(const int*)a].id, y = slots[*(const int*)b].id;
+    return x < y ? -1 : x > y;
+}
+
+// Un read-modify-write por bloque de la tabla con inodos sucios
+int icache_sync(const char *folder) {
+    if (!slots || strcmp(ic_folder, folder) != 0) return 0;
+    int *dirty = (int*)malloc(nslots * sizeof(int));
+    if (!dirty) { errno = ENOMEM; return -1; }
+    u32 n = 0;
+    for (u32 s = 0; s < nslots; s++) {
+        if (slots[s].valid && slots[s].dirty) dirty[n++] = (int)s;
+    }
+    qsort(dirty, n, sizeof(int), by_id);
+
+    u32 bs = spblock.blocksize;
+    unsigned char *buf = (unsigned char*)malloc(bs);
+    int rc = buf ? 0 : -1;
+    for (u32 i = 0; i < n && rc == 0; ) {
+        u32 tb = table_block(slots[dirty[i]].id), first = i;
+        if ((rc = bcache_read(folder, tb, buf, bs)) != 0) break;
+        for (; i < n && table_block(slots[dirty[i]].id) == tb; i++) {
+            ic_slot *p = &slots[dirty[i]];
+            inode_encode128(&buf[table_offset(p->id)], &p->node);
+        }
+        if ((rc = bcache_write(folder, tb, buf, bs)) != 0) break;
+        // Limpios recién ahora: si la escritura falla siguen pendientes
+        for (u32 k = first; k < i; k++) set_dirty(dirty[k], 0);
+        stats.records_written += i - first;
+        stats.blocks_written++;
+    }
+    if (!buf) errno = ENOMEM;
+    free(buf);
+    free(dirty);
+    return rc;
+}
+
+int icache_flush(const char *folder) {
+    int rc = icache_sync(folder);
+    if (bcache_flush(folder) != 0) rc = -1;
+    return rc;
+}
+
+void icache_get_stats(icache_stats *out) {
+    *out = stats;
+}
+
+double icache_hit_rate(void) {
+    unsigned long long total = stats.hits + stats.misses;
+    return total ? (double)stats.hits / (double)total : 0.0;
+}
+
+u32 icache_capacity(void) {
+    return nslots;
+}
+
+u32 icache_dirty(void) {
+    return ndirty;
+}
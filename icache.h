@@ -0,0 +1,41 @@
+#ifndef ICACHE_H
+#define ICACHE_H
+#include "fs_basic.h"
+#include <stddef.h>
+
+// Cache de inodos deserializados sobre la tabla de inodos. Escritura
+// diferida: los registros sucios bajan a la cache de bloques agrupados por
+// bloque de la tabla (icache_sync) o al desalojarse.
+#define ICACHE_DEFAULT_BUDGET (512u * 1024u)
+
+typedef struct icache_stats {
+    unsigned long long hits;
+    unsigned long long misses;
+    unsigned long long prefetched;      // inodos cargados junto con el pedido
+    unsigned long long evictions;
+    unsigned long long records_written;
+    unsigned long long blocks_written;  // bloques de la tabla reescritos
+} icache_stats;
+
+int  icache_init(size_t budget_bytes);
+void icache_shutdown(void);
+
+// Inodo fijado en memoria (con referencia); liberar con icache_put. Los
+// cambios se hacen sobre el puntero y se marcan con icache_mark_dirty.
+inode *icache_get(const char *folder, u32 inode_id);
+void   icache_put(inode *node);
+void   icache_mark_dirty(inode *node);
+
+// Copia un inodo completo a la cache como sucio, sin leer el registro viejo
+int  icache_store(const char *folder, const inode *node);
+void icache_forget(const char *folder, u32 inode_id);
+
+int  icache_sync(const char *folder);    // sucios -> cache de bloques
+int  icache_flush(const char *folder);   // icache_sync + bcache_flush
+
+void   icache_get_stats(icache_stats *out);
+double icache_hit_rate(void);
+u32    icache_capacity(void);
+u32    icache_dirty(void);      // inodos sucios que todavía no pasaron a la tabla
+
+#endif
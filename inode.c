@@ -1,8 +1,13 @@
 #include "fs_basic.h"
 #include "fs_utils.h"
+#include "inode.h"
+#include "icache.h"
+#include <errno.h>
 #include <string.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <time.h>
+#include <sys/stat.h>
 void init_inode(inode *node, u32 inode_id, mode_t mode, u32 size) {
     node->inode_number = inode_id;
     node->inode_mode   = mode;
@@ -15,8 +20,10 @@ void init_inode(inode *node, u32 inode_id, mode_t mode, u32 size) {
     node->last_modification_time    = node->last_access_time;
     node->metadata_last_change_time = node->last_access_time;
 
-    memset(node->direct, 0, sizeof(node->direct));
-    node->indirect1 = 0;
+    memset(node->inline_data, 0, sizeof(node->inline_data));
+    node->flags = (spblock.features & QRFS_FEAT_EXTENTS) ? QRFS_INODE_EXTENTS : 0;
+    // Un archivo regular nuevo empieza sin bloques, con los datos en el inodo
+    if (S_ISREG(mode) && (spblock.features & QRFS_FEAT_INLINE_DATA)) node->flags = QRFS_INODE_INLINE;
 }
 
  void inode_serialize128(unsigned char out[128],u32 inode_number, u32 inode_mode, u32 user_id, u32 group_id,
@@ -50,6 +57,48 @@ void inode_deserialize128(const unsigned char in[128],u32 *inode_number, u32 *in
 }
 
 
+// Registro completo. Los extents comparten en memoria el espacio de
+// direct[12]/indirect1 (mismos 13 u32 en el mismo orden), así que se
+// serializan igual que los punteros; el offset 76 guarda los flags. Los
+// datos en el inodo van tal cual en 24..75 y siguen en 80..127.
+void inode_encode128(unsigned char out[128], const inode *node) {
+    inode_serialize128(out, node->inode_number, (u32)node->inode_mode, node->user_id, node->group_id,
+                       node->links_quaintities, node->inode_size, node->direct, node->indirect1);
+    u32le_write(node->flags, &out[76]);
+    if (node->flags & QRFS_INODE_INLINE) {
+        memcpy(&out[24], node->inline_data, 52);
+        memcpy(&out[80], node->inline_data + 52, QRFS_INLINE_DATA - 52);
+    }
+}
+
+void inode_decode128(const unsigned char in[128], inode *node) {
+    u32 mode;
+    memset(node, 0, sizeof(*node));
+    inode_deserialize128(in, &node->inode_number, &mode, &node->user_id, &node->group_id,
+                         &node->links_quaintities, &node->inode_size, node->direct, &node->indirect1);
+    node->inode_mode = (mode_t)mode;
+    node->flags = u32le_read(&in[76]);
+    if (node->flags & QRFS_INODE_INLINE) {
+        memcpy(node->inline_data, &in[24], 52);
+        memcpy(node->inline_data + 52, &in[80], QRFS_INLINE_DATA - 52);
+    }
+}
+
+// Copias desde/hacia la cache de inodos; el registro baja a la tabla con
+// icache_sync/icache_flush.
+int inode_read(const char *folder, u32 inode_id, inode *node) {
+    inode *cached = icache_get(folder, inode_id);
+    if (!cached) return -1;
+    *node = *cached;
+    icache_put(cached);
+    return 0;
+}
+
+int inode_write(const char *folder, const inode *node) {
+    return icache_store(folder, node);
+}
+
+
 //Esto es estatico, estamos usando la pública asi que se puede borrar, esta en dir.c
 
 
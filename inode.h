@@ -8,4 +8,8 @@ void inode_serialize128(unsigned char out[128], u32 inode_number, u32 inode_mode
                         const u32 direct[12], u32 indirect1);
 void inode_deserialize128(const unsigned char in[128], u32 *inode_number, u32 *inode_mode, u32 *user_id, u32 *group_id,
     u32 *links, u32 *size,u32 direct[12], u32 *indirect1);
+void inode_encode128(unsigned char out[128], const inode *node);
+void inode_decode128(const unsigned char in[128], inode *node);
+int  inode_read(const char *folder, u32 inode_id, inode *node);
+int  inode_write(const char *folder, const inode *node);
 #endif
\ No newline at end of file
@@ -0,0 +1,771 @@
+#define _POSIX_C_SOURCE 200809L
+#include "journal.h"
+#include "block.h"
+#include "fs_utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+// Formato en disco (enteros little-endian):
+//   encabezado: "QRJH", id, seq de la cola (u64), posición de la cola, tamaño del anillo
+//   descriptor: "QRJD", id, seq (u64), cantidad, -, entradas (bloque, flags) desde el byte 24
+//   commit:     "QRJC", id, seq (u64), bloques de la transacción, suma
+// Una transacción son uno o más descriptores, cada uno seguido de las copias
+// de sus entradas (las revocaciones no llevan copia), y un bloque de commit.
+// El id distingue este diario de restos de un volumen anterior.
+#define JD_ENTRIES_OFF 24
+#define JE_REVOKE 1u
+
+// Conjunto de bloques con su copia (transacciones y pendientes de checkpoint).
+// Hash encadenado por índice, como las caches.
+typedef struct jset {
+    u32 n, cap;
+    u32 *index;
+    u64 *seq;            // transacción de la copia; 0 = revocada (en la tx en vuelo)
+    u64 *first;          // pendientes: tx más vieja aún no escrita en su lugar (0 = ya está)
+    unsigned char *data;
+    int *next;
+    int *buckets;
+    u32 nbuckets;
+} jset;
+
+typedef struct jtxrec {
+    u64 seq;
+    u32 pos;
+} jtxrec;
+
+static pthread_mutex_t jlock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t space_cv = PTHREAD_COND_INITIALIZER;   // lugar en el anillo / fin de la tx en vuelo
+static pthread_cond_t ckpt_cv = PTHREAD_COND_INITIALIZER;
+static pthread_t ckpt_thread;
+static int active = 0, threaded = 0, stopping = 0, ckpt_requested = 0;
+
+static char j_folder[512];
+static u32 j_start, j_ring, j_bs, j_id;   // j_ring = bloques del anillo (la región menos el encabezado)
+static u32 head, tail, committed_end;     // posiciones en el anillo
+static u64 next_seq, committed_seq, inflight_seq;
+static int has_inflight = 0;
+
+static jset running, inflight, pending;
+static jset running_rev, inflight_rev;    // revocaciones (sin copia)
+static jtxrec *txrecs = NULL;             // transacciones confirmadas aún en el anillo
+static u32 ntx = 0, txcap = 0;
+static u32 dirty_blocks = 0;              // pendientes con first != 0
+static unsigned char *stage = NULL;
+static size_t stage_cap = 0;
+static journal_stats stats;
+static u64 last_close_ms;                 // último cierre de una transacción (o el montaje)
+static void (*commit_hook)(void) = NULL;
+static int in_hook = 0;
+
+static u64 now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000u + (u64)ts.tv_nsec / 1000000u;
+}
+
+// ---- Conjuntos ----
+
+static u32 jset_bucket(const jset *s, u32 index) {
+    return (index * 2654435761u) & (s->nbuckets - 1);
+}
+
+static int jset_find(const jset *s, u32 index) {
+    if (!s->nbuckets) return -1;
+    for (int i = s->buckets[jset_bucket(s, index)]; i >= 0; i = s->next[i]) {
+        if (s->index[i] == index) return i;
+    }
+    return -1;
+}
+
+static void jset_link(jset *s, u32 i) {
+    u32 b = jset_bucket(s, s->index[i]);
+    s->next[i] = s->buckets[b];
+    s->buckets[b] = (int)i;
+}
+
+static void jset_unlink(jset *s, u32 i) {
+    int *p = &s->buckets[jset_bucket(s, s->index[i])];
+    while (*p >= 0 && *p != (int)i) p = &s->next[*p];
+    if (*p == (int)i) *p = s->next[i];
+}
+
+static int jset_grow(jset *s, u32 bs) {
+    u32 cap = s->cap ? s->cap * 2 : 64;
+    u32 *index = (u32*)realloc(s->index, cap * sizeof(u32));
+    if (index) s->index = index;
+    u64 *seq = (u64*)realloc(s->seq, cap * sizeof(u64));
+    if (seq) s->seq = seq;
+    u64 *first = (u64*)realloc(s->first, cap * sizeof(u64));
+    if (first) s->first = first;
+    int *next = (int*)realloc(s->next, cap * sizeof(int));
+    if (next) s->next = next;
+    int *buckets = (int*)realloc(s->buckets, cap * 2 * sizeof(int));
+    if (buckets) s->buckets = buckets;
+    unsigned char *data = bs ? (unsigned char*)realloc(s->data, (size_t)cap * bs) : NULL;
+    if (bs && data) s->data = data;
+    if (!index || !seq || !first || !next || !buckets || (bs && !data)) { errno = ENOMEM; return -1; }
+
+    s->cap = cap;
+    s->nbuckets = cap * 2;
+    for (u32 b = 0; b < s->nbuckets; b++) s->buckets[b] = -1;
+    for (u32 i = 0; i < s->n; i++) jset_link(s, i);
+    return 0;
+}
+
+// Agrega o reemplaza la copia de `index`; devuelve su posición
+static int jset_put(jset *s, u32 index, const void *data, u64 seq, u32 bs) {
+    int i = jset_find(s, index);
+    if (i < 0) {
+        if (s->n == s->cap && jset_grow(s, bs) != 0) return -1;
+        i = (int)s->n++;
+        s->index[i] = index;
+        s->first[i] = 0;
+        jset_link(s, (u32)i);
+    }
+    s->seq[i] = seq;
+    if (bs) memcpy(s->data + (size_t)i * bs, data, bs);
+    return i;
+}
+
+// Quita la entrada i moviendo la última a su lugar
+static void jset_remove(jset *s, u32 i, u32 bs) {
+    u32 last = s->n - 1;
+    jset_unlink(s, i);
+    if (i != last) {
+        jset_unlink(s, last);
+        s->index[i] = s->index[last];
+        s->seq[i] = s->seq[last];
+        s->first[i] = s->first[last];
+        if (bs) memcpy(s->data + (size_t)i * bs, s->data + (size_t)last * bs, bs);
+        jset_link(s, i);
+    }
+    s->n--;
+}
+
+static void jset_clear(jset *s) {
+    s->n = 0;
+    for (u32 b = 0; b < s->nbuckets; b++) s->buckets[b] = -1;
+}
+
+static void jset_free(jset *s) {
+    free(s->index); free(s->seq); free(s->first); free(s->data); free(s->next); free(s->buckets);
+    memset(s, 0, sizeof(*s));
+}
+
+static void jset_swap(jset *a, jset *b) {
+    jset t = *a;
+    *a = *b;
+    *b = t;
+}
+
+static unsigned char *jset_data(const jset *s, u32 i, u32 bs) {
+    return s->data + (size_t)i * bs;
+}
+
+// ---- Formato ----
+
+static void u64le_write(u64 v, unsigned char *p) {
+    u32le_write((u32)v, p);
+    u32le_write((u32)(v >> 32), p + 4);
+}
+
+static u64 u64le_read(const unsigned char *p) {
+    return (u64)u32le_read(p) | ((u64)u32le_read(p + 4) << 32);
+}
+
+static int has_magic(const unsigned char *b, const char *magic) {
+    return memcmp(b, magic, 4) == 0;
+}
+
+// FNV-1a: alcanza para detectar un commit escrito a medias
+static u32 log_sum(u32 h, const unsigned char *p, size_t len) {
+    for (size_t i = 0; i < len; i++) h = (h ^ p[i]) * 16777619u;
+    return h;
+}
+#define LOG_SUM_INIT 2166136261u
+
+static u32 entries_per_desc(u32 bs) {
+    return (bs - JD_ENTRIES_OFF) / 8;
+}
+
+static int write_header(const char *folder, u32 start, u32 bs, u32 id, u64 seq, u32 pos, u32 ring) {
+    unsigned char *buf = (unsigned char*)calloc(1, bs);
+    if (!buf) { errno = ENOMEM; return -1; }
+    memcpy(buf, "QRJH", 4);
+    u32le_write(id, &buf[4]);
+    u64le_write(seq, &buf[8]);
+    u32le_write(pos, &buf[16]);
+    u32le_write(ring, &buf[20]);
+    int rc = write_block(folder, start, buf, bs);
+    free(buf);
+    if (rc == 0) rc = block_flush(folder);
+    return rc;
+}
+
+static int read_header(const char *folder, u32 start, u32 blocks, u32 bs,
+                       u32 *id, u64 *seq, u32 *pos) {
+    unsigned char *buf = (unsigned char*)malloc(bs);
+    if (!buf) { errno = ENOMEM; return -1; }
+    int rc = read_block(folder, start, buf, bs);
+    if (rc == 0 && (!has_magic(buf, "QRJH") || u32le_read(&buf[20]) != blocks - 1 ||
+                    u32le_read(&buf[16]) >= blocks - 1)) {
+        fprintf(stderr, "Encabezado del diario inválido (bloque %u)\n", start);
+        errno = EINVAL;
+        rc = -1;
+    }
+    if (rc == 0) {
+        *id = u32le_read(&buf[4]);
+        *seq = u64le_read(&buf[8]);
+        *pos = u32le_read(&buf[16]);
+    }
+    free(buf);
+    return rc;
+}
+
+int journal_format(const char *folder, u32 start, u32 blocks, u32 block_size) {
+    if (blocks < 4 || block_size < 64) { errno = EINVAL; return -1; }
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    u32 id = (u32)ts.tv_nsec ^ (u32)ts.tv_sec ^ ((u32)getpid() << 16);
+    return write_header(folder, start, block_size, id ? id : 1, 1, 0, blocks - 1);
+}
+
+// ---- Reaplicación ----
+
+static int ring_read(const char *folder, u32 start, u32 ring, u32 pos, unsigned char *buf, u32 bs) {
+    return read_block(folder, start + 1 + pos % ring, buf, bs);
+}
+
+// Recorre el anillo desde la cola mientras haya transacciones completas de
+// este diario con seq consecutivos, se queda con la última copia de cada
+// bloque y la escribe en su lugar salvo que una revocación posterior la anule.
+int journal_replay(const char *folder, u32 start, u32 blocks, u32 block_size, u32 *transactions) {
+    u32 id, pos, ring = blocks - 1, bs = block_size, ntrans = 0;
+    u64 seq;
+    *transactions = 0;
+    if (read_header(folder, start, blocks, bs, &id, &seq, &pos) != 0) return -1;
+
+    jset latest = {0}, rev = {0}, tx = {0}, txrev = {0};
+    unsigned char *blk = (unsigned char*)malloc(bs);
+    int rc = blk ? 0 : -1;
+    u32 per = entries_per_desc(bs), scanned = 0;
+
+    while (rc == 0 && scanned < ring) {
+        jset_clear(&tx);
+        jset_clear(&txrev);
+        u32 used = 0, sum = LOG_SUM_INIT;
+        int ok = 0;
+        while (used < ring && rc == 0) {
+            if (ring_read(folder, start, ring, pos + used, blk, bs) != 0) { rc = -1; break; }
+            if (u32le_read(&blk[4]) != id || u64le_read(&blk[8]) != seq) break;
+            if (has_magic(blk, "QRJC")) {
+                ok = used > 0 && u32le_read(&blk[16]) == used + 1 && u32le_read(&blk[20]) == sum;
+                used++;
+                break;
+            }
+            if (!has_magic(blk, "QRJD")) break;
+            u32 count = u32le_read(&blk[16]);
+            if (count == 0 || count > per) break;
+            sum = log_sum(sum, blk, bs);
+            used++;
+
+            // Las entradas se copian antes de reusar blk para las copias
+            u32 idx[count], flags[count];
+            for (u32 e = 0; e < count; e++) {
+                idx[e] = u32le_read(&blk[JD_ENTRIES_OFF + e * 8]);
+                flags[e] = u32le_read(&blk[JD_ENTRIES_OFF + e * 8 + 4]);
+            }
+            for (u32 e = 0; e < count && rc == 0 && used < ring; e++) {
+                if (flags[e] & JE_REVOKE) {
+                    if (jset_put(&txrev, idx[e], NULL, seq, 0) < 0) rc = -1;
+                    continue;
+                }
+                if (ring_read(folder, start, ring, pos + used, blk, bs) != 0) { rc = -1; break; }
+                sum = log_sum(sum, blk, bs);
+                used++;
+                if (jset_put(&tx, idx[e], blk, seq, bs) < 0) rc = -1;
+            }
+        }
+        if (rc != 0 || !ok) break;
+
+        for (u32 i = 0; i < txrev.n && rc == 0; i++) {
+            if (jset_put(&rev, txrev.index[i], NULL, seq, 0) < 0) rc = -1;
+        }
+        for (u32 i = 0; i < tx.n && rc == 0; i++) {
+            if (jset_put(&latest, tx.index[i], jset_data(&tx, i, bs), seq, bs) < 0) rc = -1;
+        }
+        ntrans++;
+        seq++;
+        pos = (pos + used) % ring;
+        scanned += used;
+    }
+
+    // Una revocación en la tx R anula las copias de transacciones anteriores a R
+    u32 applied = 0;
+    for (u32 i = 0; i < latest.n && rc == 0; i++) {
+        int r = jset_find(&rev, latest.index[i]);
+        if (r >= 0 && rev.seq[r] > latest.seq[i]) continue;
+        if (write_block(folder, latest.index[i], jset_data(&latest, i, bs), bs) != 0) rc = -1;
+        applied++;
+    }
+    if (rc == 0 && ntrans > 0) {
+        if (block_flush(folder) != 0 || write_header(folder, start, bs, id, seq, pos, ring) != 0) rc = -1;
+        else fprintf(stderr, "Diario: %u transacciones reaplicadas (%u bloques)\n", ntrans, applied);
+    }
+    free(blk);
+    jset_free(&latest); jset_free(&rev); jset_free(&tx); jset_free(&txrev);
+    if (rc == 0) *transactions = ntrans;
+    return rc;
+}
+
+// ---- Checkpoint ----
+
+static u32 ring_used(void) {
+    return (head + j_ring - tail) % j_ring;
+}
+
+static u32 ring_free(void) {
+    return j_ring - 1 - ring_used();
+}
+
+// Escribe en su lugar las copias confirmadas que faltan, hace flush y recién
+// entonces avanza la cola en el encabezado. Las entradas ya escritas quedan
+// hasta que la cola las pasa: mientras estén en el anillo, liberar su bloque
+// tiene que dejar una revocación.
+static int checkpoint_pass(void) {
+    pthread_mutex_lock(&jlock);
+    u32 n = 0, cap = dirty_blocks;
+    u32 *idx = (u32*)malloc((cap ? cap : 1) * sizeof(u32));
+    u64 *written = (u64*)malloc((cap ? cap : 1) * sizeof(u64));
+    if (!idx || !written) {
+        pthread_mutex_unlock(&jlock);
+        free(idx); free(written);
+        errno = ENOMEM;
+        return -1;
+    }
+    for (u32 i = 0; i < pending.n && n < cap; i++) {
+        if (pending.first[i]) idx[n++] = pending.index[i];
+    }
+    pthread_mutex_unlock(&jlock);
+
+    // Un bloque por vez bajo jlock: una revocación no puede cruzarse con la
+    // escritura de la copia vieja
+    int rc = 0;
+    for (u32 k = 0; k < n; k++) {
+        pthread_mutex_lock(&jlock);
+        int i = jset_find(&pending, idx[k]);
+        written[k] = 0;
+        if (i >= 0 && pending.first[i]) {
+            if (write_block(j_folder, idx[k], jset_data(&pending, (u32)i, j_bs), j_bs) != 0) rc = -1;
+            written[k] = pending.seq[i];
+        }
+        pthread_mutex_unlock(&jlock);
+    }
+    if (n && block_flush(j_folder) != 0) rc = -1;
+
+    pthread_mutex_lock(&jlock);
+    if (rc == 0) {
+        for (u32 k = 0; k < n; k++) {
+            int i = jset_find(&pending, idx[k]);
+            if (i < 0 || !written[k] || !pending.first[i]) continue;
+            if (pending.seq[i] == written[k]) {
+                pending.first[i] = 0;
+                dirty_blocks--;
+            } else {
+                pending.first[i] = pending.seq[i];   // llegó una versión más nueva
+            }
+            stats.blocks_checkpointed++;
+        }
+
+        u64 tail_seq = committed_seq + 1;
+        for (u32 i = 0; i < pending.n; i++) {
+            if (pending.first[i] && pending.first[i] < tail_seq) tail_seq = pending.first[i];
+        }
+        u32 drop = 0;
+        while (drop < ntx && txrecs[drop].seq < tail_seq) drop++;
+        u32 new_tail = drop < ntx ? txrecs[drop].pos : committed_end;
+        if (drop > 0 || new_tail != tail) {
+            if (write_header(j_folder, j_start, j_bs, j_id, tail_seq, new_tail, j_ring) != 0) {
+                rc = -1;
+            } else {
+                tail = new_tail;
+                memmove(txrecs, txrecs + drop, (ntx - drop) * sizeof(jtxrec));
+                ntx -= drop;
+                for (u32 i = pending.n; i-- > 0; ) {
+                    if (!pending.first[i] && pending.seq[i] < tail_seq) jset_remove(&pending, i, j_bs);
+                }
+            }
+        }
+        stats.checkpoints++;
+    }
+    pthread_cond_broadcast(&space_cv);
+    pthread_mutex_unlock(&jlock);
+    free(idx); free(written);
+    return rc;
+}
+
+static void *checkpoint_main(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&jlock);
+    while (!stopping) {
+        // Sin nada que bajar despierta igual cada JOURNAL_COMMIT_MS, para que
+        // la transacción en curso no quede abierta indefinidamente
+        int idle = dirty_blocks == 0 && !ckpt_requested;
+        long ms = idle ? JOURNAL_COMMIT_MS : JOURNAL_CHECKPOINT_MS;
+        // Deja juntar bloques salvo que un commit esté esperando lugar
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += ms / 1000;
+        deadline.tv_nsec += (ms % 1000) * 1000000L;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+        deadline.tv_nsec %= 1000000000L;
+        int woke = 0;
+        while (!stopping && !ckpt_requested && !woke) {
+            if (pthread_cond_timedwait(&ckpt_cv, &jlock, &deadline) == ETIMEDOUT) break;
+            woke = idle && dirty_blocks > 0;
+        }
+        if (stopping) break;
+        if (woke) continue;      // llegaron bloques: empieza la espera del checkpoint
+        void (*hook)(void) = ckpt_requested ? NULL : commit_hook;   // un commit espera lugar
+        in_hook = hook != NULL;
+        pthread_mutex_unlock(&jlock);
+        if (hook) hook();
+        pthread_mutex_lock(&jlock);
+        in_hook = 0;
+        pthread_cond_broadcast(&space_cv);
+        if (dirty_blocks == 0 && !ckpt_requested) continue;
+        ckpt_requested = 0;
+        pthread_mutex_unlock(&jlock);
+        checkpoint_pass();
+        pthread_mutex_lock(&jlock);
+    }
+    pthread_mutex_unlock(&jlock);
+    return NULL;
+}
+
+// ---- Montaje ----
+
+int journal_start(const char *folder, u32 start, u32 blocks, u32 block_size, int use_thread) {
+    u64 seq;
+    u32 pos, id;
+    if (active) { errno = EBUSY; return -1; }
+    if (read_header(folder, start, blocks, block_size, &id, &seq, &pos) != 0) return -1;
+
+    snprintf(j_folder, sizeof(j_folder), "%s", folder);
+    j_start = start;
+    j_ring = blocks - 1;
+    j_bs = block_size;
+    j_id = id;
+    head = tail = committed_end = pos;
+    next_seq = seq;
+    committed_seq = seq - 1;
+    has_inflight = 0;
+    ntx = 0;
+    dirty_blocks = 0;
+    stopping = ckpt_requested = 0;
+    memset(&stats, 0, sizeof(stats));
+    last_close_ms = now_ms();
+    threaded = use_thread;
+    if (threaded && pthread_create(&ckpt_thread, NULL, checkpoint_main, NULL) != 0) threaded = 0;
+    active = 1;
+    return 0;
+}
+
+int journal_stop(void) {
+    if (!active) return 0;
+    pthread_mutex_lock(&jlock);
+    stopping = 1;
+    pthread_cond_broadcast(&ckpt_cv);
+    pthread_mutex_unlock(&jlock);
+    if (threaded) pthread_join(ckpt_thread, NULL);
+
+    int rc = checkpoint_pass();
+    if (rc == 0 && dirty_blocks != 0) rc = -1;
+    active = 0;
+    jset_free(&running); jset_free(&inflight); jset_free(&pending);
+    jset_free(&running_rev); jset_free(&inflight_rev);
+    commit_hook = NULL;
+    free(txrecs); free(stage);
+    txrecs = NULL; stage = NULL;
+    ntx = txcap = 0;
+    stage_cap = 0;
+    return rc;
+}
+
+int journal_active(void) {
+    return active;
+}
+
+void journal_set_commit_hook(void (*fn)(void)) {
+    pthread_mutex_lock(&jlock);
+    commit_hook = fn;
+    while (!fn && in_hook) pthread_cond_wait(&space_cv, &jlock);
+    pthread_mutex_unlock(&jlock);
+}
+
+// ---- Transacciones ----
+
+int journal_log(u32 index, const void *data) {
+    pthread_mutex_lock(&jlock);
+    int rc = jset_put(&running, index, data, 1, j_bs) < 0 ? -1 : 0;
+    pthread_mutex_unlock(&jlock);
+    return rc;
+}
+
+int journal_lookup(u32 index, unsigned char *buf) {
+    pthread_mutex_lock(&jlock);
+    const jset *sets[3] = {&running, &inflight, &pending};
+    int found = 0;
+    for (int k = 0; k < 3 && !found; k++) {
+        int i = jset_find(sets[k], index);
+        if (i < 0 || sets[k]->seq[i] == 0) continue;
+        memcpy(buf, jset_data(sets[k], (u32)i, j_bs), j_bs);
+        found = 1;
+    }
+    pthread_mutex_unlock(&jlock);
+    return found;
+}
+
+void journal_revoke(u32 index) {
+    pthread_mutex_lock(&jlock);
+    int logged = 0, i;
+    if ((i = jset_find(&running, index)) >= 0) jset_remove(&running, (u32)i, j_bs);
+    if ((i = jset_find(&inflight, index)) >= 0) {
+        inflight.seq[i] = 0;
+        logged = 1;
+    }
+    if ((i = jset_find(&pending, index)) >= 0) {
+        if (pending.first[i]) dirty_blocks--;
+        jset_remove(&pending, (u32)i, j_bs);
+        logged = 1;
+    }
+    if (logged && jset_put(&running_rev, index, NULL, 1, 0) >= 0) stats.revokes++;
+    pthread_mutex_unlock(&jlock);
+}
+
+int journal_close(void) {
+    pthread_mutex_lock(&jlock);
+    while (has_inflight) pthread_cond_wait(&space_cv, &jlock);
+    int any = running.n > 0 || running_rev.n > 0;
+    if (any) {
+        jset_clear(&inflight);
+        jset_clear(&inflight_rev);
+        jset_swap(&running, &inflight);
+        jset_swap(&running_rev, &inflight_rev);
+        inflight_seq = next_seq++;
+        for (u32 i = 0; i < inflight.n; i++) inflight.seq[i] = inflight_seq;
+        has_inflight = 1;
+    }
+    last_close_ms = now_ms();
+    pthread_mutex_unlock(&jlock);
+    return any;
+}
+
+static u32 tx_blocks(u32 copies, u32 revokes) {
+    u32 per = entries_per_desc(j_bs), entries = copies + revokes;
+    u32 desc = entries ? (entries + per - 1) / per : 1;
+    return desc + copies + 1;
+}
+
+int journal_commit_due(u32 cached) {
+    pthread_mutex_lock(&jlock);
+    int due = 0;
+    if (active && !has_inflight) {
+        u32 changes = running.n + running_rev.n + cached;
+        due = tx_blocks(running.n + cached, running_rev.n) > j_ring / JOURNAL_COMMIT_FRACTION ||
+              (changes > 0 && now_ms() - last_close_ms >= JOURNAL_COMMIT_MS);
+    }
+    pthread_mutex_unlock(&jlock);
+    return due;
+}
+
+// Arma la transacción en vuelo en `stage`: cada descriptor seguido de las
+// copias de sus entradas (primero las copias, después las revocaciones) y al
+// final el commit con la suma de todo lo anterior. Devuelve los bloques.
+static u32 build_tx(u32 copies, u32 nblocks) {
+    u32 per = entries_per_desc(j_bs), revokes = inflight_rev.n;
+    u32 out = 0, c = 0, r = 0;
+    memset(stage, 0, (size_t)nblocks * j_bs);
+    while (copies > 0 || revokes > 0) {
+        unsigned char *desc = stage + (size_t)out++ * j_bs;
+        u32 count = 0;
+        memcpy(desc, "QRJD", 4);
+        u32le_write(j_id, &desc[4]);
+        u64le_write(inflight_seq, &desc[8]);
+        for (; count < per && (copies > 0 || revokes > 0); count++) {
+            unsigned char *ent = &desc[JD_ENTRIES_OFF + count * 8];
+            if (copies > 0) {
+                while (inflight.seq[c] == 0) c++;   // revocada después de cerrar
+                u32le_write(inflight.index[c], ent);
+                memcpy(stage + (size_t)out++ * j_bs, jset_data(&inflight, c, j_bs), j_bs);
+                c++;
+                copies--;
+            } else {
+                u32le_write(inflight_rev.index[r++], ent);
+                u32le_write(JE_REVOKE, ent + 4);
+                revokes--;
+            }
+        }
+        u32le_write(count, &desc[16]);
+    }
+    unsigned char *commit = stage + (size_t)out * j_bs;
+    memcpy(commit, "QRJC", 4);
+    u32le_write(j_id, &commit[4]);
+    u64le_write(inflight_seq, &commit[8]);
+    u32le_write(out + 1, &commit[16]);
+    u32le_write(log_sum(LOG_SUM_INIT, stage, (size_t)out * j_bs), &commit[20]);
+    return out + 1;
+}
+
+static int ring_write(u32 pos, u32 count, const unsigned char *buf) {
+    u32 first = j_ring - pos < count ? j_ring - pos : count;
+    if (write_blocks(j_folder, j_start + 1 + pos, first, buf, j_bs) != 0) return -1;
+    if (first < count &&
+        write_blocks(j_folder, j_start + 1, count - first, buf + (size_t)first * j_bs, j_bs) != 0) return -1;
+    return 0;
+}
+
+// Pasa la transacción en vuelo a pendientes de checkpoint (bajo jlock)
+static void inflight_done(u32 pos, u32 nblocks) {
+    for (u32 i = 0; i < inflight.n; i++) {
+        if (inflight.seq[i] == 0) continue;
+        int p = jset_put(&pending, inflight.index[i], jset_data(&inflight, i, j_bs), inflight_seq, j_bs);
+        if (p < 0) continue;
+        if (!pending.first[p]) {
+            pending.first[p] = inflight_seq;
+            dirty_blocks++;
+        }
+    }
+    if (ntx == txcap) {
+        u32 cap = txcap ? txcap * 2 : 64;
+        jtxrec *t = (jtxrec*)realloc(txrecs, cap * sizeof(jtxrec));
+        if (t) { txrecs = t; txcap = cap; }
+    }
+    if (ntx < txcap) txrecs[ntx++] = (jtxrec){inflight_seq, pos};
+    committed_seq = inflight_seq;
+    committed_end = (pos + nblocks) % j_ring;
+    has_inflight = 0;
+    jset_clear(&inflight);
+    jset_clear(&inflight_rev);
+    pthread_cond_broadcast(&space_cv);
+    pthread_cond_signal(&ckpt_cv);
+}
+
+// Espera lugar en el anillo: sin hilo, o desde el propio hilo (commit por
+// plazo), el checkpoint se hace acá mismo
+static int wait_space(u32 need) {
+    int inline_ckpt = !threaded || pthread_equal(pthread_self(), ckpt_thread);
+    while (ring_free() < need) {
+        stats.space_waits++;
+        if (!inline_ckpt) {
+            ckpt_requested = 1;
+            pthread_cond_signal(&ckpt_cv);
+            pthread_cond_wait(&space_cv, &jlock);
+        } else {
+            u32 before = ring_free();
+            pthread_mutex_unlock(&jlock);
+            int rc = checkpoint_pass();
+            pthread_mutex_lock(&jlock);
+            if (rc != 0) return -1;
+            if (ring_free() == before && ring_free() < need) { errno = ENOSPC; return -1; }
+        }
+    }
+    return 0;
+}
+
+int journal_write(void) {
+    pthread_mutex_lock(&jlock);
+    if (!has_inflight) {
+        pthread_mutex_unlock(&jlock);
+        return 0;
+    }
+    u32 copies = 0;
+    for (u32 i = 0; i < inflight.n; i++) copies += inflight.seq[i] != 0;
+    u32 need = tx_blocks(copies, inflight_rev.n);
+    int rc = 0;
+
+    if (copies == 0 && inflight_rev.n == 0) {
+        need = 0;                                   // todo revocado: no hay nada que escribir
+    } else if (need >= j_ring) {
+        // No entra en el diario: va a su lugar sin atomicidad, detrás de lo pendiente
+        fprintf(stderr, "Diario: transacción de %u bloques no entra en %u, se escribe sin diario\n",
+                need, j_ring);
+        need = 0;
+        for (u32 i = 0; i < inflight.n && rc == 0; i++) {
+            if (inflight.seq[i] == 0) continue;
+            int p = jset_find(&pending, inflight.index[i]);
+            if (p >= 0) {
+                // Sus copias viejas siguen en el anillo: que la reaplicación no las use
+                if (pending.first[p]) dirty_blocks--;
+                jset_remove(&pending, (u32)p, j_bs);
+                jset_put(&running_rev, inflight.index[i], NULL, 1, 0);
+            }
+            rc = write_block(j_folder, inflight.index[i], jset_data(&inflight, i, j_bs), j_bs);
+        }
+        if (rc == 0) rc = block_flush(j_folder);
+    } else if (wait_space(need) != 0) {
+        rc = -1;
+    } else {
+        size_t bytes = (size_t)need * j_bs;
+        if (bytes > stage_cap) {
+            unsigned char *p = (unsigned char*)realloc(stage, bytes);
+            if (p) { stage = p; stage_cap = bytes; }
+        }
+        if (bytes > stage_cap) {
+            errno = ENOMEM;
+            rc = -1;
+        }
+    }
+    if (rc != 0) {
+        // La transacción queda en vuelo para el próximo intento; los bloques
+        // siguen visibles por journal_lookup
+        pthread_mutex_unlock(&jlock);
+        return -1;
+    }
+    if (need == 0) {
+        committed_seq = inflight_seq;
+        has_inflight = 0;
+        jset_clear(&inflight);
+        jset_clear(&inflight_rev);
+        pthread_cond_broadcast(&space_cv);
+        pthread_mutex_unlock(&jlock);
+        return 0;
+    }
+
+    u32 pos = head;
+    build_tx(copies, need);
+    head = (head + need) % j_ring;
+    pthread_mutex_unlock(&jlock);
+
+    // Un solo flush por commit: la suma del commit detecta una escritura a medias
+    rc = ring_write(pos, need, stage);
+    if (rc == 0) rc = block_flush(j_folder);
+
+    pthread_mutex_lock(&jlock);
+    if (rc == 0) {
+        inflight_done(pos, need);
+        stats.commits++;
+        stats.blocks_logged += copies;
+        if (threaded && ring_used() > j_ring / 2) {
+            ckpt_requested = 1;
+            pthread_cond_signal(&ckpt_cv);
+        }
+    } else {
+        head = pos;   // se vuelve a escribir en el mismo lugar
+    }
+    int inline_ckpt = rc == 0 && !threaded && ring_used() > j_ring / 2;
+    pthread_mutex_unlock(&jlock);
+    if (inline_ckpt) checkpoint_pass();
+    return rc;
+}
+
+void journal_get_stats(journal_stats *out) {
+    pthread_mutex_lock(&jlock);
+    *out = stats;
+    pthread_mutex_unlock(&jlock);
+}
@@ -0,0 +1,64 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+#include "fs_basic.h"
+
+// Diario de metadatos (write-ahead log) en una región fija del volumen
+// (QRFS_FEAT_JOURNAL). Con el diario activo, los bloques sucios que baja la
+// cache de bloques no se escriben en su lugar: se suman a la transacción en
+// curso, que se escribe entera en el diario (descriptores + copias + commit
+// con suma) con un solo flush. Después un checkpoint copia los bloques
+// confirmados a su lugar y avanza la cola; con backends que admiten acceso
+// concurrente lo hace un hilo aparte. Al montar, las transacciones completas
+// que quedaron en el diario se reaplican (journal_replay).
+//
+// Región: el primer bloque es el encabezado (cola del diario), el resto un
+// anillo de bloques de log.
+//
+// Liberar un bloque que pasó por el diario deja un registro de revocación:
+// la reaplicación no pisa con metadatos viejos un bloque que ya es de datos.
+
+// Tiempo que el checkpoint deja juntar bloques antes de escribirlos
+#define JOURNAL_CHECKPOINT_MS 200
+// La transacción en curso se cierra al pasar esta fracción del anillo o
+// después de este plazo, para que nunca quede más grande que el diario
+#define JOURNAL_COMMIT_FRACTION 4
+#define JOURNAL_COMMIT_MS 5000
+
+typedef struct journal_stats {
+    unsigned long long commits;
+    unsigned long long blocks_logged;    // copias escritas en el diario
+    unsigned long long revokes;
+    unsigned long long checkpoints;      // pasadas del checkpoint
+    unsigned long long blocks_checkpointed;
+    unsigned long long space_waits;      // commits que esperaron lugar en el anillo
+} journal_stats;
+
+int  journal_format(const char *folder, u32 start, u32 blocks, u32 block_size);
+int  journal_replay(const char *folder, u32 start, u32 blocks, u32 block_size, u32 *transactions);
+
+// threaded = 0 con el backend de archivos (no reentrante): el checkpoint se
+// hace dentro de journal_write, que debe llamarse con el lock del llamador.
+int  journal_start(const char *folder, u32 start, u32 blocks, u32 block_size, int threaded);
+int  journal_stop(void);        // checkpoint completo, diario vacío
+int  journal_active(void);
+
+int  journal_log(u32 index, const void *data);    // copia el bloque a la transacción en curso
+void journal_revoke(u32 index);
+int  journal_lookup(u32 index, unsigned char *buf);   // 1 = copia más nueva que la de su lugar
+
+// Commit en dos pasos, para que el llamador suelte sus locks mientras se
+// escribe: journal_close cierra la transacción en curso (1 = hay algo que
+// escribir) y journal_write la escribe y hace el flush.
+int  journal_close(void);
+int  journal_write(void);
+
+// 1 = conviene cerrar la transacción en curso (tamaño o plazo); `cached` son
+// los bloques sucios que todavía no pasaron por journal_log
+int  journal_commit_due(u32 cached);
+// Con hilo de checkpoint, se llama desde ese hilo cada JOURNAL_COMMIT_MS sin
+// locks tomados. NULL la saca y espera a que termine una llamada en curso.
+void journal_set_commit_hook(void (*fn)(void));
+
+void journal_get_stats(journal_stats *out);
+
+#endif
@@ -1,221 +1,451 @@
-#include "fs_basic.h"
+#include "mkfs.h"
 #include "fs_utils.h"
 #include "block.h"
+#include "bcache.h"
+#include "icache.h"
 #include "superblock.h"
 #include "inode.h"
 #include "dir.h"
+#include "htree.h"
+#include "bitmaps.h"
+#include "journal.h"
+#include "fscheck.h"
+#include "csum.h"
+#include "dedup.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <time.h>
 
 int mkfs(int argc, char **argv) {
     const char *folder = (argc >= 2) ? argv[1] : "./qrfolder";
     u32 block_size   = 1024;
-    u32 total_blocks = DEFAULT_TOTAL_BLOCKS;  // <=128
-    u32 total_inodes = DEFAULT_TOTAL_INODES;  // <=128
+    u32 total_blocks = DEFAULT_TOTAL_BLOCKS;
+    u32 total_inodes = DEFAULT_TOTAL_INODES;
+    u32 backend      = QRFS_BACKEND_FILES;
+    size_t cache_budget = BCACHE_DEFAULT_BUDGET;
+    u32 features     = QRFS_FEAT_PACKED_BITMAPS | QRFS_FEAT_PACKED_DIRS;
+    block_format_opts fmt = {0, 0};
+    int with_journal = 0;
+    int png = 0;
+    u32 journal_blocks = 0;   // 0 = tamaño por defecto
 
     // Procesar argumentos opcionales
     for (int i = 2; i < argc; ++i) {
         if (strncmp(argv[i], "--blocks=", 9) == 0) {total_blocks = (u32)strtoul(argv[i] + 9, NULL, 10);}
         else if (strncmp(argv[i], "--inodes=", 9) == 0) {total_inodes = (u32)strtoul(argv[i] + 9, NULL, 10);}
         else if (strncmp(argv[i], "--blocksize=", 12) == 0) {block_size = (u32)strtoul(argv[i] + 12, NULL, 10);}
+        else if (strncmp(argv[i], "--cache=", 8) == 0) {cache_budget = (size_t)strtoul(argv[i] + 8, NULL, 10) * 1024;}
+        else if (strcmp(argv[i], "--extents") == 0) {features |= QRFS_FEAT_EXTENTS;}
+        else if (strcmp(argv[i], "--inline") == 0) {features |= QRFS_FEAT_INLINE_DATA;}
+        else if (strcmp(argv[i], "--png") == 0) {png = 1;}
+        else if (strcmp(argv[i], "--checksums") == 0) {features |= QRFS_FEAT_CHECKSUMS;}
+        else if (strcmp(argv[i], "--dedup") == 0) {features |= QRFS_FEAT_DEDUP;}
+        else if (strcmp(argv[i], "--lazy") == 0) {features |= QRFS_FEAT_SPARSE;}
+        else if (strcmp(argv[i], "--fixed-dirs") == 0) {features &= ~QRFS_FEAT_PACKED_DIRS;}   // entradas fijas, como los volúmenes viejos
+        else if (strcmp(argv[i], "--journal") == 0) {with_journal = 1;}
+        else if (strncmp(argv[i], "--journal=", 10) == 0) {
+            journal_blocks = (u32)strtoul(argv[i] + 10, NULL, 10);
+            with_journal = journal_blocks > 0;
+        }
+        else if (strncmp(argv[i], "--threads=", 10) == 0) {fmt.threads = (u32)strtoul(argv[i] + 10, NULL, 10);}
+        else if (strcmp(argv[i], "--backend=image") == 0) {backend = QRFS_BACKEND_IMAGE;}
+        else if (strcmp(argv[i], "--backend=files") == 0) {backend = QRFS_BACKEND_FILES;}
+        else if (strncmp(argv[i], "--backend=", 10) == 0) {
+            fprintf(stderr, "Backend desconocido: %s (usar files o image)\n", argv[i] + 10);
+            return 2;
+        }
     }
 
-    // Esto lo podemos quitar si el profe quieremás
-    if (total_blocks > 128 || total_inodes > 128) {
-        fprintf(stderr, "Por ahora mkfs.qrfs soporta como máximo 128 bloques e inodos.\n");
+    if (total_blocks == 0 || total_inodes == 0) {
+        fprintf(stderr, "Hace falta al menos un bloque y un inodo.\n");
         return 2;
     }
     if (block_size < 512 || block_size > 65536) {
         fprintf(stderr, "block_size fuera de rango razonable (512..65536).\n");
         return 2;
     }
-
-    //  Crear carpeta y bloques
-    if (ensure_folder(folder) != 0) {
-        fprintf(stderr, "No se pudo preparar la carpeta destino: %s\n", strerror(errno));
-        return 1;
-    }
-    for (u32 i = 0; i < total_blocks; ++i) {
-        if (create_zero_block(folder, i, block_size) != 0) {
-            fprintf(stderr, "No se pudo crear block_%04u.png: %s\n", i, strerror(errno));
-            return 1;
-        }
+    if (png && backend != QRFS_BACKEND_FILES) {
+        fprintf(stderr, "--png solo con --backend=files.\n");
+        return 2;
     }
 
-    // Offsets
+    // Offsets: los bitmaps ocupan tantos bloques como necesiten (1 bit por entrada)
     u32 inode_bitmap_start  = 1;
-    u32 inode_bitmap_blocks = 1;
+    u32 inode_bitmap_blocks = ceil_div(BITMAP_BYTES(total_inodes), block_size);
     u32 data_bitmap_start   = inode_bitmap_start + inode_bitmap_blocks;
-    u32 data_bitmap_blocks  = 1;
+    u32 data_bitmap_blocks  = ceil_div(BITMAP_BYTES(total_blocks), block_size);
     u32 inode_table_start   = data_bitmap_start + data_bitmap_blocks;
 
     u32 inode_record_size   = 128;
-    u32 inode_table_bytes   = total_inodes * inode_record_size;
-    u32 inode_table_blocks  = ceil_div(inode_table_bytes, block_size);
+    u64 inode_table_bytes   = (u64)total_inodes * inode_record_size;
+    u32 inode_table_blocks  = (u32)((inode_table_bytes + block_size - 1) / block_size);
+
+    // Diario de metadatos entre la tabla de inodos y los datos (~3% del volumen)
+    if (with_journal && journal_blocks == 0) {
+        journal_blocks = total_blocks / 32;
+        if (journal_blocks < 64) journal_blocks = 64;
+        if (journal_blocks > 8192) journal_blocks = 8192;
+    }
+    if (with_journal && journal_blocks < 4) {
+        fprintf(stderr, "El diario necesita al menos 4 bloques.\n");
+        return 2;
+    }
+    if (with_journal) features |= QRFS_FEAT_JOURNAL;
+    u32 journal_start       = inode_table_start + inode_table_blocks;
 
-    u32 data_region_start   = inode_table_start + inode_table_blocks;
+    // Tabla de sumas (un CRC32C de 4 bytes por bloque) después del diario
+    u32 csum_start          = journal_start + journal_blocks;
+    u32 csum_blocks         = (features & QRFS_FEAT_CHECKSUMS) ? ceil_div(total_blocks, block_size / 4) : 0;
 
-    if (data_region_start >= total_blocks) {
+    // Tabla de deduplicación (hash y referencias, 16 bytes por bloque) después de las sumas
+    u32 dedup_start         = csum_start + csum_blocks;
+    u32 dedup_blocks        = (features & QRFS_FEAT_DEDUP) ? ceil_div(total_blocks, block_size / DEDUP_RECORD_SIZE) : 0;
+
+    u64 data_region_end     = (u64)dedup_start + dedup_blocks;
+    if (data_region_end >= total_blocks) {
         fprintf(stderr, "No hay espacio para región de datos.\n");
         return 1;
     }
+    u32 data_region_start   = (u32)data_region_end;
+
+    //  Crear carpeta y bloques
+    if (ensure_folder(folder) != 0) {
+        fprintf(stderr, "No se pudo preparar la carpeta destino: %s\n", strerror(errno));
+        return 1;
+    }
+    if (bcache_init(cache_budget, block_size) != 0) {
+        fprintf(stderr, "No se pudo reservar la cache de bloques.\n");
+        return 1;
+    }
+    // Lazy: solo se crea el superbloque; bitmaps, tabla de inodos y datos
+    // aparecen al escribirse (los bloques en cero no llegan a existir)
+    if (features & QRFS_FEAT_SPARSE) fmt.materialize = 1;
+    block_set_sparse((features & QRFS_FEAT_SPARSE) != 0);
+    block_set_png(png);
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    if (block_format(folder, backend, total_blocks, block_size, &fmt) != 0) {
+        fprintf(stderr, "No se pudieron crear los bloques (%s): %s\n",
+                block_backend_name(backend), strerror(errno));
+        return 1;
+    }
+    if (with_journal && journal_format(folder, journal_start, journal_blocks, block_size) != 0) {
+        fprintf(stderr, "No se pudo crear el diario: %s\n", strerror(errno));
+        return 1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double format_ms = (double)(t1.tv_sec - t0.tv_sec) * 1e3 + (double)(t1.tv_nsec - t0.tv_nsec) / 1e6;
+
+
 
     // Bitmaps
-    unsigned char inode_bitmap[128];
-    unsigned char data_bitmap[128];
-    memset(inode_bitmap, '0', sizeof(inode_bitmap));
-    memset(data_bitmap,  '0', sizeof(data_bitmap));
+    spblock.version      = QRFS_VERSION;
+    spblock.blocksize    = block_size;
+    spblock.total_blocks = total_blocks;
+    spblock.total_inodes = total_inodes;
+    spblock.features     = features;
+    spblock.backend      = backend;
+    spblock.inode_bitmap_start  = inode_bitmap_start;
+    spblock.inode_bitmap_blocks = inode_bitmap_blocks;
+    spblock.data_bitmap_start   = data_bitmap_start;
+    spblock.data_bitmap_blocks  = data_bitmap_blocks;
+    spblock.inode_table_start   = inode_table_start;
+    spblock.inode_table_blocks  = inode_table_blocks;
+    spblock.data_region_start   = data_region_start;
+    spblock.journal_start       = with_journal ? journal_start : 0;
+    spblock.journal_blocks      = journal_blocks;
+    spblock.csum_start          = csum_blocks ? csum_start : 0;
+    spblock.csum_blocks         = csum_blocks;
+    spblock.dedup_start         = dedup_blocks ? dedup_start : 0;
+    spblock.dedup_blocks        = dedup_blocks;
+    if (csum_blocks && csum_init(&spblock) != 0) {
+        fprintf(stderr, "Memoria insuficiente para la tabla de sumas.\n");
+        return 1;
+    }
+    // La región ya está en cero (block_format): la tabla vacía no se escribe
+    if (!dedup_blocks) {
+        dedup_close();
+    } else if (dedup_init(&spblock) != 0) {
+        fprintf(stderr, "Memoria insuficiente para la tabla de deduplicación.\n");
+        return 1;
+    }
+    if (bitmaps_init(total_inodes, total_blocks) != 0) {
+        fprintf(stderr, "Memoria insuficiente para los bitmaps.\n");
+        return 1;
+    }
 
     u32 root_inode = 0;
-    inode_bitmap[root_inode] = '1';
+    spblock.root_inode = root_inode;
+    bitmap_set(spblock.inode_bitmap, root_inode);
 
-    data_bitmap[0] = '1'; // SB
-    for (u32 b = inode_bitmap_start; b < inode_bitmap_start + inode_bitmap_blocks; ++b) data_bitmap[b] = '1';
-    for (u32 b = data_bitmap_start;  b < data_bitmap_start + data_bitmap_blocks;  ++b) data_bitmap[b] = '1';
-    for (u32 b = inode_table_start;  b < inode_table_start + inode_table_blocks;  ++b) data_bitmap[b] = '1';
+    // SB + bitmaps + tabla de inodos son contiguos desde el bloque 0
+    for (u32 b = 0; b < data_region_start; ++b) bitmap_set(spblock.data_bitmap, b);
 
     u32 root_dir_block = data_region_start;
-    data_bitmap[root_dir_block] = '1';
+    bitmap_set(spblock.data_bitmap, root_dir_block);
 
-    // Escribir bitmaps
-    if (write_block(folder, inode_bitmap_start, inode_bitmap, block_size) != 0 ||
-        write_block(folder, data_bitmap_start, data_bitmap, block_size) != 0) {
-        fprintf(stderr, "Error escribiendo bitmaps.\n");
-        return 1;
-    }
+    bitmaps_recount();
+    spblock.block_rotor = root_dir_block + 1;
+    spblock.inode_rotor = root_inode + 1;
 
     //  Tabla de inodos (inodo raíz)
-    unsigned char rec[128];
-    u32 direct[12] = {0};
-    direct[0] = root_dir_block;
     u32 mode_dir = 0040000 | 0755; // S_IFDIR | 0755
-    u32 dir_size = 520;
-
-    inode_serialize128(rec, root_inode, mode_dir, 0, 0, 2, dir_size, direct, 0);
-
-    unsigned char *itbl_block0 = (unsigned char*)calloc(1, block_size);
-    memcpy(itbl_block0, rec, 128);
-    if (write_block(folder, inode_table_start, itbl_block0, block_size) != 0) {
+    u32 dir_size = block_size;   // las entradas encadenadas cubren el bloque entero
+
+    // Con --extents la raíz también usa extents, así puede crecer sin el tope de direct/indirect1
+    inode root;
+    init_inode(&root, root_inode, mode_dir, dir_size);
+    root.user_id = root.group_id = 0;
+    root.links_quaintities = 2;
+    if (root.flags & QRFS_INODE_EXTENTS) {
+        root.extents[0].logical = 0;
+        root.extents[0].physical = root_dir_block;
+        root.extents[0].length = 1;
+    } else {
+        root.direct[0] = root_dir_block;
+    }
+    if (inode_write(folder, &root) != 0) {
         fprintf(stderr, "Error escribiendo tabla de inodos.\n");
-        free(itbl_block0);
         return 1;
     }
-    free(itbl_block0);
 
     // Directorio raíz
     unsigned char *dirblk = (unsigned char*)calloc(1, block_size);
     build_root_dir_block(dirblk, block_size, root_inode);
-    if (write_block(folder, root_dir_block, dirblk, block_size) != 0) {
+    if (bcache_write(folder, root_dir_block, dirblk, block_size) != 0) {
         fprintf(stderr, "Error escribiendo directorio raíz.\n");
         free(dirblk);
         return 1;
     }
     free(dirblk);
 
-    // Superbloque
-    if (write_superblock_with_offsets(folder, block_size, total_blocks, total_inodes,
-                                      inode_bitmap, data_bitmap, root_inode,
-                                      inode_bitmap_start, inode_bitmap_blocks,
-                                      data_bitmap_start, data_bitmap_blocks,
-                                      inode_table_start, inode_table_blocks,
-                                      data_region_start) != 0) {
-        fprintf(stderr, "Error escribiendo superbloque.\n");
+    // Superbloque (v2) y regiones de bitmap, enteras aunque antes se haya
+    // guardado otro volumen en el mismo proceso
+    superblock_forget_bitmaps();
+    if (superblock_store(folder) != 0) {
+        fprintf(stderr, "Error escribiendo superbloque y bitmaps.\n");
+        return 1;
+    }
+
+    if (icache_flush(folder) != 0) {
+        fprintf(stderr, "Error sincronizando bloques: %s\n", strerror(errno));
         return 1;
     }
 
     //Reporte
     printf("QRFS creado en '%s'\n", folder);
-    printf("block_size=%u, total_blocks=%u, total_inodes=%u\n", block_size, total_blocks, total_inodes);
+    printf("block_size=%u, total_blocks=%u, total_inodes=%u, backend=%s%s\n",
+           block_size, total_blocks, total_inodes, block_backend_name(backend), png ? " (PNG)" : "");
     printf("Layout:\n");
     printf("  SB               : block 0\n");
     printf("  inode_bitmap     : start=%u, blocks=%u\n", inode_bitmap_start, inode_bitmap_blocks);
     printf("  data_bitmap      : start=%u, blocks=%u\n", data_bitmap_start, data_bitmap_blocks);
     printf("  inode_table      : start=%u, blocks=%u (record_size=128)\n", inode_table_start, inode_table_blocks);
+    if (with_journal) printf("  journal          : start=%u, blocks=%u\n", journal_start, journal_blocks);
+    if (csum_blocks) printf("  checksums        : start=%u, blocks=%u (CRC32C, %s)\n", csum_start, csum_blocks, csum_impl());
+    if (dedup_blocks) printf("  dedup            : start=%u, blocks=%u (hash de 64 bits y referencias por bloque)\n", dedup_start, dedup_blocks);
     printf("  data_region_start: %u\n", data_region_start);
-    printf("  root inode       : %u  (direct[0]=%u, size=%u)\n", root_inode, root_dir_block, dir_size);
+    printf("  mapeo de datos   : %s%s\n", (features & QRFS_FEAT_EXTENTS) ? "extents" : "direct/indirect1",
+           (features & QRFS_FEAT_INLINE_DATA) ? ", archivos chicos en el inodo" : "");
+    printf("  root inode       : %u  (bloque=%u, size=%u)\n", root_inode, root_dir_block, dir_size);
+    u32 present = total_blocks;
+    block_materialized(folder, total_blocks, block_size, &present);
+    printf("  bloques creados  : %u de %u%s, formato en %.1f ms\n",
+           present, total_blocks, (features & QRFS_FEAT_SPARSE) ? " (lazy)" : "", format_ms);
 
     return 0;
 }
 
 
-
-int fsck_qrfs(const char *folder) {
-    u32 version, total_blocks, total_inodes;
-    unsigned char inode_bitmap[128], data_bitmap[128];
-    u32 root_inode;
-    u32 ib_start, ib_blocks, db_start, db_blocks, it_start, it_blocks, data_start;
-
-    // Leer superbloque
-    if (read_superblock(folder, 1024, &version, &total_blocks, &total_inodes,
-                        inode_bitmap, data_bitmap, &root_inode,
-                        &ib_start, &ib_blocks, &db_start, &db_blocks,
-                        &it_start, &it_blocks, &data_start) != 0) {
+int fsck_qrfs(const char *folder, u32 fsck_threads, int fix_checksums) {
+    // Leer superbloque (v1 o v2) y bitmaps con el tamaño de bloque del volumen
+    u32 bs;
+    if (superblock_probe(folder, &bs) != 0 || superblock_load(folder, bs) != 0) {
         fprintf(stderr, "Error: superbloque inválido.\n");
         return 1;
     }
+    u32 total_blocks = spblock.total_blocks, total_inodes = spblock.total_inodes;
+    u32 root_inode = spblock.root_inode;
+    u32 it_start = spblock.inode_table_start;
 
-    printf("Superbloque OK: version=%u, blocks=%u, inodes=%u\n", version, total_blocks, total_inodes);
+    printf("Superbloque OK: version=%u, blocks=%u, inodes=%u, backend=%s\n",
+           spblock.version, total_blocks, total_inodes, block_backend_name(spblock.backend));
 
-    // Validar layout
-    if (ib_start + ib_blocks > total_blocks ||
-        db_start + db_blocks > total_blocks ||
-        it_start + it_blocks > total_blocks ||
-        data_start >= total_blocks) {
-        fprintf(stderr, "Error: layout inconsistente.\n");
+    if (spblock.backend != (u32)block_detect_backend(folder)) {
+        fprintf(stderr, "Error: el superbloque indica backend '%s' pero la carpeta tiene '%s'.\n",
+                block_backend_name(spblock.backend), block_backend_name((u32)block_detect_backend(folder)));
         return 1;
     }
 
-    // Leer tabla de inodos (primer bloque)
-    unsigned char buf[1024];
-    if (read_block(folder, it_start, buf, 1024) != 0) {
-        fprintf(stderr, "Error leyendo tabla de inodos.\n");
+    // Validar layout
+    if ((u64)spblock.inode_bitmap_start + spblock.inode_bitmap_blocks > total_blocks ||
+        (u64)spblock.data_bitmap_start + spblock.data_bitmap_blocks > total_blocks ||
+        (u64)it_start + spblock.inode_table_blocks > total_blocks ||
+        (u64)spblock.inode_table_blocks * bs < (u64)total_inodes * 128 ||
+        spblock.data_region_start >= total_blocks ||
+        ((spblock.features & QRFS_FEAT_JOURNAL) &&
+         (u64)spblock.journal_start + spblock.journal_blocks > spblock.data_region_start) ||
+        ((spblock.features & QRFS_FEAT_CHECKSUMS) &&
+         (u64)spblock.csum_start + spblock.csum_blocks > spblock.data_region_start) ||
+        ((spblock.features & QRFS_FEAT_DEDUP) &&
+         (u64)spblock.dedup_start + spblock.dedup_blocks > spblock.data_region_start)) {
+        fprintf(stderr, "Error: layout inconsistente.\n");
         return 1;
     }
+    if (spblock.features & QRFS_FEAT_JOURNAL) {
+        printf("Diario: start=%u, blocks=%u\n", spblock.journal_start, spblock.journal_blocks);
+    }
+    if (spblock.features & QRFS_FEAT_CHECKSUMS) {
+        printf("Sumas por bloque: start=%u, blocks=%u (CRC32C, %s)\n", spblock.csum_start, spblock.csum_blocks, csum_impl());
+        if (fix_checksums) {
+            if (csum_rebuild(folder) != 0 || block_flush(folder) != 0) {
+                fprintf(stderr, "Error recalculando la tabla de sumas: %s\n", strerror(errno));
+                return 1;
+            }
+            printf("Tabla de sumas recalculada desde el contenido de los bloques.\n");
+        }
+    } else if (fix_checksums) {
+        fprintf(stderr, "Aviso: el volumen no tiene sumas por bloque (mkfs --checksums).\n");
+    }
+    if (spblock.features & QRFS_FEAT_DEDUP) {
+        dedup_stats ds;
+        dedup_get_stats(&ds);
+        printf("Deduplicación: start=%u, blocks=%u, %u bloques en el índice, %u compartidos\n",
+               spblock.dedup_start, spblock.dedup_blocks, ds.indexed, ds.shared);
+    }
 
-    // Extraer inodo raíz
-    unsigned char in[128];
-    memcpy(in, buf, 128);
+    // Materialización: en un volumen no ralo cada bloque debe existir
+    u32 present;
+    if (block_materialized(folder, total_blocks, spblock.blocksize, &present) == 0) {
+        if (spblock.features & QRFS_FEAT_SPARSE) {
+            printf("Volumen ralo: %u de %u bloques materializados (el resto se lee como ceros)\n",
+                   present, total_blocks);
+        } else if (present < total_blocks && spblock.backend == QRFS_BACKEND_FILES) {
+            fprintf(stderr, "Error: faltan %u archivos de bloque y el volumen no es ralo.\n",
+                    total_blocks - present);
+            return 1;
+        }
+    }
 
-    u32 inode_number, inode_mode, user_id, group_id, links, size, indirect1;
-    u32 direct[12];
-    //deserializar los inodos
-    inode_deserialize128(in, &inode_number, &inode_mode, &user_id, &group_id,
-                         &links, &size, direct, &indirect1);
+    // Bitmaps
+    if (!(spblock.features & QRFS_FEAT_PACKED_BITMAPS)) {
+        printf("Aviso: bitmaps en formato ASCII viejo (usar --migrate para convertirlos).\n");
+    }
+    printf("Libres: inodos=%u/%u, bloques=%u/%u\n",
+           count_free_inodes(), total_inodes, count_free_blocks(), total_blocks);
+
+    // Los contadores se recalculan desde los bitmaps y se corrigen si difieren
+    u32 sb_free_inodes = spblock.free_inodes, sb_free_blocks = spblock.free_blocks;
+    bitmaps_recount();
+    if (sb_free_inodes != spblock.free_inodes || sb_free_blocks != spblock.free_blocks) {
+        fprintf(stderr, "Advertencia: contadores de libres incorrectos (inodos %u->%u, bloques %u->%u), corrigiendo.\n",
+                sb_free_inodes, spblock.free_inodes, sb_free_blocks, spblock.free_blocks);
+        if (spblock.block_rotor >= total_blocks) spblock.block_rotor = spblock.data_region_start;
+        if (spblock.inode_rotor >= total_inodes) spblock.inode_rotor = 0;
+        if (spblock.version == QRFS_VERSION && (superblock_store(folder) != 0 || bcache_flush(folder) != 0)) {
+            fprintf(stderr, "Error reescribiendo el superbloque.\n");
+            return 1;
+        }
+    }
+    if (!bitmap_test(spblock.inode_bitmap, root_inode)) {
+        fprintf(stderr, "Error: inodo raíz marcado como libre.\n");
+        return 1;
+    }
 
+    // Inodo raíz (pasa por la cache de inodos)
+    inode root;
+    if (inode_read(folder, root_inode, &root) != 0) {
+        fprintf(stderr, "Error leyendo inodo raíz.\n");
+        return 1;
+    }
     printf("Inodo raíz: inode=%u, mode=%o, size=%u, links=%u\n",
-           inode_number, inode_mode, size, links);
+           root.inode_number, (unsigned)root.inode_mode, root.inode_size, root.links_quaintities);
 
-    if ((inode_mode & 0040000) == 0) {
+    if ((root.inode_mode & 0040000) == 0) {
         fprintf(stderr, "Error: inodo raíz no es directorio.\n");
         return 1;
     }
-    if (links != 2) {
-        fprintf(stderr, "Advertencia: inodo raíz links=%u (esperado 2).\n", links);
+    // "." y ".." más el ".." de cada subdirectorio
+    if (root.links_quaintities < 2) {
+        fprintf(stderr, "Advertencia: inodo raíz links=%u (esperado al menos 2).\n", root.links_quaintities);
     }
 
-    // Leer bloque del directorio raíz
-    unsigned char dirbuf[1024];
-    if (read_block(folder, direct[0], dirbuf, 1024) != 0) {
-        fprintf(stderr, "Error leyendo bloque del directorio raíz.\n");
-        return 1;
+    // Directorio raíz: índice hash o bloques lineales
+    if (root.flags & QRFS_INODE_HTREE) {
+        htree_info hi;
+        if (htree_check(folder, &root, &hi) != 0) {
+            fprintf(stderr, "Error: índice del directorio raíz ilegible.\n");
+            return 1;
+        }
+        printf("Directorio raíz indexado: niveles=%u, bloques de índice=%u, hojas=%u, entradas=%u\n",
+               hi.levels, hi.index_blocks, hi.leaves, hi.entries);
+        if (hi.misplaced) {
+            fprintf(stderr, "Error: %u entradas fuera de su hoja en el índice del directorio raíz.\n", hi.misplaced);
+            return 1;
+        }
+    } else {
+        for (u32 l = 0; l < dir_nblocks(&root); l++) {
+            u32 root_dir_block; // El bloque del directorio raíz viene del inodo raíz
+            if (dir_map(folder, &root, l, &root_dir_block) != 0) {
+                fprintf(stderr, "Error leyendo bloque del directorio raíz.\n");
+                return 1;
+            }
+            list_directory_block(folder, bs, root_dir_block);
+        }
     }
 
-	u32 root_dir_block = direct[0]; // El bloque del directorio raíz viene del inodo raíz
+    // Tabla de inodos y árbol completos, en paralelo
+    fscheck_report rep;
+    if (fscheck_run(folder, fsck_threads, &rep) != 0) {
+        fprintf(stderr, "Error: chequeo completo interrumpido: %s\n", strerror(errno));
+        return 1;
+    }
+    double mib = (double)rep.bytes_read / (1024.0 * 1024.0);
+    printf("Chequeo completo (%u hilos): %u inodos en uso, %u alcanzables, %u directorios, %llu entradas, %llu bloques reclamados\n",
+           rep.threads, rep.inodes_used, rep.reachable, rep.directories, rep.entries, rep.blocks_claimed);
+    printf("Leídos %.1f MiB en %.1f ms (%.1f MiB/s, %.0f inodos/s)\n", mib, rep.seconds * 1000.0,
+           rep.seconds > 0 ? mib / rep.seconds : 0.0, rep.seconds > 0 ? rep.inodes_used / rep.seconds : 0.0);
+    if (rep.orphan_inodes || rep.blocks_leaked) {
+        fprintf(stderr, "Advertencia: %u inodos ocupados sin nombre y %u bloques marcados sin dueño (espacio perdido).\n",
+                rep.orphan_inodes, rep.blocks_leaked);
+    }
+    if (spblock.features & QRFS_FEAT_CHECKSUMS) {
+        printf("Sumas verificadas: %llu bloques en uso, %u no coinciden\n", rep.blocks_verified, rep.bad_checksums);
+    }
+    if (spblock.features & QRFS_FEAT_DEDUP) {
+        printf("Datos: %llu bloques referenciados en %llu físicos (ratio de deduplicación %.2f), %u compartidos\n",
+               rep.data_refs, rep.data_blocks, rep.data_blocks ? (double)rep.data_refs / rep.data_blocks : 1.0,
+               rep.shared_blocks);
+    }
+    if (!fscheck_clean(&rep)) {
+        fprintf(stderr, "Error: inodos inválidos=%u, bloques duplicados=%u, directorios dañados=%u, "
+                "entradas colgadas=%u, links incorrectos=%u, bloques en uso marcados libres=%u, sumas incorrectas=%u, "
+                "referencias incorrectas=%u.\n",
+                rep.bad_inodes, rep.duplicate_blocks, rep.bad_directories, rep.dangling_entries,
+                rep.link_mismatches, rep.blocks_unmarked, rep.bad_checksums, rep.bad_refcounts);
+        if (rep.bad_checksums) {
+            fprintf(stderr, "Si el volumen se cortó sin sincronizar, las sumas pueden ser de antes de la última "
+                            "escritura: --fix-checksums las recalcula.\n");
+        }
+        return 1;
+    }
 
-	list_directory_block(folder, 1024, root_dir_block);
+    block_fd_stats st;
+    block_fd_cache_stats(&st);
+    printf("Cache de descriptores: hits=%llu, misses=%llu, hit_rate=%.2f, syscalls ahorradas=%llu\n",
+           st.hits, st.misses, block_fd_cache_hit_rate(), st.syscalls_saved);
+    bcache_stats bst;
+    bcache_get_stats(&bst);
+    printf("Cache de bloques (%u slots): hits=%llu, misses=%llu, evictions=%llu, hit_rate=%.2f\n",
+           bcache_capacity(), bst.hits, bst.misses, bst.evictions, bcache_hit_rate());
+    icache_stats ist;
+    icache_get_stats(&ist);
+    printf("Cache de inodos (%u slots): hits=%llu, misses=%llu, precargados=%llu, hit_rate=%.2f\n",
+           icache_capacity(), ist.hits, ist.misses, ist.prefetched, icache_hit_rate());
     printf("Chequeo completado: QRFS parece consistente.\n");
     return 0;
 }
 
-
-int main(int argc, char **argv) {
-    if (argc < 2) {
-        fprintf(stderr, "Uso: %s <carpeta>\n", argv[0]);
-        return 1;
-    }
-
-    return fsck_qrfs(argv[1]);
-}
@@ -0,0 +1,14 @@
+#ifndef MKFS_H
+#define MKFS_H
+#include "fs_basic.h"
+
+// Formateo y chequeo como funciones de la biblioteca: los usan los binarios
+// mkfs.qrfs y fsck.qrfs y quien formatee en el proceso (benchmarks, pruebas).
+
+// argv[1] = carpeta, después las opciones (--blocks=N, --backend=image, ...)
+int mkfs(int argc, char **argv);
+// threads: hilos del chequeo completo (0 = uno por CPU); fix_checksums:
+// recalcular la tabla de sumas desde el contenido antes de chequear
+int fsck_qrfs(const char *folder, u32 threads, int fix_checksums);
+
+#endif
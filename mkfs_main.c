@@ -0,0 +1,12 @@
+#include "mkfs.h"
+#include <stdio.h>
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Uso: %s <carpeta> [--blocks=N] [--inodes=N] [--blocksize=N] [--backend=files|image]\n"
+                        "       [--extents] [--inline] [--journal[=N]] [--checksums] [--dedup] [--lazy] [--png]\n"
+                        "       [--fixed-dirs] [--threads=N] [--cache=KiB]\n", argv[0]);
+        return 1;
+    }
+    return mkfs(argc, argv);
+}
@@ -0,0 +1,407 @@
+#include "png.h"
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define PNG_X86 1
+#endif
+
+static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+
+// ---- CRC32 (polinomio 0xEDB88320, reflejado) ----
+
+static u32 crc_table[8][256];
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+static int use_pclmul = 0, use_ssse3 = 0;
+static int want_simd = 1;
+
+static void crc_init(void) {
+    for (u32 i = 0; i < 256; i++) {
+        u32 c = i;
+        for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        crc_table[0][i] = c;
+    }
+    for (u32 i = 0; i < 256; i++) {
+        for (int t = 1; t < 8; t++) {
+            u32 c = crc_table[t - 1][i];
+            crc_table[t][i] = crc_table[0][c & 0xff] ^ (c >> 8);
+        }
+    }
+#ifdef PNG_X86
+    __builtin_cpu_init();
+    use_pclmul = __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+    use_ssse3 = __builtin_cpu_supports("ssse3");
+#endif
+}
+
+static inline u32 load32le(const unsigned char *p) {
+    u32 v;
+    memcpy(&v, p, 4);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap32(v);
+#endif
+    return v;
+}
+
+// Slicing-by-8: 8 bytes por vuelta con 8 tablas; `c` ya invertido
+static u32 crc32_slice8(u32 c, const unsigned char *p, size_t n) {
+    while (n >= 8) {
+        u32 a = load32le(p) ^ c, b = load32le(p + 4);
+        c = crc_table[7][a & 0xff] ^ crc_table[6][(a >> 8) & 0xff] ^
+            crc_table[5][(a >> 16) & 0xff] ^ crc_table[4][a >> 24] ^
+            crc_table[3][b & 0xff] ^ crc_table[2][(b >> 8) & 0xff] ^
+            crc_table[1][(b >> 16) & 0xff] ^ crc_table[0][b >> 24];
+        p += 8;
+        n -= 8;
+    }
+    while (n--) c = crc_table[0][(c ^ *p++) & 0xff] ^ (c >> 8);
+    return c;
+}
+
+#ifdef PNG_X86
+// Plegado con multiplicación sin acarreo: 4 acumuladores de 128 bits sobre
+// tandas de 64 bytes, luego a 128, a 64 y reducción de Barrett a 32 bits.
+// n >= 64 y múltiplo de 16; `c` ya invertido.
+__attribute__((target("pclmul,sse4.1")))
+static u32 crc32_pclmul(u32 c, const unsigned char *p, size_t n) {
+    const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+    const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+    const __m128i k5k0 = _mm_set_epi64x(0, 0x0163cd6124);
+    const __m128i poly = _mm_set_epi64x(0x01f7011641, 0x01db710641);
+    const __m128i mask = _mm_setr_epi32(~0, 0, ~0, 0);
+
+    __m128i x1 = _mm_loadu_si128((const __m128i*)(p + 0x00));
+    __m128i x2 = _mm_loadu_si128((const __m128i*)(p + 0x10));
+    __m128i x3 = _mm_loadu_si128((const __m128i*)(p + 0x20));
+    __m128i x4 = _mm_loadu_si128((const __m128i*)(p + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)c));
+    p += 64;
+    n -= 64;
+    while (n >= 64) {
+        __m128i x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+        __m128i x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+        __m128i x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+        __m128i x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i*)(p + 0x00)));
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128((const __m128i*)(p + 0x10)));
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128((const __m128i*)(p + 0x20)));
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128((const __m128i*)(p + 0x30)));
+        p += 64;
+        n -= 64;
+    }
+
+    // 4 acumuladores -> 1
+    __m128i x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), x2), x5);
+    x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), x3), x5);
+    x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), x4), x5);
+    while (n >= 16) {
+        x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i*)p));
+        p += 16;
+        n -= 16;
+    }
+
+    // 128 -> 64 bits
+    x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, mask);
+    x1 = _mm_xor_si128(_mm_clmulepi64_si128(x1, k5k0, 0x00), x2);
+
+    // Barrett
+    x2 = _mm_and_si128(x1, mask);
+    x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+    x2 = _mm_and_si128(x2, mask);
+    x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+    return (u32)_mm_extract_epi32(x1, 1);
+}
+#endif
+
+u32 png_crc32(u32 crc, const void *buf, size_t len) {
+    pthread_once(&crc_once, crc_init);
+    const unsigned char *p = (const unsigned char*)buf;
+    u32 c = ~crc;
+#ifdef PNG_X86
+    if (use_pclmul && want_simd && len >= 64) {
+        size_t n = len & ~(size_t)15;
+        c = crc32_pclmul(c, p, n);
+        p += n;
+        len -= n;
+    }
+#endif
+    return ~crc32_slice8(c, p, len);
+}
+
+void png_set_simd(int enable) {
+    want_simd = enable;
+}
+
+const char *png_checksum_impl(void) {
+    pthread_once(&crc_once, crc_init);
+    if (!want_simd) return "slicing-by-8/escalar";
+    return use_pclmul ? (use_ssse3 ? "pclmul/ssse3" : "pclmul/escalar")
+                      : (use_ssse3 ? "slicing-by-8/ssse3" : "slicing-by-8/escalar");
+}
+
+// ---- Adler32 ----
+
+#define ADLER_MOD  65521u
+#define ADLER_NMAX 5552     // mayor n sin desbordar b en 32 bits antes del módulo
+
+#ifdef PNG_X86
+// Tandas de 32 bytes: a suma los bytes (sad), b los pondera 32..1 (maddubs)
+// y se le suma 32 veces el a de antes de cada tanda (v_ps). Devuelve lo que
+// queda sin procesar (< 32 bytes).
+__attribute__((target("ssse3")))
+static size_t adler32_ssse3(u32 *pa, u32 *pb, const unsigned char **pp, size_t len) {
+    const __m128i tap1 = _mm_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17);
+    const __m128i tap2 = _mm_setr_epi8(16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ones = _mm_set1_epi16(1);
+    const unsigned char *p = *pp;
+    u32 a = *pa, b = *pb;
+    size_t blocks = len / 32;
+    len -= blocks * 32;
+    while (blocks > 0) {
+        u32 n = ADLER_NMAX / 32;
+        if (n > blocks) n = (u32)blocks;
+        blocks -= n;
+        __m128i v_ps = _mm_set_epi32(0, 0, 0, (int)(a * n));
+        __m128i v_s2 = _mm_set_epi32(0, 0, 0, (int)b);
+        __m128i v_s1 = zero;
+        do {
+            const __m128i x1 = _mm_loadu_si128((const __m128i*)p);
+            const __m128i x2 = _mm_loadu_si128((const __m128i*)(p + 16));
+            v_ps = _mm_add_epi32(v_ps, v_s1);
+            v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(x1, zero));
+            v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(_mm_maddubs_epi16(x1, tap1), ones));
+            v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(x2, zero));
+            v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(_mm_maddubs_epi16(x2, tap2), ones));
+            p += 32;
+        } while (--n);
+        v_s2 = _mm_add_epi32(v_s2, _mm_slli_epi32(v_ps, 5));
+        v_s1 = _mm_add_epi32(v_s1, _mm_shuffle_epi32(v_s1, _MM_SHUFFLE(2, 3, 0, 1)));
+        v_s1 = _mm_add_epi32(v_s1, _mm_shuffle_epi32(v_s1, _MM_SHUFFLE(1, 0, 3, 2)));
+        v_s2 = _mm_add_epi32(v_s2, _mm_shuffle_epi32(v_s2, _MM_SHUFFLE(2, 3, 0, 1)));
+        v_s2 = _mm_add_epi32(v_s2, _mm_shuffle_epi32(v_s2, _MM_SHUFFLE(1, 0, 3, 2)));
+        a = (a + (u32)_mm_cvtsi128_si32(v_s1)) % ADLER_MOD;
+        b = (u32)_mm_cvtsi128_si32(v_s2) % ADLER_MOD;
+    }
+    *pa = a;
+    *pb = b;
+    *pp = p;
+    return len;
+}
+#endif
+
+u32 png_adler32(u32 adler, const void *buf, size_t len) {
+    const unsigned char *p = (const unsigned char*)buf;
+    u32 a = adler & 0xffff, b = adler >> 16;
+#ifdef PNG_X86
+    pthread_once(&crc_once, crc_init);
+    if (use_ssse3 && want_simd) len = adler32_ssse3(&a, &b, &p, len);
+#endif
+    while (len > 0) {
+        size_t n = len < ADLER_NMAX ? len : ADLER_NMAX;
+        len -= n;
+        while (n >= 8) {
+            a += p[0]; b += a;
+            a += p[1]; b += a;
+            a += p[2]; b += a;
+            a += p[3]; b += a;
+            a += p[4]; b += a;
+            a += p[5]; b += a;
+            a += p[6]; b += a;
+            a += p[7]; b += a;
+            p += 8;
+            n -= 8;
+        }
+        while (n--) { a += *p++; b += a; }
+        a %= ADLER_MOD;
+        b %= ADLER_MOD;
+    }
+    return (b << 16) | a;
+}
+
+// ---- Contenedor ----
+
+static void put32be(u32 v, unsigned char *p) {
+    p[0] = (unsigned char)(v >> 24);
+    p[1] = (unsigned char)(v >> 16);
+    p[2] = (unsigned char)(v >> 8);
+    p[3] = (unsigned char)v;
+}
+
+static u32 get32be(const unsigned char *p) {
+    return ((u32)p[0] << 24) | ((u32)p[1] << 16) | ((u32)p[2] << 8) | p[3];
+}
+
+// Bytes [pos, pos + n) del stream de filas (filtro + PNG_WIDTH píxeles) de
+// una imagen con `data` de `len` bytes
+static void rows_out(unsigned char *out, const unsigned char *data, u32 len, u32 pos, u32 n) {
+    while (n > 0) {
+        u32 row = pos / (PNG_WIDTH + 1), col = pos % (PNG_WIDTH + 1);
+        if (col == 0) {
+            *out++ = 0;                               // filtro None
+            pos++;
+            n--;
+            continue;
+        }
+        u32 take = PNG_WIDTH + 1 - col, at = row * PNG_WIDTH + col - 1;
+        if (take > n) take = n;
+        u32 have = at < len ? len - at : 0;
+        if (have > take) have = take;
+        memcpy(out, data + at, have);
+        memset(out + have, 0, take - have);           // relleno de la última fila
+        out += take;
+        pos += take;
+        n -= take;
+    }
+}
+
+size_t png_encode(const void *data, u32 len, unsigned char *out) {
+    u32 rows = PNG_ROWS(len), raw = PNG_RAW(len), stored = PNG_STORED(len);
+    unsigned char *p = out;
+    memcpy(p, signature, 8);
+    p += 8;
+
+    put32be(13, p);
+    memcpy(p + 4, "IHDR", 4);
+    put32be(PNG_WIDTH, p + 8);
+    put32be(rows, p + 12);
+    p[16] = 8;                  // bits por muestra
+    p[17] = 0;                  // escala de grises
+    p[18] = p[19] = p[20] = 0;  // deflate, filtro adaptativo, sin entrelazado
+    put32be(png_crc32(0, p + 4, 17), p + 21);
+    p += 25;
+
+    unsigned char *idat = p;
+    put32be(2 + 5 * stored + raw + 4, p);
+    memcpy(p + 4, "IDAT", 4);
+    p += 8;
+    p[0] = 0x78;                // deflate, ventana de 32 KiB
+    p[1] = 0x01;                // sin diccionario, nivel "más rápido"; (0x7801 % 31) == 0
+    p += 2;
+    u32 adler = 1;
+    for (u32 pos = 0, s = 0; s < stored; s++) {
+        u32 n = raw - pos < 65535 ? raw - pos : 65535;
+        p[0] = s + 1 == stored;                       // BFINAL, BTYPE = 00
+        p[1] = (unsigned char)n;
+        p[2] = (unsigned char)(n >> 8);
+        p[3] = (unsigned char)~n;
+        p[4] = (unsigned char)(~n >> 8);
+        rows_out(p + 5, (const unsigned char*)data, len, pos, n);
+        adler = png_adler32(adler, p + 5, n);
+        p += 5 + n;
+        pos += n;
+    }
+    put32be(adler, p);
+    p += 4;
+    put32be(png_crc32(0, idat + 4, (size_t)(p - idat - 4)), p);
+    p += 4;
+
+    static const unsigned char iend[12] = {0, 0, 0, 0, 'I', 'E', 'N', 'D', 0xAE, 0x42, 0x60, 0x82};
+    memcpy(p, iend, 12);
+    p += 12;
+    return (size_t)(p - out);
+}
+
+int png_is_png(const unsigned char *in, size_t in_len) {
+    return in_len >= 8 && memcmp(in, signature, 8) == 0;
+}
+
+static int bad(void) {
+    errno = EINVAL;
+    return -1;
+}
+
+// Cabeceras hasta el primer byte del stream zlib; devuelve su offset
+static long parse_headers(const unsigned char *in, size_t in_len, u32 *width, u32 *height, u32 *idat_len) {
+    if (in_len < 8 + 25 + 8 + 2 || !png_is_png(in, in_len)) return bad();
+    const unsigned char *h = in + 8;
+    if (get32be(h) != 13 || memcmp(h + 4, "IHDR", 4) != 0) return bad();
+    *width = get32be(h + 8);
+    *height = get32be(h + 12);
+    if (*width == 0 || *width > 65536 || h[16] != 8 || h[17] != 0 || h[18] || h[19] || h[20]) return bad();
+    const unsigned char *d = h + 25;
+    if (memcmp(d + 4, "IDAT", 4) != 0) return bad();
+    *idat_len = get32be(d);
+    const unsigned char *z = d + 8;
+    if ((z[0] & 0x0f) != 8 || (z[1] & 0x20) || ((u32)z[0] << 8 | z[1]) % 31 != 0) return bad();
+    return (long)(z + 2 - in);
+}
+
+int png_decode(const unsigned char *in, size_t in_len, void *data, u32 len) {
+    u32 width, height, idat_len;
+    long off = parse_headers(in, in_len, &width, &height, &idat_len);
+    if (off < 0) return -1;
+    if ((u64)width * height < len) return bad();
+
+    unsigned char *out = (unsigned char*)data;
+    const unsigned char *p = in + off, *end = in + in_len;
+    u64 row_len = (u64)width + 1;
+    u64 pos = 0;                // posición en el stream de filas
+    u32 got = 0;
+    int final = 0;
+    while (got < len) {
+        if (final || end - p < 5) return bad();
+        if ((p[0] & 0x06) != 0) return bad();      // solo bloques stored
+        final = p[0] & 1;
+        u32 n = (u32)p[1] | (u32)p[2] << 8;
+        if ((n ^ ((u32)p[3] | (u32)p[4] << 8)) != 0xffff) return bad();
+        p += 5;
+        u32 avail = (u32)(end - p) < n ? (u32)(end - p) : n;
+        for (u32 i = 0; i < avail && got < len; ) {
+            u64 col = pos % row_len;
+            if (col == 0) {
+                if (p[i] != 0) return bad();        // filtro distinto de None
+                i++;
+                pos++;
+                continue;
+            }
+            u32 take = (u32)(row_len - col);
+            if (take > avail - i) take = avail - i;
+            if (take > len - got) take = len - got;
+            memcpy(out + got, p + i, take);
+            got += take;
+            i += take;
+            pos += take;
+        }
+        if (got < len && avail < n) return bad();   // prefijo corto
+        p += n;
+    }
+    return 0;
+}
+
+int png_verify(const unsigned char *in, size_t in_len) {
+    u32 width, height, idat_len;
+    long off = parse_headers(in, in_len, &width, &height, &idat_len);
+    if (off < 0) return -1;
+    const unsigned char *h = in + 8, *d = h + 25;
+    if (png_crc32(0, h + 4, 17) != get32be(h + 21)) return bad();
+    if ((size_t)(d - in) + 12 + idat_len > in_len) return bad();
+    if (png_crc32(0, d + 4, 4 + (size_t)idat_len) != get32be(d + 8 + idat_len)) return bad();
+
+    const unsigned char *p = in + off, *end = d + 8 + idat_len - 4;
+    u32 adler = 1;
+    for (int final = 0; !final; ) {
+        if (end - p < 5 || (p[0] & 0x06) != 0) return bad();
+        final = p[0] & 1;
+        u32 n = (u32)p[1] | (u32)p[2] << 8;
+        if ((n ^ ((u32)p[3] | (u32)p[4] << 8)) != 0xffff || (size_t)(end - p - 5) < n) return bad();
+        adler = png_adler32(adler, p + 5, n);
+        p += 5 + n;
+    }
+    if (p != end || adler != get32be(end)) return bad();
+    return 0;
+}
@@ -0,0 +1,39 @@
+#ifndef PNG_H
+#define PNG_H
+#include "fs_basic.h"
+#include <stddef.h>
+
+// Contenedor PNG para bloques: cada bloque es una imagen en escala de grises
+// de 8 bits, PNG_WIDTH píxeles de ancho y tantas filas como hagan falta (la
+// última rellenada con ceros). El IDAT es un stream zlib con bloques deflate
+// "stored" (sin comprimir) y filtro 0 en cada fila, así codificar es copiar
+// filas y calcular CRC32 y Adler32; no hay zlib de por medio.
+//
+// Decodificar valida solo las cabeceras (firma, IHDR, IDAT, zlib, bloques
+// stored y filtros) y copia las filas; los CRC y el Adler32 se comprueban
+// aparte con png_verify.
+
+#define PNG_WIDTH 256
+
+// Tamaño fijo del archivo para un bloque de `len` bytes
+#define PNG_ROWS(len)   (((len) + PNG_WIDTH - 1) / PNG_WIDTH)
+#define PNG_RAW(len)    (PNG_ROWS(len) * (PNG_WIDTH + 1))
+#define PNG_STORED(len) (PNG_RAW(len) != 0 ? (PNG_RAW(len) + 65534) / 65535 : 1)
+#define PNG_ENCODED_SIZE(len) (63 + 5 * PNG_STORED(len) + PNG_RAW(len))
+
+size_t png_encode(const void *data, u32 len, unsigned char *out);    // devuelve PNG_ENCODED_SIZE(len)
+// Los primeros `len` bytes de la imagen; alcanza con que `in` traiga el
+// prefijo que los contiene. -1 con errno = EINVAL si no es un bloque PNG.
+int    png_decode(const unsigned char *in, size_t in_len, void *data, u32 len);
+int    png_verify(const unsigned char *in, size_t in_len);          // 0 = CRC y Adler32 correctos
+int    png_is_png(const unsigned char *in, size_t in_len);          // firma PNG
+
+// Sumas del formato (convención de zlib: empezar con crc = 0, adler = 1)
+u32  png_crc32(u32 crc, const void *buf, size_t len);
+u32  png_adler32(u32 adler, const void *buf, size_t len);
+// CRC32 con PCLMUL y Adler32 con SSSE3 si la CPU los tiene; si no (o con
+// enable = 0), slicing-by-8 y el escalar desenrollado
+void png_set_simd(int enable);
+const char *png_checksum_impl(void);
+
+#endif
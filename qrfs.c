@@ -0,0 +1,293 @@
+#define _XOPEN_SOURCE 700
+#include "qrfs.h"
+#include "dir.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+
+struct qrfs {
+    char folder[512];
+};
+
+struct qrfs_file {
+    qrfs *fs;
+    u32 inode_id;
+    int flags;
+    u64 pos;
+    pthread_mutex_t lock;     // protege pos entre hilos que comparten el handle
+    fsops_ra ra;              // lectura anticipada de este handle
+};
+
+static pthread_mutex_t mount_lock = PTHREAD_MUTEX_INITIALIZER;
+static qrfs *mounted = NULL;
+
+qrfs *qrfs_mount(const char *folder, const fsops_options *opt) {
+    pthread_mutex_lock(&mount_lock);
+    qrfs *fs = NULL;
+    if (mounted) {
+        errno = EBUSY;
+    } else if (!(fs = (qrfs*)calloc(1, sizeof(qrfs)))) {
+        errno = ENOMEM;
+    } else {
+        snprintf(fs->folder, sizeof(fs->folder), "%s", folder);
+        if (fsops_mount(fs->folder, opt) != 0) {
+            free(fs);
+            fs = NULL;
+        } else {
+            mounted = fs;
+        }
+    }
+    pthread_mutex_unlock(&mount_lock);
+    return fs;
+}
+
+int qrfs_unmount(qrfs *fs) {
+    pthread_mutex_lock(&mount_lock);
+    int rc = -1;
+    if (!fs || fs != mounted) {
+        errno = EINVAL;
+    } else {
+        rc = fsops_unmount(fs->folder);
+        mounted = NULL;
+        free(fs);
+    }
+    pthread_mutex_unlock(&mount_lock);
+    return rc;
+}
+
+int qrfs_sync(qrfs *fs) {
+    return fsops_sync(fs->folder);
+}
+
+int qrfs_statfs(qrfs *fs, struct statvfs *st) {
+    return fsops_statfs(fs->folder, st);
+}
+
+// ---- Rutas ----
+
+// Copia el siguiente componente de *p en `name` y avanza; 0 = no hay más
+static int next_component(const char **p, char name[DIR_NAME_MAX + 1]) {
+    while (**p == '/') (*p)++;
+    size_t len = strcspn(*p, "/");
+    if (len == 0) return 0;
+    if (len > DIR_NAME_MAX) { errno = ENAMETOOLONG; return -1; }
+    memcpy(name, *p, len);
+    name[len] = '\0';
+    *p += len;
+    return 1;
+}
+
+// Las rutas son siempre desde la raíz del volumen (con o sin '/' inicial)
+static int resolve(qrfs *fs, const char *path, u32 *inode_id) {
+    char name[DIR_NAME_MAX + 1];
+    u32 cur = fsops_root();
+    int r;
+    while ((r = next_component(&path, name)) > 0) {
+        if (fsops_lookup(fs->folder, cur, name, &cur) != 0) return -1;
+    }
+    if (r < 0) return -1;
+    *inode_id = cur;
+    return 0;
+}
+
+// Directorio padre y último componente; la raíz no tiene
+static int split(qrfs *fs, const char *path, u32 *parent, char name[DIR_NAME_MAX + 1]) {
+    char comp[DIR_NAME_MAX + 1];
+    u32 cur = fsops_root();
+    int r, have = 0;
+    while ((r = next_component(&path, comp)) > 0) {
+        if (have && fsops_lookup(fs->folder, cur, name, &cur) != 0) return -1;
+        memcpy(name, comp, strlen(comp) + 1);
+        have = 1;
+    }
+    if (r < 0) return -1;
+    if (!have) { errno = EINVAL; return -1; }
+    *parent = cur;
+    return 0;
+}
+
+int qrfs_stat(qrfs *fs, const char *path, struct stat *st) {
+    u32 ino;
+    if (resolve(fs, path, &ino) != 0) return -1;
+    return fsops_getattr(fs->folder, ino, st);
+}
+
+int qrfs_mkdir(qrfs *fs, const char *path, mode_t mode) {
+    char name[DIR_NAME_MAX + 1];
+    u32 parent, ino;
+    if (split(fs, path, &parent, name) != 0) return -1;
+    return fsops_mkdir(fs->folder, parent, name, mode, (u32)getuid(), (u32)getgid(), &ino);
+}
+
+int qrfs_rmdir(qrfs *fs, const char *path) {
+    char name[DIR_NAME_MAX + 1];
+    u32 parent;
+    if (split(fs, path, &parent, name) != 0) return -1;
+    return fsops_rmdir(fs->folder, parent, name);
+}
+
+int qrfs_unlink(qrfs *fs, const char *path) {
+    char name[DIR_NAME_MAX + 1];
+    u32 parent;
+    if (split(fs, path, &parent, name) != 0) return -1;
+    return fsops_unlink(fs->folder, parent, name);
+}
+
+int qrfs_rename(qrfs *fs, const char *from, const char *to) {
+    char name[DIR_NAME_MAX + 1], new_name[DIR_NAME_MAX + 1];
+    u32 parent, new_parent;
+    if (split(fs, from, &parent, name) != 0 || split(fs, to, &new_parent, new_name) != 0) return -1;
+    return fsops_rename(fs->folder, parent, name, new_parent, new_name);
+}
+
+int qrfs_truncate(qrfs *fs, const char *path, u64 size) {
+    u32 ino;
+    if (resolve(fs, path, &ino) != 0) return -1;
+    return fsops_truncate(fs->folder, ino, size);
+}
+
+typedef struct readdir_ctx {
+    qrfs_dir_fn fn;
+    void *ctx;
+} readdir_ctx;
+
+static int readdir_cb(const char *name, u32 inode_id, mode_t mode, u64 next, void *p) {
+    (void)next;
+    readdir_ctx *rd = (readdir_ctx*)p;
+    qrfs_dirent e = {name, inode_id, mode};
+    return rd->fn(&e, rd->ctx);
+}
+
+int qrfs_readdir(qrfs *fs, const char *path, qrfs_dir_fn fn, void *ctx) {
+    u32 ino;
+    if (resolve(fs, path, &ino) != 0) return -1;
+    readdir_ctx rd = {fn, ctx};
+    return fsops_readdir(fs->folder, ino, 0, readdir_cb, &rd);
+}
+
+// ---- Archivos abiertos ----
+
+qrfs_file *qrfs_open(qrfs *fs, const char *path, int flags, mode_t mode) {
+    char name[DIR_NAME_MAX + 1];
+    u32 parent, ino;
+    int acc = flags & O_ACCMODE;
+
+    if (flags & O_CREAT) {
+        if (split(fs, path, &parent, name) != 0) return NULL;
+        if (fsops_lookup(fs->folder, parent, name, &ino) == 0) {
+            if (flags & O_EXCL) { errno = EEXIST; return NULL; }
+        } else if (errno != ENOENT) {
+            return NULL;
+        } else if (fsops_create(fs->folder, parent, name, mode, (u32)getuid(), (u32)getgid(), &ino) != 0) {
+            // Otro hilo lo creó entre la búsqueda y el alta
+            if (errno != EEXIST || (flags & O_EXCL) ||
+                fsops_lookup(fs->folder, parent, name, &ino) != 0) return NULL;
+        }
+    } else if (resolve(fs, path, &ino) != 0) {
+        return NULL;
+    }
+
+    struct stat st;
+    if (fsops_getattr(fs->folder, ino, &st) != 0) return NULL;
+    if (S_ISDIR(st.st_mode) && acc != O_RDONLY) { errno = EISDIR; return NULL; }
+    if ((flags & O_TRUNC) && acc != O_RDONLY && st.st_size > 0 &&
+        fsops_truncate(fs->folder, ino, 0) != 0) return NULL;
+
+    qrfs_file *f = (qrfs_file*)calloc(1, sizeof(qrfs_file));
+    if (!f) { errno = ENOMEM; return NULL; }
+    if (fsops_open(fs->folder, ino) != 0) {
+        free(f);
+        return NULL;
+    }
+    f->fs = fs;
+    f->inode_id = ino;
+    f->flags = flags;
+    pthread_mutex_init(&f->lock, NULL);
+    return f;
+}
+
+int qrfs_close(qrfs_file *f) {
+    if (!f) { errno = EBADF; return -1; }
+    int rc = fsops_release(f->fs->folder, f->inode_id);
+    pthread_mutex_destroy(&f->lock);
+    free(f);
+    return rc;
+}
+
+static int can_read(const qrfs_file *f) {
+    if ((f->flags & O_ACCMODE) == O_WRONLY) { errno = EBADF; return 0; }
+    return 1;
+}
+
+static int can_write(const qrfs_file *f) {
+    if ((f->flags & O_ACCMODE) == O_RDONLY) { errno = EBADF; return 0; }
+    return 1;
+}
+
+long qrfs_pread(qrfs_file *f, void *buf, size_t len, u64 offset) {
+    if (!can_read(f)) return -1;
+    if (len > UINT32_MAX) len = UINT32_MAX;
+    (void)fsops_readahead(f->fs->folder, f->inode_id, &f->ra, offset, (u32)len);   // solo un aviso
+    return fsops_read(f->fs->folder, f->inode_id, offset, buf, (u32)len);
+}
+
+long qrfs_pwrite(qrfs_file *f, const void *buf, size_t len, u64 offset) {
+    if (!can_write(f)) return -1;
+    if (len > UINT32_MAX) len = UINT32_MAX;
+    return fsops_write(f->fs->folder, f->inode_id, offset, buf, (u32)len);
+}
+
+long qrfs_read(qrfs_file *f, void *buf, size_t len) {
+    pthread_mutex_lock(&f->lock);
+    long r = qrfs_pread(f, buf, len, f->pos);
+    if (r > 0) f->pos += (u64)r;
+    pthread_mutex_unlock(&f->lock);
+    return r;
+}
+
+long qrfs_write(qrfs_file *f, const void *buf, size_t len) {
+    pthread_mutex_lock(&f->lock);
+    long r = -1;
+    struct stat st;
+    if (!(f->flags & O_APPEND) || fsops_getattr(f->fs->folder, f->inode_id, &st) == 0) {
+        if (f->flags & O_APPEND) f->pos = (u64)st.st_size;
+        r = qrfs_pwrite(f, buf, len, f->pos);
+        if (r > 0) f->pos += (u64)r;
+    }
+    pthread_mutex_unlock(&f->lock);
+    return r;
+}
+
+long long qrfs_seek(qrfs_file *f, long long offset, int whence) {
+    pthread_mutex_lock(&f->lock);
+    long long base = -1;
+    struct stat st;
+    if (whence == SEEK_SET) base = 0;
+    else if (whence == SEEK_CUR) base = (long long)f->pos;
+    else if (whence == SEEK_END && fsops_getattr(f->fs->folder, f->inode_id, &st) == 0) base = (long long)st.st_size;
+    else if (whence != SEEK_END) errno = EINVAL;
+
+    long long pos = -1;
+    if (base >= 0) {
+        if (base + offset < 0) errno = EINVAL;
+        else f->pos = (u64)(pos = base + offset);
+    }
+    pthread_mutex_unlock(&f->lock);
+    return pos;
+}
+
+int qrfs_fstat(qrfs_file *f, struct stat *st) {
+    return fsops_getattr(f->fs->folder, f->inode_id, st);
+}
+
+int qrfs_ftruncate(qrfs_file *f, u64 size) {
+    if (!can_write(f)) return -1;
+    return fsops_truncate(f->fs->folder, f->inode_id, size);
+}
+
+int qrfs_fsync(qrfs_file *f) {
+    return fsops_sync(f->fs->folder);
+}
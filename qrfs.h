@@ -0,0 +1,55 @@
+#ifndef QRFS_H
+#define QRFS_H
+#include "fs_basic.h"
+#include "fsops.h"
+#include <stddef.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+// libqrfs: API embebible por rutas sobre un volumen montado en el proceso,
+// sin FUSE ni /dev/fuse. Pensada para pruebas de carga, benchmarks e
+// ingesta por lotes. Las llamadas son seguras entre hilos (van por fsops).
+// El estado del volumen es global: un solo volumen montado por proceso.
+//
+// Biblioteca estática, desde la raíz del repo: make lib (libqrfs.a, que trae
+// también mkfs() y fsck_qrfs() de mkfs.h). Enlazar con -lqrfs -lpthread -lm.
+// Errores: NULL o -1 con errno.
+
+typedef struct qrfs qrfs;
+typedef struct qrfs_file qrfs_file;
+
+typedef struct qrfs_dirent {
+    const char *name;
+    u32 inode_id;
+    mode_t mode;
+} qrfs_dirent;
+
+// Devolver != 0 corta el listado
+typedef int (*qrfs_dir_fn)(const qrfs_dirent *entry, void *ctx);
+
+qrfs *qrfs_mount(const char *folder, const fsops_options *opt);   // opt puede ser NULL
+int   qrfs_unmount(qrfs *fs);
+int   qrfs_sync(qrfs *fs);
+int   qrfs_statfs(qrfs *fs, struct statvfs *st);
+
+int   qrfs_stat(qrfs *fs, const char *path, struct stat *st);
+int   qrfs_mkdir(qrfs *fs, const char *path, mode_t mode);
+int   qrfs_rmdir(qrfs *fs, const char *path);
+int   qrfs_unlink(qrfs *fs, const char *path);
+int   qrfs_rename(qrfs *fs, const char *from, const char *to);
+int   qrfs_readdir(qrfs *fs, const char *path, qrfs_dir_fn fn, void *ctx);
+int   qrfs_truncate(qrfs *fs, const char *path, u64 size);
+
+// flags: O_RDONLY/O_WRONLY/O_RDWR con O_CREAT, O_EXCL, O_TRUNC, O_APPEND
+qrfs_file *qrfs_open(qrfs *fs, const char *path, int flags, mode_t mode);
+int   qrfs_close(qrfs_file *f);
+long  qrfs_read(qrfs_file *f, void *buf, size_t len);
+long  qrfs_write(qrfs_file *f, const void *buf, size_t len);
+long  qrfs_pread(qrfs_file *f, void *buf, size_t len, u64 offset);
+long  qrfs_pwrite(qrfs_file *f, const void *buf, size_t len, u64 offset);
+long long qrfs_seek(qrfs_file *f, long long offset, int whence);
+int   qrfs_fstat(qrfs_file *f, struct stat *st);
+int   qrfs_ftruncate(qrfs_file *f, u64 size);
+int   qrfs_fsync(qrfs_file *f);     // con diario, commit agrupado con los demás hilos
+
+#endif
@@ -0,0 +1,516 @@
+// Frontend FUSE de bajo nivel (por número de inodo) sobre fsops, con el loop
+// multihilo de libfuse. Las lecturas salen con fuse_reply_data apuntando a
+// los bloques (descriptor de la imagen para splice, o la vista mmap) y las
+// escrituras entran con write_buf, sin buffer intermedio propio.
+//
+// Compilar desde la raíz del repo (libfuse >= 3.12): make fuse
+// Con libfuse 3.x anterior a 3.12: make fuse CPPFLAGS=-DFUSE_USE_VERSION=35
+//
+// Uso: ./qrfs_fuse <carpeta> <punto de montaje> [--threads=N] [--mmap] [--cache=KiB] [--sync]
+//                  [--verify=always|metadata|off] [opciones FUSE]
+// --sync: las operaciones de nombres son persistentes al volver (commit agrupado).
+// --verify: qué lecturas se comprueban en volúmenes con sumas por bloque (mkfs --checksums).
+#ifndef FUSE_USE_VERSION
+#define FUSE_USE_VERSION 312
+#endif
+#define _GNU_SOURCE
+#include <fuse_lowlevel.h>
+#include "fsops.h"
+#include "block.h"
+#include "csum.h"
+#include "superblock.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+// Los inodos de QRFS empiezan en 0; FUSE reserva el 1 para la raíz
+#define TO_FUSE(ino)  ((fuse_ino_t)(ino) + 1)
+#define TO_QRFS(ino)  ((u32)((ino) - 1))
+
+#define DEFAULT_THREADS 8
+#define ATTR_TIMEOUT    1.0
+
+static const char *folder;
+static unsigned char *zero_page;     // fuente de los huecos en fuse_reply_data
+static u32 zero_len;
+static int mounted = 0;
+
+static int fill_entry(fuse_req_t req, u32 ino, struct fuse_entry_param *e) {
+    (void)req;
+    memset(e, 0, sizeof(*e));
+    if (fsops_getattr(folder, ino, &e->attr) != 0) return -1;
+    e->ino = TO_FUSE(ino);
+    e->attr.st_ino = e->ino;
+    e->generation = 1;
+    e->attr_timeout = ATTR_TIMEOUT;
+    e->entry_timeout = ATTR_TIMEOUT;
+    return 0;
+}
+
+static void reply_entry(fuse_req_t req, u32 ino) {
+    struct fuse_entry_param e;
+    if (fill_entry(req, ino, &e) != 0) fuse_reply_err(req, errno);
+    else fuse_reply_entry(req, &e);
+}
+
+static void qr_init(void *userdata, struct fuse_conn_info *conn) {
+    (void)userdata;
+    if (conn->capable & FUSE_CAP_SPLICE_WRITE) conn->want |= FUSE_CAP_SPLICE_WRITE;
+    if (conn->capable & FUSE_CAP_SPLICE_MOVE)  conn->want |= FUSE_CAP_SPLICE_MOVE;
+    if (conn->capable & FUSE_CAP_SPLICE_READ)  conn->want |= FUSE_CAP_SPLICE_READ;
+}
+
+static void qr_destroy(void *userdata) {
+    (void)userdata;
+    if (fsops_unmount(folder) != 0) fprintf(stderr, "Error al desmontar: %s\n", strerror(errno));
+    mounted = 0;
+}
+
+static void qr_lookup(fuse_req_t req, fuse_ino_t parent, const char *name) {
+    u32 ino;
+    if (fsops_lookup(folder, TO_QRFS(parent), name, &ino) == 0) {
+        reply_entry(req, ino);
+    } else if (errno == ENOENT) {
+        // Entrada negativa: el kernel la cachea por entry_timeout
+        struct fuse_entry_param e;
+        memset(&e, 0, sizeof(e));
+        e.entry_timeout = ATTR_TIMEOUT;
+        fuse_reply_entry(req, &e);
+    } else {
+        fuse_reply_err(req, errno);
+    }
+}
+
+static void qr_getattr(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+    (void)fi;
+    struct stat st;
+    if (fsops_getattr(folder, TO_QRFS(ino), &st) != 0) {
+        fuse_reply_err(req, errno);
+        return;
+    }
+    st.st_ino = ino;
+    fuse_reply_attr(req, &st, ATTR_TIMEOUT);
+}
+
+static void qr_setattr(fuse_req_t req, fuse_ino_t ino, struct stat *attr, int to_set,
+                       struct fuse_file_info *fi) {
+    (void)fi;
+    u32 id = TO_QRFS(ino);
+    int rc = 0;
+    if (to_set & FUSE_SET_ATTR_MODE) rc = fsops_chmod(folder, id, attr->st_mode);
+    if (rc == 0 && (to_set & (FUSE_SET_ATTR_UID | FUSE_SET_ATTR_GID))) {
+        rc = fsops_chown(folder, id,
+                         (to_set & FUSE_SET_ATTR_UID) ? (u32)attr->st_uid : (u32)-1,
+                         (to_set & FUSE_SET_ATTR_GID) ? (u32)attr->st_gid : (u32)-1);
+    }
+    if (rc == 0 && (to_set & FUSE_SET_ATTR_SIZE)) rc = fsops_truncate(folder, id, (u64)attr->st_size);
+    // Los tiempos no se guardan en el registro del inodo: se aceptan sin cambios
+    if (rc != 0) {
+        fuse_reply_err(req, errno);
+        return;
+    }
+    qr_getattr(req, ino, NULL);
+}
+
+typedef struct dir_buf {
+    fuse_req_t req;
+    char *buf;
+    size_t size, used;
+} dir_buf;
+
+static int add_dirent(const char *name, u32 inode_id, mode_t mode, u64 next, void *ctx) {
+    dir_buf *d = (dir_buf*)ctx;
+    struct stat st;
+    memset(&st, 0, sizeof(st));
+    st.st_ino = TO_FUSE(inode_id);
+    st.st_mode = mode;
+    size_t n = fuse_add_direntry(d->req, d->buf + d->used, d->size - d->used, name, &st, (off_t)next);
+    if (n > d->size - d->used) return 1;   // no entra: la próxima llamada empieza por esta
+    d->used += n;
+    return 0;
+}
+
+static void qr_readdir(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off, struct fuse_file_info *fi) {
+    (void)fi;
+    dir_buf d = {req, (char*)malloc(size), size, 0};
+    if (!d.buf) {
+        fuse_reply_err(req, ENOMEM);
+        return;
+    }
+    if (fsops_readdir(folder, TO_QRFS(ino), (u64)off, add_dirent, &d) != 0) fuse_reply_err(req, errno);
+    else fuse_reply_buf(req, d.buf, d.used);
+    free(d.buf);
+}
+
+static void qr_open(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+    struct stat st;
+    if (fsops_getattr(folder, TO_QRFS(ino), &st) != 0) {
+        fuse_reply_err(req, errno);
+        return;
+    }
+    if (S_ISDIR(st.st_mode)) {
+        fuse_reply_err(req, EISDIR);
+        return;
+    }
+    if ((fi->flags & O_TRUNC) && fsops_truncate(folder, TO_QRFS(ino), 0) != 0) {
+        fuse_reply_err(req, errno);
+        return;
+    }
+    if (fsops_open(folder, TO_QRFS(ino)) != 0) {
+        fuse_reply_err(req, errno);
+        return;
+    }
+    fi->fh = (uint64_t)(uintptr_t)calloc(1, sizeof(fsops_ra));   // sin memoria: sin lectura anticipada
+    fi->keep_cache = 1;
+    fuse_reply_open(req, fi);
+}
+
+static void qr_release(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+    free((void*)(uintptr_t)fi->fh);
+    fsops_release(folder, TO_QRFS(ino));
+    fuse_reply_err(req, 0);
+}
+
+// Lectura sin copia: un buffer de la bufvec por tramo físico
+static void qr_read(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off, struct fuse_file_info *fi) {
+    u32 id = TO_QRFS(ino), bs = fsops_block_size();
+    if (size > UINT32_MAX) size = UINT32_MAX;
+    (void)fsops_readahead(folder, id, (fsops_ra*)(uintptr_t)fi->fh, (u64)off, (u32)size);
+
+    if (!fsops_parallel_io()) {
+        void *buf = malloc(size ? size : 1);
+        long r = buf ? fsops_read(folder, id, (u64)off, buf, (u32)size) : (errno = ENOMEM, -1);
+        if (r < 0) fuse_reply_err(req, errno);
+        else fuse_reply_buf(req, (const char*)buf, (size_t)r);
+        free(buf);
+        return;
+    }
+
+    fsops_seg *segs;
+    u32 n, got;
+    if (fsops_map(folder, id, (u64)off, (u32)size, 0, &segs, &n, &got) != 0) {
+        fuse_reply_err(req, errno);
+        return;
+    }
+    // Los huecos más largos que zero_page se parten en varios buffers
+    size_t count = 0;
+    for (u32 i = 0; i < n; i++) count += (segs[i].physical || segs[i].data) ? 1 : (segs[i].len + zero_len - 1) / zero_len;
+    struct fuse_bufvec *bv = (struct fuse_bufvec*)calloc(1, sizeof(*bv) + count * sizeof(struct fuse_buf));
+    if (!bv) {
+        fsops_io_end();
+        free(segs);
+        fuse_reply_err(req, ENOMEM);
+        return;
+    }
+    bv->count = 0;
+    int rc = 0;
+    unsigned char *copy = NULL;       // tramos sin descriptor ni vista (sumas por bloque)
+    size_t copied = 0;
+    for (u32 i = 0; i < n && rc == 0; i++) {
+        if (segs[i].data) {           // datos en el inodo: la copia vive en segs
+            struct fuse_buf *b = &bv->buf[bv->count++];
+            b->size = segs[i].len;
+            b->mem = (void*)segs[i].data;
+            continue;
+        }
+        if (segs[i].physical == 0) {
+            for (u32 left = segs[i].len; left > 0; ) {
+                struct fuse_buf *b = &bv->buf[bv->count++];
+                b->size = left < zero_len ? left : zero_len;
+                b->mem = zero_page;
+                left -= (u32)b->size;
+            }
+            continue;
+        }
+        struct fuse_buf *b = &bv->buf[bv->count++];
+        b->size = segs[i].len;
+        off_t pos;
+        int fd = block_fd(folder, segs[i].physical, bs, &pos);
+        if (fd >= 0) {
+            b->flags = FUSE_BUF_IS_FD | FUSE_BUF_FD_SEEK;
+            b->fd = fd;
+            b->pos = pos + segs[i].in_block;
+        } else if ((b->mem = (void*)block_view(folder, segs[i].physical, bs)) != NULL) {
+            // mmap: la vista es contigua en todo el tramo
+            b->mem = (unsigned char*)b->mem + segs[i].in_block;
+        } else {
+            if (!copy && !(copy = (unsigned char*)malloc(size ? size : 1))) { rc = ENOMEM; break; }
+            b->mem = copy + copied;
+            copied += segs[i].len;
+            if (block_pread(folder, segs[i].physical, segs[i].in_block, b->mem, segs[i].len, bs) != 0) rc = errno;
+        }
+    }
+    if (rc == 0) fuse_reply_data(req, bv, FUSE_BUF_SPLICE_MOVE);
+    else fuse_reply_err(req, rc);
+    fsops_io_end();
+    free(copy);
+    free(bv);
+    free(segs);
+}
+
+// Escritura: fuse_buf_copy mueve de la request (memoria o pipe) al destino
+// final; con la imagen hace splice/pwrite directo sobre su descriptor.
+static void qr_write_buf(fuse_req_t req, fuse_ino_t ino, struct fuse_bufvec *in_buf, off_t off,
+                         struct fuse_file_info *fi) {
+    (void)fi;
+    u32 id = TO_QRFS(ino), bs = fsops_block_size();
+    size_t size = fuse_buf_size(in_buf);
+    if (size > UINT32_MAX) size = UINT32_MAX;
+
+    // Lo que puede quedar dentro del inodo va por fsops_write, bajo el lock
+    // global; con deduplicación, todo
+    if (!fsops_direct_writes() || (u64)off + size <= QRFS_INLINE_DATA) {
+        struct fuse_bufvec dst = FUSE_BUFVEC_INIT(size);
+        dst.buf[0].mem = malloc(size ? size : 1);
+        if (!dst.buf[0].mem) {
+            fuse_reply_err(req, ENOMEM);
+            return;
+        }
+        ssize_t got = fuse_buf_copy(&dst, in_buf, 0);
+        long w = got < 0 ? (errno = (int)-got, -1) : fsops_write(folder, id, (u64)off, dst.buf[0].mem, (u32)got);
+        if (w < 0) fuse_reply_err(req, errno);
+        else fuse_reply_write(req, (size_t)w);
+        free(dst.buf[0].mem);
+        return;
+    }
+
+    fsops_seg *segs;
+    u32 n, got;
+    if (fsops_map(folder, id, (u64)off, (u32)size, 1, &segs, &n, &got) != 0) {
+        fuse_reply_err(req, errno);
+        return;
+    }
+    size_t done = 0;
+    int err = 0;
+    unsigned char *tmp = NULL;
+    for (u32 i = 0; i < n && !err; i++) {
+        off_t pos;
+        int fd = block_fd(folder, segs[i].physical, bs, &pos);
+        struct fuse_bufvec dst = FUSE_BUFVEC_INIT(segs[i].len);
+        if (fd >= 0) {
+            dst.buf[0].flags = FUSE_BUF_IS_FD | FUSE_BUF_FD_SEEK;
+            dst.buf[0].fd = fd;
+            dst.buf[0].pos = pos + segs[i].in_block;
+            ssize_t w = fuse_buf_copy(&dst, in_buf, 0);
+            if (w != (ssize_t)segs[i].len) err = w < 0 ? (int)-w : EIO;
+        } else if (in_buf->count == 1 && !(in_buf->buf[0].flags & FUSE_BUF_IS_FD)) {
+            // mmap con la request ya en memoria: una sola copia hacia el mapeo
+            const unsigned char *src = (const unsigned char*)in_buf->buf[0].mem + in_buf->off;
+            if (block_pwrite(folder, segs[i].physical, segs[i].in_block, src, segs[i].len, bs) != 0) err = errno;
+            in_buf->off += segs[i].len;
+        } else {
+            if (!tmp && !(tmp = (unsigned char*)malloc(size))) { err = ENOMEM; break; }
+            dst.buf[0].mem = tmp;
+            ssize_t w = fuse_buf_copy(&dst, in_buf, 0);
+            if (w != (ssize_t)segs[i].len) err = w < 0 ? (int)-w : EIO;
+            else if (block_pwrite(folder, segs[i].physical, segs[i].in_block, tmp, segs[i].len, bs) != 0) err = errno;
+        }
+        if (!err) done += segs[i].len;
+    }
+    fsops_write_end(folder, id, (u64)off, segs, n, (u32)done);
+    free(tmp);
+    free(segs);
+    if (err && done == 0) fuse_reply_err(req, err);
+    else fuse_reply_write(req, done);
+}
+
+static void qr_create(fuse_req_t req, fuse_ino_t parent, const char *name, mode_t mode,
+                      struct fuse_file_info *fi) {
+    const struct fuse_ctx *ctx = fuse_req_ctx(req);
+    u32 ino;
+    struct fuse_entry_param e;
+    if (fsops_create(folder, TO_QRFS(parent), name, mode & ~ctx->umask, ctx->uid, ctx->gid, &ino) != 0 ||
+        fsops_open(folder, ino) != 0 || fill_entry(req, ino, &e) != 0) {
+        fuse_reply_err(req, errno);
+        return;
+    }
+    fi->fh = (uint64_t)(uintptr_t)calloc(1, sizeof(fsops_ra));
+    fi->keep_cache = 1;
+    fuse_reply_create(req, &e, fi);
+}
+
+static void qr_mknod(fuse_req_t req, fuse_ino_t parent, const char *name, mode_t mode, dev_t rdev) {
+    (void)rdev;
+    const struct fuse_ctx *ctx = fuse_req_ctx(req);
+    u32 ino;
+    if (!S_ISREG(mode)) {
+        fuse_reply_err(req, EPERM);
+        return;
+    }
+    if (fsops_create(folder, TO_QRFS(parent), name, mode & ~ctx->umask, ctx->uid, ctx->gid, &ino) != 0) {
+        fuse_reply_err(req, errno);
+        return;
+    }
+    reply_entry(req, ino);
+}
+
+static void qr_mkdir(fuse_req_t req, fuse_ino_t parent, const char *name, mode_t mode) {
+    const struct fuse_ctx *ctx = fuse_req_ctx(req);
+    u32 ino;
+    if (fsops_mkdir(folder, TO_QRFS(parent), name, mode & ~ctx->umask, ctx->uid, ctx->gid, &ino) != 0) {
+        fuse_reply_err(req, errno);
+        return;
+    }
+    reply_entry(req, ino);
+}
+
+static void qr_unlink(fuse_req_t req, fuse_ino_t parent, const char *name) {
+    fuse_reply_err(req, fsops_unlink(folder, TO_QRFS(parent), name) == 0 ? 0 : errno);
+}
+
+static void qr_rmdir(fuse_req_t req, fuse_ino_t parent, const char *name) {
+    fuse_reply_err(req, fsops_rmdir(folder, TO_QRFS(parent), name) == 0 ? 0 : errno);
+}
+
+static void qr_rename(fuse_req_t req, fuse_ino_t parent, const char *name, fuse_ino_t newparent,
+                      const char *newname, unsigned int flags) {
+    if (flags) {        // RENAME_NOREPLACE / RENAME_EXCHANGE
+        fuse_reply_err(req, EINVAL);
+        return;
+    }
+    int rc = fsops_rename(folder, TO_QRFS(parent), name, TO_QRFS(newparent), newname);
+    fuse_reply_err(req, rc == 0 ? 0 : errno);
+}
+
+static void qr_statfs(fuse_req_t req, fuse_ino_t ino) {
+    (void)ino;
+    struct statvfs st;
+    fsops_statfs(folder, &st);
+    fuse_reply_statfs(req, &st);
+}
+
+static void qr_flush(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+    (void)ino; (void)fi;
+    fuse_reply_err(req, 0);
+}
+
+static void qr_fsync(fuse_req_t req, fuse_ino_t ino, int datasync, struct fuse_file_info *fi) {
+    (void)ino; (void)datasync; (void)fi;
+    fuse_reply_err(req, fsops_sync(folder) == 0 ? 0 : errno);
+}
+
+static const struct fuse_lowlevel_ops qr_ops = {
+    .init       = qr_init,
+    .destroy    = qr_destroy,
+    .lookup     = qr_lookup,
+    .getattr    = qr_getattr,
+    .setattr    = qr_setattr,
+    .readdir    = qr_readdir,
+    .open       = qr_open,
+    .release    = qr_release,
+    .read       = qr_read,
+    .write_buf  = qr_write_buf,
+    .create     = qr_create,
+    .mknod      = qr_mknod,
+    .mkdir      = qr_mkdir,
+    .unlink     = qr_unlink,
+    .rmdir      = qr_rmdir,
+    .rename     = qr_rename,
+    .statfs     = qr_statfs,
+    .flush      = qr_flush,
+    .fsync      = qr_fsync,
+    .fsyncdir   = qr_fsync,
+};
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        fprintf(stderr, "Uso: %s <carpeta> <punto de montaje> [--threads=N] [--mmap] [--cache=KiB] [--sync] "
+                        "[--verify=always|metadata|off] [opciones FUSE]\n", argv[0]);
+        return 1;
+    }
+    folder = argv[1];
+
+    // Opciones propias; el resto (punto de montaje, -f, -d, -o ...) va a libfuse
+    fsops_options opt = {0, 0, 0, 0, 0, 0};
+    unsigned threads = DEFAULT_THREADS;
+    char **fargv = (char**)calloc((size_t)argc, sizeof(char*));
+    int fargc = 0;
+    if (!fargv) return 1;
+    fargv[fargc++] = argv[0];
+    for (int i = 2; i < argc; i++) {
+        if (strncmp(argv[i], "--threads=", 10) == 0) threads = (unsigned)strtoul(argv[i] + 10, NULL, 10);
+        else if (strcmp(argv[i], "--mmap") == 0) opt.use_mmap = 1;
+        else if (strcmp(argv[i], "--sync") == 0) opt.sync_ops = 1;
+        else if (strncmp(argv[i], "--cache=", 8) == 0) opt.bcache_budget = (size_t)strtoul(argv[i] + 8, NULL, 10) * 1024;
+        else if (strncmp(argv[i], "--verify=", 9) == 0) {
+            if ((opt.verify = csum_parse_policy(argv[i] + 9)) < 0) {
+                fprintf(stderr, "Política de verificación desconocida: %s (usar always, metadata u off)\n", argv[i] + 9);
+                free(fargv);
+                return 1;
+            }
+        }
+        else fargv[fargc++] = argv[i];
+    }
+    if (threads == 0) threads = 1;
+
+    // El volumen se monta después de fuse_daemonize: el fork solo se lleva el
+    // hilo que llama, y fsops_mount arranca hilos (checkpoint del diario, pool
+    // de E/S). Antes solo se valida el superbloque, para fallar con el error
+    // todavía a la vista.
+    u32 bs;
+    if (superblock_probe(folder, &bs) != 0) {
+        fprintf(stderr, "No se pudo montar %s: %s\n", folder, strerror(errno));
+        free(fargv);
+        return 1;
+    }
+    zero_len = bs * 16;
+    zero_page = (unsigned char*)calloc(1, zero_len);
+
+    struct fuse_args args = FUSE_ARGS_INIT(fargc, fargv);
+    struct fuse_cmdline_opts opts;
+    struct fuse_session *se = NULL;
+    int ret = 1;
+    memset(&opts, 0, sizeof(opts));
+    if (!zero_page || fuse_parse_cmdline(&args, &opts) != 0) goto out;
+    if (!opts.mountpoint) {
+        fprintf(stderr, "Falta el punto de montaje\n");
+        goto out;
+    }
+
+    se = fuse_session_new(&args, &qr_ops, sizeof(qr_ops), NULL);
+    if (!se) goto out;
+    if (fuse_set_signal_handlers(se) != 0) goto out;
+    if (fuse_session_mount(se, opts.mountpoint) != 0) goto out_signals;
+
+    printf("QRFS %s montado en %s (%u hilos, E/S de datos %s)\n", folder, opts.mountpoint, threads,
+           block_detect_backend(folder) != QRFS_BACKEND_FILES ? "en paralelo" : "serializada");
+    fflush(stdout);
+    fuse_daemonize(opts.foreground);
+
+    if (fsops_mount(folder, &opt) != 0) {
+        fprintf(stderr, "No se pudo montar %s: %s\n", folder, strerror(errno));
+        goto out_unmount;
+    }
+    mounted = 1;
+
+    if (opts.singlethread) {
+        ret = fuse_session_loop(se);
+    } else {
+#if FUSE_USE_VERSION >= 312
+        struct fuse_loop_config *cfg = fuse_loop_cfg_create();
+        fuse_loop_cfg_set_clone_fd(cfg, opts.clone_fd);
+        fuse_loop_cfg_set_max_threads(cfg, threads);
+        fuse_loop_cfg_set_idle_threads(cfg, threads);
+        ret = fuse_session_loop_mt(se, cfg);
+        fuse_loop_cfg_destroy(cfg);
+#else
+        struct fuse_loop_config cfg = { .clone_fd = opts.clone_fd, .max_idle_threads = threads };
+        ret = fuse_session_loop_mt(se, &cfg);
+#endif
+    }
+out_unmount:
+    fuse_session_unmount(se);
+out_signals:
+    fuse_remove_signal_handlers(se);
+out:
+    if (se) fuse_session_destroy(se);   // llama a destroy -> fsops_unmount si hubo init
+    if (mounted) fsops_unmount(folder);
+    free(opts.mountpoint);
+    free(zero_page);
+    fuse_opt_free_args(&args);
+    free(fargv);
+    return ret ? 1 : 0;
+}
@@ -1,11 +1,75 @@
 #include "superblock.h"
 #include "block.h"
+#include "bcache.h"
+#include "bitmaps.h"
 #include "fs_utils.h"
+#include "journal.h"
+#include "csum.h"
+#include "dedup.h"
 #include <string.h>
 #include <stdlib.h>
 #include <errno.h>
 #include <stdio.h>
 
+// Campos del bloque 0 comunes a v1 y v2. En v1 los bytes 20..275 llevan
+// además una copia de los bitmaps; en v2 quedan en cero.
+static void sb_encode(unsigned char *buf, const superblock *sb) {
+    buf[0]='Q'; buf[1]='R'; buf[2]='F'; buf[3]='S';
+    u32le_write(sb->version,      &buf[4]);
+    u32le_write(sb->blocksize,    &buf[8]);
+    u32le_write(sb->total_blocks, &buf[12]);
+    u32le_write(sb->total_inodes, &buf[16]);
+
+    u32le_write(sb->root_inode, &buf[276]);
+    u32le_write(sb->inode_bitmap_start,  &buf[280]);
+    u32le_write(sb->inode_bitmap_blocks, &buf[284]);
+    u32le_write(sb->data_bitmap_start,   &buf[288]);
+    u32le_write(sb->data_bitmap_blocks,  &buf[292]);
+    u32le_write(sb->inode_table_start,   &buf[296]);
+    u32le_write(sb->inode_table_blocks,  &buf[300]);
+    u32le_write(sb->data_region_start,   &buf[304]);
+    u32le_write(sb->backend,             &buf[308]);
+    u32le_write(sb->features,            &buf[312]);
+    u32le_write(sb->free_blocks,         &buf[316]);
+    u32le_write(sb->free_inodes,         &buf[320]);
+    u32le_write(sb->block_rotor,         &buf[324]);
+    u32le_write(sb->inode_rotor,         &buf[328]);
+    u32le_write(sb->journal_start,       &buf[332]);
+    u32le_write(sb->journal_blocks,      &buf[336]);
+    u32le_write(sb->csum_start,          &buf[340]);
+    u32le_write(sb->csum_blocks,         &buf[344]);
+    u32le_write(sb->dedup_start,         &buf[348]);
+    u32le_write(sb->dedup_blocks,        &buf[352]);
+}
+
+static void sb_decode(const unsigned char *buf, superblock *sb) {
+    sb->version      = u32le_read(&buf[4]);
+    sb->blocksize    = u32le_read(&buf[8]);
+    sb->total_blocks = u32le_read(&buf[12]);
+    sb->total_inodes = u32le_read(&buf[16]);
+
+    sb->root_inode          = u32le_read(&buf[276]);
+    sb->inode_bitmap_start  = u32le_read(&buf[280]);
+    sb->inode_bitmap_blocks = u32le_read(&buf[284]);
+    sb->data_bitmap_start   = u32le_read(&buf[288]);
+    sb->data_bitmap_blocks  = u32le_read(&buf[292]);
+    sb->inode_table_start   = u32le_read(&buf[296]);
+    sb->inode_table_blocks  = u32le_read(&buf[300]);
+    sb->data_region_start   = u32le_read(&buf[304]);
+    sb->backend             = u32le_read(&buf[308]);
+    sb->features            = u32le_read(&buf[312]);
+    sb->free_blocks         = u32le_read(&buf[316]);
+    sb->free_inodes         = u32le_read(&buf[320]);
+    sb->block_rotor         = u32le_read(&buf[324]);
+    sb->inode_rotor         = u32le_read(&buf[328]);
+    sb->journal_start       = u32le_read(&buf[332]);
+    sb->journal_blocks      = u32le_read(&buf[336]);
+    sb->csum_start          = u32le_read(&buf[340]);
+    sb->csum_blocks         = u32le_read(&buf[344]);
+    sb->dedup_start         = u32le_read(&buf[348]);
+    sb->dedup_blocks        = u32le_read(&buf[352]);
+}
+
 int write_superblock_with_offsets(
     const char *folder,
     u32 block_size,
@@ -17,30 +81,34 @@ int write_superblock_with_offsets(
     u32 inode_bitmap_start, u32 inode_bitmap_blocks,
     u32 data_bitmap_start,  u32 data_bitmap_blocks,
     u32 inode_table_start,  u32 inode_table_blocks,
-    u32 data_region_start
+    u32 data_region_start,
+    u32 backend,
+    u32 features
 ) {
     unsigned char *buf = (unsigned char*)calloc(1, block_size);
     if (!buf) { errno = ENOMEM; return -1; }
 
-    buf[0]='Q'; buf[1]='R'; buf[2]='F'; buf[3]='S';
-    u32le_write(1,              &buf[4]);   // version
-    u32le_write(block_size,     &buf[8]);
-    u32le_write(total_blocks,   &buf[12]);
-    u32le_write(total_inodes,   &buf[16]);
+    superblock sb = {0};
+    sb.version = 1;
+    sb.blocksize = block_size;
+    sb.total_blocks = total_blocks;
+    sb.total_inodes = total_inodes;
+    sb.root_inode = root_inode;
+    sb.inode_bitmap_start = inode_bitmap_start;
+    sb.inode_bitmap_blocks = inode_bitmap_blocks;
+    sb.data_bitmap_start = data_bitmap_start;
+    sb.data_bitmap_blocks = data_bitmap_blocks;
+    sb.inode_table_start = inode_table_start;
+    sb.inode_table_blocks = inode_table_blocks;
+    sb.data_region_start = data_region_start;
+    sb.backend = backend;
+    sb.features = features;
+    sb_encode(buf, &sb);
 
     memcpy(&buf[20],  inode_bitmap_128, 128);
     memcpy(&buf[148], data_bitmap_128,  128);
 
-    u32le_write(root_inode, &buf[276]);
-    u32le_write(inode_bitmap_start,  &buf[280]);
-    u32le_write(inode_bitmap_blocks, &buf[284]);
-    u32le_write(data_bitmap_start,   &buf[288]);
-    u32le_write(data_bitmap_blocks,  &buf[292]);
-    u32le_write(inode_table_start,   &buf[296]);
-    u32le_write(inode_table_blocks,  &buf[300]);
-    u32le_write(data_region_start,   &buf[304]);
-
-    int rc = write_block(folder, 0, buf, block_size);
+    int rc = bcache_write(folder, 0, buf, block_size);
     free(buf);
     return rc;
 }
@@ -54,36 +122,19 @@ int read_superblock(const char *folder, u32 block_size,
                     u32 *inode_bitmap_start, u32 *inode_bitmap_blocks,
                     u32 *data_bitmap_start,  u32 *data_bitmap_blocks,
                     u32 *inode_table_start,  u32 *inode_table_blocks,
-                    u32 *data_region_start)
+                    u32 *data_region_start,
+                    u32 *backend,
+                    u32 *features)
 {
-    // Construir ruta del bloque 0
-    char path[512];
-    snprintf(path, sizeof(path), "%s/block_%04u.png", folder, 0);
-
-    FILE *fp = fopen(path, "rb");
-    if (!fp) {
-        fprintf(stderr, "Error abriendo superbloque: %s\n", strerror(errno));
-        return -1;
-    }
-
-    unsigned char *buf = (unsigned char*)malloc(block_size);
+    const unsigned char *buf = bcache_get(folder, 0, block_size);
     if (!buf) {
-        fclose(fp);
-        errno = ENOMEM;
-        return -1;
-    }
-
-    size_t r = fread(buf, 1, block_size, fp);
-    fclose(fp);
-    if (r != block_size) {
-        free(buf);
-        fprintf(stderr, "Error leyendo superbloque (bytes leídos=%zu)\n", r);
+        fprintf(stderr, "Error leyendo superbloque\n");
         return -1;
     }
 
     // Validar magic
     if (buf[0] != 'Q' || buf[1] != 'R' || buf[2] != 'F' || buf[3] != 'S') {
-        free(buf);
+        bcache_put(buf);
         fprintf(stderr, "Magic inválido: no es QRFS\n");
         return -1;
     }
@@ -108,7 +159,258 @@ int read_superblock(const char *folder, u32 block_size,
     *inode_table_start   = u32le_read(&buf[296]);
     *inode_table_blocks  = u32le_read(&buf[300]);
     *data_region_start   = u32le_read(&buf[304]);
+    *backend             = u32le_read(&buf[308]);   // 0 en superbloques viejos = archivos
+    *features            = u32le_read(&buf[312]);
 
-    free(buf);
+    bcache_put(buf);
+    return 0;
+}
+
+// Carga los bitmaps crudos del superbloque en spblock. Sin QRFS_FEAT_PACKED_BITMAPS
+// el volumen es del formato viejo (un byte '0'/'1' por entrada) y se convierte.
+int superblock_load_bitmaps(const unsigned char inode_raw[128], const unsigned char data_raw[128],
+                            u32 features, u32 total_inodes, u32 total_blocks) {
+    spblock.total_inodes = total_inodes;
+    spblock.total_blocks = total_blocks;
+    spblock.features = features;
+    if (bitmaps_init(total_inodes, total_blocks) != 0) return -1;
+
+    if (features & QRFS_FEAT_PACKED_BITMAPS) {
+        bitmap_unpack_le(inode_raw, total_inodes, spblock.inode_bitmap);
+        bitmap_unpack_le(data_raw,  total_blocks, spblock.data_bitmap);
+        return 0;
+    }
+    if (total_inodes > 128 || total_blocks > 128 ||
+        !bitmap_is_ascii(inode_raw, total_inodes) || !bitmap_is_ascii(data_raw, total_blocks)) {
+        fprintf(stderr, "Bitmaps del superbloque con formato desconocido\n");
+        errno = EINVAL;
+        return -1;
+    }
+    bitmap_from_ascii(inode_raw, total_inodes, spblock.inode_bitmap);
+    bitmap_from_ascii(data_raw,  total_blocks, spblock.data_bitmap);
+    return 0;
+}
+
+// Reescribe un volumen con bitmaps ASCII al formato empaquetado: superbloque
+// y bloques de bitmap. No hace nada si ya está empaquetado.
+int superblock_migrate_bitmaps(const char *folder, u32 block_size) {
+    u32 version, total_blocks, total_inodes, root_inode, backend, features;
+    u32 ib_start, ib_blocks, db_start, db_blocks, it_start, it_blocks, data_start;
+    unsigned char inode_raw[128], data_raw[128];
+
+    if (read_superblock(folder, block_size, &version, &total_blocks, &total_inodes,
+                        inode_raw, data_raw, &root_inode,
+                        &ib_start, &ib_blocks, &db_start, &db_blocks,
+                        &it_start, &it_blocks, &data_start, &backend, &features) != 0) return -1;
+    if (features & QRFS_FEAT_PACKED_BITMAPS) return 0;
+    if (superblock_load_bitmaps(inode_raw, data_raw, features, total_inodes, total_blocks) != 0) return -1;
+
+    features |= QRFS_FEAT_PACKED_BITMAPS;
+    memset(inode_raw, 0, sizeof(inode_raw));
+    memset(data_raw,  0, sizeof(data_raw));
+    bitmap_pack_le(spblock.inode_bitmap, total_inodes, inode_raw);
+    bitmap_pack_le(spblock.data_bitmap,  total_blocks, data_raw);
+
+    unsigned char *blk = (unsigned char*)calloc(1, block_size);
+    if (!blk) { errno = ENOMEM; return -1; }
+    memcpy(blk, inode_raw, sizeof(inode_raw));
+    int rc = bcache_write(folder, ib_start, blk, block_size);
+    memset(blk, 0, block_size);
+    memcpy(blk, data_raw, sizeof(data_raw));
+    if (rc == 0) rc = bcache_write(folder, db_start, blk, block_size);
+    free(blk);
+
+    if (rc == 0) rc = write_superblock_with_offsets(folder, block_size, total_blocks, total_inodes,
+                                                    inode_raw, data_raw, root_inode,
+                                                    ib_start, ib_blocks, db_start, db_blocks,
+                                                    it_start, it_blocks, data_start, backend, features);
+    if (rc == 0) rc = bcache_flush(folder);
+    return rc;
+}
+
+// Última versión guardada de cada región de bitmap (inodos, bloques), para
+// que superblock_store solo reescriba los bloques que cambiaron
+static unsigned char *stored_raw[2] = {NULL, NULL};
+static size_t stored_len[2] = {0, 0};
+
+static void keep_stored(int which, unsigned char *raw, size_t len) {
+    free(stored_raw[which]);
+    stored_raw[which] = raw;
+    stored_len[which] = len;
+}
+
+void superblock_forget_bitmaps(void) {
+    keep_stored(0, NULL, 0);
+    keep_stored(1, NULL, 0);
+}
+
+// Lee una región de bitmap (v2) de `blocks` bloques a partir de `start`
+static int load_bitmap_region(const char *folder, u32 block_size, u32 start, u32 blocks,
+                              u32 nbits, u64 *bm, int which) {
+    u32 nbytes = BITMAP_BYTES(nbits);
+    if ((u64)blocks * block_size < nbytes) {
+        fprintf(stderr, "Región de bitmap demasiado chica (%u bloques para %u entradas)\n", blocks, nbits);
+        errno = EINVAL;
+        return -1;
+    }
+    unsigned char *raw = (unsigned char*)malloc((size_t)blocks * block_size);
+    if (!raw) { errno = ENOMEM; return -1; }
+    for (u32 k = 0; k < blocks; k++) {
+        if (bcache_read(folder, start + k, raw + (size_t)k * block_size, block_size) != 0) {
+            free(raw);
+            return -1;
+        }
+    }
+    bitmap_unpack_le(raw, nbits, bm);
+    keep_stored(which, raw, (size_t)blocks * block_size);
+    return 0;
+}
+
+static int store_bitmap_region(const char *folder, u32 block_size, u32 start, u32 blocks,
+                               u32 nbits, const u64 *bm, int which) {
+    size_t len = (size_t)blocks * block_size;
+    unsigned char *raw = (unsigned char*)calloc(blocks, block_size);
+    if (!raw) { errno = ENOMEM; return -1; }
+    bitmap_pack_le(bm, nbits, raw);
+    const unsigned char *old = stored_len[which] == len ? stored_raw[which] : NULL;
+    int rc = 0;
+    for (u32 k = 0; k < blocks && rc == 0; k++) {
+        size_t off = (size_t)k * block_size;
+        if (old && memcmp(old + off, raw + off, block_size) == 0) continue;
+        rc = bcache_write(folder, start + k, raw + off, block_size);
+    }
+    if (rc == 0) keep_stored(which, raw, len);
+    else free(raw);
+    return rc;
+}
+
+// Tamaño de bloque con el que se formateó el volumen. Lee solo el encabezado
+// del bloque 0 y cierra el backend para que se reabra con el tamaño correcto.
+int superblock_probe(const char *folder, u32 *block_size) {
+    unsigned char buf[512];
+    if (read_block(folder, 0, buf, sizeof(buf)) != 0) return -1;
+    block_close();
+    if (buf[0] != 'Q' || buf[1] != 'R' || buf[2] != 'F' || buf[3] != 'S') {
+        fprintf(stderr, "Magic inválido: no es QRFS\n");
+        errno = EINVAL;
+        return -1;
+    }
+    u32 bs = u32le_read(&buf[8]);
+    if (bs < sizeof(buf) || (bs & (bs - 1)) != 0) {
+        fprintf(stderr, "Tamaño de bloque inválido en el superbloque: %u\n", bs);
+        errno = EINVAL;
+        return -1;
+    }
+    *block_size = bs;
+    return 0;
+}
+
+// Carga el superbloque (v1 o v2) y los bitmaps en spblock
+int superblock_load(const char *folder, u32 block_size) {
+    unsigned char inode_raw[128], data_raw[128];
+    superblock *sb = &spblock;
+
+    const unsigned char *buf = bcache_get(folder, 0, block_size);
+    if (!buf) {
+        fprintf(stderr, "Error leyendo superbloque\n");
+        return -1;
+    }
+    if (buf[0] != 'Q' || buf[1] != 'R' || buf[2] != 'F' || buf[3] != 'S') {
+        bcache_put(buf);
+        fprintf(stderr, "Magic inválido: no es QRFS\n");
+        errno = EINVAL;
+        return -1;
+    }
+    sb_decode(buf, sb);
+    block_set_sparse((sb->features & QRFS_FEAT_SPARSE) != 0);
+
+    // La tabla de sumas va primero: lo que escriba el diario la actualiza
+    if (!(sb->features & QRFS_FEAT_CHECKSUMS)) {
+        csum_close();
+    } else if (csum_load(folder, sb) != 0) {
+        bcache_put(buf);
+        return -1;
+    }
+
+    // Después se reaplica el diario; si trajo bloques, el bloque 0
+    // pudo ser uno de ellos
+    if ((sb->features & QRFS_FEAT_JOURNAL) && !journal_active()) {
+        bcache_put(buf);
+        u32 replayed;
+        if (sb->journal_blocks < 4 || (u64)sb->journal_start + sb->journal_blocks > sb->total_blocks ||
+            journal_replay(folder, sb->journal_start, sb->journal_blocks, block_size, &replayed) != 0) {
+            fprintf(stderr, "Error reaplicando el diario\n");
+            return -1;
+        }
+        if (replayed) bcache_invalidate();
+        buf = bcache_get(folder, 0, block_size);
+        if (!buf) {
+            fprintf(stderr, "Error leyendo superbloque\n");
+            return -1;
+        }
+        sb_decode(buf, sb);
+    }
+    superblock_forget_bitmaps();
+    memcpy(inode_raw, &buf[20], 128);
+    memcpy(data_raw,  &buf[148], 128);
+    bcache_put(buf);
+
+    if (sb->blocksize != block_size) {
+        fprintf(stderr, "Advertencia: block_size esperado=%u, en SB=%u\n", block_size, sb->blocksize);
+        sb->blocksize = block_size;
+    }
+
+    if (sb->version == 1) {
+        if (superblock_load_bitmaps(inode_raw, data_raw, sb->features,
+                                    sb->total_inodes, sb->total_blocks) != 0) return -1;
+    } else if (sb->version == QRFS_VERSION) {
+        if (bitmaps_init(sb->total_inodes, sb->total_blocks) != 0) return -1;
+        if (load_bitmap_region(folder, block_size, sb->inode_bitmap_start, sb->inode_bitmap_blocks,
+                               sb->total_inodes, sb->inode_bitmap, 0) != 0 ||
+            load_bitmap_region(folder, block_size, sb->data_bitmap_start, sb->data_bitmap_blocks,
+                               sb->total_blocks, sb->data_bitmap, 1) != 0) {
+            fprintf(stderr, "Error leyendo bitmaps\n");
+            return -1;
+        }
+    } else {
+        fprintf(stderr, "Versión de superbloque no soportada: %u\n", sb->version);
+        errno = EINVAL;
+        return -1;
+    }
+
+    // Volúmenes sin contadores: se calculan una vez desde los bitmaps
+    if (!(sb->features & QRFS_FEAT_FREE_COUNTS)) {
+        bitmaps_recount();
+        sb->block_rotor = sb->data_region_start;
+        sb->inode_rotor = 0;
+    }
+
+    // Referencias de bloques compartidos, ya con lo que trajo el diario
+    if (!(sb->features & QRFS_FEAT_DEDUP)) dedup_close();
+    else if (dedup_load(folder, sb) != 0) return -1;
     return 0;
 }
+
+// Escribe spblock como superbloque v2 más sus regiones de bitmap (y los
+// bloques cambiados de la tabla de deduplicación)
+int superblock_store(const char *folder) {
+    superblock *sb = &spblock;
+    u32 bs = sb->blocksize;
+
+    if (store_bitmap_region(folder, bs, sb->inode_bitmap_start, sb->inode_bitmap_blocks,
+                            sb->total_inodes, sb->inode_bitmap, 0) != 0 ||
+        store_bitmap_region(folder, bs, sb->data_bitmap_start, sb->data_bitmap_blocks,
+                            sb->total_blocks, sb->data_bitmap, 1) != 0 ||
+        dedup_store(folder) != 0) {
+        return -1;
+    }
+
+    unsigned char *buf = (unsigned char*)calloc(1, bs);
+    if (!buf) { errno = ENOMEM; return -1; }
+    sb->version = QRFS_VERSION;
+    sb->features |= QRFS_FEAT_PACKED_BITMAPS | QRFS_FEAT_FREE_COUNTS;
+    sb_encode(buf, sb);
+    int rc = bcache_write(folder, 0, buf, bs);
+    free(buf);
+    return rc;
+}
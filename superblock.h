@@ -13,10 +13,21 @@ int write_superblock_with_offsets(
     u32 inode_bitmap_start, u32 inode_bitmap_blocks,
     u32 data_bitmap_start,  u32 data_bitmap_blocks,
     u32 inode_table_start,  u32 inode_table_blocks,
-    u32 data_region_start
+    u32 data_region_start,
+    u32 backend,
+    u32 features
 );
 int read_superblock(const char *folder, u32 block_size,u32 *version, u32 *total_blocks, u32 *total_inodes,
                     unsigned char inode_bitmap[128],unsigned char data_bitmap[128],u32 *root_inode,
                     u32 *inode_bitmap_start, u32 *inode_bitmap_blocks,u32 *data_bitmap_start,  u32 *data_bitmap_blocks,
-                    u32 *inode_table_start,  u32 *inode_table_blocks,u32 *data_region_start);
+                    u32 *inode_table_start,  u32 *inode_table_blocks,u32 *data_region_start, u32 *backend, u32 *features);
+int superblock_load_bitmaps(const unsigned char inode_raw[128], const unsigned char data_raw[128],
+                            u32 features, u32 total_inodes, u32 total_blocks);
+int superblock_migrate_bitmaps(const char *folder, u32 block_size);
+int superblock_probe(const char *folder, u32 *block_size);
+int superblock_load(const char *folder, u32 block_size);
+int superblock_store(const char *folder);
+// Olvida las regiones de bitmap guardadas: la próxima superblock_store las
+// escribe enteras (volumen recién formateado)
+void superblock_forget_bitmaps(void);
 #endif
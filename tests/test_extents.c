@@ -0,0 +1,169 @@
+// Mapas de extents muy fragmentados (cientos de extents, varios bloques de
+// cadena): dos archivos escritos a la vez en orden aleatorio, así cada
+// asignación cae entre extents ya existentes y los bloques de la cadena se
+// parten y se vacían. Se verifica el contenido después de escribir, de
+// achicar y de volver a crecer; con --dedup las sobrescrituras pasan por
+// extent_remap. Cada etapa termina con el chequeo limpio.
+//
+// Compilar desde la raíz del repo: make check
+// Uso: ./test_extents [carpeta] [bloques por archivo]
+#include "../fsops.h"
+#include "../mkfs.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#define FAIL(...) do { fprintf(stderr, "FALLA: " __VA_ARGS__); fprintf(stderr, "\n"); return 1; } while (0)
+
+static const char *folder;
+static u32 bs;
+static unsigned char *blk;
+
+// Contenido del bloque `logical` del archivo `tag` en la versión `gen`
+static void pattern(u32 tag, u32 logical, u32 gen) {
+    for (u32 i = 0; i < bs; i += 4) {
+        u32 v = (tag << 24) ^ (logical << 4) ^ gen ^ i;
+        memcpy(&blk[i], &v, 4);
+    }
+}
+
+static void shuffle(u32 *v, u32 n) {
+    for (u32 i = n; i > 1; i--) {
+        u32 j = (u32)rand() % i, t = v[i - 1];
+        v[i - 1] = v[j];
+        v[j] = t;
+    }
+}
+
+static int write_block(u32 id, u32 tag, u32 logical, u32 gen) {
+    pattern(tag, logical, gen);
+    if (fsops_write(folder, id, (u64)logical * bs, blk, bs) != (long)bs)
+        FAIL("write %u/%u: %s", tag, logical, strerror(errno));
+    return 0;
+}
+
+// gen[i] == 0: el bloque tiene que leerse en cero
+static int verify(u32 id, u32 tag, u32 n, const u32 *gen) {
+    unsigned char *got = (unsigned char*)malloc(bs);
+    if (!got) FAIL("malloc");
+    for (u32 i = 0; i < n; i++) {
+        if (fsops_read(folder, id, (u64)i * bs, got, bs) != (long)bs) FAIL("read %u/%u: %s", tag, i, strerror(errno));
+        if (gen[i]) pattern(tag, i, gen[i]);
+        else memset(blk, 0, bs);
+        if (memcmp(got, blk, bs) != 0) FAIL("archivo %u, bloque %u: contenido distinto (versión %u)", tag, i, gen[i]);
+    }
+    free(got);
+    return 0;
+}
+
+static int remount_and_fsck(void) {
+    if (fsops_unmount(folder) != 0) FAIL("unmount: %s", strerror(errno));
+    if (fsck_qrfs(folder, 0, 0) != 0) FAIL("fsck");
+    if (fsops_mount(folder, NULL) != 0) FAIL("mount: %s", strerror(errno));
+    return 0;
+}
+
+static int format(const char *extra) {
+    char *mk[] = {"mkfs", (char*)folder, "--blocks=16384", "--inodes=64", "--backend=image", "--extents", (char*)extra, NULL};
+    if (mkfs(extra ? 7 : 6, mk) != 0) FAIL("mkfs");
+    if (fsops_mount(folder, NULL) != 0) FAIL("mount: %s", strerror(errno));
+    bs = fsops_block_size();
+    free(blk);
+    if (!(blk = (unsigned char*)malloc(bs))) FAIL("malloc");
+    return 0;
+}
+
+// Dos archivos intercalados en orden aleatorio; después achicar, crecer y rellenar
+static int fragmented(u32 n) {
+    u32 root = fsops_root(), id[2];
+    u32 *order[2], *gen[2];
+    if (fsops_create(folder, root, "a", 0644, 0, 0, &id[0]) != 0 ||
+        fsops_create(folder, root, "b", 0644, 0, 0, &id[1]) != 0) FAIL("create: %s", strerror(errno));
+    for (int f = 0; f < 2; f++) {
+        order[f] = (u32*)malloc(n * sizeof(u32));
+        gen[f] = (u32*)calloc(n, sizeof(u32));
+        if (!order[f] || !gen[f]) FAIL("malloc");
+        for (u32 i = 0; i < n; i++) order[f][i] = i;
+        shuffle(order[f], n);
+    }
+    for (u32 i = 0; i < n; i++) {
+        for (u32 f = 0; f < 2; f++) {
+            if (write_block(id[f], f + 1, order[f][i], 1) != 0) return 1;
+            gen[f][order[f][i]] = 1;
+        }
+    }
+    for (u32 f = 0; f < 2; f++) {
+        if (verify(id[f], f + 1, n, gen[f]) != 0) return 1;
+    }
+    if (remount_and_fsck() != 0) return 1;
+
+    // Achicar "a" en cortes que caen en medio de extents y de la cadena
+    u32 cuts[] = {n - 1, n * 3 / 4 + 1, n / 2, n / 5 + 3, 7, 3, 0};
+    for (u32 c = 0; c < sizeof(cuts) / sizeof(cuts[0]); c++) {
+        u64 size = (u64)cuts[c] * bs + (cuts[c] ? bs / 2 : 0);
+        if (fsops_truncate(folder, id[0], size) != 0) FAIL("truncate: %s", strerror(errno));
+        for (u32 i = cuts[c]; i < n; i++) gen[0][i] = 0;
+        // El bloque cortado por la mitad no se compara: solo los enteros
+        if (verify(id[0], 1, cuts[c], gen[0]) != 0) return 1;
+        if (verify(id[1], 2, n, gen[1]) != 0) return 1;
+        if (remount_and_fsck() != 0) return 1;
+    }
+
+    // Volver a llenar "a" salteado y después los huecos
+    shuffle(order[0], n);
+    for (u32 i = 0; i < n; i++) {
+        u32 l = order[0][i];
+        if (l % 3 == 0) continue;
+        if (write_block(id[0], 1, l, 2) != 0) return 1;
+        gen[0][l] = 2;
+    }
+    for (u32 i = 0; i < n; i += 3) {
+        if (write_block(id[0], 1, i, 3) != 0) return 1;
+        gen[0][i] = 3;
+    }
+    if (verify(id[0], 1, n, gen[0]) != 0) return 1;
+    if (remount_and_fsck() != 0) return 1;
+    for (int f = 0; f < 2; f++) { free(order[f]); free(gen[f]); }
+    return 0;
+}
+
+// Con deduplicación sobrescribir un bloque lo remapea: se parte su extent
+static int remapped(u32 n) {
+    u32 id, *order = (u32*)malloc(n * sizeof(u32)), *gen = (u32*)calloc(n, sizeof(u32));
+    if (!order || !gen) FAIL("malloc");
+    if (fsops_create(folder, fsops_root(), "r", 0644, 0, 0, &id) != 0) FAIL("create: %s", strerror(errno));
+    for (u32 i = 0; i < n; i++) {
+        if (write_block(id, 3, i, 1) != 0) return 1;
+        gen[i] = 1;
+        order[i] = i;
+    }
+    shuffle(order, n);
+    for (u32 i = 0; i < n; i++) {
+        u32 l = order[i], g = i % 4 == 0 ? 1 : 2;  // algunos vuelven a lo que tenían
+        if (write_block(id, 3, l, g) != 0) return 1;
+        gen[l] = g;
+    }
+    if (verify(id, 3, n, gen) != 0) return 1;
+    if (remount_and_fsck() != 0) return 1;
+    if (verify(id, 3, n, gen) != 0) return 1;
+    free(order);
+    free(gen);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    folder = argc > 1 ? argv[1] : "/tmp/qrfs_test_extents";
+    u32 n = argc > 2 ? (u32)strtoul(argv[2], NULL, 10) : 3000;
+    srand(12345);
+    mkdir(folder, 0755);
+    if (format(NULL) != 0 || fragmented(n) != 0) return 1;
+    if (fsops_unmount(folder) != 0) FAIL("unmount: %s", strerror(errno));
+    if (format("--dedup") != 0 || remapped(n) != 0) return 1;
+    if (fsops_unmount(folder) != 0) FAIL("unmount: %s", strerror(errno));
+    if (fsck_qrfs(folder, 0, 0) != 0) FAIL("fsck");
+    free(blk);
+    printf("OK: %u bloques por archivo fragmentados, achicados, rellenados y remapeados\n", n);
+    return 0;
+}
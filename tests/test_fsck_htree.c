@@ -0,0 +1,64 @@
+// Chequeo de directorios indexados en un volumen con entradas fijas
+// (mkfs --fixed-dirs): los nodos de índice no se leen como entradas, así que
+// el directorio da limpio. Después se corre una clave de la raíz del índice
+// para que nombres queden fuera del rango de su hoja, y el chequeo lo ve.
+//
+// Compilar desde la raíz del repo: make check
+// Uso: ./test_fsck_htree [carpeta]
+#include "../fsops.h"
+#include "../mkfs.h"
+#include "../fs_utils.h"
+#include "../icache.h"
+#include "../bcache.h"
+#include "../htree.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#define FAIL(...) do { fprintf(stderr, "FALLA: " __VA_ARGS__); fprintf(stderr, "\n"); return 1; } while (0)
+#define ENTRIES 3000
+
+int main(int argc, char **argv) {
+    const char *folder = argc > 1 ? argv[1] : "/tmp/qrfs_test_fsck_htree";
+    char *mk[] = {"mkfs", (char*)folder, "--blocks=16384", "--inodes=4096", "--backend=image", "--fixed-dirs", NULL};
+    char name[32];
+    mkdir(folder, 0755);
+    if (mkfs(6, mk) != 0) FAIL("mkfs");
+    if (fsops_mount(folder, NULL) != 0) FAIL("mount: %s", strerror(errno));
+
+    u32 dir, id;
+    if (fsops_mkdir(folder, fsops_root(), "d", 0755, 0, 0, &dir) != 0) FAIL("mkdir: %s", strerror(errno));
+    for (u32 i = 0; i < ENTRIES; i++) {
+        snprintf(name, sizeof(name), "archivo_%u", i);
+        if (fsops_create(folder, dir, name, 0644, 0, 0, &id) != 0) FAIL("create %s: %s", name, strerror(errno));
+    }
+    inode *node = icache_get(folder, dir);
+    if (!node || !(node->flags & QRFS_INODE_HTREE)) FAIL("el directorio no pasó a índice");
+    icache_put(node);
+    if (fsops_unmount(folder) != 0) FAIL("unmount: %s", strerror(errno));
+    if (fsck_qrfs(folder, 0, 0) != 0) FAIL("fsck con el índice sano");
+
+    // Subir la clave de la entrada 1 de la raíz hasta la mitad de su rango:
+    // los nombres del principio de ese rango quedan fuera de su hoja
+    if (fsops_mount(folder, NULL) != 0) FAIL("mount: %s", strerror(errno));
+    u32 bs = fsops_block_size(), phys;
+    node = icache_get(folder, dir);
+    if (!node || dir_map(folder, node, 0, &phys) != 0) FAIL("mapa del directorio: %s", strerror(errno));
+    icache_put(node);
+    unsigned char *b = (unsigned char*)malloc(bs);
+    if (!b || bcache_read(folder, phys, b, bs) != 0) FAIL("lectura de la raíz del índice");
+    u32 count = u32le_read(&b[12]);
+    if (memcmp(&b[8], "QRHT", 4) != 0 || count < 2) FAIL("raíz del índice inesperada (%u entradas)", count);
+    u32 lo = u32le_read(&b[HTREE_HEADER + HTREE_ENTRY_SIZE]);
+    u32 hi = count > 2 ? u32le_read(&b[HTREE_HEADER + 2 * HTREE_ENTRY_SIZE]) : UINT32_MAX;
+    u32le_write((lo + (hi - lo) / 2) & ~1u, &b[HTREE_HEADER + HTREE_ENTRY_SIZE]);
+    if (bcache_write(folder, phys, b, bs) != 0) FAIL("escritura de la raíz del índice");
+    free(b);
+    if (fsops_unmount(folder) != 0) FAIL("unmount: %s", strerror(errno));
+    if (fsck_qrfs(folder, 0, 0) == 0) FAIL("fsck no vio los nombres fuera de su hoja");
+
+    printf("OK: índice con entradas fijas limpio y claves corridas detectadas\n");
+    return 0;
+}
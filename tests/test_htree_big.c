@@ -0,0 +1,66 @@
+// Directorio grande en un volumen sin --extents: al pasar a índice hash el
+// directorio se mapea con extents, así que no choca con el tope de
+// direct/indirect1 (~13k entradas con bloques de 1 KiB). Crea N entradas en
+// un solo directorio, busca algunas, borra una de cada diez, remonta y
+// cuenta con readdir; al final el chequeo tiene que dar limpio.
+//
+// Compilar desde la raíz del repo: make check
+// Uso: ./test_htree_big [carpeta] [entradas]
+#include "../fsops.h"
+#include "../mkfs.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#define FAIL(...) do { fprintf(stderr, "FALLA: " __VA_ARGS__); fprintf(stderr, "\n"); return 1; } while (0)
+
+static int count_cb(const char *name, u32 inode_id, mode_t mode, u64 next, void *ctx) {
+    (void)inode_id; (void)mode; (void)next;
+    if (strcmp(name, ".") != 0 && strcmp(name, "..") != 0) (*(u32*)ctx)++;
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    const char *folder = argc > 1 ? argv[1] : "/tmp/qrfs_test_htree";
+    u32 n = argc > 2 ? (u32)strtoul(argv[2], NULL, 10) : 100000;
+    char inodes[32], name[32];
+    snprintf(inodes, sizeof(inodes), "--inodes=%u", n + 64);
+    char *mk[] = {"mkfs", (char*)folder, "--blocks=65536", inodes, "--backend=image", NULL};
+    mkdir(folder, 0755);
+    if (mkfs(5, mk) != 0) FAIL("mkfs");
+
+    if (fsops_mount(folder, NULL) != 0) FAIL("mount: %s", strerror(errno));
+    u32 dir, id;
+    if (fsops_mkdir(folder, fsops_root(), "grande", 0755, 0, 0, &dir) != 0) FAIL("mkdir: %s", strerror(errno));
+    for (u32 i = 0; i < n; i++) {
+        snprintf(name, sizeof(name), "archivo_%u", i);
+        if (fsops_create(folder, dir, name, 0644, 0, 0, &id) != 0)
+            FAIL("create de la entrada %u: %s", i, strerror(errno));
+    }
+    for (u32 i = 0; i < n; i += n / 100 ? n / 100 : 1) {
+        snprintf(name, sizeof(name), "archivo_%u", i);
+        if (fsops_lookup(folder, dir, name, &id) != 0) FAIL("lookup de %s: %s", name, strerror(errno));
+    }
+    u32 removed = 0;
+    for (u32 i = 0; i < n; i += 10, removed++) {
+        snprintf(name, sizeof(name), "archivo_%u", i);
+        if (fsops_unlink(folder, dir, name) != 0) FAIL("unlink de %s: %s", name, strerror(errno));
+    }
+    if (fsops_unmount(folder) != 0) FAIL("unmount: %s", strerror(errno));
+
+    if (fsops_mount(folder, NULL) != 0) FAIL("remount: %s", strerror(errno));
+    if (fsops_lookup(folder, fsops_root(), "grande", &dir) != 0) FAIL("lookup del directorio");
+    u32 seen = 0;
+    if (fsops_readdir(folder, dir, 0, count_cb, &seen) != 0) FAIL("readdir: %s", strerror(errno));
+    if (seen != n - removed) FAIL("readdir vio %u entradas, se esperaban %u", seen, n - removed);
+    if (fsops_lookup(folder, dir, "archivo_0", &id) == 0) FAIL("archivo_0 sigue después de borrarlo");
+    snprintf(name, sizeof(name), "archivo_%u", n - 1);
+    if ((n - 1) % 10 != 0 && fsops_lookup(folder, dir, name, &id) != 0) FAIL("lookup de %s después de remontar", name);
+    if (fsops_unmount(folder) != 0) FAIL("unmount: %s", strerror(errno));
+
+    if (fsck_qrfs(folder, 0, 0) != 0) FAIL("fsck");
+    printf("OK: %u entradas en un directorio, %u después de borrar\n", n, seen);
+    return 0;
+}
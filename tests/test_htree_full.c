@@ -0,0 +1,115 @@
+// Conversión a índice hash sin lugar en el volumen: se llena un directorio
+// lineal hasta DIR_INDEX_MIN_BLOCKS bloques, se ocupan todos los bloques
+// libres y se sigue creando hasta que la conversión falla. El directorio
+// tiene que quedar entero (lookup, readdir y fsck); al liberar lugar la
+// conversión se hace y los nombres siguen ahí.
+//
+// Compilar desde la raíz del repo: make check
+// Uso: ./test_htree_full [carpeta]
+#include "../fsops.h"
+#include "../mkfs.h"
+#include "../dir.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+
+#define FAIL(...) do { fprintf(stderr, "FALLA: " __VA_ARGS__); fprintf(stderr, "\n"); return 1; } while (0)
+
+static const char *folder;
+
+static void entry_name(char *out, size_t len, u32 i) {
+    snprintf(out, len, "una_entrada_con_nombre_largo_%05u", i);
+}
+
+static int count_cb(const char *name, u32 inode_id, mode_t mode, u64 next, void *ctx) {
+    (void)inode_id; (void)mode; (void)next;
+    if (strcmp(name, ".") != 0 && strcmp(name, "..") != 0) (*(u32*)ctx)++;
+    return 0;
+}
+
+// Todos los nombres [0, n) resuelven y readdir ve exactamente n
+static int check_dir(u32 dir, u32 n) {
+    char name[64];
+    u32 id, seen = 0;
+    for (u32 i = 0; i < n; i++) {
+        entry_name(name, sizeof(name), i);
+        if (fsops_lookup(folder, dir, name, &id) != 0) FAIL("lookup de %s: %s", name, strerror(errno));
+    }
+    if (fsops_readdir(folder, dir, 0, count_cb, &seen) != 0) FAIL("readdir: %s", strerror(errno));
+    if (seen != n) FAIL("readdir vio %u entradas, se esperaban %u", seen, n);
+    return 0;
+}
+
+static int remount_and_fsck(void) {
+    if (fsops_unmount(folder) != 0) FAIL("unmount: %s", strerror(errno));
+    if (fsck_qrfs(folder, 0, 0) != 0) FAIL("fsck");
+    if (fsops_mount(folder, NULL) != 0) FAIL("mount: %s", strerror(errno));
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    folder = argc > 1 ? argv[1] : "/tmp/qrfs_test_htree_full";
+    char *mk[] = {"mkfs", (char*)folder, "--blocks=2048", "--inodes=1024", "--backend=image", NULL};
+    mkdir(folder, 0755);
+    if (mkfs(5, mk) != 0) FAIL("mkfs");
+    if (fsops_mount(folder, NULL) != 0) FAIL("mount: %s", strerror(errno));
+
+    u32 root = fsops_root(), bs = fsops_block_size(), dir, id, n = 0;
+    char name[64];
+    struct stat st;
+    if (fsops_mkdir(folder, root, "d", 0755, 0, 0, &dir) != 0) FAIL("mkdir: %s", strerror(errno));
+    for (;;) {
+        if (fsops_getattr(folder, dir, &st) != 0) FAIL("getattr: %s", strerror(errno));
+        if (st.st_size >= (off_t)DIR_INDEX_MIN_BLOCKS * bs) break;
+        entry_name(name, sizeof(name), n);
+        if (fsops_create(folder, dir, name, 0644, 0, 0, &id) != 0) FAIL("create: %s", strerror(errno));
+        n++;
+    }
+
+    // Ocupar todos los bloques libres con archivos de relleno
+    unsigned char *blk = (unsigned char*)malloc(bs);
+    if (!blk) FAIL("malloc");
+    memset(blk, 0x5a, bs);
+    u32 fill = 0, filler[64];
+    for (int full = 0; !full; fill++) {
+        if (fill == 64) FAIL("demasiados archivos de relleno");
+        snprintf(name, sizeof(name), "relleno_%u", fill);
+        if (fsops_create(folder, root, name, 0644, 0, 0, &filler[fill]) != 0) FAIL("create relleno: %s", strerror(errno));
+        for (u64 off = 0; ; off += bs) {
+            if (fsops_write(folder, filler[fill], off, blk, bs) == (long)bs) continue;
+            if (errno == ENOSPC) full = 1;
+            else if (errno != EFBIG) FAIL("write relleno: %s", strerror(errno));
+            break;
+        }
+    }
+    free(blk);
+    struct statvfs sv;
+    if (fsops_statfs(folder, &sv) != 0 || sv.f_bfree != 0) FAIL("quedan %lu bloques libres", (unsigned long)sv.f_bfree);
+
+    // Seguir creando hasta que la conversión no tenga lugar
+    for (;;) {
+        entry_name(name, sizeof(name), n);
+        if (fsops_create(folder, dir, name, 0644, 0, 0, &id) != 0) break;
+        n++;
+    }
+    if (errno != ENOSPC) FAIL("la conversión falló con %s, se esperaba ENOSPC", strerror(errno));
+    if (check_dir(dir, n) != 0) return 1;
+    if (remount_and_fsck() != 0) return 1;
+    if (check_dir(dir, n) != 0) return 1;
+
+    // Con lugar otra vez, la conversión se hace
+    if (fsops_unlink(folder, root, "relleno_0") != 0) FAIL("unlink relleno: %s", strerror(errno));
+    u32 before = n;
+    for (; n < before + 200; n++) {
+        entry_name(name, sizeof(name), n);
+        if (fsops_create(folder, dir, name, 0644, 0, 0, &id) != 0) FAIL("create después de liberar: %s", strerror(errno));
+    }
+    if (check_dir(dir, n) != 0) return 1;
+    if (fsops_unmount(folder) != 0) FAIL("unmount: %s", strerror(errno));
+    if (fsck_qrfs(folder, 0, 0) != 0) FAIL("fsck");
+    printf("OK: conversión sin lugar falló limpia con %u entradas y se hizo después (%u)\n", before, n);
+    return 0;
+}
@@ -0,0 +1,192 @@
+// Reaplicación del diario después de una caída. Un proceso hijo monta con el
+// backend de archivos (checkpoint dentro del commit), hace commits chicos hasta
+// que el anillo dio vuelta y la cola quedó cerca del final, y desde ahí, sin
+// otro checkpoint: crea un directorio con muchas entradas, lo borra (sus
+// bloques quedan revocados), llena el volumen con un archivo de datos que
+// reusa esos bloques y crea unos archivos más. Termina sin desmontar. Al
+// montar se reaplican esas transacciones, que cruzan el final del anillo: los
+// cambios tienen que estar, los datos no pueden quedar pisados con el
+// directorio viejo y el chequeo tiene que dar limpio.
+//
+// Compilar desde la raíz del repo: make check
+// Uso: ./test_journal_replay [carpeta]
+#include "../fsops.h"
+#include "../mkfs.h"
+#include "../fs_utils.h"
+#include "../block.h"
+#include "../journal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define FAIL(...) do { fprintf(stderr, "FALLA: " __VA_ARGS__); fprintf(stderr, "\n"); return 1; } while (0)
+#define OLD_ENTRIES 60
+#define FINAL_FILES 10
+#define MAX_TICKS 20000
+
+static const char *folder;
+static u32 bs;
+
+// Posición del anillo en el momento del último checkpoint (la cola, que
+// después de un checkpoint completo es también la cabeza) y el tamaño del anillo
+static int ring_tail(u32 *pos, u32 *ring) {
+    unsigned char *b = (unsigned char*)malloc(bs);
+    if (!b || read_block(folder, spblock.journal_start, b, bs) != 0) FAIL("lectura del encabezado del diario");
+    if (memcmp(b, "QRJH", 4) != 0) FAIL("encabezado del diario inválido");
+    *pos = u32le_read(&b[16]);
+    *ring = u32le_read(&b[20]);
+    free(b);
+    return 0;
+}
+
+// Bloques del anillo usados desde `base`: un descriptor y un commit por
+// transacción (todas entran en un descriptor) más las copias
+static u32 ring_since(const journal_stats *base) {
+    journal_stats now;
+    journal_get_stats(&now);
+    return (u32)(now.blocks_logged - base->blocks_logged + 2 * (now.commits - base->commits));
+}
+
+static void pattern(unsigned char *blk, u32 logical) {
+    for (u32 i = 0; i < bs; i += 4) {
+        u32 v = (logical << 12) ^ i ^ 0x5a5a0000u;
+        memcpy(&blk[i], &v, 4);
+    }
+}
+
+static void old_name(char *out, size_t len, u32 i) {
+    snprintf(out, len, "entrada_con_nombre_largo_%03u", i);
+}
+
+// Lo que hace el hijo; no desmonta
+static int crash_run(u32 *data_blocks) {
+    if (fsops_mount(folder, NULL) != 0) FAIL("mount: %s", strerror(errno));
+    if (fsops_parallel_io()) FAIL("el backend de archivos no debería tener hilo de checkpoint");
+    bs = fsops_block_size();
+    u32 root = fsops_root(), mark, dir, data, id;
+    char name[64];
+    if (fsops_create(folder, root, "marca", 0644, 0, 0, &mark) != 0) FAIL("create: %s", strerror(errno));
+    if (fsops_sync(folder) != 0) FAIL("sync: %s", strerror(errno));
+
+    // Commits de un inodo hasta quedar, justo después de un checkpoint, a
+    // pocos bloques del final del anillo con lugar para el resto sin otro
+    journal_stats base, st;
+    u32 tail = 0, ring = 0, head = 0, used = 0, ticks = 0;
+    u64 seen = 0;
+    journal_get_stats(&base);
+    for (;; ticks++) {
+        if (ticks == MAX_TICKS) FAIL("la cabeza del anillo nunca quedó cerca del final");
+        if (fsops_chmod(folder, mark, 0600 | (ticks & 077)) != 0 || fsops_sync(folder) != 0)
+            FAIL("chmod/sync: %s", strerror(errno));
+        journal_get_stats(&st);
+        if (st.checkpoints != seen) {
+            seen = st.checkpoints;
+            base = st;
+            if (ring_tail(&tail, &ring) != 0) return 1;
+        }
+        if (!ring) continue;
+        used = ring_since(&base);
+        head = (tail + used) % ring;
+        if (head + 8 >= ring && used <= ring / 4) break;
+    }
+    journal_get_stats(&base);
+
+    // Directorio que pasa por el diario y después se borra: revocaciones
+    if (fsops_mkdir(folder, root, "viejo", 0755, 0, 0, &dir) != 0) FAIL("mkdir: %s", strerror(errno));
+    for (u32 i = 0; i < OLD_ENTRIES; i++) {
+        old_name(name, sizeof(name), i);
+        if (fsops_create(folder, dir, name, 0644, 0, 0, &id) != 0) FAIL("create %s: %s", name, strerror(errno));
+    }
+    if (fsops_sync(folder) != 0) FAIL("sync: %s", strerror(errno));
+    for (u32 i = 0; i < OLD_ENTRIES; i++) {
+        old_name(name, sizeof(name), i);
+        if (fsops_unlink(folder, dir, name) != 0) FAIL("unlink %s: %s", name, strerror(errno));
+    }
+    if (fsops_rmdir(folder, root, "viejo") != 0) FAIL("rmdir: %s", strerror(errno));
+    if (fsops_sync(folder) != 0) FAIL("sync: %s", strerror(errno));
+
+    // Llenar el volumen: los bloques del directorio vuelven como datos
+    unsigned char *blk = (unsigned char*)malloc(bs);
+    if (!blk) FAIL("malloc");
+    if (fsops_create(folder, root, "datos", 0644, 0, 0, &data) != 0) FAIL("create: %s", strerror(errno));
+    for (*data_blocks = 0; ; (*data_blocks)++) {
+        pattern(blk, *data_blocks);
+        if (fsops_write(folder, data, (u64)*data_blocks * bs, blk, bs) != (long)bs) break;
+    }
+    if (errno != ENOSPC) FAIL("write: %s", strerror(errno));
+    free(blk);
+    if (fsops_sync(folder) != 0) FAIL("sync: %s", strerror(errno));
+
+    for (u32 i = 0; i < FINAL_FILES; i++) {
+        snprintf(name, sizeof(name), "final_%u", i);
+        if (fsops_create(folder, root, name, 0644, 0, 0, &id) != 0) FAIL("create %s: %s", name, strerror(errno));
+    }
+    if (fsops_chmod(folder, mark, 0640) != 0 || fsops_sync(folder) != 0) FAIL("chmod/sync: %s", strerror(errno));
+
+    journal_get_stats(&st);
+    if (st.checkpoints != base.checkpoints) FAIL("hubo un checkpoint antes de la caída");
+    if (st.revokes == base.revokes) FAIL("borrar el directorio no dejó revocaciones");
+    if (head + ring_since(&base) < ring) FAIL("las transacciones sin checkpoint no cruzan el final del anillo");
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    folder = argc > 1 ? argv[1] : "/tmp/qrfs_test_journal_replay";
+    char *mk[] = {"mkfs", (char*)folder, "--blocks=2048", "--inodes=512", "--backend=files", "--extents",
+                  "--journal=256", NULL};
+    mkdir(folder, 0755);
+    if (mkfs(7, mk) != 0) FAIL("mkfs");
+
+    // El hijo pasa por el pipe cuántos bloques escribió
+    int fds[2];
+    if (pipe(fds) != 0) FAIL("pipe: %s", strerror(errno));
+    pid_t pid = fork();
+    if (pid < 0) FAIL("fork: %s", strerror(errno));
+    if (pid == 0) {
+        u32 n = 0;
+        int rc = crash_run(&n);
+        if (rc == 0 && write(fds[1], &n, sizeof(n)) != (ssize_t)sizeof(n)) rc = 1;
+        _exit(rc);
+    }
+    close(fds[1]);
+    int status;
+    u32 data_blocks = 0;
+    if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0) FAIL("el proceso hijo falló");
+    if (read(fds[0], &data_blocks, sizeof(data_blocks)) != (ssize_t)sizeof(data_blocks) || data_blocks == 0)
+        FAIL("el hijo no escribió datos");
+    close(fds[0]);
+
+    // Montar reaplica el diario
+    if (fsops_mount(folder, NULL) != 0) FAIL("mount: %s", strerror(errno));
+    bs = fsops_block_size();
+    u32 root = fsops_root(), id;
+    char name[64];
+    struct stat st;
+    for (u32 i = 0; i < FINAL_FILES; i++) {
+        snprintf(name, sizeof(name), "final_%u", i);
+        if (fsops_lookup(folder, root, name, &id) != 0) FAIL("%s no está después de reaplicar: %s", name, strerror(errno));
+    }
+    if (fsops_lookup(folder, root, "viejo", &id) == 0) FAIL("el directorio borrado volvió");
+    if (fsops_lookup(folder, root, "marca", &id) != 0 || fsops_getattr(folder, id, &st) != 0) FAIL("marca: %s", strerror(errno));
+    if ((st.st_mode & 07777) != 0640) FAIL("marca tiene modo %o, se esperaba 640", st.st_mode & 07777);
+
+    if (fsops_lookup(folder, root, "datos", &id) != 0 || fsops_getattr(folder, id, &st) != 0) FAIL("datos: %s", strerror(errno));
+    if (st.st_size != (off_t)data_blocks * bs) FAIL("datos mide %ld, se esperaban %lu", (long)st.st_size, (unsigned long)data_blocks * bs);
+    unsigned char *want = (unsigned char*)malloc(bs), *got = (unsigned char*)malloc(bs);
+    if (!want || !got) FAIL("malloc");
+    for (u32 l = 0; l < data_blocks; l++) {
+        pattern(want, l);
+        if (fsops_read(folder, id, (u64)l * bs, got, bs) != (long)bs) FAIL("read %u: %s", l, strerror(errno));
+        if (memcmp(want, got, bs) != 0) FAIL("datos, bloque %u: pisado al reaplicar", l);
+    }
+    free(want);
+    free(got);
+    if (fsops_unmount(folder) != 0) FAIL("unmount: %s", strerror(errno));
+    if (fsck_qrfs(folder, 0, 0) != 0) FAIL("fsck después de reaplicar");
+    printf("OK: %u bloques de datos intactos después de reaplicar el diario\n", data_blocks);
+    return 0;
+}
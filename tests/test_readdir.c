@@ -0,0 +1,128 @@
+// Listado por páginas con cambios entre una página y la siguiente, en un
+// directorio lineal y en uno indexado:
+//  - borrando lo ya listado (como rm -r): cada nombre sale una vez y el
+//    directorio termina vacío;
+//  - creando nombres nuevos (con partición de hojas): ninguno sale dos veces
+//    y todos los que estaban antes del listado salen.
+//
+// Compilar desde la raíz del repo: make check
+// Uso: ./test_readdir [carpeta]
+#include "../fsops.h"
+#include "../mkfs.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#define FAIL(...) do { fprintf(stderr, "FALLA: " __VA_ARGS__); fprintf(stderr, "\n"); return 1; } while (0)
+#define MAX_NAMES 20000
+
+static const char *folder;
+
+typedef struct page {
+    u32 limit, n;
+    u64 next;
+    char names[128][32];
+} page;
+
+static int page_cb(const char *name, u32 inode_id, mode_t mode, u64 next, void *ctx) {
+    page *pg = (page*)ctx;
+    (void)inode_id; (void)mode;
+    if (pg->n == pg->limit) return 1;
+    snprintf(pg->names[pg->n++], sizeof(pg->names[0]), "%s", name);
+    pg->next = next;
+    return 0;
+}
+
+// Cuenta cuántas veces sale cada nombre "<prefijo><número>"
+static void tally(const char *name, u32 *orig, u32 *added) {
+    unsigned v;
+    if (sscanf(name, "e_%u", &v) == 1 && v < MAX_NAMES) orig[v]++;
+    else if (sscanf(name, "n_%u", &v) == 1 && v < MAX_NAMES) added[v]++;
+}
+
+static int fill(u32 dir, u32 n) {
+    char name[32];
+    u32 id;
+    for (u32 i = 0; i < n; i++) {
+        snprintf(name, sizeof(name), "e_%u", i);
+        if (fsops_create(folder, dir, name, 0644, 0, 0, &id) != 0) FAIL("create %s: %s", name, strerror(errno));
+    }
+    return 0;
+}
+
+static int list_removing(u32 dir, u32 n, u32 per_page) {
+    static u32 orig[MAX_NAMES], added[MAX_NAMES];
+    memset(orig, 0, sizeof(orig));
+    page pg = {per_page, 0, 0, {{0}}};
+    for (;;) {
+        pg.n = 0;
+        if (fsops_readdir(folder, dir, pg.next, page_cb, &pg) != 0) FAIL("readdir: %s", strerror(errno));
+        if (pg.n == 0) break;
+        for (u32 i = 0; i < pg.n; i++) {
+            tally(pg.names[i], orig, added);
+            if (strcmp(pg.names[i], ".") == 0 || strcmp(pg.names[i], "..") == 0) continue;
+            if (fsops_unlink(folder, dir, pg.names[i]) != 0) FAIL("unlink %s: %s", pg.names[i], strerror(errno));
+        }
+    }
+    for (u32 i = 0; i < n; i++) {
+        if (orig[i] != 1) FAIL("borrando: e_%u salió %u veces", i, orig[i]);
+    }
+    u32 left = 0;
+    pg.limit = 128;
+    pg.n = 0;
+    if (fsops_readdir(folder, dir, 0, page_cb, &pg) != 0) FAIL("readdir: %s", strerror(errno));
+    for (u32 i = 0; i < pg.n; i++) left += strcmp(pg.names[i], ".") != 0 && strcmp(pg.names[i], "..") != 0;
+    if (left) FAIL("borrando: quedaron %u entradas sin listar", left);
+    return 0;
+}
+
+static int list_adding(u32 dir, u32 n, u32 per_page, u32 add_per_page, u32 max_added) {
+    static u32 orig[MAX_NAMES], added[MAX_NAMES];
+    memset(orig, 0, sizeof(orig));
+    memset(added, 0, sizeof(added));
+    page pg = {per_page, 0, 0, {{0}}};
+    u32 created = 0, id;
+    char name[32];
+    for (;;) {
+        pg.n = 0;
+        if (fsops_readdir(folder, dir, pg.next, page_cb, &pg) != 0) FAIL("readdir: %s", strerror(errno));
+        if (pg.n == 0) break;
+        for (u32 i = 0; i < pg.n; i++) tally(pg.names[i], orig, added);
+        for (u32 k = 0; k < add_per_page && created < max_added; k++, created++) {
+            snprintf(name, sizeof(name), "n_%u", created);
+            if (fsops_create(folder, dir, name, 0644, 0, 0, &id) != 0) FAIL("create %s: %s", name, strerror(errno));
+        }
+    }
+    for (u32 i = 0; i < n; i++) {
+        if (orig[i] != 1) FAIL("agregando: e_%u salió %u veces", i, orig[i]);
+    }
+    for (u32 i = 0; i < created; i++) {
+        if (added[i] > 1) FAIL("agregando: n_%u salió %u veces", i, added[i]);
+    }
+    return 0;
+}
+
+// max_added: el directorio lineal no tiene que llegar a convertirse a índice
+static int run(const char *dirname, u32 n, u32 per_page, u32 max_added) {
+    u32 dir;
+    if (fsops_mkdir(folder, fsops_root(), dirname, 0755, 0, 0, &dir) != 0) FAIL("mkdir: %s", strerror(errno));
+    if (fill(dir, n) != 0 || list_removing(dir, n, per_page) != 0) return 1;
+    if (fill(dir, n) != 0 || list_adding(dir, n, per_page, per_page / 2, max_added) != 0) return 1;
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    folder = argc > 1 ? argv[1] : "/tmp/qrfs_test_readdir";
+    char *mk[] = {"mkfs", (char*)folder, "--blocks=16384", "--inodes=32768", "--backend=image", NULL};
+    mkdir(folder, 0755);
+    if (mkfs(5, mk) != 0) FAIL("mkfs");
+    if (fsops_mount(folder, NULL) != 0) FAIL("mount: %s", strerror(errno));
+    if (run("lineal", 40, 7, 60) != 0) return 1;
+    if (run("indexado", 5000, 100, MAX_NAMES) != 0) return 1;
+    if (fsops_unmount(folder) != 0) FAIL("unmount: %s", strerror(errno));
+    if (fsck_qrfs(folder, 0, 0) != 0) FAIL("fsck");
+    printf("OK: listado por páginas estable al borrar y al agregar\n");
+    return 0;
+}
@@ -0,0 +1,76 @@
+// Bloques asignados por fsops_map(for_write) cuya copia nunca llega: ni
+// llenando un hueco dentro del tamaño ni más allá del final (que después
+// aparece al crecer con truncate) se puede leer lo que tenía un archivo
+// borrado antes. El volumen se llena primero con un archivo de 0x5a.
+//
+// Compilar desde la raíz del repo: make check
+// Uso: ./test_write_stale [carpeta]
+#include "../fsops.h"
+#include "../mkfs.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#define FAIL(...) do { fprintf(stderr, "FALLA: " __VA_ARGS__); fprintf(stderr, "\n"); return 1; } while (0)
+static const char *folder;
+
+// Reserva [offset, offset+len) para escribir y termina sin copiar nada
+static int map_and_abort(u32 id, u64 offset, u32 len) {
+    fsops_seg *segs;
+    u32 n, mapped;
+    if (fsops_map(folder, id, offset, len, 1, &segs, &n, &mapped) != 0) FAIL("map: %s", strerror(errno));
+    fsops_write_end(folder, id, offset, segs, n, 0);
+    free(segs);
+    return 0;
+}
+
+static int check_zero(u32 id, u64 size, const char *what) {
+    unsigned char *buf = (unsigned char*)malloc(size);
+    if (!buf) FAIL("malloc");
+    long got = fsops_read(folder, id, 0, buf, (u32)size);
+    if (got != (long)size) FAIL("%s: read dio %ld de %lu", what, got, (unsigned long)size);
+    for (u64 i = 0; i < size; i++) {
+        if (buf[i]) FAIL("%s: byte %lu vale 0x%02x", what, (unsigned long)i, buf[i]);
+    }
+    free(buf);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    folder = argc > 1 ? argv[1] : "/tmp/qrfs_test_write_stale";
+    char *mk[] = {"mkfs", (char*)folder, "--blocks=4096", "--inodes=256", "--backend=image", "--extents", NULL};
+    mkdir(folder, 0755);
+    if (mkfs(6, mk) != 0) FAIL("mkfs");
+    if (fsops_mount(folder, NULL) != 0) FAIL("mount: %s", strerror(errno));
+    if (!fsops_parallel_io()) FAIL("el backend image debería permitir fsops_map");
+
+    u32 root = fsops_root(), bs = fsops_block_size(), old, id;
+    unsigned char *blk = (unsigned char*)malloc(bs);
+    if (!blk) FAIL("malloc");
+    memset(blk, 0x5a, bs);
+    if (fsops_create(folder, root, "viejo", 0644, 0, 0, &old) != 0) FAIL("create: %s", strerror(errno));
+    for (u64 off = 0; fsops_write(folder, old, off, blk, bs) == (long)bs; off += bs) {}
+    if (errno != ENOSPC) FAIL("write: %s", strerror(errno));
+    free(blk);
+    if (fsops_unlink(folder, root, "viejo") != 0) FAIL("unlink: %s", strerror(errno));
+    if (fsops_sync(folder) != 0) FAIL("sync: %s", strerror(errno));
+
+    if (fsops_create(folder, root, "f", 0644, 0, 0, &id) != 0) FAIL("create: %s", strerror(errno));
+    if (fsops_truncate(folder, id, 16ull * bs) != 0) FAIL("truncate: %s", strerror(errno));
+    if (map_and_abort(id, 4ull * bs, 8 * bs) != 0) return 1;
+    if (check_zero(id, 16ull * bs, "hueco") != 0) return 1;
+
+    if (map_and_abort(id, 20ull * bs, 8 * bs) != 0) return 1;
+    struct stat st;
+    if (fsops_getattr(folder, id, &st) != 0) FAIL("getattr: %s", strerror(errno));
+    if (st.st_size != (off_t)16 * bs) FAIL("el tamaño pasó a %ld sin copiar nada", (long)st.st_size);
+    if (fsops_truncate(folder, id, 32ull * bs) != 0) FAIL("truncate: %s", strerror(errno));
+    if (check_zero(id, 32ull * bs, "después del final") != 0) return 1;
+
+    if (fsops_unmount(folder) != 0) FAIL("unmount: %s", strerror(errno));
+    if (fsck_qrfs(folder, 0, 0) != 0) FAIL("fsck");
+    printf("OK: los bloques asignados sin escribir se leen en cero\n");
+    return 0;
+}